@@ -0,0 +1,134 @@
+/**
+ * @file bench-dbus.c
+ * D-Bus dispatch microbenchmark
+ * <p>
+ * Messages are passed to mce_dbus_dispatch() directly,
+ * without a bus connection; without a connection,
+ * mce_dbus_handler_add() sets up no match rules
+ * <p>
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <glib.h>
+#include <dbus/dbus.h>
+
+#include "mce-dbus.h"
+#include "mce-bench.h"
+
+/** Number of handlers registered by a typical mce configuration */
+#define BENCH_DBUS_HANDLERS	64
+
+/** Number of dispatches per measurement, before scaling */
+#define BENCH_DBUS_ITERATIONS	100000
+
+/**
+ * Handler callback that does nothing
+ *
+ * @param msg Unused
+ * @return TRUE
+ */
+static gboolean bench_dbus_cb(DBusMessage *const msg)
+{
+	(void)msg;
+
+	return TRUE;
+}
+
+/** Cookies of the handlers added by the benchmark */
+static GSList *bench_dbus_cookies = NULL;
+
+/**
+ * Add a handler to the handler list
+ *
+ * @param interface The interface
+ * @param name The method or signal name
+ * @param type DBUS_MESSAGE_TYPE_METHOD_CALL or DBUS_MESSAGE_TYPE_SIGNAL
+ */
+static void bench_dbus_handler_add(const gchar *interface, const gchar *name,
+				   guint type)
+{
+	gconstpointer cookie = mce_dbus_handler_add(interface, name, NULL,
+						    type, bench_dbus_cb);
+
+	if (cookie != NULL)
+		bench_dbus_cookies = g_slist_prepend(bench_dbus_cookies,
+						     (gpointer)cookie);
+}
+
+/**
+ * Dispatch a message repeatedly and report the cost
+ *
+ * @param name Name of the measurement
+ * @param msg The message to dispatch
+ * @param iterations Number of dispatches
+ */
+static void bench_dbus_dispatch(const gchar *name, DBusMessage *msg,
+				guint64 iterations)
+{
+	gint64 start = bench_now();
+	guint64 i;
+
+	for (i = 0; i < iterations; i++)
+		(void)mce_dbus_dispatch(msg);
+
+	bench_report(name, iterations, bench_now() - start);
+}
+
+/**
+ * Measure msg_handler() dispatch with a realistic number of handlers
+ *
+ * @param scale Multiplier for the number of iterations
+ */
+void bench_dbus(guint scale)
+{
+	guint64 iterations = (guint64)BENCH_DBUS_ITERATIONS * scale;
+	DBusMessage *msg;
+	gchar *name;
+	guint i;
+
+	/* Registered first, so that it ends up last in the list */
+	bench_dbus_handler_add(MCE_REQUEST_IF, "bench_last",
+			       DBUS_MESSAGE_TYPE_METHOD_CALL);
+
+	for (i = 1; i < BENCH_DBUS_HANDLERS - 1; i++) {
+		name = g_strdup_printf("bench_%u", i);
+		bench_dbus_handler_add((i % 4) ? MCE_REQUEST_IF : MCE_SIGNAL_IF,
+				       name,
+				       (i % 4) ? DBUS_MESSAGE_TYPE_METHOD_CALL :
+						 DBUS_MESSAGE_TYPE_SIGNAL);
+		g_free(name);
+	}
+
+	bench_dbus_handler_add(MCE_REQUEST_IF, "bench_first",
+			       DBUS_MESSAGE_TYPE_METHOD_CALL);
+
+	msg = dbus_message_new_method_call(MCE_SERVICE, MCE_REQUEST_PATH,
+					   MCE_REQUEST_IF, "bench_first");
+	bench_dbus_dispatch("dbus/dispatch/method-first", msg, iterations);
+	dbus_message_unref(msg);
+
+	msg = dbus_message_new_method_call(MCE_SERVICE, MCE_REQUEST_PATH,
+					   MCE_REQUEST_IF, "bench_last");
+	bench_dbus_dispatch("dbus/dispatch/method-last", msg, iterations);
+	dbus_message_unref(msg);
+
+	msg = dbus_message_new_signal(MCE_SIGNAL_PATH, MCE_SIGNAL_IF,
+				      "bench_unhandled");
+	bench_dbus_dispatch("dbus/dispatch/signal-unhandled", msg, iterations);
+	dbus_message_unref(msg);
+
+	while (bench_dbus_cookies != NULL) {
+		mce_dbus_handler_remove(bench_dbus_cookies->data);
+		bench_dbus_cookies = g_slist_delete_link(bench_dbus_cookies,
+							 bench_dbus_cookies);
+	}
+}
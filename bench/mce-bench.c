@@ -0,0 +1,550 @@
+/**
+ * @file mce-bench.c
+ * Microbenchmarks for the mce utilities
+ * <p>
+ * The results are written to stdout as JSON, one object per
+ * measurement, so that runs can be compared against a baseline
+ * <p>
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/input.h>
+
+#include "mce.h"
+#include "mce-conf.h"
+#include "mce-io.h"
+#include "mce-log.h"
+#include "datapipe.h"
+#include "mce-bench.h"
+
+/** Name shown by --help etc. */
+#define PRG_NAME			"mce-bench"
+
+/** Default directory for the file write benchmark; normally tmpfs */
+#define DEFAULT_WRITE_DIR		"/dev/shm"
+
+/** Number of datapipe executions per measurement, before scaling */
+#define BENCH_DATAPIPE_ITERATIONS	1000000
+
+/** Number of input events per measurement, before scaling */
+#define BENCH_IO_EVENTS			200000
+
+/** Time after which the input event benchmark gives up; [s] */
+#define BENCH_IO_TIMEOUT		60
+
+/** Number of configuration lookups per measurement, before scaling */
+#define BENCH_CONF_ITERATIONS		100000
+
+/** Number of override files for the configuration benchmark */
+#define BENCH_CONF_OVERRIDES		8
+
+/** Number of file writes per measurement, before scaling */
+#define BENCH_WRITE_ITERATIONS		20000
+
+/** The mainloop; needed by the I/O monitors */
+GMainLoop *mainloop = NULL;
+
+/** TRUE when the next result is the first one written */
+static gboolean first_result = TRUE;
+
+/**
+ * Get the monotonic time
+ *
+ * @return The time in nanoseconds
+ */
+gint64 bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (gint64)ts.tv_sec * G_GINT64_CONSTANT(1000000000) + ts.tv_nsec;
+}
+
+/**
+ * Write the result of a measurement
+ *
+ * @param name Name of the measurement
+ * @param iterations Number of operations measured
+ * @param elapsed Time taken by the operations in nanoseconds
+ */
+void bench_report(const gchar *name, guint64 iterations, gint64 elapsed)
+{
+	gdouble ns_per_op = 0;
+	gdouble ops_per_sec = 0;
+
+	/* Faster than the clock can tell; count it as 1 ns,
+	 * so that no inf ends up in the JSON
+	 */
+	if (elapsed < 1)
+		elapsed = 1;
+
+	if (iterations > 0) {
+		ns_per_op = (gdouble)elapsed / (gdouble)iterations;
+		ops_per_sec = 1e9 / ns_per_op;
+	}
+
+	printf("%s\n    {\"name\": \"%s\", \"iterations\": %" G_GUINT64_FORMAT
+	       ", \"elapsed_ns\": %" G_GINT64_FORMAT
+	       ", \"ns_per_op\": %.3f, \"ops_per_sec\": %.1f}",
+	       first_result ? "" : ",", name, iterations, elapsed,
+	       ns_per_op, ops_per_sec);
+	fflush(stdout);
+
+	first_result = FALSE;
+}
+
+/** Datapipe filter that passes the data through */
+static gpointer bench_filter(gpointer data)
+{
+	return data;
+}
+
+/** Datapipe trigger that does nothing */
+static void bench_trigger(gconstpointer data)
+{
+	(void)data;
+}
+
+/**
+ * Measure execute_datapipe() with a number of filters and triggers
+ *
+ * @param scale Multiplier for the number of iterations
+ */
+static void bench_datapipe(guint scale)
+{
+	static const guint counts[] = { 0, 1, 4, 16 };
+	guint64 iterations = (guint64)BENCH_DATAPIPE_ITERATIONS * scale;
+	guint c;
+
+	for (c = 0; c < G_N_ELEMENTS(counts); c++) {
+		datapipe_struct pipe;
+		gchar *name;
+		gint64 start;
+		guint64 i;
+		guint n;
+
+		setup_datapipe(&pipe, READ_WRITE, DONT_FREE_CACHE,
+			       0, GINT_TO_POINTER(0));
+
+		for (n = 0; n < counts[c]; n++) {
+			append_filter_to_datapipe(&pipe, bench_filter);
+			append_input_trigger_to_datapipe(&pipe, bench_trigger);
+			append_output_trigger_to_datapipe(&pipe, bench_trigger);
+		}
+
+		start = bench_now();
+
+		for (i = 0; i < iterations; i++)
+			(void)execute_datapipe(&pipe, GINT_TO_POINTER(i & 1),
+					       USE_INDATA, CACHE_INDATA);
+
+		name = g_strdup_printf("datapipe/execute/filters=%u/triggers=%u",
+				       counts[c], 2 * counts[c]);
+		bench_report(name, iterations, bench_now() - start);
+		g_free(name);
+
+		for (n = 0; n < counts[c]; n++) {
+			remove_filter_from_datapipe(&pipe, bench_filter);
+			remove_input_trigger_from_datapipe(&pipe, bench_trigger);
+			remove_output_trigger_from_datapipe(&pipe, bench_trigger);
+		}
+
+		free_datapipe(&pipe);
+	}
+}
+
+/** Number of bytes received by the I/O monitor */
+static guint64 io_bytes_received = 0;
+
+/** TRUE once the I/O monitor has reported an error */
+static gboolean io_failed = FALSE;
+
+/**
+ * I/O monitor callback for the input event benchmark
+ *
+ * @param data Unused
+ * @param bytes_read Number of bytes read
+ * @param iomon_id Unused
+ */
+static void bench_io_cb(gpointer data, gsize bytes_read,
+			gconstpointer iomon_id)
+{
+	(void)data;
+	(void)iomon_id;
+
+	io_bytes_received += bytes_read;
+}
+
+/**
+ * I/O monitor error callback for the input event benchmark
+ *
+ * @param data Unused
+ * @param device The name of the monitored file
+ * @param iomon_id Unused
+ * @param error The error
+ */
+static void bench_io_error_cb(gpointer data, const gchar *device,
+			      gconstpointer iomon_id, GError *error)
+{
+	(void)data;
+	(void)iomon_id;
+
+	mce_log(LL_ERR, "%s: %s", device,
+		error ? error->message : "unknown error");
+	io_failed = TRUE;
+}
+
+/**
+ * Measure the chunk I/O monitor with a socket flooded with input events
+ *
+ * @param scale Multiplier for the number of events
+ */
+static void bench_io(guint scale)
+{
+	guint64 events = (guint64)BENCH_IO_EVENTS * scale;
+	guint64 total = events * sizeof (struct input_event);
+	struct input_event ev[64];
+	gconstpointer iomon;
+	guint64 sent = 0;
+	gint64 start;
+	gint64 deadline;
+	int fds[2];
+	guint i;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+		mce_log(LL_ERR, "socketpair failed; %s", g_strerror(errno));
+		goto EXIT;
+	}
+
+	(void)fcntl(fds[1], F_SETFL, O_NONBLOCK);
+
+	memset(ev, 0, sizeof ev);
+
+	for (i = 0; i < G_N_ELEMENTS(ev); i++) {
+		ev[i].type = (i & 1) ? EV_SYN : EV_KEY;
+		ev[i].code = (i & 1) ? SYN_REPORT : KEY_POWER;
+		ev[i].value = (i >> 1) & 1;
+	}
+
+	iomon = mce_register_io_monitor_chunk(fds[0], "bench-socket",
+					      MCE_IO_ERROR_POLICY_WARN, FALSE,
+					      bench_io_cb,
+					      sizeof (struct input_event),
+					      bench_io_error_cb, NULL);
+
+	if (iomon == NULL) {
+		mce_log(LL_ERR, "Failed to monitor the socket");
+		goto CLOSE;
+	}
+
+	io_bytes_received = 0;
+	io_failed = FALSE;
+	start = bench_now();
+	deadline = start + BENCH_IO_TIMEOUT * G_GINT64_CONSTANT(1000000000);
+
+	/* The socket is a byte stream, so writes may end mid-event;
+	 * keep writing from where the last write ended
+	 */
+	while (io_bytes_received < total) {
+		while (sent < total) {
+			gsize offset = sent % sizeof ev;
+			gsize count = MIN(total - sent, sizeof ev - offset);
+			ssize_t written = write(fds[1], (gchar *)ev + offset,
+						count);
+
+			if (written > 0) {
+				sent += written;
+				continue;
+			}
+
+			if ((written == -1) &&
+			    (errno != EAGAIN) && (errno != EINTR)) {
+				mce_log(LL_ERR, "write failed; %s",
+					g_strerror(errno));
+				io_failed = TRUE;
+			}
+
+			break;
+		}
+
+		if (io_failed == TRUE)
+			break;
+
+		if (bench_now() > deadline) {
+			mce_log(LL_ERR, "Timed out after receiving %"
+				G_GUINT64_FORMAT " of %" G_GUINT64_FORMAT
+				" bytes", io_bytes_received, total);
+			io_failed = TRUE;
+			break;
+		}
+
+		(void)g_main_context_iteration(NULL, FALSE);
+	}
+
+	if (io_failed == FALSE)
+		bench_report("io/chunk/input_event", events,
+			     bench_now() - start);
+
+	mce_unregister_io_monitor(iomon);
+
+CLOSE:
+	close(fds[0]);
+	close(fds[1]);
+
+EXIT:
+	return;
+}
+
+/**
+ * Write the configuration files for the lookup benchmark
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean bench_conf_setup(void)
+{
+	const gchar *dir = G_STRINGIFY(MCE_CONF_DIR);
+	gchar *override_dir = g_strconcat(dir, "/",
+					  G_STRINGIFY(MCE_CONF_OVERRIDE_DIR),
+					  NULL);
+	gboolean status = FALSE;
+	gchar *path = NULL;
+	guint i;
+
+	if (g_mkdir_with_parents(override_dir, 0755) == -1)
+		goto EXIT;
+
+	path = g_strconcat(dir, "/", G_STRINGIFY(MCE_CONF_FILE), NULL);
+
+	if (g_file_set_contents(path,
+				"[Bench]\n"
+				"MainInt=1\n"
+				"MainString=main\n"
+				"MainList=1;2;3;4;5;6\n",
+				-1, NULL) == FALSE)
+		goto EXIT;
+
+	for (i = 0; i < BENCH_CONF_OVERRIDES; i++) {
+		gchar *contents = g_strdup_printf("[Bench]\n"
+						  "Override%uInt=%u\n"
+						  "[Other%u]\n"
+						  "Key=1\n",
+						  i, i, i);
+		gboolean ok;
+
+		g_free(path);
+		path = g_strdup_printf("%s/%02u-bench.ini", override_dir, i);
+		ok = g_file_set_contents(path, contents, -1, NULL);
+		g_free(contents);
+
+		if (ok == FALSE)
+			goto EXIT;
+	}
+
+	status = TRUE;
+
+EXIT:
+	g_free(path);
+	g_free(override_dir);
+
+	return status;
+}
+
+/**
+ * Measure mce_conf_get_*() lookups across override files
+ *
+ * @param scale Multiplier for the number of iterations
+ */
+static void bench_conf(guint scale)
+{
+	guint64 iterations = (guint64)BENCH_CONF_ITERATIONS * scale;
+	gchar *top_key;
+	gint64 start;
+	guint64 i;
+
+	if ((bench_conf_setup() == FALSE) || (mce_conf_init() == FALSE)) {
+		mce_log(LL_ERR, "cannot set up the configuration in %s",
+			G_STRINGIFY(MCE_CONF_DIR));
+		goto EXIT;
+	}
+
+	top_key = g_strdup_printf("Override%uInt", BENCH_CONF_OVERRIDES - 1);
+
+	start = bench_now();
+	for (i = 0; i < iterations; i++)
+		(void)mce_conf_get_int("Bench", top_key, 0, NULL);
+	bench_report("conf/get_int/top-override", iterations,
+		     bench_now() - start);
+
+	g_free(top_key);
+
+	start = bench_now();
+	for (i = 0; i < iterations; i++)
+		(void)mce_conf_get_int("Bench", "MainInt", 0, NULL);
+	bench_report("conf/get_int/main-file", iterations,
+		     bench_now() - start);
+
+	start = bench_now();
+	for (i = 0; i < iterations; i++)
+		g_free(mce_conf_get_string("Bench", "MainString",
+					   NULL, NULL));
+	bench_report("conf/get_string/main-file", iterations,
+		     bench_now() - start);
+
+	start = bench_now();
+	for (i = 0; i < iterations; i++) {
+		gsize length;
+
+		g_free(mce_conf_get_int_list("Bench", "MainList",
+					     &length, NULL));
+	}
+	bench_report("conf/get_int_list/main-file", iterations,
+		     bench_now() - start);
+
+	start = bench_now();
+	for (i = 0; i < iterations; i++)
+		(void)mce_conf_has_key("Bench", "Missing");
+	bench_report("conf/has_key/missing", iterations,
+		     bench_now() - start);
+
+	mce_conf_exit();
+
+EXIT:
+	return;
+}
+
+/**
+ * Measure mce_write_string_to_file()
+ *
+ * @param dir Directory to write to
+ * @param scale Multiplier for the number of iterations
+ */
+static void bench_write(const gchar *dir, guint scale)
+{
+	guint64 iterations = (guint64)BENCH_WRITE_ITERATIONS * scale;
+	gchar *path = g_strconcat(dir, "/mce-bench-brightness", NULL);
+	gint64 start;
+	guint64 i;
+
+	if (g_file_set_contents(path, "0", -1, NULL) == FALSE) {
+		mce_log(LL_ERR, "cannot write to %s", path);
+		goto EXIT;
+	}
+
+	start = bench_now();
+	for (i = 0; i < iterations; i++)
+		(void)mce_write_string_to_file(path, (i & 1) ? "255" : "128");
+	bench_report("io/write_string_to_file", iterations,
+		     bench_now() - start);
+
+	(void)g_unlink(path);
+
+EXIT:
+	g_free(path);
+}
+
+/**
+ * Display usage information
+ */
+static void usage(void)
+{
+	fprintf(stdout,
+		"Usage: %s [OPTION]...\n"
+		"Microbenchmarks for the mce utilities; "
+		"the results are written as JSON\n"
+		"\n"
+		"  -d, --dir=DIR       directory for the file write "
+		"benchmark;\n"
+		"                        default " DEFAULT_WRITE_DIR "\n"
+		"  -s, --scale=N       multiply the iterations by N\n"
+		"      --help          display this help and exit\n",
+		PRG_NAME);
+}
+
+/**
+ * Main
+ *
+ * @param argc Number of command line arguments
+ * @param argv Array with command line arguments
+ * @return 0 on success, non-zero on failure
+ */
+int main(int argc, char **argv)
+{
+	const gchar *write_dir = DEFAULT_WRITE_DIR;
+	guint scale = 1;
+	int optc;
+
+	struct option const options[] = {
+		{ "dir", required_argument, 0, 'd' },
+		{ "scale", required_argument, 0, 's' },
+		{ "help", no_argument, 0, 'h' },
+		{ 0, 0, 0, 0 }
+	};
+
+	while ((optc = getopt_long(argc, argv, "d:s:",
+				   options, NULL)) != -1) {
+		switch (optc) {
+		case 'd':
+			write_dir = optarg;
+			break;
+
+		case 's':
+			scale = strtoul(optarg, NULL, 10);
+
+			if (scale == 0)
+				scale = 1;
+
+			break;
+
+		case 'h':
+			usage();
+			exit(EXIT_SUCCESS);
+
+		default:
+			usage();
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	mce_log_open(PRG_NAME, LOG_USER, MCE_LOG_STDERR);
+	mce_log_set_verbosity(LL_CRIT);
+
+	mainloop = g_main_loop_new(NULL, FALSE);
+
+	printf("{\n  \"benchmarks\": [");
+
+	bench_datapipe(scale);
+	bench_io(scale);
+	bench_dbus(scale);
+	bench_conf(scale);
+	bench_write(write_dir, scale);
+
+	printf("\n  ]\n}\n");
+
+	g_main_loop_unref(mainloop);
+	mce_log_close();
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,27 @@
+/**
+ * @file mce-bench.h
+ * Headers for the mce microbenchmarks
+ * <p>
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _MCE_BENCH_H_
+#define _MCE_BENCH_H_
+
+#include <glib.h>
+
+gint64 bench_now(void);
+void bench_report(const gchar *name, guint64 iterations, gint64 elapsed);
+
+void bench_dbus(guint scale);
+
+#endif /* _MCE_BENCH_H_ */
@@ -0,0 +1,562 @@
+#!/usr/bin/env python3
+#
+# mce-sim.py -- headless simulation harness for mce
+#
+# Runs an mce built with -DMCE_SIMULATION=ON against a fake sysfs tree,
+# uinput keyboard and touchscreen devices and a private D-Bus daemon
+# with stub services, runs the scenarios and compares the results
+# with a baseline recorded earlier on the same machine; the exit
+# status is non-zero if a result regressed by more than the limits
+# file allows. Use --record-baseline to record the baseline
+#
+# The uinput devices are real input devices on the host; the simulated
+# mce only sees them, through its own /dev/input directory, while
+# a udev rule hides them from logind and the desktop, and a logind
+# inhibitor blocks the host from acting on the simulated [power] presses.
+# Prefer running the harness in a container or VM all the same
+#
+# Needs root (for /dev/uinput and /run/udev), dbus-daemon and PyGObject
+#
+# mce is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License
+# version 2.1 as published by the Free Software Foundation.
+#
+# mce is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public
+# License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+
+"""Headless simulation harness for mce"""
+
+import argparse
+import configparser
+import fcntl
+import glob
+import os
+import shutil
+import signal
+import struct
+import subprocess
+import sys
+import time
+
+from gi.repository import Gio, GLib
+
+MCE_SERVICE = "com.nokia.mce"
+MCE_REQUEST_PATH = "/com/nokia/mce/request"
+MCE_REQUEST_IF = "com.nokia.mce.request"
+
+SYSTEMUI_SERVICE = "com.nokia.system_ui"
+
+LOGIND_SERVICE = "org.freedesktop.login1"
+LOGIND_PATH = "/org/freedesktop/login1"
+LOGIND_MANAGER_IF = "org.freedesktop.login1.Manager"
+
+# Names of the uinput devices; matched by UDEV_RULE
+DEVICE_PREFIX = "mce-sim"
+
+# Keep logind from treating the devices as power switches,
+# and libinput based desktops from using them at all
+UDEV_RULE_FILE = "/run/udev/rules.d/99-mce-sim.rules"
+UDEV_RULE = """# Installed by mce-sim.py for the duration of the simulation
+SUBSYSTEM=="input", ATTRS{name}=="%s *", TAG-="power-switch", \
+  ENV{LIBINPUT_IGNORE_DEVICE}="1"
+""" % DEVICE_PREFIX
+
+SENSORPROXY_SERVICE = "net.hadess.SensorProxy"
+SENSORPROXY_PATH = "/net/hadess/SensorProxy"
+SENSORPROXY_XML = """
+<node>
+  <interface name="net.hadess.SensorProxy">
+    <method name="ClaimLight"/>
+    <method name="ReleaseLight"/>
+    <method name="ClaimAccelerometer"/>
+    <method name="ReleaseAccelerometer"/>
+    <method name="ClaimProximity"/>
+    <method name="ReleaseProximity"/>
+    <property name="HasAmbientLight" type="b" access="read"/>
+    <property name="LightLevelUnit" type="s" access="read"/>
+    <property name="LightLevel" type="d" access="read"/>
+    <property name="HasAccelerometer" type="b" access="read"/>
+    <property name="AccelerometerOrientation" type="s" access="read"/>
+    <property name="HasProximity" type="b" access="read"/>
+    <property name="ProximityNear" type="b" access="read"/>
+  </interface>
+</node>
+"""
+
+# linux/input-event-codes.h
+EV_SYN = 0x00
+EV_KEY = 0x01
+EV_ABS = 0x03
+SYN_REPORT = 0
+KEY_POWER = 116
+BTN_TOUCH = 0x14a
+ABS_X = 0x00
+ABS_Y = 0x01
+INPUT_PROP_DIRECT = 0x01
+
+# linux/uinput.h
+UINPUT_MAX_NAME_SIZE = 80
+ABS_CNT = 0x40
+UI_DEV_CREATE = 0x5501
+UI_DEV_DESTROY = 0x5502
+UI_SET_EVBIT = 0x40045564
+UI_SET_KEYBIT = 0x40045565
+UI_SET_ABSBIT = 0x40045567
+UI_SET_PROPBIT = 0x4004556e
+UI_GET_SYSNAME_64 = 0x8040552c
+
+BUS_VIRTUAL = 0x06
+
+
+class UinputDevice:
+    """A uinput device, created with the legacy uinput_user_dev setup"""
+
+    def __init__(self, name, keys, absaxes=(), props=()):
+        self.fd = os.open("/dev/uinput", os.O_WRONLY | os.O_NONBLOCK)
+
+        fcntl.ioctl(self.fd, UI_SET_EVBIT, EV_KEY)
+        for key in keys:
+            fcntl.ioctl(self.fd, UI_SET_KEYBIT, key)
+
+        absmax = [0] * ABS_CNT
+        if absaxes:
+            fcntl.ioctl(self.fd, UI_SET_EVBIT, EV_ABS)
+            for axis, maximum in absaxes:
+                fcntl.ioctl(self.fd, UI_SET_ABSBIT, axis)
+                absmax[axis] = maximum
+
+        for prop in props:
+            fcntl.ioctl(self.fd, UI_SET_PROPBIT, prop)
+
+        user_dev = struct.pack("%ds4HI" % UINPUT_MAX_NAME_SIZE,
+                               name.encode(), BUS_VIRTUAL, 0x4d43, 1, 1, 0)
+        user_dev += struct.pack("%di" % ABS_CNT, *absmax)
+        user_dev += struct.pack("%di" % (3 * ABS_CNT), *([0] * 3 * ABS_CNT))
+        os.write(self.fd, user_dev)
+
+        fcntl.ioctl(self.fd, UI_DEV_CREATE)
+
+        buf = bytearray(64)
+        fcntl.ioctl(self.fd, UI_GET_SYSNAME_64, buf)
+        sysname = buf.split(b"\0", 1)[0].decode()
+        self.event = self._find_event_node(sysname)
+
+    @staticmethod
+    def _find_event_node(sysname):
+        deadline = time.monotonic() + 5
+        while time.monotonic() < deadline:
+            nodes = glob.glob("/sys/class/input/%s/event*" % sysname)
+            if nodes and os.path.exists("/dev/input/" +
+                                        os.path.basename(nodes[0])):
+                return os.path.basename(nodes[0])
+            time.sleep(0.01)
+        raise RuntimeError("no event node for %s" % sysname)
+
+    def emit(self, events):
+        """Write events followed by SYN_REPORT; returns the write time"""
+        now = time.time()
+        sec = int(now)
+        usec = int((now - sec) * 1000000)
+        data = b"".join(struct.pack("llHHi", sec, usec, t, c, v)
+                        for t, c, v in events)
+        data += struct.pack("llHHi", sec, usec, EV_SYN, SYN_REPORT, 0)
+        t0 = time.monotonic()
+        os.write(self.fd, data)
+        return t0
+
+    def close(self):
+        fcntl.ioctl(self.fd, UI_DEV_DESTROY)
+        os.close(self.fd)
+
+
+def write_file(path, value):
+    os.makedirs(os.path.dirname(path), exist_ok=True)
+    with open(path, "w") as f:
+        f.write(value)
+
+
+def read_int(path):
+    with open(path) as f:
+        text = f.read().strip()
+    return int(text) if text else 0
+
+
+def setup_sysfs(sysfs, devices):
+    """Create the fake sysfs tree read by the simulation build of mce"""
+    shutil.rmtree(sysfs, ignore_errors=True)
+
+    backlight = os.path.join(sysfs, "class/backlight/sim-backlight")
+    write_file(os.path.join(backlight, "brightness"), "0")
+    write_file(os.path.join(backlight, "max_brightness"), "255")
+    write_file(os.path.join(backlight, "actual_brightness"), "0")
+
+    led = os.path.join(sysfs, "class/leds/sim-led")
+    write_file(os.path.join(led, "brightness"), "0")
+    write_file(os.path.join(led, "max_brightness"), "255")
+    write_file(os.path.join(led, "trigger"), "[none]")
+
+    for device in devices:
+        write_file(os.path.join(sysfs, "class/input", device.event,
+                                "device/inhibited"), "0")
+
+    return os.path.join(backlight, "brightness")
+
+
+def setup_devinput(devinput, devices):
+    """Create the /dev/input directory read by the simulation build of mce;
+    it holds only the simulated devices"""
+    shutil.rmtree(devinput, ignore_errors=True)
+    os.makedirs(devinput)
+
+    for device in devices:
+        os.symlink(os.path.join("/dev/input", device.event),
+                   os.path.join(devinput, device.event))
+
+
+def install_udev_rule():
+    os.makedirs(os.path.dirname(UDEV_RULE_FILE), exist_ok=True)
+    with open(UDEV_RULE_FILE, "w") as f:
+        f.write(UDEV_RULE)
+    subprocess.call(["udevadm", "control", "--reload"])
+
+
+def remove_udev_rule():
+    if os.path.exists(UDEV_RULE_FILE):
+        os.unlink(UDEV_RULE_FILE)
+        subprocess.call(["udevadm", "control", "--reload"])
+
+
+def inhibit_power_key():
+    """Take a logind handle-power-key inhibitor on the host system bus;
+    returns the inhibitor fd, or None when logind is not running"""
+    try:
+        bus = Gio.bus_get_sync(Gio.BusType.SYSTEM, None)
+    except GLib.Error:
+        return None
+
+    reply = bus.call_sync("org.freedesktop.DBus", "/org/freedesktop/DBus",
+                          "org.freedesktop.DBus", "NameHasOwner",
+                          GLib.Variant("(s)", (LOGIND_SERVICE,)), None,
+                          Gio.DBusCallFlags.NONE, -1, None)
+    if not reply.unpack()[0]:
+        return None
+
+    # Failing here raises; never press [power] without the inhibitor
+    reply, fds = bus.call_with_unix_fd_list_sync(
+        LOGIND_SERVICE, LOGIND_PATH, LOGIND_MANAGER_IF, "Inhibit",
+        GLib.Variant("(ssss)", ("handle-power-key", "mce-sim",
+                                "Simulated power key presses", "block")),
+        GLib.VariantType("(h)"), Gio.DBusCallFlags.NONE, -1, None, None)
+    return fds.get(reply.unpack()[0])
+
+
+def run_stubs(address):
+    """Stub services; runs in a child process until killed"""
+    conn = Gio.DBusConnection.new_for_address_sync(
+        address,
+        Gio.DBusConnectionFlags.AUTHENTICATION_CLIENT |
+        Gio.DBusConnectionFlags.MESSAGE_BUS_CONNECTION,
+        None, None)
+
+    # systemui: accept every method call and return success
+    def systemui_filter(connection, message, incoming):
+        if (incoming and
+                message.get_message_type() ==
+                Gio.DBusMessageType.METHOD_CALL and
+                message.get_destination() == SYSTEMUI_SERVICE):
+            if not (message.get_flags() &
+                    Gio.DBusMessageFlags.NO_REPLY_EXPECTED):
+                reply = message.new_method_reply()
+                reply.set_body(GLib.Variant("(i)", (0,)))
+                connection.send_message(reply,
+                                        Gio.DBusSendMessageFlags.NONE)
+            return None
+        return message
+
+    conn.add_filter(systemui_filter)
+
+    # iio-sensor-proxy: a dark room, no accelerometer or proximity sensor
+    properties = {
+        "HasAmbientLight": GLib.Variant("b", True),
+        "LightLevelUnit": GLib.Variant("s", "lux"),
+        "LightLevel": GLib.Variant("d", 0.0),
+        "HasAccelerometer": GLib.Variant("b", False),
+        "AccelerometerOrientation": GLib.Variant("s", "undefined"),
+        "HasProximity": GLib.Variant("b", False),
+        "ProximityNear": GLib.Variant("b", False),
+    }
+
+    def method_call(connection, sender, path, interface, method,
+                    params, invocation):
+        invocation.return_value(None)
+
+    def get_property(connection, sender, path, interface, name):
+        return properties[name]
+
+    info = Gio.DBusNodeInfo.new_for_xml(SENSORPROXY_XML).interfaces[0]
+    conn.register_object(SENSORPROXY_PATH, info, method_call,
+                         get_property, None)
+
+    for name in (SYSTEMUI_SERVICE, SENSORPROXY_SERVICE):
+        conn.call_sync("org.freedesktop.DBus", "/org/freedesktop/DBus",
+                       "org.freedesktop.DBus", "RequestName",
+                       GLib.Variant("(su)", (name, 4)), None,
+                       Gio.DBusCallFlags.NONE, -1, None)
+
+    GLib.MainLoop().run()
+
+
+class Simulation:
+    def __init__(self, args):
+        self.args = args
+        self.processes = []
+        self.devices = []
+        self.results = {}
+        self.bus = None
+        self.inhibitor = None
+
+    def start(self):
+        self.inhibitor = inhibit_power_key()
+        install_udev_rule()
+
+        self.keyboard = UinputDevice(DEVICE_PREFIX + " keyboard", [KEY_POWER])
+        self.touchscreen = UinputDevice(DEVICE_PREFIX + " touchscreen",
+                                        [BTN_TOUCH],
+                                        [(ABS_X, 1023), (ABS_Y, 1023)],
+                                        [INPUT_PROP_DIRECT])
+        self.devices = [self.keyboard, self.touchscreen]
+        subprocess.call(["udevadm", "settle"])
+
+        self.brightness = setup_sysfs(os.path.join(self.args.sim_dir, "sys"),
+                                      self.devices)
+        setup_devinput(os.path.join(self.args.sim_dir, "dev/input"),
+                       self.devices)
+
+        daemon = subprocess.Popen(["dbus-daemon", "--session", "--nofork",
+                                   "--print-address=1"],
+                                  stdout=subprocess.PIPE)
+        self.processes.append(daemon)
+        address = daemon.stdout.readline().decode().strip()
+
+        env = dict(os.environ,
+                   DBUS_SYSTEM_BUS_ADDRESS=address,
+                   DBUS_SESSION_BUS_ADDRESS=address)
+
+        self.processes.append(subprocess.Popen(
+            [sys.executable, os.path.abspath(__file__),
+             "--stubs", address], env=env))
+
+        self.bus = Gio.DBusConnection.new_for_address_sync(
+            address,
+            Gio.DBusConnectionFlags.AUTHENTICATION_CLIENT |
+            Gio.DBusConnectionFlags.MESSAGE_BUS_CONNECTION,
+            None, None)
+
+        self.mce = subprocess.Popen([self.args.mce, "--force-stderr"],
+                                    env=env,
+                                    stderr=open(os.path.join(
+                                        self.args.sim_dir, "mce.log"), "w"))
+        self.processes.append(self.mce)
+
+        if not self.wait(lambda: self.has_owner(MCE_SERVICE), 10):
+            raise RuntimeError("mce did not appear on the bus")
+
+        # Let startup settle before measuring
+        time.sleep(1)
+
+    def stop(self):
+        for process in reversed(self.processes):
+            if process.poll() is None:
+                process.send_signal(signal.SIGTERM)
+                try:
+                    process.wait(5)
+                except subprocess.TimeoutExpired:
+                    process.kill()
+        for device in self.devices:
+            device.close()
+        remove_udev_rule()
+        if self.inhibitor is not None:
+            os.close(self.inhibitor)
+
+    @staticmethod
+    def wait(condition, timeout):
+        deadline = time.monotonic() + timeout
+        while time.monotonic() < deadline:
+            if condition():
+                return True
+            time.sleep(0.0005)
+        return False
+
+    def has_owner(self, name):
+        reply = self.bus.call_sync("org.freedesktop.DBus",
+                                   "/org/freedesktop/DBus",
+                                   "org.freedesktop.DBus", "NameHasOwner",
+                                   GLib.Variant("(s)", (name,)), None,
+                                   Gio.DBusCallFlags.NONE, -1, None)
+        return reply.unpack()[0]
+
+    def mce_call(self, method):
+        return self.bus.call_sync(MCE_SERVICE, MCE_REQUEST_PATH,
+                                  MCE_REQUEST_IF, method, None, None,
+                                  Gio.DBusCallFlags.NONE, 5000, None)
+
+    def record(self, name, samples):
+        samples = sorted(samples)
+        if not samples:
+            self.results[name] = None
+            return
+        self.results[name] = samples[min(len(samples) - 1,
+                                         int(len(samples) * 0.95))]
+        print("%-20s n=%-4d median %8.3f  p95 %8.3f  max %8.3f" %
+              (name, len(samples), samples[len(samples) // 2],
+               self.results[name], samples[-1]))
+
+    def scenario_dbus_round_trip(self):
+        samples = []
+        for _ in range(self.args.iterations):
+            t0 = time.monotonic()
+            self.mce_call("get_display_status")
+            samples.append((time.monotonic() - t0) * 1000)
+        self.record("DBusRoundTrip", samples)
+
+    def scenario_key_to_brightness(self):
+        samples = []
+        for _ in range(self.args.iterations):
+            self.mce_call("req_display_state_off")
+            if not self.wait(lambda: read_int(self.brightness) == 0, 2):
+                continue
+            time.sleep(0.1)
+            self.keyboard.emit([(EV_KEY, KEY_POWER, 1)])
+            t0 = self.keyboard.emit([(EV_KEY, KEY_POWER, 0)])
+            if self.wait(lambda: read_int(self.brightness) > 0, 2):
+                samples.append((time.monotonic() - t0) * 1000)
+        self.record("KeyToBrightness", samples)
+
+    def scenario_touch_to_brightness(self):
+        samples = []
+        for _ in range(self.args.iterations):
+            self.mce_call("req_display_state_on")
+            self.wait(lambda: read_int(self.brightness) > 0, 2)
+            time.sleep(0.1)
+            bright = read_int(self.brightness)
+            self.mce_call("req_display_state_dim")
+            if not self.wait(lambda: read_int(self.brightness) < bright, 2):
+                continue
+            dimmed = read_int(self.brightness)
+            time.sleep(0.1)
+            t0 = self.touchscreen.emit([(EV_ABS, ABS_X, 512),
+                                        (EV_ABS, ABS_Y, 512),
+                                        (EV_KEY, BTN_TOUCH, 1)])
+            self.touchscreen.emit([(EV_KEY, BTN_TOUCH, 0)])
+            if self.wait(lambda: read_int(self.brightness) > dimmed, 2):
+                samples.append((time.monotonic() - t0) * 1000)
+        self.record("TouchToBrightness", samples)
+
+    def context_switches(self):
+        total = 0
+        for status in glob.glob("/proc/%d/task/*/status" % self.mce.pid):
+            with open(status) as f:
+                for line in f:
+                    if line.startswith(("voluntary_ctxt_switches:",
+                                        "nonvoluntary_ctxt_switches:")):
+                        total += int(line.split()[1])
+        return total
+
+    def scenario_idle_wakeups(self):
+        self.mce_call("req_display_state_off")
+        self.wait(lambda: read_int(self.brightness) == 0, 2)
+        time.sleep(1)
+        before = self.context_switches()
+        time.sleep(self.args.idle_time)
+        after = self.context_switches()
+        rate = (after - before) / self.args.idle_time
+        self.results["IdleWakeups"] = rate
+        print("%-20s %.2f/s over %d s" %
+              ("IdleWakeups", rate, self.args.idle_time))
+
+    def save(self, path):
+        baseline = configparser.ConfigParser()
+        baseline.optionxform = str
+        baseline["Results"] = {name: repr(value)
+                               for name, value in self.results.items()
+                               if value is not None}
+        with open(path, "w") as f:
+            baseline.write(f)
+        print("Baseline written to %s" % path)
+
+    def check(self, limits, baseline):
+        failed = False
+        for name, value in self.results.items():
+            if value is None:
+                print("FAIL %s: no successful samples" % name)
+                failed = True
+                continue
+            if not limits.has_option("Limits", name):
+                continue
+            if not baseline.has_option("Results", name):
+                print("SKIP %s: not in the baseline" % name)
+                continue
+            reference = baseline.getfloat("Results", name)
+            limit = (reference * limits.getfloat("Limits", name) +
+                     limits.getfloat("Slack", name, fallback=0))
+            if value > limit:
+                print("FAIL %s: %.3f exceeds %.3f (baseline %.3f)" %
+                      (name, value, limit, reference))
+                failed = True
+        return not failed
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--mce", help="mce built with MCE_SIMULATION")
+    parser.add_argument("--sim-dir", help="simulation directory")
+    parser.add_argument("--limits", help="limits file")
+    parser.add_argument("--baseline", help="baseline to compare with")
+    parser.add_argument("--record-baseline", metavar="FILE",
+                        help="write the results to FILE as the baseline")
+    parser.add_argument("--iterations", type=int, default=50)
+    parser.add_argument("--idle-time", type=int, default=10)
+    parser.add_argument("--stubs", metavar="ADDRESS", help=argparse.SUPPRESS)
+    args = parser.parse_args()
+
+    if args.stubs:
+        run_stubs(args.stubs)
+        return 0
+
+    if None in (args.mce, args.sim_dir, args.limits):
+        parser.error("--mce, --sim-dir and --limits are required")
+
+    limits = configparser.ConfigParser()
+    limits.optionxform = str
+    limits.read(args.limits)
+
+    baseline = configparser.ConfigParser()
+    baseline.optionxform = str
+    if args.baseline and not baseline.read(args.baseline):
+        print("No baseline in %s; run with --record-baseline first" %
+              args.baseline)
+
+    sim = Simulation(args)
+    try:
+        sim.start()
+        sim.scenario_dbus_round_trip()
+        sim.scenario_key_to_brightness()
+        sim.scenario_touch_to_brightness()
+        sim.scenario_idle_wakeups()
+    finally:
+        sim.stop()
+
+    if args.record_baseline:
+        sim.save(args.record_baseline)
+        return 0
+
+    return 0 if sim.check(limits, baseline) else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -226,6 +226,49 @@
  */
 #define MCE_VERSION_GET			"get_version"
 
+/**
+ * Query the startup profile
+ *
+ * @since v1.10.17
+ * @return @c dbus array of (@c gchar @c * phase, @c gchar @c * name,
+ *         @c dbus_int64_t start, @c dbus_int64_t duration) structs;
+ *         times are in microseconds, start is relative to the startup of mce
+ */
+#define MCE_STARTUP_PROFILE_GET		"get_startup_profile"
+
+/**
+ * Query a snapshot of the device state in one call
+ *
+ * The keys are device_mode, call_state, call_type, display_status,
+ * display_brightness, display_timeout, tklock_mode, devicelock_mode,
+ * inactivity_status, keyboard_slide, system_state and submode;
+ * the values have the same types and strings as the replies
+ * of the corresponding get methods
+ *
+ * @since v1.10.17
+ * @param since @c dbus_uint32_t generation of a previous reply; optional,
+ *              only state that changed after it is returned;
+ *              pass 0, or leave out, to get everything.
+ *              A generation from before mce restarted
+ *              also returns everything
+ * @return @c dbus_uint32_t the current generation; an opaque value
+ *         that is never 0
+ * @return @c dbus dictionary of (@c gchar @c * key, @c variant value)
+ */
+#define MCE_ALL_STATE_GET		"get_all_state"
+
+/**
+ * Set the log verbosity, either globally or for a single
+ * source file or module
+ *
+ * @since v1.10.17
+ * @param name @c gchar @c * file or module name,
+ *             or an empty string to set the global verbosity
+ * @param verbosity @c dbus_int32_t @c log level, 0 (none) to 5 (debug);
+ *                  -1 to make the file or module use the global verbosity
+ */
+#define MCE_LOG_LEVEL_SET		"set_log_level"
+
 /**
  * Unblank display
  *
@@ -430,6 +473,16 @@
  */
 #define MCE_KEY_SIG		"sig_key_event_ind"
 
+/**
+ * Notify everyone of a batch of key events
+ *
+ * @since v1.10.17
+ * @return @c dbus array of (@c dbus_uint16_t code, @c dbus_int32_t value,
+ *         @c dbus_int64_t time) structs, in the order the events occurred;
+ *         time is the kernel event time in microseconds since the epoch
+ */
+#define MCE_KEYS_SIG		"sig_key_events_ind"
+
 /**
  * Notify everyone that the device orientation has changed
  * Note that this message is sent only if there is at least one active listener.
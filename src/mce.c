@@ -20,6 +20,7 @@
  * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include <glib.h>
+#include <glib-unix.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
@@ -34,6 +35,8 @@
 #include "mce-conf.h"
 #include "mce-dbus.h"
 #include "mce-modules.h"
+#include "mce-patterns.h"
+#include "mce-profile.h"
 #include "event-input.h"
 #include "datapipe.h"
 #include "modetransition.h"
@@ -52,6 +55,17 @@
 /** Name shown by --help etc. */
 #define PRG_NAME			"mce"
 
+/** Name of the logging configuration group */
+#define MCE_CONF_LOG_GROUP		"Log"
+/** Messages a single mce_log() call may log per window; 0 to disable */
+#define MCE_CONF_LOG_RATE_BURST		"RateLimitBurst"
+/** Length of the rate limit window; seconds */
+#define MCE_CONF_LOG_RATE_INTERVAL	"RateLimitInterval"
+/** Default number of messages per rate limit window */
+#define DEFAULT_LOG_RATE_BURST		10
+/** Default length of the rate limit window; seconds */
+#define DEFAULT_LOG_RATE_INTERVAL	5
+
 extern int optind;			/**< Used by getopt */
 extern char *optarg;			/**< Used by getopt */
 
@@ -144,6 +158,9 @@ static void usage(void)
 		  "      --force-stderr  log to stderr even when daemonized\n"
 		  "  -S, --session       use the session bus instead of the "
 		  "system bus for D-Bus\n"
+		  "      --startup-profile  write the startup profile to "
+		  G_STRINGIFY(MCE_VAR_DIR) "/startup-profile\n"
+		  "                      once initialised\n"
 		  "      --quiet         decrease debug message verbosity\n"
 		  "      --verbose       increase debug message verbosity\n"
 		  "      --help          display this help and exit\n"
@@ -217,10 +234,6 @@ EXIT:
 static void signal_handler(const gint signr)
 {
 	switch (signr) {
-	case SIGUSR1:
-		/* We'll probably want some way to communicate with MCE */
-		break;
-
 	case SIGHUP:
 		/* Possibly for re-reading configuration? */
 		break;
@@ -236,6 +249,63 @@ static void signal_handler(const gint signr)
 	}
 }
 
+/**
+ * SIGUSR1 handler; dumps the log ring
+ *
+ * @param data Unused
+ * @return Always returns TRUE to keep the handler installed
+ */
+static gboolean log_ring_dump_cb(gpointer data)
+{
+	FILE *fp;
+
+	(void)data;
+
+	if ((fp = fopen(MCE_LOG_RING_FILENAME, "w")) == NULL) {
+		mce_log(LL_ERR, "Failed to open %s; %s",
+			MCE_LOG_RING_FILENAME, g_strerror(errno));
+		goto EXIT;
+	}
+
+	mce_log_ring_dump(fp);
+	fclose(fp);
+
+	mce_log(LL_INFO, "Log ring dumped to %s", MCE_LOG_RING_FILENAME);
+
+EXIT:
+	return TRUE;
+}
+
+/**
+ * Configure log rate limiting; invalid values are
+ * replaced by the defaults rather than wrapped around
+ */
+static void setup_log_rate_limit(void)
+{
+	gint burst = mce_conf_get_int(MCE_CONF_LOG_GROUP,
+				      MCE_CONF_LOG_RATE_BURST,
+				      DEFAULT_LOG_RATE_BURST, NULL);
+	gint interval = mce_conf_get_int(MCE_CONF_LOG_GROUP,
+					 MCE_CONF_LOG_RATE_INTERVAL,
+					 DEFAULT_LOG_RATE_INTERVAL, NULL);
+
+	if (burst < 0) {
+		mce_log(LL_WARN, "Invalid %s/%s %d; using %d",
+			MCE_CONF_LOG_GROUP, MCE_CONF_LOG_RATE_BURST,
+			burst, DEFAULT_LOG_RATE_BURST);
+		burst = DEFAULT_LOG_RATE_BURST;
+	}
+
+	if (interval <= 0) {
+		mce_log(LL_WARN, "Invalid %s/%s %d; using %d",
+			MCE_CONF_LOG_GROUP, MCE_CONF_LOG_RATE_INTERVAL,
+			interval, DEFAULT_LOG_RATE_INTERVAL);
+		interval = DEFAULT_LOG_RATE_INTERVAL;
+	}
+
+	mce_log_set_rate_limit(burst, interval);
+}
+
 /**
  * Daemonize the program
  *
@@ -373,8 +443,9 @@ static gboolean daemonize(void)
 	signal(SIGTTOU, SIG_IGN);
 	signal(SIGTTIN, SIG_IGN);
 
-	/* Ignore child terminate signal */
-	signal(SIGCHLD, SIG_IGN);
+	/* SIGCHLD is left at its default; helpers started
+	 * with mce_spawn() are reaped by their child watches
+	 */
 
 EXIT:
 	return 0;
@@ -398,6 +469,9 @@ int main(int argc, char **argv)
 	gint status = 0;
 	gboolean daemonflag = FALSE;
 	gboolean systembus = TRUE;
+	gboolean startup_profile = FALSE;
+	gint64 startup_time;
+	gint64 profile_start;
 #ifdef ENABLE_SYSTEMD_SUPPORT
 	gboolean systemd_notify = FALSE;
 #endif
@@ -412,6 +486,7 @@ int main(int argc, char **argv)
 		{ "force-syslog", no_argument, 0, 's' },
 		{ "force-stderr", no_argument, 0, 'T' },
 		{ "session", no_argument, 0, 'S' },
+		{ "startup-profile", no_argument, 0, 'P' },
 		{ "quiet", no_argument, 0, 'q' },
 		{ "verbose", no_argument, 0, 'v' },
 		{ "debug-mode", no_argument, 0, 'D' },
@@ -423,6 +498,10 @@ int main(int argc, char **argv)
 	/* NULL the mainloop */
 	mainloop = NULL;
 
+	/* Start the clock for the startup profile */
+	(void)mce_profile_init();
+	startup_time = mce_profile_timestamp();
+
 	/* Initialise support for locales, and set the program-name */
 	if (init_locales(PRG_NAME) != 0)
 		goto EXIT;
@@ -465,6 +544,10 @@ int main(int argc, char **argv)
 			systembus = FALSE;
 			break;
 
+		case 'P':
+			startup_profile = TRUE;
+			break;
+
 		case 'q':
 			if (verbosity > LL_NONE)
 				verbosity--;
@@ -511,7 +594,6 @@ int main(int argc, char **argv)
 	if (daemonflag == TRUE)
 		daemonize();
 
-	signal(SIGUSR1, signal_handler);
 	signal(SIGHUP, signal_handler);
 	signal(SIGTERM, signal_handler);
 	signal(SIGINT, signal_handler);
@@ -524,6 +606,11 @@ int main(int argc, char **argv)
 	/* Register a mainloop */
 	mainloop = g_main_loop_new(NULL, FALSE);
 
+	/* Dump the log ring on SIGUSR1; the dump needs stdio,
+	 * so it is done from the mainloop rather than the signal handler
+	 */
+	g_unix_signal_add(SIGUSR1, log_ring_dump_cb, NULL);
+
 	/* Initialise subsystems */
 	
 	mce_log(LL_INFO, "Starting MCE");
@@ -532,15 +619,30 @@ int main(int argc, char **argv)
 	/* ignore errors; this way the defaults will be used if
 	 * the configuration file is invalid or unavailable
 	 */
+	profile_start = mce_profile_timestamp();
 	(void)mce_conf_init();
+	mce_profile_record(MCE_PROFILE_PHASE_CONF, "mce-conf", profile_start);
+
+	setup_log_rate_limit();
+
+	/* Initialise the pattern registry */
+	(void)mce_patterns_init();
 
 	/* Initialise D-Bus */
+	profile_start = mce_profile_timestamp();
 	if (mce_dbus_init(systembus) == FALSE) {
 		mce_log(LL_CRIT,
 			"Failed to initialise D-Bus");
 		mce_log_close();
 		exit(EXIT_FAILURE);
 	}
+	mce_profile_record(MCE_PROFILE_PHASE_DBUS, "mce-dbus", profile_start);
+
+	/* Export the startup profile
+	 * pre-requisite: mce_dbus_init()
+	 */
+	if (mce_profile_dbus_init() == FALSE)
+		mce_log(LL_WARN, "Failed to export the startup profile");
 
 	/* Setup all datapipes */
 	setup_datapipe(&system_state_pipe, READ_WRITE, DONT_FREE_CACHE,
@@ -563,16 +665,16 @@ int main(int argc, char **argv)
 		       0, GINT_TO_POINTER(0));
 	setup_datapipe(&led_pattern_activate_pipe, READ_WRITE, DONT_FREE_CACHE,
 		       0, NULL);
-	setup_datapipe(&led_pattern_deactivate_pipe, READ_ONLY, FREE_CACHE,
+	setup_datapipe(&led_pattern_deactivate_pipe, READ_ONLY, DONT_FREE_CACHE,
 		       0, NULL);
 	setup_datapipe(&led_enabled_pipe, READ_WRITE, DONT_FREE_CACHE,
 		       0, GINT_TO_POINTER(TRUE));
-	setup_datapipe(&vibrator_pattern_activate_pipe, READ_ONLY, FREE_CACHE,
-		       0, NULL);
-	setup_datapipe(&vibrator_pattern_deactivate_pipe, READ_ONLY, FREE_CACHE,
+	setup_datapipe(&vibrator_pattern_activate_pipe, READ_ONLY,
+		       DONT_FREE_CACHE, 0, NULL);
+	setup_datapipe(&vibrator_pattern_deactivate_pipe, READ_ONLY,
+		       DONT_FREE_CACHE, 0, NULL);
+	setup_datapipe(&keypress_pipe, READ_ONLY, DONT_FREE_CACHE,
 		       0, NULL);
-	setup_datapipe(&keypress_pipe, READ_WRITE, FREE_CACHE,
-		       sizeof (struct input_event), NULL);
 	setup_datapipe(&touchscreen_pipe, READ_ONLY, DONT_FREE_CACHE,
 		       0, GINT_TO_POINTER(0));
 	setup_datapipe(&touchscreen_suspend_pipe, READ_ONLY, DONT_FREE_CACHE,
@@ -625,34 +727,49 @@ int main(int argc, char **argv)
 	/* Initialise mode management
 	* pre-requisite: mce_dbus_init()
 	*/
+	profile_start = mce_profile_timestamp();
 	if (mce_mode_init() == FALSE) {
 		status = EXIT_FAILURE;
 		mce_log(LL_CRIT, "Failed to initialise mce-mode");
 		goto EXIT;
 	}
+	mce_profile_record(MCE_PROFILE_PHASE_CORE, "mce-mode", profile_start);
 
 	/* Initialise powerkey driver */
+	profile_start = mce_profile_timestamp();
 	if (mce_powerkey_init() == FALSE) {
 		status = EXIT_FAILURE;
 		mce_log(LL_CRIT, "Failed to initialise mce-powerkey");
 		goto EXIT;
 	}
+	mce_profile_record(MCE_PROFILE_PHASE_CORE, "mce-powerkey",
+			   profile_start);
 
+	profile_start = mce_profile_timestamp();
 	if (mce_input_init() == FALSE) {
 		status = EXIT_FAILURE;
 		mce_log(LL_CRIT, "Failed to initialise mce-input");
 		goto EXIT;
 	}
+	mce_profile_record(MCE_PROFILE_PHASE_CORE, "mce-input", profile_start);
 
 	/* Load all modules */
+	profile_start = mce_profile_timestamp();
 	if (mce_modules_init() == FALSE) {
 		status = EXIT_FAILURE;
 		mce_log(LL_CRIT, "Failed to initialise mce-modules");
 		goto EXIT;
 	}
+	mce_profile_record(MCE_PROFILE_PHASE_CORE, "mce-modules",
+			   profile_start);
 
 	mce_startup_ui();
 
+	mce_profile_record(MCE_PROFILE_PHASE_READY, PRG_NAME, startup_time);
+
+	if (startup_profile == TRUE)
+		(void)mce_profile_save();
+
 #ifdef ENABLE_SYSTEMD_SUPPORT
 	/* Tell systemd that we have started up */
 	if (systemd_notify) {
@@ -714,7 +831,9 @@ EXIT:
 
 	/* Call the exit function for all subsystems */
 	mce_dbus_exit();
+	mce_patterns_exit();
 	mce_conf_exit();
+	mce_profile_exit();
 
 	/* If the mainloop is initialised, unreference it */
 	if (mainloop != NULL)
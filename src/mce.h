@@ -44,6 +44,9 @@
 
 #define MCE_DEVLOCK_FILENAME		G_STRINGIFY(MCE_RUN_DIR) "/call"
 
+/** File the log ring is dumped to on SIGUSR1 */
+#define MCE_LOG_RING_FILENAME		G_STRINGIFY(MCE_RUN_DIR) "/log-ring"
+
 /** Indicate enabled (sub)mode */
 #define DISABLED_STRING			"yes"
 /** Indicate disabled (sub)mode */
@@ -88,7 +91,11 @@ typedef struct {
 	const gchar *const *const replaces;
 /** Module priority:
  * lower value == higher priority
- * This value is only used when modules conflict
+ * This value is only used when modules provide the same functionality;
+ * the module with the higher priority is loaded, whatever the order
+ * of the module lists, and the module listed first wins a tie.
+ * The other module is not loaded at all, even if it also provides
+ * functionality that nothing else provides
  */
 	const gint priority;
 } module_info_struct;
@@ -268,13 +275,15 @@ typedef enum {
 
 /** State of device; read only */
 extern datapipe_struct device_inactive_pipe;
-/** LED pattern to activate; read only */
+/** LED pattern to activate, as a pattern id; read only */
 extern datapipe_struct led_pattern_activate_pipe;
-/** LED pattern to deactivate; read only */
+/** LED pattern to deactivate, as a pattern id; read only */
 extern datapipe_struct led_pattern_deactivate_pipe;
 /** LED enabled / disabled */
 extern datapipe_struct led_enabled_pipe;
+/** Vibrator pattern to activate, as a pattern id; read only */
 extern datapipe_struct vibrator_pattern_activate_pipe;
+/** Vibrator pattern to deactivate, as a pattern id; read only */
 extern datapipe_struct vibrator_pattern_deactivate_pipe;
 /** State of display; read only */
 extern datapipe_struct display_state_pipe;
@@ -284,7 +293,11 @@ extern datapipe_struct display_state_pipe;
  * upper 8 bits is high brightness boost (0-2)
  */
 extern datapipe_struct display_brightness_pipe;
-/** A key has been pressed */
+/**
+ * Keys have been pressed or released;
+ * the data is an mce_input_frame_t with the key events of one report,
+ * owned by the sender; take a reference to keep it
+ */
 extern datapipe_struct keypress_pipe;
 /** Touchscreen activity took place */
 extern datapipe_struct touchscreen_pipe;
@@ -347,6 +360,8 @@ gboolean mce_set_device_mode_int32(const device_mode_t mode);
 submode_t mce_get_submode_int32(void);
 gboolean mce_add_submode_int32(const submode_t submode);
 gboolean mce_rem_submode_int32(const submode_t submode);
+void mce_begin_submode_transaction(void);
+gboolean mce_commit_submode_transaction(void);
 
 void mce_startup_ui(void);
 
@@ -0,0 +1,638 @@
+/**
+* @file battery-sysfs.c
+* Battery module -- battery and charger logic for MCE,
+* reading power_supply devices directly from sysfs
+* <p>
+* Unlike battery-upower, this does not need the UPower daemon;
+* the power_supply class is read from sysfs at startup and
+* kept up to date from the kernel uevents for that class
+* <p>
+* mce is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License
+* version 2.1 as published by the Free Software Foundation.
+*
+* mce is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "mce.h"
+#include "mce-log.h"
+#include "mce-patterns.h"
+#include "mce-conf.h"
+#include "mce-battery.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <glib.h>
+#include <gmodule.h>
+
+#define MODULE_NAME "battery_sysfs"
+/** Provided by both battery modules, so that only one of them is loaded */
+#define MODULE_PROVIDES "battery"
+
+static const gchar *const provides[] = { MODULE_PROVIDES, NULL };
+
+G_MODULE_EXPORT module_info_struct module_info = {
+	.name     = MODULE_NAME,
+	.provides = provides,
+	.priority = 90
+};
+
+
+#define UNUSED(x) (void)(x)
+
+/** Path to the power_supply class in sysfs */
+#define POWER_SUPPLY_PATH MCE_SYSFS_DIR "/class/power_supply"
+
+/** Prefix of the power_supply properties in uevents */
+#define POWER_SUPPLY_PREFIX "POWER_SUPPLY_"
+
+/** Size of the uevent receive buffer; the kernel limit is 2048 */
+#define UEVENT_BUFFER_SIZE 4096
+
+#define MCE_CONF_BATTERY_SECTION "Battery"
+#define MCE_CONF_POLL_INTERVAL_KEY "PollInterval"
+
+/** Default interval for rereading the battery; [s] */
+#define DEFAULT_POLL_INTERVAL 60
+
+/** Skip these devices */
+static const char* blacklist[] = {
+	/* List power_supply devices to be blacklisted, as named
+	 * in /sys/class/power_supply. Example:
+	 * "rx51-battery",
+	 */
+	NULL
+};
+
+/** State of a power_supply device */
+typedef struct {
+	/** Name of the device in /sys/class/power_supply */
+	gchar    *name;
+	/** Device is a battery */
+	gboolean  battery;
+	/** Device belongs to a peripheral (SCOPE=Device), such as
+	 *  a Bluetooth headset; neither powers nor charges the system */
+	gboolean  peripheral;
+	/** Device is a charger that is online */
+	gboolean  online;
+	/** Charge percentage, or -1 if not reported */
+	gint      capacity;
+	/** Voltage in V, or 0 if not reported */
+	gdouble   voltage;
+	/** Charging status, e.g. "Charging" */
+	gchar    *status;
+	/** Capacity level, e.g. "Low" */
+	gchar    *capacity_level;
+} supply_t;
+
+/** Private data */
+static struct {
+	GHashTable *supplies;
+	gint        uevent_fd;
+	guint       uevent_id;
+	guint       poll_id;
+	/** Battery is full; kept until the charger is disconnected */
+	gboolean    full;
+	mce_battery_config_t config;
+} private = {
+	.uevent_fd = -1,
+};
+
+/** Battery properties in mce statemachine compatible form */
+static mce_battery_state_t mcebat = {0};
+
+/**
+* Provide initial guess of mce battery status
+*/
+static void
+mcebat_init(void)
+{
+	mcebat.status = BATTERY_STATUS_UNDEF;
+	mcebat.charger_connected = FALSE;
+	private.full = FALSE;
+}
+
+/**
+* Free a power_supply device
+*/
+static void
+supply_free(gpointer data)
+{
+	supply_t *supply = data;
+
+	g_free(supply->name);
+	g_free(supply->status);
+	g_free(supply->capacity_level);
+	g_free(supply);
+}
+
+/**
+* Look up a power_supply device, adding it if it is not known yet
+*
+* @param name  Name of the device in /sys/class/power_supply
+* @return  The device, or NULL if it is blacklisted
+*/
+static supply_t *
+supply_get(const gchar *name)
+{
+	supply_t *supply;
+	gint i;
+
+	if ((supply = g_hash_table_lookup(private.supplies, name)) != NULL)
+		return supply;
+
+	for (i = 0; blacklist[i] != NULL; i++) {
+		if (!g_strcmp0(name, blacklist[i]))
+			return NULL;
+	}
+
+	supply = g_new0(supply_t, 1);
+	supply->name = g_strdup(name);
+	supply->capacity = -1;
+	g_hash_table_insert(private.supplies, supply->name, supply);
+
+	mce_log(LL_DEBUG, "%s: Added power supply %s", MODULE_NAME, name);
+
+	return supply;
+}
+
+/**
+* Update a power_supply device from a uevent property
+*
+* @param supply  The device
+* @param property  A KEY=VALUE property, as found in uevents
+*                  and in the uevent file in sysfs
+*/
+static void
+supply_set_property(supply_t *supply, const gchar *property)
+{
+	const gchar *key;
+	const gchar *value;
+
+	if (strncmp(property, POWER_SUPPLY_PREFIX,
+		    strlen(POWER_SUPPLY_PREFIX)) != 0)
+		return;
+
+	key = property + strlen(POWER_SUPPLY_PREFIX);
+
+	if ((value = strchr(key, '=')) == NULL)
+		return;
+
+	value++;
+
+	if (!strncmp(key, "TYPE=", 5)) {
+		supply->battery = !strcmp(value, "Battery");
+	} else if (!strncmp(key, "SCOPE=", 6)) {
+		supply->peripheral = !strcmp(value, "Device");
+	} else if (!strncmp(key, "ONLINE=", 7)) {
+		supply->online = atoi(value) != 0;
+	} else if (!strncmp(key, "CAPACITY=", 9)) {
+		supply->capacity = atoi(value);
+	} else if (!strncmp(key, "VOLTAGE_NOW=", 12)) {
+		/* Reported in uV */
+		supply->voltage = g_ascii_strtod(value, NULL) / 1000000.0;
+	} else if (!strncmp(key, "STATUS=", 7)) {
+		if (g_strcmp0(supply->status, value)) {
+			mce_log(LL_DEBUG, "%s: %s: State: %s -> %s", MODULE_NAME,
+				supply->name, supply->status, value);
+			g_free(supply->status);
+			supply->status = g_strdup(value);
+		}
+	} else if (!strncmp(key, "CAPACITY_LEVEL=", 15)) {
+		if (g_strcmp0(supply->capacity_level, value)) {
+			mce_log(LL_DEBUG, "%s: %s: Capacity Level: %s -> %s",
+				MODULE_NAME, supply->name,
+				supply->capacity_level, value);
+			g_free(supply->capacity_level);
+			supply->capacity_level = g_strdup(value);
+		}
+	}
+}
+
+/**
+* Read the state of a power_supply device from its uevent file
+*
+* @param name  Name of the device in /sys/class/power_supply
+*/
+static void
+supply_read(const gchar *name)
+{
+	gchar *path = g_strconcat(POWER_SUPPLY_PATH "/", name, "/uevent", NULL);
+	gchar *contents = NULL;
+	gchar **properties = NULL;
+	supply_t *supply;
+	gint i;
+
+	if ((supply = supply_get(name)) == NULL)
+		goto EXIT;
+
+	if (!g_file_get_contents(path, &contents, NULL, NULL)) {
+		mce_log(LL_WARN, "%s: Unable to read %s", MODULE_NAME, path);
+		goto EXIT;
+	}
+
+	properties = g_strsplit(contents, "\n", 0);
+
+	for (i = 0; properties[i] != NULL; i++)
+		supply_set_property(supply, properties[i]);
+
+EXIT:
+	g_strfreev(properties);
+	g_free(contents);
+	g_free(path);
+}
+
+/**
+* Read all power_supply devices from sysfs
+*
+* Devices that are no longer present are forgotten,
+* so that this can be used to resync after missed uevents
+*/
+static void
+supply_read_all(void)
+{
+	GHashTable *present = NULL;
+	GHashTableIter iter;
+	gpointer key;
+	GDir *dir;
+	const gchar *name;
+
+	if ((dir = g_dir_open(POWER_SUPPLY_PATH, 0, NULL)) == NULL) {
+		mce_log(LL_WARN, "%s: Unable to open %s", MODULE_NAME,
+			POWER_SUPPLY_PATH);
+		goto EXIT;
+	}
+
+	present = g_hash_table_new_full(g_str_hash, g_str_equal,
+					g_free, NULL);
+
+	while ((name = g_dir_read_name(dir)) != NULL) {
+		g_hash_table_add(present, g_strdup(name));
+		supply_read(name);
+	}
+
+	g_dir_close(dir);
+
+	g_hash_table_iter_init(&iter, private.supplies);
+
+	while (g_hash_table_iter_next(&iter, &key, NULL)) {
+		if (g_hash_table_contains(present, key))
+			continue;
+
+		mce_log(LL_DEBUG, "%s: Removed power supply %s",
+			MODULE_NAME, (const gchar *)key);
+		g_hash_table_iter_remove(&iter);
+	}
+
+EXIT:
+	if (present != NULL)
+		g_hash_table_destroy(present);
+}
+
+/**
+* Update mce battery status from the power_supply devices
+*/
+static void
+mcebat_update_from_supplies(void)
+{
+	GHashTableIter iter;
+	gpointer value;
+	supply_t *battery = NULL;
+	gboolean have_charger = FALSE;
+	gboolean charger_online = FALSE;
+	gboolean charging;
+
+	g_hash_table_iter_init(&iter, private.supplies);
+
+	while (g_hash_table_iter_next(&iter, NULL, &value)) {
+		supply_t *supply = value;
+
+		/* Peripherals are neither batteries nor chargers of the system */
+		if (supply->peripheral)
+			continue;
+
+		/* If there are multiple batteries, use the first one */
+		if (supply->battery) {
+			if (battery == NULL ||
+			    strcmp(supply->name, battery->name) < 0)
+				battery = supply;
+		} else {
+			have_charger = TRUE;
+			charger_online = charger_online || supply->online;
+		}
+	}
+
+	mcebat.status = BATTERY_STATUS_UNDEF;
+
+	if (battery == NULL) {
+		mcebat.charger_connected = charger_online;
+		private.full = FALSE;
+		return;
+	}
+
+	charging = !g_strcmp0(battery->status, "Charging") ||
+		   !g_strcmp0(battery->status, "Full");
+
+	/* Without a charger device, guess using the battery status */
+	if (have_charger)
+		mcebat.charger_connected = charger_online;
+	else
+		mcebat.charger_connected = charging ||
+			!g_strcmp0(battery->status, "Not charging");
+
+	/* Prevent 'full' -> 'charging' transitions while
+	 * the charger tops up the battery
+	 */
+	if (!mcebat.charger_connected)
+		private.full = FALSE;
+	else if (!g_strcmp0(battery->status, "Full"))
+		private.full = TRUE;
+
+	mcebat.status = mce_battery_evaluate(&private.config,
+					     mcebat.charger_connected,
+					     private.full, battery->voltage,
+					     battery->capacity,
+					     battery->capacity_level);
+}
+
+/**
+* Re-evaluate the battery status and feed changes to the datapipes
+*/
+static void
+mcebat_update(void)
+{
+	mce_battery_state_t prev = mcebat;
+
+	mcebat_update_from_supplies();
+	mce_battery_publish(MODULE_NAME, &prev, &mcebat);
+}
+
+/**
+* Handle a single kernel uevent
+*
+* @param buf  The uevent; a header followed by NUL separated
+*             KEY=VALUE properties
+* @param len  Length of the uevent
+* @return  TRUE if a power_supply device changed, FALSE otherwise
+*/
+static gboolean
+uevent_handle(const gchar *buf, gsize len)
+{
+	const gchar *action = NULL;
+	const gchar *subsystem = NULL;
+	const gchar *devpath = NULL;
+	const gchar *name;
+	supply_t *supply;
+	gsize pos;
+
+	/* Skip the action@devpath header */
+	for (pos = strlen(buf) + 1; pos < len; pos += strlen(buf + pos) + 1) {
+		const gchar *property = buf + pos;
+
+		if (!strncmp(property, "ACTION=", 7))
+			action = property + 7;
+		else if (!strncmp(property, "SUBSYSTEM=", 10))
+			subsystem = property + 10;
+		else if (!strncmp(property, "DEVPATH=", 8))
+			devpath = property + 8;
+	}
+
+	if (g_strcmp0(subsystem, "power_supply") || !action || !devpath)
+		return FALSE;
+
+	if ((name = strrchr(devpath, '/')) == NULL)
+		return FALSE;
+
+	name++;
+
+	if (!strcmp(action, "remove")) {
+		mce_log(LL_DEBUG, "%s: Removed power supply %s",
+			MODULE_NAME, name);
+		return g_hash_table_remove(private.supplies, name);
+	}
+
+	if ((supply = supply_get(name)) == NULL)
+		return FALSE;
+
+	for (pos = strlen(buf) + 1; pos < len; pos += strlen(buf + pos) + 1)
+		supply_set_property(supply, buf + pos);
+
+	return TRUE;
+}
+
+/**
+* Handle kernel uevents
+*
+* @param source  unused
+* @param condition  The condition that triggered the callback
+* @param data  unused
+* @return  TRUE to keep the watch, FALSE to remove it
+*/
+static gboolean
+uevent_cb(GIOChannel *source, GIOCondition condition, gpointer data)
+{
+	gchar buf[UEVENT_BUFFER_SIZE];
+	gboolean changed = FALSE;
+
+	UNUSED(source);
+	UNUSED(data);
+
+	if (condition & (G_IO_ERR | G_IO_HUP | G_IO_NVAL)) {
+		mce_log(LL_ERR, "%s: uevent socket failed; "
+			"relying on polling", MODULE_NAME);
+		private.uevent_id = 0;
+		return FALSE;
+	}
+
+	/* Drain all queued uevents before evaluating the new state */
+	for (;;) {
+		struct sockaddr_nl sender;
+		socklen_t sender_len = sizeof(sender);
+		ssize_t len;
+
+		len = recvfrom(private.uevent_fd, buf, sizeof(buf) - 1, 0,
+			       (struct sockaddr *)&sender, &sender_len);
+
+		if (len < 0) {
+			if (errno == ENOBUFS) {
+				/* Events were lost; start over from sysfs */
+				mce_log(LL_WARN, "%s: uevents lost", MODULE_NAME);
+				supply_read_all();
+				changed = TRUE;
+				continue;
+			}
+
+			if (errno != EAGAIN && errno != EWOULDBLOCK &&
+			    errno != EINTR)
+				mce_log(LL_ERR, "%s: recvfrom() failed; %s",
+					MODULE_NAME, g_strerror(errno));
+			break;
+		}
+
+		/* Only accept uevents from the kernel */
+		if (sender.nl_pid != 0)
+			continue;
+
+		buf[len] = '\0';
+
+		if (uevent_handle(buf, len))
+			changed = TRUE;
+	}
+
+	if (changed)
+		mcebat_update();
+
+	return TRUE;
+}
+
+/**
+* Open the kernel uevent socket and watch it from the main loop
+*
+* @return  TRUE on success, FALSE on failure
+*/
+static gboolean
+uevent_init(void)
+{
+	struct sockaddr_nl addr = {
+		.nl_family = AF_NETLINK,
+		.nl_groups = 1,
+	};
+	GIOChannel *channel;
+
+	private.uevent_fd = socket(AF_NETLINK,
+				   SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+				   NETLINK_KOBJECT_UEVENT);
+	if (private.uevent_fd == -1) {
+		mce_log(LL_ERR, "%s: Unable to open uevent socket; %s",
+			MODULE_NAME, g_strerror(errno));
+		return FALSE;
+	}
+
+	if (bind(private.uevent_fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+		mce_log(LL_ERR, "%s: Unable to bind uevent socket; %s",
+			MODULE_NAME, g_strerror(errno));
+		close(private.uevent_fd);
+		private.uevent_fd = -1;
+		return FALSE;
+	}
+
+	channel = g_io_channel_unix_new(private.uevent_fd);
+	private.uevent_id = g_io_add_watch(channel,
+					   G_IO_IN | G_IO_ERR | G_IO_HUP | G_IO_NVAL,
+					   uevent_cb, NULL);
+	g_io_channel_unref(channel);
+
+	return TRUE;
+}
+
+/**
+* Close the kernel uevent socket
+*/
+static void
+uevent_exit(void)
+{
+	if (private.uevent_id)
+		g_source_remove(private.uevent_id), private.uevent_id = 0;
+
+	if (private.uevent_fd != -1)
+		close(private.uevent_fd), private.uevent_fd = -1;
+}
+
+/**
+* Reread the power_supply devices
+*
+* Not all fuel gauges send uevents when the capacity changes,
+* so the battery is polled at a slow rate as well
+*
+* @param user_data  (not used)
+* @return  TRUE (to keep the timer repeating)
+*/
+static gboolean
+poll_cb(gpointer user_data)
+{
+	GHashTableIter iter;
+	gpointer key;
+	GSList *names = NULL;
+	GSList *l;
+
+	UNUSED(user_data);
+
+	/* Reading may add devices; don't read while iterating */
+	g_hash_table_iter_init(&iter, private.supplies);
+
+	while (g_hash_table_iter_next(&iter, &key, NULL))
+		names = g_slist_prepend(names, g_strdup(key));
+
+	for (l = names; l; l = l->next)
+		supply_read(l->data);
+
+	g_slist_free_full(names, g_free);
+
+	mcebat_update();
+
+	return TRUE;
+}
+
+
+/**
+* Init function for the battery and charger module
+* @param module  unused
+* @return  NULL on success, a string with an error message on failure
+*/
+G_MODULE_EXPORT const gchar *g_module_check_init(GModule *module);
+const gchar *g_module_check_init(GModule *module)
+{
+	gint poll_interval;
+
+	UNUSED(module);
+
+	/* Reset data used by the state machine */
+	mcebat_init();
+
+	mce_battery_read_config(&private.config, MODULE_NAME);
+	poll_interval = mce_conf_get_int(MCE_CONF_BATTERY_SECTION, MCE_CONF_POLL_INTERVAL_KEY, DEFAULT_POLL_INTERVAL, NULL);
+
+	private.supplies = g_hash_table_new_full(g_str_hash, g_str_equal,
+						 NULL, supply_free);
+
+	/* Subscribe before reading, so that no change is missed */
+	uevent_init();
+
+	supply_read_all();
+	mcebat_update();
+
+	if (poll_interval > 0)
+		private.poll_id = g_timeout_add_seconds(poll_interval, poll_cb, NULL);
+
+	return NULL;
+}
+
+/**
+* Exit function for the battery and charger module
+* @param module  unused
+*/
+G_MODULE_EXPORT void g_module_unload(GModule *module);
+void g_module_unload(GModule *module)
+{
+	UNUSED(module);
+
+	if (private.poll_id)
+		g_source_remove(private.poll_id), private.poll_id = 0;
+
+	uevent_exit();
+
+	if (private.supplies != NULL) {
+		g_hash_table_destroy(private.supplies);
+		private.supplies = NULL;
+	}
+}
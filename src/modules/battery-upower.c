@@ -22,8 +22,10 @@
 
 #include "mce.h"
 #include "mce-log.h"
+#include "mce-patterns.h"
 #include "mce-conf.h"
 #include "mce-dbus.h"
+#include "mce-battery.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -32,8 +34,10 @@
 #include <gmodule.h>
 
 #define MODULE_NAME "battery_upower"
+/** Provided by both battery modules, so that only one of them is loaded */
+#define MODULE_PROVIDES "battery"
 
-static const gchar *const provides[] = { MODULE_NAME, NULL };
+static const gchar *const provides[] = { MODULE_PROVIDES, NULL };
 
 G_MODULE_EXPORT module_info_struct module_info = {
 	.name     = MODULE_NAME,
@@ -53,20 +57,9 @@ G_MODULE_EXPORT module_info_struct module_info = {
 /** Delay from 1st property change to state machine update; [ms] */
 #define UPDATE_DELAY 100
 
-/** Whether to support legacy pattery low led pattern; nonzero for yes */
-#define SUPPORT_BATTERY_LOW_LED_PATTERN 0
-
 /** How long we want battery state to be forced after charger state changed */
 #define FORCE_STATE_TIME 10
 
-#define MCE_CONF_BATTERY_SECTION "Battery"
-#define MCE_CONF_CRIT_VOLTAGE_KEY "CriticalVoltage"
-#define MCE_CONF_LOW_VOLTAGE_KEY "LowVoltage"
-#define MCE_CONF_LOW_PERCENT_KEY "LowPercentage"
-#define MCE_CONF_EMPTY_PERCENT_KEY "EmptyPercentage"
-#define MCE_CONF_USE_CAPACITY_LEVEL "UseCapacityLevel"
-#define MCE_CONF_CAPACITY_LOW_CRITICAL_KEY "CapacityLevelLowCritical"
-
 
 /** Skip these devices */
 static const char* blacklist[] = {
@@ -85,16 +78,11 @@ static struct {
 	UpDevice *charger;
 	gboolean  fallback;
 	time_t    force_state;
-	gdouble min_voltage;
-	gdouble low_voltage;
-	int low_percentage;
-	int empty_percentage;
-	gboolean  use_capacity_level;
-	gboolean  level_low_critical;
+	mce_battery_config_t config;
 } private = {0};
 
 /** Battery properties available via UPower */
-struct {
+static struct {
 	guint    state;
 	gdouble  percentage;
 	gdouble  voltage;
@@ -103,12 +91,7 @@ struct {
 } upowbat = {0};
 
 /** Battery properties in mce statemachine compatible form */
-struct mce_battery {
-	/** Battery FULL/OK/LOW/EMPTY; for use with battery_status_pipe */
-	int       status;
-	/** Charger connected; for use with charger_state_pipe */
-	gboolean  charger_connected;
-} mcebat = {0};
+static mce_battery_state_t mcebat = {0};
 
 /** Timer for processing battery status changes */
 static guint mcebat_update_id = 0;
@@ -198,8 +181,6 @@ upowbat_update(void)
 static void
 mcebat_update_from_upowbat(void)
 {
-	mcebat.status = BATTERY_STATUS_UNDEF;
-
 	/* Try to guess charger state using battery state property */
 	if (private.charger) {
 		mcebat.charger_connected = upowbat.charger_online;
@@ -209,51 +190,11 @@ mcebat_update_from_upowbat(void)
 								upowbat.state == UP_DEVICE_STATE_PENDING_CHARGE;
 	}
 
-	if (upowbat.state == UP_DEVICE_STATE_FULLY_CHARGED)
-		mcebat.status = BATTERY_STATUS_FULL;
-
-	/*
-	 * Inhibit shutdown if charger is connected or an alternate shutdown
-	 * method (voltage or capacity_level) is configured.
-	 */
-	if (mcebat.charger_connected || private.min_voltage || private.use_capacity_level)
-		mcebat.status = BATTERY_STATUS_OK;
-
-	if (private.min_voltage && upowbat.voltage < private.min_voltage)
-		mcebat.status = BATTERY_STATUS_EMPTY;
-	else if (private.use_capacity_level &&
-			g_strcmp0(upowbat.capacity_level, "Critical") == 0)
-		mcebat.status = BATTERY_STATUS_EMPTY;
-	else if (private.use_capacity_level && private.level_low_critical &&
-			g_strcmp0(upowbat.capacity_level, "Low") == 0)
-		mcebat.status = BATTERY_STATUS_EMPTY;
-	/*
-	 * Ensure low_voltage is only considered if min_voltage is set, to avoid
-	 * getting stuck in the battery low status
-	 */
-	else if (private.min_voltage && private.low_voltage &&
-			upowbat.voltage < private.low_voltage)
-		mcebat.status = BATTERY_STATUS_LOW;
-	else if (private.use_capacity_level &&
-			g_strcmp0(upowbat.capacity_level, "Low") == 0)
-		mcebat.status = BATTERY_STATUS_LOW;
-
-	/* Bypass percentage evaluation if status has already been determined */
-	if (mcebat.status != BATTERY_STATUS_UNDEF)
-		return;
-
-	if (upowbat.percentage < private.empty_percentage)
-		mcebat.status = BATTERY_STATUS_EMPTY;
-	else if (upowbat.percentage < private.low_percentage)
-		mcebat.status = BATTERY_STATUS_LOW;
-	else
-		mcebat.status = BATTERY_STATUS_OK;
-}
-
-static inline const char *
-charger_state_repr(gboolean state)
-{
-	return state ? "on" : "off";
+	mcebat.status = mce_battery_evaluate(&private.config,
+					     mcebat.charger_connected,
+					     upowbat.state == UP_DEVICE_STATE_FULLY_CHARGED,
+					     upowbat.voltage, upowbat.percentage,
+					     upowbat.capacity_level);
 }
 
 /**
@@ -264,7 +205,7 @@ charger_state_repr(gboolean state)
 static gboolean
 mcebat_update_cb(gpointer user_data)
 {
-	struct mce_battery prev = mcebat;
+	mce_battery_state_t prev = mcebat;
 	UNUSED(user_data);
 
 	if (!mcebat_update_id)
@@ -277,73 +218,7 @@ mcebat_update_cb(gpointer user_data)
 	mcebat_update_from_upowbat();
 
 	/* Process changes */
-	if (prev.charger_connected != mcebat.charger_connected)
-	{
-		mce_log(LL_INFO, "%s: charger: %s -> %s", MODULE_NAME,
-				charger_state_repr(prev.charger_connected),
-				charger_state_repr(mcebat.charger_connected));
-
-		/* Charger connected state */
-		execute_datapipe(&charger_state_pipe,
-						GINT_TO_POINTER(mcebat.charger_connected),
-						USE_INDATA, CACHE_INDATA);
-
-		/* Charging led pattern */
-		if (mcebat.charger_connected) {
-			gchar *pattern = g_strdup(MCE_LED_PATTERN_BATTERY_CHARGING);
-			execute_datapipe(&led_pattern_activate_pipe, pattern, USE_INDATA, DONT_CACHE_INDATA);
-			g_free(pattern);
-		}
-		else {
-			execute_datapipe_output_triggers(&led_pattern_deactivate_pipe,
-											MCE_LED_PATTERN_BATTERY_CHARGING,
-											USE_INDATA);
-		}
-
-		/* Generate activity */
-		execute_datapipe(&device_inactive_pipe, GINT_TO_POINTER(FALSE),
-						USE_INDATA, CACHE_INDATA);
-	}
-
-	if (prev.status != mcebat.status) {
-		mce_log(LL_INFO, "%s: status: %d -> %d", MODULE_NAME, prev.status, mcebat.status);
-
-		/* Battery full led pattern */
-		if (mcebat.status == BATTERY_STATUS_FULL) {
-			gchar *pattern = g_strdup(MCE_LED_PATTERN_BATTERY_FULL);
-			execute_datapipe(&led_pattern_activate_pipe, pattern, USE_INDATA, DONT_CACHE_INDATA);
-			g_free(pattern);
-		}
-		else if (prev.status == BATTERY_STATUS_FULL) {
-			execute_datapipe_output_triggers(&led_pattern_deactivate_pipe,
-											MCE_LED_PATTERN_BATTERY_FULL,
-											USE_INDATA);
-		}
-
-#if SUPPORT_BATTERY_LOW_LED_PATTERN
-		/* Battery low led pattern */
-		if (mcebat.status == BATTERY_STATUS_LOW ||
-			mcebat.status == BATTERY_STATUS_EMPTY) {
-			gchar *pattern = g_strdup(MCE_LED_PATTERN_BATTERY_LOW);
-			execute_datapipe(&led_pattern_activate_pipe, pattern, USE_INDATA, DONT_CACHE_INDATA);
-			g_free(pattern);
-		}
-		else {
-			execute_datapipe_output_triggers(&led_pattern_deactivate_pipe,
-											MCE_LED_PATTERN_BATTERY_LOW,
-											USE_INDATA);
-		}
-#endif /* SUPPORT_BATTERY_LOW_LED_PATTERN */
-
-		if(mcebat.status == BATTERY_STATUS_EMPTY) 
-			mce_log(LL_INFO, "%s: battery is empty", MODULE_NAME);
-
-		/* Battery charge state */
-		execute_datapipe(&battery_status_pipe,
-						GINT_TO_POINTER(mcebat.status),
-						USE_INDATA, CACHE_INDATA);
-
-	}
+	mce_battery_publish(MODULE_NAME, &prev, &mcebat);
 
 	return FALSE;
 }
@@ -690,16 +565,7 @@ const gchar *g_module_check_init(GModule *module)
 	mcebat_init();
 	upowbat_init();
 
-	private.min_voltage = mce_conf_get_int(MCE_CONF_BATTERY_SECTION, MCE_CONF_CRIT_VOLTAGE_KEY, 0, NULL)/1000.0;
-	if(private.min_voltage > 0.1)
-		mce_log(LL_INFO, "%s: critical voltage set set to %f", MODULE_NAME, private.min_voltage);
-	private.low_voltage = mce_conf_get_int(MCE_CONF_BATTERY_SECTION, MCE_CONF_LOW_VOLTAGE_KEY, 0, NULL)/1000.0;
-	if(private.low_voltage > 0.1)
-		mce_log(LL_INFO, "%s: low voltage set set to %f", MODULE_NAME, private.low_voltage);
-	private.low_percentage = mce_conf_get_int(MCE_CONF_BATTERY_SECTION, MCE_CONF_LOW_PERCENT_KEY, 5, NULL);
-	private.empty_percentage = mce_conf_get_int(MCE_CONF_BATTERY_SECTION, MCE_CONF_EMPTY_PERCENT_KEY, 2, NULL);
-	private.use_capacity_level = mce_conf_get_bool(MCE_CONF_BATTERY_SECTION, MCE_CONF_USE_CAPACITY_LEVEL, false, NULL);
-	private.level_low_critical = mce_conf_get_bool(MCE_CONF_BATTERY_SECTION, MCE_CONF_CAPACITY_LOW_CRITICAL_KEY, false, NULL);
+	mce_battery_read_config(&private.config, MODULE_NAME);
 
 	/* Find battery/charger devices and add them to private */
 	xup_find_devices();
@@ -10,7 +10,7 @@
 
 #define MCE_BUTTON_BACKLIGHT_BRIGHTNESS_VALUES 5
 
-#define LED_SYSFS_PATH "/sys/class/leds/"
+#define LED_SYSFS_PATH MCE_SYSFS_DIR "/class/leds/"
 
 #define LED_BRIGHTNESS_PATH "/brightness"
 
@@ -48,40 +48,6 @@ G_MODULE_EXPORT module_info_struct module_info = {
 	.priority = 250
 };
 
-/** Mapping of call state integer <-> call state string */
-static const mce_translation_t call_state_translation[] = {
-	{
-		.number = CALL_STATE_NONE,
-		.string = MCE_CALL_STATE_NONE
-	}, {
-		.number = CALL_STATE_RINGING,
-		.string = MCE_CALL_STATE_RINGING,
-	}, {
-		.number = CALL_STATE_ACTIVE,
-		.string = MCE_CALL_STATE_ACTIVE,
-	}, {
-		.number = CALL_STATE_SERVICE,
-		.string = MCE_CALL_STATE_SERVICE
-	}, { /* MCE_INVALID_TRANSLATION marks the end of this array */
-		.number = MCE_INVALID_TRANSLATION,
-		.string = MCE_CALL_STATE_NONE
-	}
-};
-
-/** Mapping of call type integer <-> call type string */
-static const mce_translation_t call_type_translation[] = {
-	{
-		.number = NORMAL_CALL,
-		.string = MCE_NORMAL_CALL
-	}, {
-		.number = EMERGENCY_CALL,
-		.string = MCE_EMERGENCY_CALL
-	}, { /* MCE_INVALID_TRANSLATION marks the end of this array */
-		.number = MCE_INVALID_TRANSLATION,
-		.string = MCE_NORMAL_CALL
-	}
-};
-
 /** List of monitored call state requesters; holds zero or one entries */
 static GSList *call_state_monitor_list = NULL;
 
@@ -114,13 +80,13 @@ static gboolean send_call_state(DBusMessage *const method_call,
 	if (call_state != NULL)
 		sstate = call_state;
 	else
-		sstate = mce_translate_int_to_string(call_state_translation,
+		sstate = mce_translate_int_to_string(mce_call_state_translation,
 						     datapipe_get_gint(call_state_pipe));
 
 	if (call_type != NULL)
 		stype = call_type;
 	else
-		stype = mce_translate_int_to_string(call_type_translation,
+		stype = mce_translate_int_to_string(mce_call_type_translation,
 						    datapipe_get_gint(call_type_pipe));
 
 	/* If method_call is set, send a reply,
@@ -255,7 +221,7 @@ static gboolean change_call_state_dbus_cb(DBusMessage *const msg)
 	}
 
 	/* Convert call state to enum */
-	call_state = mce_translate_string_to_int(call_state_translation,
+	call_state = mce_translate_string_to_int(mce_call_state_translation,
 						 state);
 
 	if (call_state == MCE_INVALID_TRANSLATION) {
@@ -265,7 +231,7 @@ static gboolean change_call_state_dbus_cb(DBusMessage *const msg)
 	}
 
 	/* Convert call type to enum */
-	call_type = mce_translate_string_to_int(call_type_translation,
+	call_type = mce_translate_string_to_int(mce_call_type_translation,
 						type);
 
 	if (call_type == MCE_INVALID_TRANSLATION) {
@@ -26,6 +26,7 @@
 #include "camera.h"
 #include "mce-io.h"
 #include "mce-conf.h"
+#include "mce-patterns.h"
 #include "datapipe.h"
 
 /** Unlock the tklock if the camera is popped out? */
@@ -68,18 +69,21 @@ static gconstpointer camera_popout_state_iomon_id = NULL;
  *
  * @param data The new data
  * @param bytes_read Unused
+ * @param iomon_id Unused
  */
-static void camera_active_state_cb(gpointer data, gsize bytes_read)
+static void camera_active_state_cb(gpointer data, gsize bytes_read,
+				   gconstpointer iomon_id)
 {
 	(void)bytes_read;
+	(void)iomon_id;
 
 	if (!strncmp(data, MCE_CAMERA_ACTIVE, strlen(MCE_CAMERA_ACTIVE))) {
 		execute_datapipe_output_triggers(&led_pattern_activate_pipe,
-						 MCE_LED_PATTERN_CAMERA,
+						 mce_pattern_data(MCE_LED_PATTERN_CAMERA),
 						 USE_INDATA);
 	} else {
 		execute_datapipe_output_triggers(&led_pattern_deactivate_pipe,
-						 MCE_LED_PATTERN_CAMERA,
+						 mce_pattern_data(MCE_LED_PATTERN_CAMERA),
 						 USE_INDATA);
 	}
 }
@@ -89,10 +93,13 @@ static void camera_active_state_cb(gpointer data, gsize bytes_read)
  *
  * @param data The new data
  * @param bytes_read Unused
+ * @param iomon_id Unused
  */
-static void camera_popout_state_cb(gpointer data, gsize bytes_read)
+static void camera_popout_state_cb(gpointer data, gsize bytes_read,
+				   gconstpointer iomon_id)
 {
 	(void)bytes_read;
+	(void)iomon_id;
 
 	/* Generate activity */
 	(void)execute_datapipe(&device_inactive_pipe, GINT_TO_POINTER(FALSE),
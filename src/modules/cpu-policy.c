@@ -0,0 +1,717 @@
+/**
+ * @file cpu-policy.c
+ * CPU power policy module -- this applies CPU settings
+ * depending on the display state and the call state
+ * <p>
+ * For each policy, the set of online CPUs, the cpufreq governor,
+ * the minimum and maximum frequencies and the energy performance
+ * preference can be configured; settings that are not configured
+ * are left untouched
+ * <p>
+ * The sysfs attributes are opened once and kept open; the cpufreq
+ * attributes of a CPU are reopened when it comes back online,
+ * since the kernel may recreate them.
+ * Frequency settings are written immediately, while CPU hotplug,
+ * which can take tens of milliseconds per CPU, is done one CPU
+ * at a time from a low priority idle callback, so that it does
+ * not delay unblanking the display
+ * <p>
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <glib.h>
+#include <gmodule.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mce.h"
+#include "mce-log.h"
+#include "mce-conf.h"
+#include "datapipe.h"
+
+/** Module name */
+#define MODULE_NAME		"cpu-policy"
+
+/** Functionality provided by this module */
+static const gchar *const provides[] = { MODULE_NAME, NULL };
+
+/** Module information */
+G_MODULE_EXPORT module_info_struct module_info = {
+	/** Name of the module */
+	.name = MODULE_NAME,
+	/** Module provides */
+	.provides = provides,
+	/** Module priority */
+	.priority = 100
+};
+
+/** Path to the CPU devices in sysfs */
+#define CPU_SYSFS_PATH			MCE_SYSFS_DIR "/devices/system/cpu"
+
+/** Largest number of CPUs handled */
+#define CPU_POLICY_MAX_CPUS		64
+
+/** Configuration group for the policy used when the display is on */
+#define MCE_CONF_CPU_POLICY_DISPLAY_ON_GROUP	"CPUPolicyDisplayOn"
+/** Configuration group for the policy used when the display is dimmed */
+#define MCE_CONF_CPU_POLICY_DISPLAY_DIM_GROUP	"CPUPolicyDisplayDim"
+/** Configuration group for the policy used when the display is off */
+#define MCE_CONF_CPU_POLICY_DISPLAY_OFF_GROUP	"CPUPolicyDisplayOff"
+/** Configuration group for the policy used during calls */
+#define MCE_CONF_CPU_POLICY_CALL_GROUP		"CPUPolicyCall"
+
+/** Configuration key for the CPUs to keep online */
+#define MCE_CONF_CPU_POLICY_ONLINE_CPUS		"OnlineCpus"
+/** Configuration key for the cpufreq governor */
+#define MCE_CONF_CPU_POLICY_GOVERNOR		"Governor"
+/** Configuration key for the minimum frequency */
+#define MCE_CONF_CPU_POLICY_MIN_FREQ		"MinFreq"
+/** Configuration key for the maximum frequency */
+#define MCE_CONF_CPU_POLICY_MAX_FREQ		"MaxFreq"
+/** Configuration key for the energy performance preference */
+#define MCE_CONF_CPU_POLICY_EPP			"EnergyPerformancePreference"
+
+/** A sysfs attribute kept open */
+typedef struct {
+	gint fd;		/**< Open fd for the attribute; -1 if missing */
+	gchar *value;		/**< Last value written; NULL if unknown */
+} cpu_attr_t;
+
+/** The attributes of one CPU */
+typedef struct {
+	guint index;		/**< Number of the CPU */
+	cpu_attr_t online;	/**< online */
+	cpu_attr_t governor;	/**< cpufreq/scaling_governor */
+	cpu_attr_t min_freq;	/**< cpufreq/scaling_min_freq */
+	cpu_attr_t max_freq;	/**< cpufreq/scaling_max_freq */
+	cpu_attr_t epp;		/**< cpufreq/energy_performance_preference */
+} cpu_t;
+
+/** A configured policy */
+typedef struct {
+	/** Configuration group of the policy */
+	const gchar *group;
+	/** TRUE if any setting of the policy is configured */
+	gboolean defined;
+	/** TRUE if the set of online CPUs is configured */
+	gboolean set_online;
+	/** Bit mask of the CPUs to keep online */
+	guint64 online;
+	/** cpufreq governor; NULL to leave untouched */
+	gchar *governor;
+	/** Minimum frequency in kHz; 0 to leave untouched */
+	gint min_freq;
+	/** Maximum frequency in kHz; 0 to leave untouched */
+	gint max_freq;
+	/** Energy performance preference; NULL to leave untouched */
+	gchar *epp;
+} cpu_policy_t;
+
+/** Policy used when the display is on, or dimmed without a dim policy */
+static cpu_policy_t policy_display_on = {
+	.group = MCE_CONF_CPU_POLICY_DISPLAY_ON_GROUP,
+};
+
+/** Policy used when the display is dimmed */
+static cpu_policy_t policy_display_dim = {
+	.group = MCE_CONF_CPU_POLICY_DISPLAY_DIM_GROUP,
+};
+
+/** Policy used when the display is off */
+static cpu_policy_t policy_display_off = {
+	.group = MCE_CONF_CPU_POLICY_DISPLAY_OFF_GROUP,
+};
+
+/** Policy used when a call is ringing or active */
+static cpu_policy_t policy_call = {
+	.group = MCE_CONF_CPU_POLICY_CALL_GROUP,
+};
+
+/** The CPUs, in order */
+static GPtrArray *cpus = NULL;
+
+/** The policy currently applied */
+static const cpu_policy_t *current_policy = NULL;
+
+/** Cached display state */
+static display_state_t display_state = MCE_DISPLAY_UNDEF;
+
+/** Cached call state */
+static call_state_t call_state = CALL_STATE_NONE;
+
+/** ID for the CPU hotplug idle source */
+static guint hotplug_cb_id = 0;
+
+/** TRUE if any policy configures the set of online CPUs */
+static gboolean hotplug_configured = FALSE;
+
+/**
+ * Open a sysfs attribute of a CPU
+ *
+ * @param attr The attribute to set up
+ * @param index The number of the CPU
+ * @param name The name of the attribute, relative to the CPU directory
+ */
+static void cpu_attr_open(cpu_attr_t *attr, guint index, const gchar *name)
+{
+	gchar *path = g_strdup_printf(CPU_SYSFS_PATH "/cpu%u/%s", index, name);
+
+	attr->value = NULL;
+
+	if ((attr->fd = open(path, O_RDWR | O_CLOEXEC)) == -1) {
+		mce_log(LL_DEBUG, "%s: cannot open %s; %s",
+			MODULE_NAME, path, g_strerror(errno));
+	}
+
+	g_free(path);
+}
+
+/**
+ * Close a sysfs attribute of a CPU
+ *
+ * @param attr The attribute
+ */
+static void cpu_attr_close(cpu_attr_t *attr)
+{
+	if (attr->fd != -1) {
+		close(attr->fd);
+		attr->fd = -1;
+	}
+
+	g_free(attr->value);
+	attr->value = NULL;
+}
+
+/**
+ * Write a value to a sysfs attribute, unless it was already written
+ *
+ * @param cpu The CPU the attribute belongs to
+ * @param attr The attribute
+ * @param value The value to write
+ * @return TRUE on success or if the value was already written,
+ *         FALSE on failure
+ */
+static gboolean cpu_attr_write(const cpu_t *cpu, cpu_attr_t *attr,
+			       const gchar *value)
+{
+	gboolean status = FALSE;
+	size_t len = strlen(value);
+
+	if (attr->fd == -1)
+		goto EXIT;
+
+	if ((attr->value != NULL) && (strcmp(attr->value, value) == 0)) {
+		status = TRUE;
+		goto EXIT;
+	}
+
+	if (pwrite(attr->fd, value, len, 0) != (ssize_t)len) {
+		mce_log(LL_DEBUG, "%s: cpu%u: cannot write `%s'; %s",
+			MODULE_NAME, cpu->index, value, g_strerror(errno));
+		g_free(attr->value);
+		attr->value = NULL;
+		goto EXIT;
+	}
+
+	g_free(attr->value);
+	attr->value = g_strdup(value);
+	status = TRUE;
+
+EXIT:
+	return status;
+}
+
+/**
+ * Open the cpufreq attributes of a CPU
+ *
+ * @param cpu The CPU
+ */
+static void cpu_open_cpufreq(cpu_t *cpu)
+{
+	cpu_attr_open(&cpu->governor, cpu->index, "cpufreq/scaling_governor");
+	cpu_attr_open(&cpu->min_freq, cpu->index, "cpufreq/scaling_min_freq");
+	cpu_attr_open(&cpu->max_freq, cpu->index, "cpufreq/scaling_max_freq");
+	cpu_attr_open(&cpu->epp, cpu->index,
+		      "cpufreq/energy_performance_preference");
+}
+
+/**
+ * Close the cpufreq attributes of a CPU, and forget the values
+ * written to them; used when the CPU goes offline, since the kernel
+ * may remove the attributes, or not keep the settings
+ *
+ * @param cpu The CPU
+ */
+static void cpu_close_cpufreq(cpu_t *cpu)
+{
+	cpu_attr_close(&cpu->governor);
+	cpu_attr_close(&cpu->min_freq);
+	cpu_attr_close(&cpu->max_freq);
+	cpu_attr_close(&cpu->epp);
+}
+
+/**
+ * Write a frequency to a sysfs attribute
+ *
+ * @param cpu The CPU the attribute belongs to
+ * @param attr The attribute
+ * @param freq The frequency in kHz
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean cpu_attr_write_freq(const cpu_t *cpu, cpu_attr_t *attr,
+				    gint freq)
+{
+	gchar value[16];
+
+	snprintf(value, sizeof value, "%d", freq);
+
+	return cpu_attr_write(cpu, attr, value);
+}
+
+/**
+ * Apply the cpufreq settings of a policy to a CPU
+ *
+ * @param cpu The CPU
+ * @param policy The policy
+ */
+static void cpu_apply_cpufreq(cpu_t *cpu, const cpu_policy_t *policy)
+{
+	gboolean max_written = TRUE;
+
+	if (policy->governor != NULL)
+		(void)cpu_attr_write(cpu, &cpu->governor, policy->governor);
+
+	/* Older kernels refuse a maximum below the current minimum
+	 * and a minimum above the current maximum; writing the maximum
+	 * first and retrying it after the minimum works in both
+	 * directions
+	 */
+	if (policy->max_freq > 0)
+		max_written = cpu_attr_write_freq(cpu, &cpu->max_freq,
+						  policy->max_freq);
+
+	if (policy->min_freq > 0)
+		(void)cpu_attr_write_freq(cpu, &cpu->min_freq,
+					  policy->min_freq);
+
+	if (max_written == FALSE)
+		(void)cpu_attr_write_freq(cpu, &cpu->max_freq,
+					  policy->max_freq);
+
+	if (policy->epp != NULL)
+		(void)cpu_attr_write(cpu, &cpu->epp, policy->epp);
+}
+
+/**
+ * Check whether a policy wants a CPU online
+ *
+ * @param policy The policy
+ * @param cpu The CPU
+ * @return TRUE if the CPU should be online, FALSE otherwise
+ */
+static gboolean policy_wants_online(const cpu_policy_t *policy,
+				    const cpu_t *cpu)
+{
+	if ((policy->set_online == FALSE) ||
+	    (cpu->index >= CPU_POLICY_MAX_CPUS))
+		return TRUE;
+
+	return (policy->online & (G_GUINT64_CONSTANT(1) << cpu->index)) != 0;
+}
+
+/**
+ * Bring one CPU online or offline as the current policy wants
+ *
+ * @param cpu The CPU
+ * @param online TRUE to bring the CPU online, FALSE to take it offline
+ * @return TRUE if the CPU was changed, FALSE if it already was
+ *         in the wanted state or cannot be changed
+ */
+static gboolean cpu_set_online(cpu_t *cpu, gboolean online)
+{
+	const gchar *value = online ? "1" : "0";
+	gboolean changed = FALSE;
+
+	if ((cpu->online.fd == -1) ||
+	    ((cpu->online.value != NULL) &&
+	     (strcmp(cpu->online.value, value) == 0)))
+		goto EXIT;
+
+	mce_log(LL_DEBUG, "%s: Turning %s cpu%u",
+		MODULE_NAME, online ? "on" : "off", cpu->index);
+
+	if (cpu_attr_write(cpu, &cpu->online, value) == FALSE) {
+		mce_log(LL_WARN, "%s: can not turn %s cpu%u",
+			MODULE_NAME, online ? "on" : "off", cpu->index);
+		goto EXIT;
+	}
+
+	changed = TRUE;
+
+EXIT:
+	return changed;
+}
+
+/**
+ * Idle callback for CPU hotplug; brings at most one CPU
+ * online or offline per call, so that the main loop stays responsive
+ *
+ * @param data Unused
+ * @return TRUE while there are CPUs left to change, FALSE otherwise
+ */
+static gboolean hotplug_cb(gpointer data)
+{
+	guint i;
+
+	(void)data;
+
+	for (i = 0; (current_policy != NULL) && (i < cpus->len); i++) {
+		cpu_t *cpu = g_ptr_array_index(cpus, i);
+		gboolean online = policy_wants_online(current_policy, cpu);
+
+		if (cpu_set_online(cpu, online) == FALSE)
+			continue;
+
+		/* The cpufreq attributes may have been recreated */
+		cpu_close_cpufreq(cpu);
+
+		if (online == TRUE) {
+			cpu_open_cpufreq(cpu);
+			cpu_apply_cpufreq(cpu, current_policy);
+		}
+
+		return TRUE;
+	}
+
+	hotplug_cb_id = 0;
+
+	return FALSE;
+}
+
+/**
+ * Apply a policy
+ *
+ * @param policy The policy to apply
+ */
+static void apply_policy(const cpu_policy_t *policy)
+{
+	guint i;
+
+	if (policy == current_policy)
+		goto EXIT;
+
+	mce_log(LL_DEBUG, "%s: applying %s", MODULE_NAME, policy->group);
+
+	current_policy = policy;
+
+	/* Frequency changes are cheap and help unblanking;
+	 * do them right away, and leave hotplug for later
+	 */
+	for (i = 0; i < cpus->len; i++)
+		cpu_apply_cpufreq(g_ptr_array_index(cpus, i), policy);
+
+	/* A policy without OnlineCpus wants all CPUs online,
+	 * so that CPUs taken offline by another policy come back
+	 */
+	if ((hotplug_configured == TRUE) && (hotplug_cb_id == 0))
+		hotplug_cb_id = g_idle_add_full(G_PRIORITY_LOW, hotplug_cb,
+						NULL, NULL);
+
+EXIT:
+	return;
+}
+
+/**
+ * Select and apply the policy for the current display and call states
+ */
+static void update_policy(void)
+{
+	const cpu_policy_t *policy = NULL;
+
+	if (display_state == MCE_DISPLAY_UNDEF)
+		goto EXIT;
+
+	if ((policy_call.defined == TRUE) &&
+	    ((call_state == CALL_STATE_RINGING) ||
+	     (call_state == CALL_STATE_ACTIVE)))
+		policy = &policy_call;
+	else if (display_state == MCE_DISPLAY_OFF)
+		policy = &policy_display_off;
+	else if ((display_state == MCE_DISPLAY_DIM) &&
+		 (policy_display_dim.defined == TRUE))
+		policy = &policy_display_dim;
+	else
+		policy = &policy_display_on;
+
+	/* Policies without settings are applied as well,
+	 * since they still bring all CPUs back online
+	 */
+	apply_policy(policy);
+
+EXIT:
+	return;
+}
+
+/**
+ * Datapipe trigger for the display state
+ *
+ * @param data The display state stored in a pointer
+ */
+static void display_state_trigger(gconstpointer data)
+{
+	display_state = GPOINTER_TO_INT(data);
+	update_policy();
+}
+
+/**
+ * Datapipe trigger for the call state
+ *
+ * @param data The call state stored in a pointer
+ */
+static void call_state_trigger(gconstpointer data)
+{
+	call_state = GPOINTER_TO_INT(data);
+	update_policy();
+}
+
+/**
+ * Read a policy from the configuration
+ *
+ * @param policy The policy to read
+ */
+static void policy_read_conf(cpu_policy_t *policy)
+{
+	const gchar *group = policy->group;
+	gint *online;
+	gsize length = 0;
+	gsize i;
+
+	if (mce_conf_has_key(group, MCE_CONF_CPU_POLICY_ONLINE_CPUS) &&
+	    ((online = mce_conf_get_int_list(group,
+					     MCE_CONF_CPU_POLICY_ONLINE_CPUS,
+					     &length, NULL)) != NULL)) {
+		policy->set_online = TRUE;
+		policy->online = 0;
+
+		for (i = 0; i < length; i++) {
+			if ((online[i] < 0) ||
+			    (online[i] >= CPU_POLICY_MAX_CPUS)) {
+				mce_log(LL_WARN, "%s: %s: ignoring cpu%d",
+					MODULE_NAME, group, online[i]);
+				continue;
+			}
+
+			policy->online |= G_GUINT64_CONSTANT(1) << online[i];
+		}
+
+		g_free(online);
+	}
+
+	if (mce_conf_has_key(group, MCE_CONF_CPU_POLICY_GOVERNOR))
+		policy->governor =
+			mce_conf_get_string(group,
+					    MCE_CONF_CPU_POLICY_GOVERNOR,
+					    NULL, NULL);
+
+	if (mce_conf_has_key(group, MCE_CONF_CPU_POLICY_MIN_FREQ))
+		policy->min_freq =
+			mce_conf_get_int(group, MCE_CONF_CPU_POLICY_MIN_FREQ,
+					 0, NULL);
+
+	if (mce_conf_has_key(group, MCE_CONF_CPU_POLICY_MAX_FREQ))
+		policy->max_freq =
+			mce_conf_get_int(group, MCE_CONF_CPU_POLICY_MAX_FREQ,
+					 0, NULL);
+
+	if (mce_conf_has_key(group, MCE_CONF_CPU_POLICY_EPP))
+		policy->epp = mce_conf_get_string(group,
+						  MCE_CONF_CPU_POLICY_EPP,
+						  NULL, NULL);
+
+	policy->defined = (policy->set_online == TRUE) ||
+			  (policy->governor != NULL) ||
+			  (policy->min_freq > 0) ||
+			  (policy->max_freq > 0) ||
+			  (policy->epp != NULL);
+
+	if (policy->defined == TRUE)
+		mce_log(LL_DEBUG, "%s: %s configured", MODULE_NAME, group);
+}
+
+/**
+ * Free the configuration of a policy
+ *
+ * @param policy The policy
+ */
+static void policy_free_conf(cpu_policy_t *policy)
+{
+	g_free(policy->governor);
+	policy->governor = NULL;
+	g_free(policy->epp);
+	policy->epp = NULL;
+}
+
+/**
+ * Free a CPU, closing its attributes
+ *
+ * @param data The CPU
+ */
+static void cpu_free(gpointer data)
+{
+	cpu_t *cpu = data;
+
+	cpu_attr_close(&cpu->online);
+	cpu_close_cpufreq(cpu);
+	g_free(cpu);
+}
+
+/**
+ * Compare CPUs by number
+ *
+ * @param a Pointer to the first CPU
+ * @param b Pointer to the second CPU
+ * @return Less than, equal to or greater than zero
+ */
+static gint cpu_compare(gconstpointer a, gconstpointer b)
+{
+	const cpu_t *cpu_a = *(const cpu_t *const *)a;
+	const cpu_t *cpu_b = *(const cpu_t *const *)b;
+
+	return (cpu_a->index > cpu_b->index) - (cpu_a->index < cpu_b->index);
+}
+
+/**
+ * Find the CPUs and open their attributes
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean scan_cpus(void)
+{
+	GError *error = NULL;
+	const gchar *name;
+	GDir *dir;
+	gboolean status = FALSE;
+
+	if ((dir = g_dir_open(CPU_SYSFS_PATH, 0, &error)) == NULL) {
+		mce_log(LL_ERR, "%s: cannot open " CPU_SYSFS_PATH "; %s",
+			MODULE_NAME, error->message);
+		goto EXIT;
+	}
+
+	while ((name = g_dir_read_name(dir)) != NULL) {
+		cpu_t *cpu;
+		guint index;
+		gchar end;
+
+		if (sscanf(name, "cpu%u%c", &index, &end) != 1)
+			continue;
+
+		cpu = g_new0(cpu_t, 1);
+		cpu->index = index;
+		cpu_attr_open(&cpu->online, index, "online");
+		cpu_open_cpufreq(cpu);
+		g_ptr_array_add(cpus, cpu);
+	}
+
+	g_dir_close(dir);
+
+	g_ptr_array_sort(cpus, cpu_compare);
+
+	mce_log(LL_DEBUG, "%s: found %u cpus", MODULE_NAME, cpus->len);
+
+	status = TRUE;
+
+EXIT:
+	g_clear_error(&error);
+
+	return status;
+}
+
+/**
+ * Init function for the cpu-policy module
+ *
+ * @param module Unused
+ * @return NULL on success, a string with an error message on failure
+ */
+G_MODULE_EXPORT const gchar *g_module_check_init(GModule *module);
+const gchar *g_module_check_init(GModule *module)
+{
+	(void)module;
+
+	mce_log(LL_DEBUG, "Initalizing %s", MODULE_NAME);
+
+	policy_read_conf(&policy_display_on);
+	policy_read_conf(&policy_display_dim);
+	policy_read_conf(&policy_display_off);
+	policy_read_conf(&policy_call);
+
+	hotplug_configured = (policy_display_on.set_online == TRUE) ||
+			     (policy_display_dim.set_online == TRUE) ||
+			     (policy_display_off.set_online == TRUE) ||
+			     (policy_call.set_online == TRUE);
+
+	cpus = g_ptr_array_new_with_free_func(cpu_free);
+	(void)scan_cpus();
+
+	display_state = datapipe_get_gint(display_state_pipe);
+	call_state = datapipe_get_gint(call_state_pipe);
+
+	append_output_trigger_to_datapipe(&display_state_pipe,
+					  display_state_trigger);
+	append_output_trigger_to_datapipe(&call_state_pipe,
+					  call_state_trigger);
+
+	update_policy();
+
+	return NULL;
+}
+
+/**
+ * Exit function for the cpu-policy module;
+ * brings all CPUs back online
+ *
+ * @param module Unused
+ */
+G_MODULE_EXPORT void g_module_unload(GModule *module);
+void g_module_unload(GModule *module)
+{
+	guint i;
+
+	(void)module;
+
+	remove_output_trigger_from_datapipe(&call_state_pipe,
+					    call_state_trigger);
+	remove_output_trigger_from_datapipe(&display_state_pipe,
+					    display_state_trigger);
+
+	if (hotplug_cb_id != 0) {
+		g_source_remove(hotplug_cb_id);
+		hotplug_cb_id = 0;
+	}
+
+	current_policy = NULL;
+
+	for (i = 0; i < cpus->len; i++)
+		(void)cpu_set_online(g_ptr_array_index(cpus, i), TRUE);
+
+	g_ptr_array_free(cpus, TRUE);
+	cpus = NULL;
+
+	policy_free_conf(&policy_display_on);
+	policy_free_conf(&policy_display_dim);
+	policy_free_conf(&policy_display_off);
+	policy_free_conf(&policy_call);
+}
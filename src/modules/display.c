@@ -46,7 +46,11 @@
 #define MODULE_NAME		"display"
 
 /** Functionality provided by this module */
-static const gchar *const provides[] = { MODULE_NAME, NULL };
+static const gchar *const provides[] = {
+	MODULE_NAME,
+	"display-brightness",
+	NULL
+};
 
 /** Module information */
 G_MODULE_EXPORT module_info_struct module_info = {
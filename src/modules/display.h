@@ -23,7 +23,7 @@
 #define _DISPLAY_H_
 
 /** Path to the SysFS entry for the generic display interface */
-#define DISPLAY_GENERIC_PATH			"/sys/class/backlight/"
+#define DISPLAY_GENERIC_PATH			MCE_SYSFS_DIR "/class/backlight/"
 /** Generic brightness file */
 #define DISPLAY_GENERIC_BRIGHTNESS_FILE		"/brightness"
 /** Generic maximum brightness file */
@@ -14,6 +14,7 @@
 #include "mce.h"
 #include "mce-io.h"
 #include "mce-log.h"
+#include "mce-patterns.h"
 #include "mce-conf.h"
 #include "mce-dbus.h"
 #include "datapipe.h"
@@ -51,11 +52,12 @@ typedef struct fffeatures {
 	bool autocenter:1;	/* autocenter is adjustable */
 } fffeatures;
 
-int evdev_fd = -1;
-bool vibratorArmed = true;
+static int evdev_fd = -1;
+static bool vibratorArmed = true;
 
 typedef struct pattern_t {
 	char *name;
+	mce_pattern_t id;
 	int_fast32_t priority;
 	int_fast32_t policy;
 	int_fast32_t timeout;
@@ -66,6 +68,8 @@ typedef struct pattern_t {
 	int_fast32_t off_period;
 	uint_fast8_t speed;
 	gboolean invalid;
+	int effect_id;			/* uploaded effect, -1 if none */
+	uint_fast32_t last_used;	/* use stamp for LRU eviction */
 } pattern_t;
 
 typedef enum {
@@ -92,9 +96,11 @@ typedef enum {
 
 
 static pattern_t *patterns = NULL;
-uint_fast32_t patternsCount = 0;
+static uint_fast32_t patternsCount = 0;
+/* patterns indexed by pattern id */
+static GHashTable *patterns_by_id = NULL;
 
-int_fast32_t priority = 256;
+static int_fast32_t priority = 256;
 static unsigned int priority_timeout_cb_id = 0;
 
 static display_state_t display_state = { 0 };
@@ -103,6 +109,12 @@ static call_state_t call_state = { 0 };
 
 static bool first_run = true;
 
+/* effect slots available for patterns, one is kept for ad-hoc effects */
+static int ff_pattern_slots = 0;
+static int ff_pattern_slots_used = 0;
+static uint_fast32_t ff_use_counter = 0;
+static int ff_playing_id = -1;
+
 static bool bit_in_array(unsigned char *array, size_t bit)
 {
 	return array[bit / 8] & (1 << bit % 8);
@@ -153,6 +165,46 @@ static bool ff_features_get(const int fd, struct fffeatures *features)
 	return true;
 }
 
+static void ff_effect_fill(struct ff_effect *effect, const int lengthMs,
+			   const int delayMs, const uint8_t strength,
+			   const short attackLengthMs, const short fadeLengthMs)
+{
+	effect->type = FF_PERIODIC;
+	effect->u.periodic.waveform = FF_SINE;
+	effect->u.periodic.period = 100;
+	effect->u.periodic.magnitude = (0x7fff * strength) / 255;
+	effect->u.periodic.envelope.attack_length = attackLengthMs;
+	effect->u.periodic.envelope.fade_length = fadeLengthMs;
+	effect->replay.delay = delayMs;
+	effect->replay.length = lengthMs;
+}
+
+static bool ff_effect_write(const int fd, const int id, const int value)
+{
+	struct input_event event = {0};
+
+	event.type = EV_FF;
+	event.code = id;
+	event.value = value;
+	return write(fd, &event, sizeof(event)) >= 0;
+}
+
+static bool ff_effect_play(const int fd, const int id, const int count)
+{
+	if (fd < 0)
+		return false;
+
+	/* effects in other slots would otherwise play simultaneously */
+	if (ff_playing_id >= 0 && ff_playing_id != id)
+		ff_effect_write(fd, ff_playing_id, 0);
+
+	if (!ff_effect_write(fd, id, count))
+		return false;
+
+	ff_playing_id = id;
+	return true;
+}
+
 static bool ff_device_run(const int fd, const int lengthMs, const int delayMs,
 		   const int count, const uint8_t strength,
 		   const short attackLengthMs, const short fadeLengthMs)
@@ -164,34 +216,19 @@ static bool ff_device_run(const int fd, const int lengthMs, const int delayMs,
 
 	if (first_run) {
 		memset(&effect, 0, sizeof(struct ff_effect));
-		effect.type = FF_PERIODIC;
 		effect.id = -1;
-		effect.u.periodic.waveform = FF_SINE;
-		effect.u.periodic.period = 100;
 		first_run = false;
 	}
 
-	effect.u.periodic.magnitude = (0x7fff * strength) / 255;
-	effect.u.periodic.envelope.attack_length = attackLengthMs;
-	effect.u.periodic.envelope.fade_length = fadeLengthMs;
-	effect.replay.delay = delayMs;
-	effect.replay.length = lengthMs;
+	ff_effect_fill(&effect, lengthMs, delayMs, strength,
+		       attackLengthMs, fadeLengthMs);
 
 	if (ioctl(fd, EVIOCSFF, &effect) == -1) {
 		perror("Error at ioctl() in ff_device_run");
 		return false;
 	}
 
-	struct input_event run_event;
-	memset(&run_event, 0, sizeof(struct input_event));
-	run_event.type = EV_FF;
-	run_event.code = effect.id;
-	run_event.value = count;
-
-	if (write(fd, (const void *)&run_event, sizeof(run_event)) == -1) {
-		return false;
-	} else
-		return true;
+	return ff_effect_play(fd, effect.id, count);
 }
 
 static int ff_device_open(const char *const deviceName)
@@ -226,7 +263,105 @@ static int ff_device_open(const char *const deviceName)
 
 static bool ff_device_stop(const int fd)
 {
-	return ff_device_run(fd, 1, 0, 1, 0, 0, 0);
+	bool ret;
+
+	if (fd < 0)
+		return false;
+	if (ff_playing_id < 0)
+		return true;
+
+	ret = ff_effect_write(fd, ff_playing_id, 0);
+	ff_playing_id = -1;
+	return ret;
+}
+
+static bool pattern_effect_evict(const int fd)
+{
+	pattern_t *lru = NULL;
+
+	for (uint_fast32_t i = 0; i < patternsCount; ++i) {
+		if (patterns[i].effect_id < 0)
+			continue;
+		if (!lru || patterns[i].last_used < lru->last_used)
+			lru = &patterns[i];
+	}
+
+	if (!lru)
+		return false;
+
+	mce_log(LL_DEBUG, "%s: Evicting effect %i of pattern %s",
+		MODULE_NAME, lru->effect_id, lru->name);
+
+	if (ioctl(fd, EVIOCRMFF, lru->effect_id) == -1) {
+		mce_log(LL_WARN, "%s: Can not remove effect %i errno: %s",
+			MODULE_NAME, lru->effect_id, strerror(errno));
+	}
+	if (ff_playing_id == lru->effect_id)
+		ff_playing_id = -1;
+
+	lru->effect_id = -1;
+	--ff_pattern_slots_used;
+	return true;
+}
+
+static bool pattern_effect_upload(const int fd, pattern_t *pattern)
+{
+	struct ff_effect effect;
+
+	if (fd < 0 || ff_pattern_slots <= 0)
+		return false;
+
+	if (ff_pattern_slots_used >= ff_pattern_slots &&
+	    !pattern_effect_evict(fd))
+		return false;
+
+	memset(&effect, 0, sizeof(struct ff_effect));
+	effect.id = -1;
+	ff_effect_fill(&effect,
+		       pattern->accel_period + pattern->on_period +
+		       pattern->decel_period,
+		       pattern->off_period, pattern->speed,
+		       pattern->accel_period, pattern->decel_period);
+
+	if (ioctl(fd, EVIOCSFF, &effect) == -1) {
+		mce_log(LL_WARN, "%s: Can not upload pattern %s errno: %s",
+			MODULE_NAME, pattern->name, strerror(errno));
+		return false;
+	}
+
+	pattern->effect_id = effect.id;
+	++ff_pattern_slots_used;
+	return true;
+}
+
+static void pattern_effects_init(const int fd)
+{
+	int max_effects = 0;
+
+	if (ioctl(fd, EVIOCGEFFECTS, &max_effects) == -1)
+		max_effects = 0;
+
+	ff_pattern_slots = max_effects - 1;
+
+	for (uint_fast32_t i = 0; i < patternsCount &&
+	     ff_pattern_slots_used < ff_pattern_slots; ++i)
+		pattern_effect_upload(fd, &patterns[i]);
+
+	mce_log(LL_DEBUG, "%s: %i effect slots, %i patterns preuploaded",
+		MODULE_NAME, max_effects, ff_pattern_slots_used);
+}
+
+static void pattern_effects_free(const int fd)
+{
+	for (uint_fast32_t i = 0; i < patternsCount; ++i) {
+		if (patterns[i].effect_id < 0)
+			continue;
+		if (fd >= 0)
+			ioctl(fd, EVIOCRMFF, patterns[i].effect_id);
+		patterns[i].effect_id = -1;
+	}
+	ff_pattern_slots_used = 0;
+	ff_playing_id = -1;
 }
 
 static gboolean priority_timeout_cb(gpointer data)
@@ -257,65 +392,69 @@ static void setup_priority_timeout(unsigned int msec)
 }
 
 
-static pattern_t find_pattern(const char *const name)
+static pattern_t *find_pattern(const mce_pattern_t id)
 {
-	for (uint_fast32_t i = 0; i < patternsCount; ++i) {
-		if (strcmp(name, patterns[i].name) == 0) {
-			return patterns[i];
-		}
-	}
-	pattern_t ivld = { 0 };
-	ivld.invalid = true;
-	return ivld;
+	if (!patterns_by_id || id == MCE_PATTERN_NONE)
+		return NULL;
+	return g_hash_table_lookup(patterns_by_id, MCE_PATTERN_TO_POINTER(id));
 }
 
-static gboolean should_run_pattern(const pattern_t pattern)
+static gboolean should_run_pattern(const pattern_t *pattern)
 {
-	if (pattern.policy == VIBRATE_POLICY_PLAY_ALWAYS || pattern.policy == VIBRATE_POLICY_PLAY_DISPLAY_ON_ACTDEAD)
+	if (pattern->policy == VIBRATE_POLICY_PLAY_ALWAYS || pattern->policy == VIBRATE_POLICY_PLAY_DISPLAY_ON_ACTDEAD)
 		return true;
-	else if (pattern.policy == VIBRATE_POLICY_PLAY_DISPLAY_OFF_OR_ACTDEAD &&
+	else if (pattern->policy == VIBRATE_POLICY_PLAY_DISPLAY_OFF_OR_ACTDEAD &&
 		 (system_state == MCE_STATE_ACTDEAD
 		  || display_state == MCE_DISPLAY_OFF))
 		return true;
-	else if (pattern.policy == VIBRATE_POLICY_PLAY_DISPLAY_OFF_ACTDEAD &&
+	else if (pattern->policy == VIBRATE_POLICY_PLAY_DISPLAY_OFF_ACTDEAD &&
 		 (system_state == MCE_STATE_ACTDEAD
 		  && display_state == MCE_DISPLAY_OFF))
 		return true;
-	else if (pattern.policy == VIBRATE_POLICY_PLAY_DISPLAY_ON_OR_OFF && system_state != MCE_STATE_ACTDEAD)
+	else if (pattern->policy == VIBRATE_POLICY_PLAY_DISPLAY_ON_OR_OFF && system_state != MCE_STATE_ACTDEAD)
 		return true;
-	else if (pattern.policy == VIBRATE_POLICY_PLAY_DISPLAY_OFF &&
+	else if (pattern->policy == VIBRATE_POLICY_PLAY_DISPLAY_OFF &&
 		 (system_state != MCE_STATE_ACTDEAD
 		  && display_state == MCE_DISPLAY_OFF))
 		return true;
 	return false;
 }
 
-static gboolean run_pattern(const pattern_t pattern)
+static gboolean run_pattern(pattern_t *pattern)
 {
-	if (!pattern.invalid && vibratorArmed && should_run_pattern(pattern)) {
-		if (pattern.priority < priority) {
-			priority = pattern.priority;
+	if (pattern && !pattern->invalid && vibratorArmed && should_run_pattern(pattern)) {
+		if (pattern->priority < priority) {
+			priority = pattern->priority;
 			int count;
-			if (pattern.repeat_count != 0)
-				count = pattern.repeat_count;
-			else if (pattern.timeout != 0) {
+			if (pattern->repeat_count != 0)
+				count = pattern->repeat_count;
+			else if (pattern->timeout != 0) {
 				count =
-				    (pattern.timeout * 1000ULL) /
-				    (pattern.on_period + pattern.off_period) +
+				    (pattern->timeout * 1000ULL) /
+				    (pattern->on_period + pattern->off_period) +
 				    1;
 			} else {
 				count = INT_MAX;
 			}
-			if( ((int64_t)count)*(pattern.accel_period + pattern.on_period + pattern.decel_period) < INT_MAX )
-				setup_priority_timeout((pattern.accel_period + pattern.on_period + pattern.decel_period)*count);
+			if( ((int64_t)count)*(pattern->accel_period + pattern->on_period + pattern->decel_period) < INT_MAX )
+				setup_priority_timeout((pattern->accel_period + pattern->on_period + pattern->decel_period)*count);
+
+			pattern->last_used = ++ff_use_counter;
+			if (pattern->effect_id >= 0 ||
+			    pattern_effect_upload(evdev_fd, pattern))
+				return ff_effect_play(evdev_fd,
+						      pattern->effect_id,
+						      count);
+
+			/* no slot available, fall back to ad-hoc upload */
 			return ff_device_run(evdev_fd,
-					     pattern.accel_period +
-					     pattern.on_period +
-					     pattern.decel_period,
-					     pattern.off_period, count,
-					     pattern.speed,
-					     pattern.accel_period,
-					     pattern.decel_period);
+					     pattern->accel_period +
+					     pattern->on_period +
+					     pattern->decel_period,
+					     pattern->off_period, count,
+					     pattern->speed,
+					     pattern->accel_period,
+					     pattern->decel_period);
 		}
 	}
 	return true;
@@ -341,7 +480,7 @@ static gboolean vibrator_activate_pattern_dbus_cb(DBusMessage * const msg)
 		return false;
 	}
 
-	run_pattern(find_pattern(patternName));
+	run_pattern(find_pattern(mce_pattern_lookup(patternName)));
 
 	if (no_reply == false) {
 		DBusMessage *reply = dbus_new_method_reply(msg);
@@ -387,6 +526,10 @@ static gboolean vibrator_disable_dbus_cb(DBusMessage * const msg)
 
 static void free_patterns(void)
 {
+	if (patterns_by_id) {
+		g_hash_table_destroy(patterns_by_id);
+		patterns_by_id = NULL;
+	}
 	if (patterns) {
 		for (uint_fast32_t i = 0; i < patternsCount; ++i) {
 			free(patterns[i].name);
@@ -417,6 +560,7 @@ static gboolean init_patterns(void)
 		g_strfreev(patternlist);
 		return false;
 	}
+	patterns_by_id = g_hash_table_new(g_direct_hash, g_direct_equal);
 
 	for (int i = 0; patternlist[i]; ++i) {
 		int *tmp;
@@ -450,6 +594,12 @@ static gboolean init_patterns(void)
 			pattern->off_period = ABS(tmp[PATTERN_OFF_PERIOD_FIELD]);
 			pattern->speed = ABS(tmp[PATTERN_SPEED_FIELD]);
 			pattern->invalid = false;
+			pattern->effect_id = -1;
+			pattern->last_used = 0;
+			pattern->id = mce_pattern_intern(pattern->name);
+			g_hash_table_insert(patterns_by_id,
+					    MCE_PATTERN_TO_POINTER(pattern->id),
+					    pattern);
 			
 			++patternsCount;
 			
@@ -524,7 +674,7 @@ static void call_state_trigger(gconstpointer data)
 
 static void vibrator_pattern_activate_trigger(gconstpointer data)
 {
-	run_pattern(find_pattern((const char *)data));
+	run_pattern(find_pattern(MCE_POINTER_TO_PATTERN(data)));
 }
 
 static void vibrator_pattern_deactivate_trigger(gconstpointer data)
@@ -584,6 +734,8 @@ const char *g_module_check_init(GModule * module)
 		return NULL;
 	}
 
+	pattern_effects_init(evdev_fd);
+
 	if (mce_dbus_handler_add(MCE_REQUEST_IF,
 				 MCE_ACTIVATE_VIBRATOR_PATTERN,
 				 NULL,
@@ -654,6 +806,7 @@ void g_module_unload(GModule * module)
 
 	cancel_priority_timeout();
 
+	pattern_effects_free(evdev_fd);
 	free_patterns();
 
 	remove_output_trigger_from_datapipe(&call_state_pipe,
@@ -35,7 +35,7 @@ G_MODULE_EXPORT module_info_struct module_info = {
 static GSList *blanking_pause_monitor_list = NULL;
 static guint blank_prevent_timeout_cb_id = 0;
 
-bool timed_inhibit = false;
+static bool timed_inhibit = false;
 
 static gboolean blank_prevent_timeout_cb(gpointer data)
 {
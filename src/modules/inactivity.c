@@ -85,6 +85,9 @@ static guint inactivity_inhibit_gconf_cb_id = 0;
 
 static gint inactivity_timeout = DEFAULT_TIMEOUT;
 
+/** TRUE while the timeout is being published in inactivity_timeout_pipe */
+static gboolean publishing_timeout = FALSE;
+
 /**
  * Enable/Disable blanking inhibit,
  * based on charger status and inhibit mode
@@ -280,6 +283,21 @@ static gpointer device_inactive_filter(gpointer data)
 	return data;
 }
 
+/**
+ * Publish the inactivity timeout in inactivity_timeout_pipe,
+ * so that the cache holds the value in use;
+ * a running timeout is left alone, the new value
+ * takes effect the next time the timeout is set up
+ */
+static void update_inactivity_timeout(void)
+{
+	publishing_timeout = TRUE;
+	(void)execute_datapipe(&inactivity_timeout_pipe,
+			       GINT_TO_POINTER(inactivity_timeout),
+			       USE_INDATA, CACHE_INDATA);
+	publishing_timeout = FALSE;
+}
+
 /**
  * Inactivity timeout trigger
  *
@@ -289,6 +307,9 @@ static void inactivity_timeout_trigger(gconstpointer data)
 {
 	(void)data;
 
+	if (publishing_timeout == TRUE)
+		return;
+
 	setup_inactivity_timeout();
 }
 
@@ -371,6 +392,7 @@ static gboolean inactivity_timeout_set_dbus_cb(DBusMessage *const msg)
 	}
 
 	inactivity_timeout = tmp;
+	update_inactivity_timeout();
 	inactivity_timeout_dbus_signal();
 	mce_rtconf_set_int(MCE_DISPLAY_DIM_TIMEOUT_KEY, inactivity_timeout);
 	mce_log(LL_DEBUG, "%s: inactivity_timeout set to %i", MODULE_NAME, inactivity_timeout);
@@ -518,6 +540,7 @@ static void inactiveity_rtconf_cb(const gchar *key, guint cb_id, void *user_data
 	if (cb_id == inactivity_timeout_gconf_cb_id) {
 		mce_rtconf_get_int(MCE_DISPLAY_DIM_TIMEOUT_KEY, &inactivity_timeout);
 		mce_log(LL_DEBUG, "%s: inactivity_timeout set to %i", MODULE_NAME, inactivity_timeout);
+		update_inactivity_timeout();
 		inactivity_timeout_dbus_signal();
 	} else if (cb_id == inactivity_inhibit_gconf_cb_id) {
 		mce_rtconf_get_int(MCE_BLANKING_INHIBIT_MODE_PATH, &inactivity_inhibit_mode);
@@ -609,6 +632,7 @@ const gchar *g_module_check_init(GModule *module)
 				 inactivity_mode_get_dbus_cb) == NULL)
 		goto EXIT;
 
+	update_inactivity_timeout();
 	setup_inactivity_timeout();
 
 EXIT:
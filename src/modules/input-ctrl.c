@@ -17,6 +17,7 @@
  *
  */
 #include <glib.h>
+#include <gio/gio.h>
 #include <gmodule.h>
 
 #include "mce.h"
@@ -26,6 +27,8 @@
 #include "event-input.h"
 #include "event-input-utils.h"
 
+#include <errno.h>
+#include <fcntl.h>
 #include <string.h>
 #include <unistd.h>
 
@@ -35,7 +38,7 @@
 /** Functionality provided by this module */
 static const gchar *const provides[] = { MODULE_NAME, NULL };
 
-#define SYSFS_PATH "/sys/class/input/"
+#define SYSFS_PATH MCE_SYSFS_DIR "/class/input/"
 
 /** Module information */
 G_MODULE_EXPORT module_info_struct module_info = {
@@ -48,68 +51,157 @@ G_MODULE_EXPORT module_info_struct module_info = {
 	.priority = 250
 };
 
-static void scan_input_devices_cb(const char *filename, gpointer user_data)
+/** An input device that supports inhibiting */
+typedef struct {
+	gint fd;		/**< Open fd for the inhibited attribute */
+	gint inhibited;		/**< Last state written; -1 if unknown */
+} input_device_t;
+
+/** Inhibit capable devices, indexed by event device path */
+static GHashTable *input_devices = NULL;
+
+/** Handler id of the /dev/input hotplug callback */
+static gulong dev_input_changed_id = 0;
+
+static void input_device_free(gpointer data)
 {
-	GList **input_devices = user_data;
+	input_device_t *device = data;
 
-	*input_devices = g_list_prepend(*input_devices, g_strdup(filename));
+	close(device->fd);
+	g_free(device);
 }
 
-static void inhibit_input_devices(gboolean inhibit)
+/**
+ * Add an event device to the device table if it supports inhibiting
+ *
+ * @param filename Path to the event device
+ */
+static void input_device_add(const gchar *filename)
 {
-	GList *devices = NULL;
-	GList *l;
+	gchar *base = g_path_get_basename(filename);
+	gchar *path = g_strconcat(SYSFS_PATH, base, "/device/inhibited", NULL);
+	input_device_t *device;
+	gint fd;
 
-	mce_scan_inputdevices(scan_input_devices_cb, &devices);
+	if ((fd = open(path, O_WRONLY | O_CLOEXEC)) == -1) {
+		mce_log(LL_DEBUG,
+			"%s: device %s does not support inhibit, kernel too old?",
+			MODULE_NAME, filename);
+		goto EXIT;
+	}
 
-	if (inhibit) {
-		GSList *kbd_devs = mce_input_get_monitored_keyboard_devices();
-		GHashTable *table = g_hash_table_new(g_str_hash, g_str_equal);
-		GSList *sl;
+	device = g_new0(input_device_t, 1);
+	device->fd = fd;
+	device->inhibited = -1;
 
-		for (sl = kbd_devs; sl; sl = sl->next) {
-			const gchar *data = mce_get_io_monitor_name(sl->data);
+	g_hash_table_replace(input_devices, g_strdup(filename), device);
 
-			g_hash_table_add(table, (gpointer)data);
-		}
+EXIT:
+	g_free(path);
+	g_free(base);
+}
 
-		for (l = devices; l;) {
-			GList *next = l->next;
+static void scan_input_devices_cb(const char *filename, gpointer user_data)
+{
+	(void)user_data;
 
-			if (g_hash_table_contains(table, l->data)) {
-				mce_log(LL_DEBUG,
-					"%s: Ignoring monitored device %s",
-					MODULE_NAME, (gchar *)l->data);
-				g_free(l->data);
-				devices = g_list_delete_link(devices, l);
-			}
+	input_device_add(filename);
+}
 
-			l = next;
-		}
+static void input_device_set_inhibited(const gchar *filename,
+				       input_device_t *device,
+				       gboolean inhibit)
+{
+	const gchar *value = inhibit ? "1" : "0";
+
+	if (device->inhibited == inhibit)
+		return;
+
+	mce_log(LL_DEBUG, "%s: %s device %s", MODULE_NAME,
+		inhibit ? "inhibit" : "resume", filename);
+
+	if (pwrite(device->fd, value, 1, 0) != 1) {
+		mce_log(LL_WARN, "%s: failed to %s device %s; %s",
+			MODULE_NAME, inhibit ? "inhibit" : "resume",
+			filename, g_strerror(errno));
+		return;
+	}
+
+	device->inhibited = inhibit;
+}
+
+static gboolean is_monitored_keyboard(GSList *kbd_devs, const gchar *filename)
+{
+	GSList *sl;
 
-		g_hash_table_destroy(table);
+	for (sl = kbd_devs; sl; sl = sl->next) {
+		if (strcmp(mce_get_io_monitor_name(sl->data), filename) == 0)
+			return TRUE;
 	}
 
-	for (l = devices; l; l = l->next) {
-		gchar *path = g_strconcat(SYSFS_PATH, basename(l->data),
-					  "/device/inhibited", NULL);
+	return FALSE;
+}
+
+static void inhibit_input_devices(gboolean inhibit)
+{
+	GSList *kbd_devs = mce_input_get_monitored_keyboard_devices();
+	GHashTableIter iter;
+	gpointer key, value;
 
-		if (access(path, F_OK) == 0) {
-			mce_log(LL_DEBUG, "%s: %s device %s", MODULE_NAME,
-				inhibit ? "inhibit" : "resume",
-				(gchar *)l->data);
+	g_hash_table_iter_init(&iter, input_devices);
 
-			mce_write_string_to_file(path, inhibit ? "1" : "0");
-		} else {
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		if (inhibit && is_monitored_keyboard(kbd_devs, key)) {
 			mce_log(LL_DEBUG,
-				"%s: device %s does not support inhibit, kernel too old?",
-				MODULE_NAME, (gchar *)l->data);
+				"%s: Ignoring monitored device %s",
+				MODULE_NAME, (gchar *)key);
+			continue;
 		}
 
-		g_free(path);
+		input_device_set_inhibited(key, value, inhibit);
 	}
+}
+
+/**
+ * Callback for /dev/input changes
+ *
+ * @param monitor Unused
+ * @param file The file that changed
+ * @param other_file Unused
+ * @param event_type The event that occured
+ * @param user_data Unused
+ */
+static void dev_input_changed_cb(GFileMonitor *monitor,
+				 GFile *file, GFile *other_file,
+				 GFileMonitorEvent event_type, gpointer user_data)
+{
+	gchar *filename = g_file_get_path(file);
+	gchar *base = g_file_get_basename(file);
+
+	(void)monitor;
+	(void)other_file;
+	(void)user_data;
+
+	if (strncmp(base, EVENT_FILE_PREFIX, strlen(EVENT_FILE_PREFIX)) != 0)
+		goto EXIT;
+
+	switch (event_type) {
+	case G_FILE_MONITOR_EVENT_CREATED:
+		/* New devices are picked up on the next state change */
+		input_device_add(filename);
+		break;
 
-	g_list_free_full(devices, g_free);
+	case G_FILE_MONITOR_EVENT_DELETED:
+		g_hash_table_remove(input_devices, filename);
+		break;
+
+	default:
+		break;
+	}
+
+EXIT:
+	g_free(base);
+	g_free(filename);
 }
 
 /** @brief inhibit/resume all non-keyboard input devices
@@ -123,8 +215,27 @@ static void input_control_trigger(gconstpointer data)
 G_MODULE_EXPORT const gchar *g_module_check_init(GModule *module);
 const gchar *g_module_check_init(GModule *module)
 {
+	GFileMonitor *dev_input_monitor = mce_input_get_dev_input_monitor();
+
 	(void)module;
 
+	input_devices = g_hash_table_new_full(g_str_hash, g_str_equal,
+					      g_free, input_device_free);
+
+	/* Track hotplugged devices, so that inhibiting
+	 * does not need to rescan /dev/input
+	 */
+	if (dev_input_monitor != NULL) {
+		dev_input_changed_id =
+			g_signal_connect(G_OBJECT(dev_input_monitor), "changed",
+					 G_CALLBACK(dev_input_changed_cb), NULL);
+	} else {
+		mce_log(LL_WARN, "%s: %s is not monitored", MODULE_NAME,
+			DEV_INPUT_PATH);
+	}
+
+	mce_scan_inputdevices(scan_input_devices_cb, NULL);
+
 	/* Append triggers/filters to datapipes */
 	append_output_trigger_to_datapipe(&touchscreen_suspend_pipe,
 					  input_control_trigger);
@@ -142,5 +253,14 @@ void g_module_unload(GModule *module)
 	remove_output_trigger_from_datapipe(&touchscreen_suspend_pipe,
 					    input_control_trigger);
 
+	if (dev_input_changed_id != 0) {
+		g_signal_handler_disconnect(mce_input_get_dev_input_monitor(),
+					    dev_input_changed_id);
+		dev_input_changed_id = 0;
+	}
+
 	inhibit_input_devices(FALSE);
+
+	g_hash_table_destroy(input_devices);
+	input_devices = NULL;
 }
@@ -25,7 +25,9 @@
 #include <linux/input.h>
 #include "mce.h"
 #include "mce-log.h"
+#include "mce-conf.h"
 #include "mce-dbus.h"
+#include "mce-input-frame.h"
 #include "datapipe.h"
 
 /** Module name */
@@ -44,6 +46,33 @@ G_MODULE_EXPORT module_info_struct module_info = {
 	.priority = 100
 };
 
+/** Name of key-dbus configuration group */
+#define MCE_CONF_KEY_DBUS_GROUP		"KeyDBus"
+
+/** Name of configuration key for the batching window */
+#define MCE_CONF_KEY_DBUS_BATCH_WINDOW	"BatchWindow"
+
+/** Name of configuration key for the per-key compatibility signal */
+#define MCE_CONF_KEY_DBUS_PER_KEY	"PerKeySignal"
+
+/** Largest number of key events sent in one signal */
+#define MAX_BATCH_EVENTS		64
+
+/** Time in milliseconds to collect key events; 0 for one input frame */
+static gint batch_window = 0;
+
+/** Send the per-key signal instead of batches */
+static gboolean per_key_signal = TRUE;
+
+/** Key events waiting to be sent */
+static struct input_event batch[MAX_BATCH_EVENTS];
+
+/** Number of events in batch */
+static guint batch_count = 0;
+
+/** ID for the batching window timeout source */
+static guint batch_timeout_cb_id = 0;
+
 static gboolean send_key(uint16_t code, int32_t value)
 {
 	DBusMessage *msg = NULL;
@@ -71,13 +100,133 @@ static gboolean send_key(uint16_t code, int32_t value)
 	return status;
 }
 
+/**
+ * Send the collected key events in one signal
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean send_keys(void)
+{
+	DBusMessage *msg = NULL;
+	DBusMessageIter iter;
+	DBusMessageIter array;
+	gboolean status = FALSE;
+	guint i;
+
+	if (batch_count == 0) {
+		status = TRUE;
+		goto EXIT;
+	}
+
+	mce_log(LL_DEBUG, "%s: Sending %u key events", MODULE_NAME, batch_count);
+
+	msg = dbus_new_signal(MCE_SIGNAL_PATH, MCE_SIGNAL_IF, MCE_KEYS_SIG);
+
+	dbus_message_iter_init_append(msg, &iter);
+
+	if (dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					     "(qix)", &array) == FALSE)
+		goto ERROR;
+
+	for (i = 0; i < batch_count; i++) {
+		dbus_uint16_t code = batch[i].code;
+		dbus_int32_t value = batch[i].value;
+		dbus_int64_t time = (dbus_int64_t)batch[i].input_event_sec *
+				    G_USEC_PER_SEC + batch[i].input_event_usec;
+		DBusMessageIter sub;
+
+		if ((dbus_message_iter_open_container(&array, DBUS_TYPE_STRUCT,
+						      NULL, &sub) == FALSE) ||
+		    (dbus_message_iter_append_basic(&sub, DBUS_TYPE_UINT16,
+						    &code) == FALSE) ||
+		    (dbus_message_iter_append_basic(&sub, DBUS_TYPE_INT32,
+						    &value) == FALSE) ||
+		    (dbus_message_iter_append_basic(&sub, DBUS_TYPE_INT64,
+						    &time) == FALSE) ||
+		    (dbus_message_iter_close_container(&array,
+						       &sub) == FALSE))
+			goto ERROR;
+	}
+
+	if (dbus_message_iter_close_container(&iter, &array) == FALSE)
+		goto ERROR;
+
+	batch_count = 0;
+
+	status = dbus_send_message(msg);
+	goto EXIT;
+
+ERROR:
+	mce_log(LL_CRIT,
+		"Failed to append argument to D-Bus message for %s.%s",
+		MCE_SIGNAL_IF, MCE_KEYS_SIG);
+	dbus_message_unref(msg);
+	batch_count = 0;
+
+EXIT:
+	return status;
+}
+
+/**
+ * Cancel the batching window
+ */
+static void cancel_batch_timeout(void)
+{
+	if (batch_timeout_cb_id != 0) {
+		g_source_remove(batch_timeout_cb_id);
+		batch_timeout_cb_id = 0;
+	}
+}
+
+/**
+ * Timeout callback for the end of the batching window
+ *
+ * @param data Unused
+ * @return Always returns FALSE, to disable the timeout
+ */
+static gboolean batch_timeout_cb(gpointer data)
+{
+	(void)data;
+
+	batch_timeout_cb_id = 0;
+	send_keys();
+
+	return FALSE;
+}
+
 static void keypress_trigger(gconstpointer data)
 {
-	const struct input_event * const ev =
-		*((const struct input_event * const *)data);
+	const mce_input_frame_t *frame = data;
+	guint i;
+
+	if (frame == NULL)
+		return;
+
+	for (i = 0; i < frame->count; i++) {
+		const struct input_event *ev = &frame->events[i];
+
+		if (ev->code != KEY_VOLUMEDOWN && ev->code != KEY_VOLUMEUP)
+			continue;
 
-	if(ev->code == KEY_VOLUMEDOWN || ev->code == KEY_VOLUMEUP) {
-		send_key(ev->code, ev->value);
+		if (per_key_signal == TRUE) {
+			send_key(ev->code, ev->value);
+			continue;
+		}
+
+		if (batch_count == MAX_BATCH_EVENTS)
+			send_keys();
+
+		batch[batch_count++] = *ev;
+	}
+
+	if (per_key_signal == TRUE || batch_count == 0)
+		return;
+
+	if (batch_window <= 0) {
+		send_keys();
+	} else if (batch_timeout_cb_id == 0) {
+		batch_timeout_cb_id = g_timeout_add(batch_window,
+						    batch_timeout_cb, NULL);
 	}
 }
 
@@ -86,6 +235,13 @@ const gchar *g_module_check_init(GModule *module)
 {
 	(void)module;
 
+	batch_window = mce_conf_get_int(MCE_CONF_KEY_DBUS_GROUP,
+					MCE_CONF_KEY_DBUS_BATCH_WINDOW,
+					0, NULL);
+	per_key_signal = mce_conf_get_bool(MCE_CONF_KEY_DBUS_GROUP,
+					   MCE_CONF_KEY_DBUS_PER_KEY,
+					   TRUE, NULL);
+
 	/* Append triggers/filters to datapipes */
 	append_output_trigger_to_datapipe(&keypress_pipe, keypress_trigger);
 
@@ -99,4 +255,8 @@ void g_module_unload(GModule *module)
 	
 	/* Remove triggers/filters from datapipes */
 	remove_output_trigger_from_datapipe(&keypress_pipe, keypress_trigger);
+
+	/* Don't lose the events of an open batching window */
+	cancel_batch_timeout();
+	send_keys();
 }
@@ -7,6 +7,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "mce-log.h"
+#include "mce-patterns.h"
 #include "mce-dbus.h"
 #include "mce-rtconf.h"
 #include "datapipe.h"
@@ -17,7 +18,7 @@
 #define MODULE_NAME		"led-dbus"
 #define MODULE_PROVIDES	"led-dbus"
 
-#define LED_SYSFS_PATH "/sys/class/leds/"
+#define LED_SYSFS_PATH MCE_SYSFS_DIR "/class/leds/"
 #define LED_BRIGHTNESS_PATH "/brightness"
 
 #define MCE_CONF_LED_GROUP			"LED"
@@ -40,12 +41,15 @@ G_MODULE_EXPORT module_info_struct module_info = {
 
 struct led_pattern {
 	char* name;
+	mce_pattern_t id;
 	unsigned int gconf_cb_id;
 	bool enabled;
 };
 
 static struct led_pattern *led_patterns = NULL;
 static unsigned int patterns_count = 0;
+/* led_patterns indexed by pattern id */
+static GHashTable *patterns_by_id = NULL;
 
 static gboolean pattern_set_enabled_conf(struct led_pattern *pattern);
 
@@ -58,13 +62,16 @@ static struct led_pattern *find_pattern_id(unsigned int id)
 	return NULL;
 }
 
+static struct led_pattern *find_pattern(mce_pattern_t id)
+{
+	if (!patterns_by_id || id == MCE_PATTERN_NONE)
+		return NULL;
+	return g_hash_table_lookup(patterns_by_id, MCE_PATTERN_TO_POINTER(id));
+}
+
 static struct led_pattern *find_pattern_name(const gchar* name)
 {
-	for (unsigned int i = 0; i < patterns_count; ++i) {
-		if (strcmp(led_patterns[i].name, name) == 0)
-			return &(led_patterns[i]);
-	}
-	return NULL;
+	return find_pattern(mce_pattern_lookup(name));
 }
 
 /**
@@ -96,7 +103,9 @@ static gboolean led_activate_pattern_dbus_cb(DBusMessage *const msg)
 		return FALSE;
 	}
 
-	execute_datapipe(&led_pattern_activate_pipe, pattern, USE_INDATA, DONT_CACHE_INDATA);
+	execute_datapipe(&led_pattern_activate_pipe,
+			 MCE_PATTERN_TO_POINTER(mce_pattern_lookup(pattern)),
+			 USE_INDATA, DONT_CACHE_INDATA);
 
 	if (no_reply == FALSE) {
 		DBusMessage *reply = dbus_new_method_reply(msg);
@@ -137,7 +146,9 @@ static gboolean led_deactivate_pattern_dbus_cb(DBusMessage *const msg)
 		dbus_error_free(&error);
 		return FALSE;
 	}
-	execute_datapipe_output_triggers(&led_pattern_deactivate_pipe, pattern, USE_INDATA);
+	execute_datapipe_output_triggers(&led_pattern_deactivate_pipe,
+					 MCE_PATTERN_TO_POINTER(mce_pattern_lookup(pattern)),
+					 USE_INDATA);
 
 	if (no_reply == FALSE) {
 		DBusMessage *reply = dbus_new_method_reply(msg);
@@ -400,7 +411,7 @@ static void led_rtconf_cb(const gchar *key, guint cb_id, void *user_data)
 			mce_log(LL_DEBUG, "%s: pattern %s id %u %s", 
 					MODULE_NAME, pattern->name, cb_id, pattern->enabled ? "enabled" : "disabled");
 			if (!pattern->enabled)
-				execute_datapipe(&led_pattern_deactivate_pipe, pattern->name, USE_CACHE, CACHE_INDATA);
+				execute_datapipe(&led_pattern_deactivate_pipe, MCE_PATTERN_TO_POINTER(pattern->id), USE_INDATA, DONT_CACHE_INDATA);
 		}
 	} else {
 		mce_log(LL_WARN, "%s: Spurious rtconf value received; confused!", MODULE_NAME);
@@ -451,6 +462,7 @@ static bool init_patterns(void)
 		g_strfreev(patternlist);
 		return false;
 	}
+	patterns_by_id = g_hash_table_new(g_direct_hash, g_direct_equal);
 
 	for (int i = 0; patternlist[i]; ++i) {
 		struct led_pattern *pattern;
@@ -459,6 +471,9 @@ static bool init_patterns(void)
 		pattern->gconf_cb_id = 0;
 		pattern->enabled = pattern_get_enabled_conf(patternlist[i], &pattern->gconf_cb_id);
 		pattern->name = strdup(patternlist[i]);
+		pattern->id = mce_pattern_intern(pattern->name);
+		g_hash_table_insert(patterns_by_id,
+				    MCE_PATTERN_TO_POINTER(pattern->id), pattern);
 		++patterns_count;
 	}
 	mce_log(LL_DEBUG, "%s: found %i patterns", MODULE_NAME, patterns_count);
@@ -469,19 +484,18 @@ static bool init_patterns(void)
 
 static gpointer led_pattern_activate_filter(gpointer data)
 {
-	const gchar * const name = (const gchar * const)data;
-	if (name) {
-		mce_log(LL_DEBUG, "%s: %s", MODULE_NAME, name);
+	const mce_pattern_t id = MCE_POINTER_TO_PATTERN(data);
+	if (id != MCE_PATTERN_NONE) {
 		static struct led_pattern* pattern = NULL;
-		if ((pattern = find_pattern_name(name))) {
-			mce_log(LL_DEBUG, "%s: found name: %s", MODULE_NAME, name);
+		if ((pattern = find_pattern(id))) {
+			mce_log(LL_DEBUG, "%s: found name: %s", MODULE_NAME, pattern->name);
 			if(pattern->enabled)
 				return data;
 		} else {
-			mce_log(LL_DEBUG, "%s: did not find name: %s", MODULE_NAME, name);
+			mce_log(LL_DEBUG, "%s: did not find pattern: %u", MODULE_NAME, id);
 		}
 	}
-	return NULL;
+	return MCE_PATTERN_TO_POINTER(MCE_PATTERN_NONE);
 }
 
 /**
@@ -596,6 +610,10 @@ void g_module_unload(GModule *module)
 {
 	(void)module;
 	remove_filter_from_datapipe(&led_pattern_activate_pipe, led_pattern_activate_filter);
+	if (patterns_by_id) {
+		g_hash_table_destroy(patterns_by_id);
+		patterns_by_id = NULL;
+	}
 	if (led_patterns) {
 		for (unsigned int i = 0; i < patterns_count; ++i)
 			free(led_patterns[i].name);
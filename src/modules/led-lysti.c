@@ -31,6 +31,8 @@
 #include "mce-io.h"
 #include "mce-lib.h"
 #include "mce-log.h"
+#include "mce-patterns.h"
+#include "mce-led-arbiter.h"
 #include "mce-conf.h"
 #include "datapipe.h"
 
@@ -52,6 +54,10 @@ G_MODULE_EXPORT module_info_struct module_info = {
 
 /** The pattern queue */
 static GQueue *pattern_stack = NULL;
+/** The patterns in the pattern queue, indexed by pattern id */
+static GHashTable *pattern_index = NULL;
+/** Arbitration between the active patterns */
+static mce_led_arbiter_t *pattern_arbiter = NULL;
 /** The D-Bus controlled LED switch */
 static gboolean led_enabled = FALSE;
 
@@ -98,6 +104,8 @@ typedef struct {
 	/** Pattern for the B-channel */
 	gchar channel3[CHANNEL_SIZE + 1];
 	guint gconf_cb_id;		/**< Callback ID for GConf entry */
+	/** Arbitration entry */
+	mce_led_arbiter_entry_t *entry;
 } pattern_struct;
 
 /** Pointer to the top pattern */
@@ -108,6 +116,55 @@ static gint active_brightness = -1;
 /** Currently driven leds */
 static guint current_lysti_led_pattern = 0;
 
+/** Value used in the shadow state for attributes in an unknown state */
+#define LYSTI_SHADOW_UNKNOWN	-1
+
+/**
+ * Shadow copy of the state of a Lysti engine
+ *
+ * Used to avoid rewriting sysfs attributes that already
+ * hold the requested value
+ */
+typedef struct {
+	const gchar *mode_path;		/**< Path to the engine mode */
+	const gchar *leds_path;		/**< Path to the engine muxing */
+	const gchar *load_path;		/**< Path to the engine microcode */
+	const gchar *mode;		/**< Engine mode; NULL if unknown */
+	gint mux;			/**< Engine muxing */
+	/** Loaded microcode; empty if unknown */
+	gchar program[CHANNEL_SIZE + 1];
+} lysti_engine_t;
+
+/** Shadow state of Lysti engine 1 */
+static lysti_engine_t lysti_engine1 = {
+	.mode_path = MCE_LYSTI_ENGINE1_MODE_PATH,
+	.leds_path = MCE_LYSTI_ENGINE1_LEDS_PATH,
+	.load_path = MCE_LYSTI_ENGINE1_LOAD_PATH,
+	.mode = NULL,
+	.mux = LYSTI_SHADOW_UNKNOWN,
+	.program = "",
+};
+
+/** Shadow state of Lysti engine 2 */
+static lysti_engine_t lysti_engine2 = {
+	.mode_path = MCE_LYSTI_ENGINE2_MODE_PATH,
+	.leds_path = MCE_LYSTI_ENGINE2_LEDS_PATH,
+	.load_path = MCE_LYSTI_ENGINE2_LOAD_PATH,
+	.mode = NULL,
+	.mux = LYSTI_SHADOW_UNKNOWN,
+	.program = "",
+};
+
+/** Shadow state of the direct R/G/B brightness */
+static gint lysti_direct_brightness[3] = {
+	LYSTI_SHADOW_UNKNOWN, LYSTI_SHADOW_UNKNOWN, LYSTI_SHADOW_UNKNOWN
+};
+
+/** Shadow state of the R/G/B led current */
+static gint lysti_led_current[3] = {
+	LYSTI_SHADOW_UNKNOWN, LYSTI_SHADOW_UNKNOWN, LYSTI_SHADOW_UNKNOWN
+};
+
 /** LED type */
 typedef enum {
 	LED_TYPE_UNSET = -1,
@@ -155,25 +212,17 @@ EXIT:
 }
 
 /**
- * Custom find function to get a particular entry in the pattern stack
+ * Find a particular entry in the pattern stack
  *
- * @param data The pattern_struct entry
- * @param userdata The pattern name
+ * @param id The pattern id
+ * @return The pattern_struct entry, or NULL if not found
  */
-static gint queue_find(gconstpointer data, gconstpointer userdata) G_GNUC_PURE;
-static gint queue_find(gconstpointer data, gconstpointer userdata)
+static pattern_struct *find_pattern(const mce_pattern_t id)
 {
-	pattern_struct *psp;
-
-	if (data == NULL || userdata == NULL)
-		return -1;
-
-	psp = (pattern_struct *)data;
-
-	if (psp->name == NULL)
-		return -1;
+	if ((pattern_index == NULL) || (id == MCE_PATTERN_NONE))
+		return NULL;
 
-	return strcmp(psp->name, (gchar *)userdata);
+	return g_hash_table_lookup(pattern_index, MCE_PATTERN_TO_POINTER(id));
 }
 
 /**
@@ -198,6 +247,97 @@ static gint queue_prio_compare(gconstpointer entry1,
 	return psp1->priority - psp2->priority;
 }
 
+/**
+ * Write a number to a Lysti sysfs attribute unless it already holds it
+ *
+ * @param file The attribute to write to
+ * @param shadow The shadow copy of the attribute
+ * @param number The number to write
+ */
+static void lysti_write_number(const gchar *const file, gint *shadow,
+			       const guint number)
+{
+	if (*shadow == (gint)number)
+		goto EXIT;
+
+	if (mce_write_number_string_to_file(file, number) == TRUE)
+		*shadow = (gint)number;
+	else
+		*shadow = LYSTI_SHADOW_UNKNOWN;
+
+EXIT:
+	return;
+}
+
+/**
+ * Set the mode of a Lysti engine unless it is already in that mode
+ *
+ * @param engine The engine to set the mode for
+ * @param mode The new mode; one of MCE_LED_*_MODE
+ */
+static void lysti_engine_set_mode(lysti_engine_t *engine,
+				  const gchar *const mode)
+{
+	if (g_strcmp0(engine->mode, mode) == 0)
+		goto EXIT;
+
+	if (mce_write_string_to_file(engine->mode_path, mode) == TRUE)
+		engine->mode = mode;
+	else
+		engine->mode = NULL;
+
+EXIT:
+	return;
+}
+
+/**
+ * Load muxing and microcode into a Lysti engine,
+ * skipping the attributes that already hold the requested values;
+ * the engine must be in load mode
+ *
+ * @param engine The engine to load
+ * @param mux The new muxing
+ * @param program The new microcode
+ */
+static void lysti_engine_load(lysti_engine_t *engine,
+			      const guint mux, const gchar *const program)
+{
+	if (engine->mux != (gint)mux) {
+		if (mce_write_string_to_file(engine->leds_path,
+					     bin_to_string(mux)) == TRUE)
+			engine->mux = (gint)mux;
+		else
+			engine->mux = LYSTI_SHADOW_UNKNOWN;
+	}
+
+	if (strcmp(engine->program, program) != 0) {
+		if (mce_write_string_to_file(engine->load_path,
+					     program) == TRUE)
+			g_strlcpy(engine->program, program,
+				  sizeof (engine->program));
+		else
+			engine->program[0] = '\0';
+	}
+}
+
+/**
+ * Check whether a Lysti engine is running the requested microcode
+ *
+ * @param engine The engine to check
+ * @param mux The requested muxing
+ * @param program The requested microcode
+ * @return TRUE if the engine is already running the microcode,
+ *         FALSE otherwise
+ */
+static gboolean lysti_engine_is_running(const lysti_engine_t *engine,
+					const guint mux,
+					const gchar *const program)
+{
+	return ((g_strcmp0(engine->mode, MCE_LED_RUN_MODE) == 0) &&
+		(engine->mux == (gint)mux) &&
+		(strcmp(engine->program, program) == 0));
+}
+
 static void lysti_set_brightness(gint brightness)
 {
 	guint r_brightness = 0;
@@ -245,9 +385,12 @@ static void lysti_set_brightness(gint brightness)
 		b_brightness = (unsigned)active_brightness;
 	}
 
-	(void)mce_write_number_string_to_file(MCE_LYSTI_DIRECT_R_LED_CURRENT_PATH, r_brightness);
-	(void)mce_write_number_string_to_file(MCE_LYSTI_DIRECT_G_LED_CURRENT_PATH, g_brightness);
-	(void)mce_write_number_string_to_file(MCE_LYSTI_DIRECT_B_LED_CURRENT_PATH, b_brightness);
+	lysti_write_number(MCE_LYSTI_DIRECT_R_LED_CURRENT_PATH,
+			   &lysti_led_current[0], r_brightness);
+	lysti_write_number(MCE_LYSTI_DIRECT_G_LED_CURRENT_PATH,
+			   &lysti_led_current[1], g_brightness);
+	lysti_write_number(MCE_LYSTI_DIRECT_B_LED_CURRENT_PATH,
+			   &lysti_led_current[2], b_brightness);
 
 	mce_log(LL_DEBUG, "Brightness set to %d (%d, %d, %d)",
 		active_brightness, r_brightness, g_brightness, b_brightness);
@@ -259,17 +402,18 @@ static void lysti_set_brightness(gint brightness)
 static void lysti_disable_led(void)
 {
 	/* Disable engine 1 */
-	(void)mce_write_string_to_file(MCE_LYSTI_ENGINE1_MODE_PATH,
-				       MCE_LED_DISABLED_MODE);
+	lysti_engine_set_mode(&lysti_engine1, MCE_LED_DISABLED_MODE);
 
 	/* Disable engine 2 */
-	(void)mce_write_string_to_file(MCE_LYSTI_ENGINE2_MODE_PATH,
-				       MCE_LED_DISABLED_MODE);
+	lysti_engine_set_mode(&lysti_engine2, MCE_LED_DISABLED_MODE);
 
 	/* Turn off all three leds */
-	(void)mce_write_number_string_to_file(MCE_LYSTI_DIRECT_R_BRIGHTNESS_PATH, 0);
-	(void)mce_write_number_string_to_file(MCE_LYSTI_DIRECT_G_BRIGHTNESS_PATH, 0);
-	(void)mce_write_number_string_to_file(MCE_LYSTI_DIRECT_B_BRIGHTNESS_PATH, 0);
+	lysti_write_number(MCE_LYSTI_DIRECT_R_BRIGHTNESS_PATH,
+			   &lysti_direct_brightness[0], 0);
+	lysti_write_number(MCE_LYSTI_DIRECT_G_BRIGHTNESS_PATH,
+			   &lysti_direct_brightness[1], 0);
+	lysti_write_number(MCE_LYSTI_DIRECT_B_BRIGHTNESS_PATH,
+			   &lysti_direct_brightness[2], 0);
 }
 
 /**
@@ -301,8 +445,8 @@ static gboolean led_pattern_timeout_cb(gpointer data)
 
 	led_pattern_timeout_cb_id = 0;
 
-	disable_led();
 	active_pattern->active = FALSE;
+	mce_led_arbiter_deactivate(pattern_arbiter, active_pattern->entry);
 
 	return FALSE;
 }
@@ -338,29 +482,41 @@ static void setup_pattern_timeout(gint timeout)
  */
 static void lysti_program_led(const pattern_struct *const pattern)
 {
-	/* Disable old LED patterns */
-	lysti_disable_led();
-
-	/* Load new patterns, one engine at a time */
-
-	(void)mce_write_string_to_file(MCE_LYSTI_ENGINE1_MODE_PATH,
-				       MCE_LED_LOAD_MODE);
-	(void)mce_write_string_to_file(MCE_LYSTI_ENGINE1_LEDS_PATH,
-				       bin_to_string(pattern->engine1_mux));
-	(void)mce_write_string_to_file(MCE_LYSTI_ENGINE1_LOAD_PATH,
-				       pattern->channel1);
-
-	(void)mce_write_string_to_file(MCE_LYSTI_ENGINE2_MODE_PATH,
-				       MCE_LED_LOAD_MODE);
-	(void)mce_write_string_to_file(MCE_LYSTI_ENGINE2_LEDS_PATH,
-				       bin_to_string(pattern->engine2_mux));
-	(void)mce_write_string_to_file(MCE_LYSTI_ENGINE2_LOAD_PATH,
-				       pattern->channel2);
-
-	(void)mce_write_string_to_file(MCE_LYSTI_ENGINE2_MODE_PATH,
-				       MCE_LED_RUN_MODE);
-	(void)mce_write_string_to_file(MCE_LYSTI_ENGINE1_MODE_PATH,
-				       MCE_LED_RUN_MODE);
+	/* Nothing to do if the engines already run this pattern */
+	if ((lysti_engine_is_running(&lysti_engine1, pattern->engine1_mux,
+				     pattern->channel1) == TRUE) &&
+	    (lysti_engine_is_running(&lysti_engine2, pattern->engine2_mux,
+				     pattern->channel2) == TRUE)) {
+		mce_log(LL_DEBUG, "Pattern %s already running",
+			pattern->name);
+		goto EXIT;
+	}
+
+	/* Turn off the directly driven leds */
+	lysti_write_number(MCE_LYSTI_DIRECT_R_BRIGHTNESS_PATH,
+			   &lysti_direct_brightness[0], 0);
+	lysti_write_number(MCE_LYSTI_DIRECT_G_BRIGHTNESS_PATH,
+			   &lysti_direct_brightness[1], 0);
+	lysti_write_number(MCE_LYSTI_DIRECT_B_BRIGHTNESS_PATH,
+			   &lysti_direct_brightness[2], 0);
+
+	/* Load new patterns, one engine at a time;
+	 * entering load mode stops the engine and resets
+	 * its program counter, so both engines restart in sync
+	 * even if their microcode is already loaded
+	 */
+	lysti_engine_set_mode(&lysti_engine1, MCE_LED_LOAD_MODE);
+	lysti_engine_load(&lysti_engine1, pattern->engine1_mux,
+			  pattern->channel1);
+
+	lysti_engine_set_mode(&lysti_engine2, MCE_LED_LOAD_MODE);
+	lysti_engine_load(&lysti_engine2, pattern->engine2_mux,
+			  pattern->channel2);
+
+	lysti_engine_set_mode(&lysti_engine2, MCE_LED_RUN_MODE);
+	lysti_engine_set_mode(&lysti_engine1, MCE_LED_RUN_MODE);
+
+EXIT:
 
         /* Save what colors we are driving */
         current_lysti_led_pattern = pattern->engine1_mux | pattern->engine2_mux;
@@ -386,112 +542,141 @@ static void program_led(const pattern_struct *const pattern)
 }
 
 /**
- * Recalculate active pattern and update the pattern timer
+ * Check whether a pattern may be shown in a context
+ *
+ * Whether the LED is enabled is not considered here;
+ * see show_pattern()
+ *
+ * @param data The pattern_struct entry
+ * @param context The context; a mask of MCE_LED_CONTEXT_*
+ * @return TRUE if the pattern may be shown, FALSE otherwise
  */
-static void led_update_active_pattern(void)
+static gboolean pattern_visible(gconstpointer data, const guint context)
 {
-	display_state_t display_state = datapipe_get_gint(display_state_pipe);
-	system_state_t system_state = datapipe_get_gint(system_state_pipe);
-	pattern_struct *new_active_pattern;
-	gint i = 0;
+	const pattern_struct *psp = data;
+	gboolean visible = FALSE;
 
-	if (g_queue_is_empty(pattern_stack) == TRUE) {
-		disable_led();
+	/* Always show pattern with visibility 3 or 5 */
+	if ((psp->policy == 3) || (psp->policy == 5)) {
+		visible = TRUE;
 		goto EXIT;
 	}
 
-	while ((new_active_pattern = g_queue_peek_nth(pattern_stack,
-						      i++)) != NULL) {
-		mce_log(LL_DEBUG,
-			"pattern: %s, active: %d",
-			new_active_pattern->name,
-			new_active_pattern->active);
-
-		/* If the pattern is deactivated, ignore */
-		if (new_active_pattern->active == FALSE)
-			continue;
-
-		/* Always show pattern with visibility 3 or 5 */
-		if ((new_active_pattern->policy == 3) ||
-		    (new_active_pattern->policy == 5))
-			break;
-
-		/* Acting dead behaviour */
-		if (system_state == MCE_STATE_ACTDEAD) {
-			/* If we're in acting dead,
-			 * show patterns with visibility 4
-			 */
-			if (new_active_pattern->policy == 4)
-				break;
-
-			/* If we're in acting dead
-			 * and the display is off, show pattern
-			 */
-			if ((display_state == MCE_DISPLAY_OFF) &&
-			    (new_active_pattern->policy == 2))
-				break;
-
-			/* If the display is on and visibility is 2,
-			 * or if visibility is 1/0, ignore pattern
-			 */
-			continue;
-		}
+	/* Acting dead behaviour */
+	if ((context & MCE_LED_CONTEXT_ACTDEAD) != 0) {
+		/* If we're in acting dead,
+		 * show patterns with visibility 4
+		 */
+		if (psp->policy == 4)
+			visible = TRUE;
+
+		/* If we're in acting dead
+		 * and the display is off, show pattern
+		 */
+		if (((context & MCE_LED_CONTEXT_DISPLAY_OFF) != 0) &&
+		    (psp->policy == 2))
+			visible = TRUE;
+
+		/* If the display is on and visibility is 2,
+		 * or if visibility is 1/0, ignore pattern
+		 */
+		goto EXIT;
+	}
 
-		/* If the display is off, we can use any active pattern */
-		if (display_state == MCE_DISPLAY_OFF)
-			break;
+	/* If the display is off, we can use any active pattern */
+	if ((context & MCE_LED_CONTEXT_DISPLAY_OFF) != 0)
+		visible = TRUE;
 
-		/* If the pattern should be shown with screen on, use it */
-		if (new_active_pattern->policy == 1)
-			break;
-	}
+	/* If the pattern should be shown with screen on, use it */
+	if (psp->policy == 1)
+		visible = TRUE;
+
+EXIT:
+	return visible;
+}
+
+/**
+ * Show a pattern and update the pattern timer
+ *
+ * When the LED is disabled, only a pattern with visibility 5
+ * is shown; if the pattern at the top has another visibility,
+ * the LED is turned off rather than showing a lower priority
+ * pattern with visibility 5
+ *
+ * @param psp The pattern at the top of the arbiter, or NULL
+ */
+static void show_pattern(pattern_struct *psp)
+{
+	if ((psp != NULL) && (led_enabled == FALSE) && (psp->policy != 5))
+		psp = NULL;
 
-	if ((new_active_pattern == NULL) ||
-	    ((led_enabled == FALSE) &&
-	     (new_active_pattern->policy != 5))) {
-		active_pattern = NULL;
+	active_pattern = psp;
+
+	if (psp == NULL) {
 		disable_led();
-		cancel_pattern_timeout();
 		goto EXIT;
 	}
 
-	/* Only reprogram the pattern and timer if the pattern changed */
-	if (new_active_pattern != active_pattern) {
-		disable_led();
-		cancel_pattern_timeout();
+	mce_log(LL_DEBUG, "pattern: %s", psp->name);
 
-		if (new_active_pattern->timeout != -1) {
-			setup_pattern_timeout(new_active_pattern->timeout);
-		}
+	/* program_led() only rewrites what differs from the old pattern */
+	cancel_pattern_timeout();
 
-		program_led(new_active_pattern);
+	if (psp->timeout != -1) {
+		setup_pattern_timeout(psp->timeout);
 	}
 
-	active_pattern = new_active_pattern;
+	program_led(psp);
 
 EXIT:
 	return;
 }
 
+/**
+ * Show a new active pattern
+ *
+ * @param old_pattern The pattern previously shown, or NULL
+ * @param new_pattern The pattern to show, or NULL
+ * @param user_data Unused
+ */
+static void pattern_changed(gpointer old_pattern, gpointer new_pattern,
+			    gpointer user_data)
+{
+	(void)old_pattern;
+	(void)user_data;
+
+	show_pattern(new_pattern);
+}
+
+/**
+ * Recalculate active pattern and update the pattern timer
+ */
+static void led_update_active_pattern(void)
+{
+	display_state_t display_state = datapipe_get_gint(display_state_pipe);
+	system_state_t system_state = datapipe_get_gint(system_state_pipe);
+
+	mce_led_arbiter_set_context(pattern_arbiter,
+				    mce_led_context(system_state,
+						    display_state,
+						    led_enabled));
+}
+
 /**
  * Activate a pattern in the pattern-stack
  *
- * @param name The name of the pattern to activate
+ * @param id The id of the pattern to activate
  */
-static void led_activate_pattern(const gchar *const name)
+static void led_activate_pattern(const mce_pattern_t id)
 {
 	pattern_struct *psp;
-	GList *glp;
 
-	if ((name != NULL) &&
-	    ((glp = g_queue_find_custom(pattern_stack,
-					name, queue_find)) != NULL)) {
-		psp = (pattern_struct *)glp->data;
+	if ((psp = find_pattern(id)) != NULL) {
 		psp->active = TRUE;
-		led_update_active_pattern();
+		mce_led_arbiter_activate(pattern_arbiter, psp->entry);
 		mce_log(LL_DEBUG,
 			"LED pattern %s activated",
-			name);
+			psp->name);
 	} else {
 		mce_log(LL_DEBUG,
 			"Received request to activate "
@@ -502,22 +687,18 @@ static void led_activate_pattern(const gchar *const name)
 /**
  * Deactivate a pattern in the pattern-stack
  *
- * @param name The name of the pattern to deactivate
+ * @param id The id of the pattern to deactivate
  */
-static void led_deactivate_pattern(const gchar *const name)
+static void led_deactivate_pattern(const mce_pattern_t id)
 {
 	pattern_struct *psp;
-	GList *glp;
 
-	if ((name != NULL) &&
-	    ((glp = g_queue_find_custom(pattern_stack,
-					name, queue_find)) != NULL)) {
-		psp = (pattern_struct *)glp->data;
+	if ((psp = find_pattern(id)) != NULL) {
 		psp->active = FALSE;
-		led_update_active_pattern();
+		mce_led_arbiter_deactivate(pattern_arbiter, psp->entry);
 		mce_log(LL_DEBUG,
 			"LED pattern %s deactivated",
-			name);
+			psp->name);
 	} else {
 		mce_log(LL_DEBUG,
 			"Received request to deactivate "
@@ -530,8 +711,13 @@ static void led_deactivate_pattern(const gchar *const name)
  */
 static void led_enable(void)
 {
-	led_update_active_pattern();
 	led_enabled = TRUE;
+	led_update_active_pattern();
+
+	/* The visible patterns do not depend on the LED being enabled,
+	 * so the top pattern is the same; show it
+	 */
+	show_pattern(mce_led_arbiter_top(pattern_arbiter));
 }
 
 /**
@@ -570,23 +756,23 @@ static void display_state_trigger(gconstpointer data)
 /**
  * Handle LED pattern activate requests
  *
- * @param data The pattern name
+ * @param data The pattern id
  */
 static void led_pattern_activate_trigger(gconstpointer data)
 {
-	if (data) {
-		led_activate_pattern((gchar *)data);
+	if (MCE_POINTER_TO_PATTERN(data) != MCE_PATTERN_NONE) {
+		led_activate_pattern(MCE_POINTER_TO_PATTERN(data));
 	}
 }
 
 /**
  * Handle LED pattern deactivate requests
  *
- * @param data The pattern name
+ * @param data The pattern id
  */
 static void led_pattern_deactivate_trigger(gconstpointer data)
 {
-	led_deactivate_pattern((gchar *)data);
+	led_deactivate_pattern(MCE_POINTER_TO_PATTERN(data));
 }
 
 static gboolean init_lysti_patterns(void)
@@ -715,6 +901,11 @@ static gboolean init_lysti_patterns(void)
 			g_queue_insert_sorted(pattern_stack, psp,
 					      queue_prio_compare,
 					      NULL);
+			g_hash_table_insert(pattern_index,
+					    MCE_PATTERN_TO_POINTER(mce_pattern_intern(psp->name)),
+					    psp);
+			psp->entry = mce_led_arbiter_add(pattern_arbiter, psp,
+							 psp->priority);
 		}
 	}
 
@@ -782,6 +973,9 @@ const gchar *g_module_check_init(GModule *module)
 					  led_pattern_deactivate_trigger);
 
 	pattern_stack = g_queue_new();
+	pattern_index = g_hash_table_new(g_direct_hash, g_direct_equal);
+	pattern_arbiter = mce_led_arbiter_new(pattern_visible,
+					      pattern_changed, NULL);
 
 	if (init_patterns() == FALSE)
 		goto EXIT;
@@ -824,6 +1018,14 @@ void g_module_unload(GModule *module)
 	}
 
 	/* Free the pattern stack */
+	if (pattern_index != NULL) {
+		g_hash_table_destroy(pattern_index);
+		pattern_index = NULL;
+	}
+
+	mce_led_arbiter_free(pattern_arbiter);
+	pattern_arbiter = NULL;
+
 	if (pattern_stack != NULL) {
 		pattern_struct *psp;
 
@@ -10,6 +10,8 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "mce-log.h"
+#include "mce-patterns.h"
+#include "mce-led-arbiter.h"
 #include "mce-conf.h"
 #include "mce-io.h"
 #include "datapipe.h"
@@ -23,13 +25,18 @@
 #define MCE_CONF_G		"GreenSysfs"
 #define MCE_CONF_B		"BlueSysfs"
 #define MCE_CONF_W		"WhiteSysfs"
+#define MCE_CONF_KERNEL_TRIGGERS	"KernelTriggers"
 
 /** Module name */
 #define MODULE_NAME		"led-sw"
 #define MODULE_PROVIDES	"led"
 
-#define LED_SYSFS_PATH "/sys/class/leds/"
+#define LED_SYSFS_PATH MCE_SYSFS_DIR "/class/leds/"
 #define LED_BRIGHTNESS_PATH "/brightness"
+#define LED_TRIGGER_PATH "/trigger"
+#define LED_DELAY_ON_PATH "/delay_on"
+#define LED_DELAY_OFF_PATH "/delay_off"
+#define LED_PATTERN_PATH "/pattern"
 
 /** Functionality provided by this module */
 static const gchar *const provides[] = { MODULE_PROVIDES, NULL };
@@ -67,6 +74,7 @@ typedef enum {
 
 struct led_pattern {
 	char* name;
+	mce_pattern_t id;
 	uint8_t priority;
 	uint8_t policy;
 	unsigned int timeoutSec;
@@ -79,24 +87,45 @@ struct led_pattern {
 	bool active;
 	bool ledOn;
 	bool foreground;
+	bool offloaded;
 
 	unsigned int disableTimer;
 	unsigned int periodTimer;
+
+	mce_led_arbiter_entry_t *entry;
 };
 
 static struct led_pattern *led_patterns = NULL;
 static unsigned int patterns_count = 0;
+/* led_patterns indexed by pattern id */
+static GHashTable *patterns_by_id = NULL;
+static mce_led_arbiter_t *arbiter = NULL;
 static bool monochromic = false;
 static char* r_sysfs = NULL;
 static char* g_sysfs = NULL;
 static char* b_sysfs = NULL;
 static char* w_sysfs = NULL;
 
+/** Blink triggers supported by the kernel for a led */
+struct led_triggers {
+	char *dir;
+	bool timer;
+	bool pattern;
+};
+
+static bool kernel_triggers = true;
+static struct led_triggers r_triggers;
+static struct led_triggers g_triggers;
+static struct led_triggers b_triggers;
+static struct led_triggers w_triggers;
+
 static bool led_enabled;
 static display_state_t display_state = { 0 };
 static system_state_t system_state = { 0 };
 
-static void update_patterns(void);
+static gboolean pattern_visible(gconstpointer data, const guint context);
+static void pattern_changed(gpointer old_pattern, gpointer new_pattern,
+			    gpointer user_data);
 
 static bool init_patterns(void)
 {
@@ -151,6 +180,7 @@ static bool init_patterns(void)
 			pattern->active = false;
 			pattern->foreground = false;
 			pattern->ledOn = false;
+			pattern->offloaded = false;
 			pattern->disableTimer = 0;
 			pattern->periodTimer = 0;
 
@@ -162,6 +192,18 @@ static bool init_patterns(void)
 			g_free(tmp);
 		}
 	}
+	patterns_by_id = g_hash_table_new(g_direct_hash, g_direct_equal);
+	arbiter = mce_led_arbiter_new(pattern_visible, pattern_changed, NULL);
+	for (unsigned int i = 0; i < patterns_count; ++i) {
+		led_patterns[i].id = mce_pattern_intern(led_patterns[i].name);
+		g_hash_table_insert(patterns_by_id,
+				    MCE_PATTERN_TO_POINTER(led_patterns[i].id),
+				    &led_patterns[i]);
+		led_patterns[i].entry =
+			mce_led_arbiter_add(arbiter, &led_patterns[i],
+					    led_patterns[i].priority);
+	}
+
 	mce_log(LL_DEBUG, "%s: found %i patterns", MODULE_NAME, patterns_count);
 	g_strfreev(patternlist);
 
@@ -179,27 +221,201 @@ static void set_led(uint8_t r, uint8_t g, uint8_t b)
 	}
 }
 
-static bool should_run_pattern(const struct led_pattern * const pattern)
+/**
+ * Find out which blink triggers the kernel supports for a led
+ *
+ * @param brightness_path The brightness file of the led
+ * @param triggers Will contain the supported triggers on return
+ */
+static void probe_triggers(const char *brightness_path,
+			   struct led_triggers *triggers)
+{
+	gchar *path;
+	gchar *available = NULL;
+	gchar **names;
+
+	triggers->dir = g_strndup(brightness_path,
+				  strlen(brightness_path) -
+				  strlen(LED_BRIGHTNESS_PATH));
+	triggers->timer = false;
+	triggers->pattern = false;
+
+	path = g_strconcat(triggers->dir, LED_TRIGGER_PATH, NULL);
+
+	if (!mce_read_string_from_file(path, &available)) {
+		g_free(path);
+		return;
+	}
+
+	/* The trigger file lists the triggers separated by spaces,
+	 * with the active one in brackets
+	 */
+	names = g_strsplit_set(g_strstrip(available), " []", 0);
+
+	for (int i = 0; names[i]; ++i) {
+		if (strcmp(names[i], "timer") == 0)
+			triggers->timer = true;
+		else if (strcmp(names[i], "pattern") == 0)
+			triggers->pattern = true;
+	}
+
+	mce_log(LL_DEBUG, "%s: %s: timer trigger %s, pattern trigger %s",
+		MODULE_NAME, triggers->dir,
+		triggers->timer ? "available" : "not available",
+		triggers->pattern ? "available" : "not available");
+
+	g_strfreev(names);
+	g_free(available);
+	g_free(path);
+}
+
+/**
+ * Write to a file in the sysfs directory of a led
+ *
+ * @param triggers The led
+ * @param file The file, relative to the led directory
+ * @param value The string to write
+ * @return true on success, false on failure
+ */
+static bool write_led_file(const struct led_triggers *triggers,
+			   const char *file, const char *value)
+{
+	gchar *path = g_strconcat(triggers->dir, file, NULL);
+	bool status = mce_write_string_to_file(path, value);
+
+	g_free(path);
+
+	return status;
+}
+
+/**
+ * Let the kernel blink a led;
+ * writing 0 to the brightness file stops the blinking again
+ *
+ * @param triggers The led
+ * @param brightness The brightness when on
+ * @param on_ms Time the led spends on
+ * @param off_ms Time the led spends off
+ * @return true if the kernel blinks the led, false otherwise
+ */
+static bool blink_led(const struct led_triggers *triggers, uint8_t brightness,
+		      unsigned long on_ms, unsigned long off_ms)
+{
+	gchar *value;
+	bool status = false;
+
+	if (triggers->dir == NULL)
+		return false;
+
+	if (triggers->timer) {
+		if (!write_led_file(triggers, LED_TRIGGER_PATH, "timer"))
+			goto EXIT;
+
+		value = g_strdup_printf("%lu", on_ms);
+		status = write_led_file(triggers, LED_DELAY_ON_PATH, value);
+		g_free(value);
+
+		if (!status)
+			goto EXIT;
+
+		value = g_strdup_printf("%lu", off_ms);
+		status = write_led_file(triggers, LED_DELAY_OFF_PATH, value);
+		g_free(value);
+
+		if (!status)
+			goto EXIT;
+
+		/* While blinking this sets the brightness used when on */
+		value = g_strdup_printf("%u", brightness);
+		status = write_led_file(triggers, LED_BRIGHTNESS_PATH, value);
+		g_free(value);
+	} else if (triggers->pattern) {
+		if (!write_led_file(triggers, LED_TRIGGER_PATH, "pattern"))
+			goto EXIT;
+
+		/* A square wave: hold the brightness, drop to zero,
+		 * hold zero, and jump back up
+		 */
+		value = g_strdup_printf("%u %lu %u 0 0 %lu 0 0",
+					brightness, on_ms, brightness, off_ms);
+		status = write_led_file(triggers, LED_PATTERN_PATH, value);
+		g_free(value);
+	}
+
+EXIT:
+	return status;
+}
+
+/**
+ * Hand a blink pattern over to the kernel, if possible;
+ * only patterns using a single led are offloaded,
+ * since separately blinking leds drift out of phase
+ *
+ * @param pattern The pattern
+ * @return true if the kernel blinks the pattern, false otherwise
+ */
+static bool offload_pattern(const struct led_pattern *pattern)
+{
+	const struct led_triggers *triggers = NULL;
+	uint8_t brightness = 0;
+	bool status;
+
+	if (!kernel_triggers)
+		return false;
+
+	if (monochromic) {
+		triggers = &w_triggers;
+		brightness = (pattern->r + pattern->g + pattern->b) / 3;
+	} else if (pattern->g == 0 && pattern->b == 0) {
+		triggers = &r_triggers;
+		brightness = pattern->r;
+	} else if (pattern->r == 0 && pattern->b == 0) {
+		triggers = &g_triggers;
+		brightness = pattern->g;
+	} else if (pattern->r == 0 && pattern->g == 0) {
+		triggers = &b_triggers;
+		brightness = pattern->b;
+	} else {
+		return false;
+	}
+
+	status = blink_led(triggers, brightness,
+			   pattern->onPeriodMs, pattern->offPeriodMs);
+
+	if (status) {
+		mce_log(LL_DEBUG, "%s: %s blinked by the kernel",
+			MODULE_NAME, pattern->name);
+	} else {
+		/* Leave the led in a known state for the fallback */
+		set_led(pattern->r, pattern->g, pattern->b);
+	}
+
+	return status;
+}
+
+static gboolean pattern_visible(gconstpointer data, const guint context)
 {
+	const struct led_pattern * const pattern = data;
+	const bool actdead = (context & MCE_LED_CONTEXT_ACTDEAD) != 0;
+	const bool display_off = (context & MCE_LED_CONTEXT_DISPLAY_OFF) != 0;
+	const bool enabled = (context & MCE_LED_CONTEXT_LED_ENABLED) != 0;
+
 	if (pattern->r == 0 && pattern->g == 0 && pattern->b == 0)
 		return false;
 	else if (pattern->policy == POLICY_PLAY_ALWAYS ||
-		(pattern->policy == POLICY_PLAY_DISPLAY_ON_ACTDEAD && led_enabled))
+		(pattern->policy == POLICY_PLAY_DISPLAY_ON_ACTDEAD && enabled))
 		return true;
 	else if (pattern->policy == POLICY_PLAY_DISPLAY_OFF_OR_ACTDEAD &&
-		 (system_state == MCE_STATE_ACTDEAD
-		  || display_state == MCE_DISPLAY_OFF))
+		 (actdead || display_off))
 		return true;
 	else if (pattern->policy == POLICY_PLAY_DISPLAY_OFF_ACTDEAD &&
-		 (system_state == MCE_STATE_ACTDEAD
-		  && display_state == MCE_DISPLAY_OFF))
+		 (actdead && display_off))
 		return true;
 	else if (pattern->policy == POLICY_PLAY_DISPLAY_ON_OR_OFF &&
-		 (system_state != MCE_STATE_ACTDEAD))
+		 !actdead)
 		return true;
 	else if (pattern->policy == POLICY_PLAY_DISPLAY_OFF &&
-		 (system_state != MCE_STATE_ACTDEAD
-		  && display_state == MCE_DISPLAY_OFF))
+		 (!actdead && display_off))
 		return true;
 	return false;
 }
@@ -208,11 +424,9 @@ static gboolean disable_timeout_cb(gpointer data)
 {
 	struct led_pattern *pattern = (struct led_pattern *)data;
 
-	set_led(0, 0, 0);
-	pattern->ledOn = false;
+	pattern->disableTimer = 0;
 	pattern->active = false;
-
-	update_patterns();
+	mce_led_arbiter_deactivate(arbiter, pattern->entry);
 
 	return false;
 }
@@ -220,10 +434,8 @@ static gboolean disable_timeout_cb(gpointer data)
 static void cancel_disable_timer(struct led_pattern *pattern)
 {
 	if (pattern->disableTimer != 0) {
-		set_led(0, 0, 0);
 		g_source_remove(pattern->disableTimer);
 		pattern->disableTimer = 0;
-		pattern->foreground = false;
 	}
 }
 
@@ -255,10 +467,13 @@ static gboolean period_timeout_cb(gpointer data)
 
 static void cancel_period_timer(struct led_pattern *pattern)
 {
-	if (pattern->periodTimer != 0) {
+	if (pattern->periodTimer != 0 || pattern->offloaded) {
+		/* Writing 0 to the brightness also stops kernel blinking */
 		set_led(0, 0, 0);
-		g_source_remove(pattern->periodTimer);
+		if (pattern->periodTimer != 0)
+			g_source_remove(pattern->periodTimer);
 		pattern->periodTimer = 0;
+		pattern->offloaded = false;
 		pattern->foreground = false;
 	}
 }
@@ -267,43 +482,46 @@ static void setup_period_timer(struct led_pattern *pattern)
 {
 	cancel_period_timer(pattern);
 
-	if (pattern->offPeriodMs > 0 && pattern->onPeriodMs > 0)
-		pattern->periodTimer =
-			g_timeout_add(pattern->ledOn ? pattern->onPeriodMs : pattern->offPeriodMs, &period_timeout_cb, pattern);
+	if (pattern->offPeriodMs > 0 && pattern->onPeriodMs > 0) {
+		if (offload_pattern(pattern))
+			pattern->offloaded = true;
+		else
+			pattern->periodTimer =
+				g_timeout_add(pattern->ledOn ? pattern->onPeriodMs : pattern->offPeriodMs, &period_timeout_cb, pattern);
+	}
 }
 
-static void update_patterns(void)
+static void pattern_changed(gpointer old_pattern, gpointer new_pattern,
+			    gpointer user_data)
 {
-	struct led_pattern *pattern_to_run = NULL;
-	int prio = 256;
-	for (unsigned int i = 0; i < patterns_count; ++i) {
-		if (!led_patterns[i].active || !should_run_pattern(&led_patterns[i]) || prio < led_patterns[i].priority) {
-			if (led_patterns[i].foreground) {
-				cancel_period_timer(&led_patterns[i]);
-				set_led(0, 0, 0);
-				led_patterns[i].foreground = false;
-				led_patterns[i].ledOn = false;
-			}
-			continue;
-		}
+	struct led_pattern *old = old_pattern;
+	struct led_pattern *pattern = new_pattern;
 
-		if (pattern_to_run != NULL) {
-			cancel_period_timer(pattern_to_run);
-			pattern_to_run->foreground = false;
-		}
+	(void)user_data;
 
-		prio = led_patterns[i].priority;
-		pattern_to_run = &led_patterns[i];
+	if (old) {
+		cancel_period_timer(old);
+		set_led(0, 0, 0);
+		old->foreground = false;
+		old->ledOn = false;
 	}
 
-	if (pattern_to_run && pattern_to_run->foreground == false) {
-		set_led(pattern_to_run->r, pattern_to_run->g, pattern_to_run->b);
-		pattern_to_run->ledOn = true;
-		pattern_to_run->foreground = true;
-		setup_period_timer(pattern_to_run);
+	if (pattern) {
+		set_led(pattern->r, pattern->g, pattern->b);
+		pattern->ledOn = true;
+		pattern->foreground = true;
+		setup_period_timer(pattern);
 	}
 }
 
+static void update_patterns(void)
+{
+	mce_led_arbiter_set_context(arbiter,
+				    mce_led_context(system_state,
+						    display_state,
+						    led_enabled));
+}
+
 static char *led_create_sysfs_path(const gchar *key)
 {
 	char *path = NULL;
@@ -348,44 +566,43 @@ static void led_enabled_trigger(gconstpointer data)
 }
 
 
+static struct led_pattern *find_pattern(mce_pattern_t id)
+{
+	if (!patterns_by_id || id == MCE_PATTERN_NONE)
+		return NULL;
+	return g_hash_table_lookup(patterns_by_id, MCE_PATTERN_TO_POINTER(id));
+}
+
 static void led_pattern_activate_trigger(gconstpointer data)
 {
-	const gchar * const name = (const gchar * const)data;
-	if (name) {
-		bool found = false;
-		for (unsigned int i = 0; i < patterns_count; ++i) {
-			if (strcmp(led_patterns[i].name, name) == 0) {
-				found = true;
-				led_patterns[i].active = true;
-				update_patterns();
-				setup_disable_timer(&led_patterns[i]);
-				mce_log(LL_DEBUG, "%s: activate called on: %s", MODULE_NAME, name);
-				break;
-			}
+	const mce_pattern_t id = MCE_POINTER_TO_PATTERN(data);
+	if (id != MCE_PATTERN_NONE) {
+		struct led_pattern *pattern = find_pattern(id);
+
+		if (pattern) {
+			pattern->active = true;
+			mce_led_arbiter_activate(arbiter, pattern->entry);
+			setup_disable_timer(pattern);
+			mce_log(LL_DEBUG, "%s: activate called on: %s", MODULE_NAME, pattern->name);
+		} else {
+			mce_log(LL_WARN, "%s: activate called on non existing pattern: %s", MODULE_NAME, mce_pattern_name(id));
 		}
-
-		if (!found)
-			mce_log(LL_WARN, "%s: activate called on non existing pattern: %s", MODULE_NAME, name);
 	}
 }
 
 static void led_pattern_deactivate_trigger(gconstpointer data)
 {
-	const gchar * const name = (const gchar * const)data;
-	bool found = false;
-	for (unsigned int i = 0; i < patterns_count; ++i) {
-		if (strcmp(led_patterns[i].name, name) == 0) {
-			found = true;
-			led_patterns[i].active = false;
-			update_patterns();
-			cancel_disable_timer(&led_patterns[i]);
-			mce_log(LL_DEBUG, "%s: deactivate called on: %s", MODULE_NAME, name);
-			break;
-		}
+	const mce_pattern_t id = MCE_POINTER_TO_PATTERN(data);
+	struct led_pattern *pattern = find_pattern(id);
+
+	if (pattern) {
+		pattern->active = false;
+		mce_led_arbiter_deactivate(arbiter, pattern->entry);
+		cancel_disable_timer(pattern);
+		mce_log(LL_DEBUG, "%s: deactivate called on: %s", MODULE_NAME, pattern->name);
+	} else {
+		mce_log(LL_WARN, "%s: deactivate called on non existing pattern: %s", MODULE_NAME, mce_pattern_name(id));
 	}
-
-	if (!found)
-		mce_log(LL_WARN, "%s: deactivate called on non existing pattern: %s", MODULE_NAME, name);
 }
 
 
@@ -415,12 +632,24 @@ const gchar *g_module_check_init(GModule *module)
 			return NULL;
 	}
 
+	kernel_triggers = mce_conf_get_bool(MCE_CONF_LED_GENERIC, MCE_CONF_KERNEL_TRIGGERS, true, NULL);
+	if (kernel_triggers) {
+		if (monochromic) {
+			probe_triggers(w_sysfs, &w_triggers);
+		} else {
+			probe_triggers(r_sysfs, &r_triggers);
+			probe_triggers(g_sysfs, &g_triggers);
+			probe_triggers(b_sysfs, &b_triggers);
+		}
+	}
+
 	if (!init_patterns())
 		return NULL;
 
 	led_enabled = datapipe_get_gbool(led_enabled_pipe);
 	system_state = datapipe_get_gint(system_state_pipe);
-	display_state = datapipe_get_gint(system_state_pipe);
+	display_state = datapipe_get_gint(display_state_pipe);
+	update_patterns();
 
 	/* Append triggers/filters to datapipes */
 	append_output_trigger_to_datapipe(&system_state_pipe,
@@ -470,9 +699,23 @@ void g_module_unload(GModule *module)
 		free(b_sysfs);
 	if (w_sysfs)
 		free(w_sysfs);
+	g_free(r_triggers.dir);
+	g_free(g_triggers.dir);
+	g_free(b_triggers.dir);
+	g_free(w_triggers.dir);
+	if (patterns_by_id) {
+		g_hash_table_destroy(patterns_by_id);
+		patterns_by_id = NULL;
+	}
+	mce_led_arbiter_free(arbiter);
+	arbiter = NULL;
 	if (led_patterns) {
-		for (unsigned int i = 0; i < patterns_count; ++i)
+		for (unsigned int i = 0; i < patterns_count; ++i) {
+			cancel_disable_timer(&led_patterns[i]);
+			if (led_patterns[i].periodTimer != 0)
+				g_source_remove(led_patterns[i].periodTimer);
 			free(led_patterns[i].name);
+		}
 		free(led_patterns);
 	}
 }
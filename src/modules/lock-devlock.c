@@ -435,8 +435,10 @@ static void disable_devlock_internal(void)
 
 static gboolean enable_devlock(void)
 {
+	mce_begin_submode_transaction();
 	mce_add_submode_int32(MCE_DEVLOCK_SUBMODE);
 	mce_rem_submode_int32(MCE_VERIFY_SUBMODE);
+	mce_commit_submode_transaction();
 	(void)mce_send_devlock_mode(NULL);
 	enable_devlock_internal();
 
@@ -460,8 +462,10 @@ static gboolean disable_devlock(void)
 	if (close_devlock_ui() == FALSE)
 		goto EXIT;
 
+	mce_begin_submode_transaction();
 	mce_rem_submode_int32(MCE_DEVLOCK_SUBMODE);
 	mce_rem_submode_int32(MCE_VERIFY_SUBMODE);
+	mce_commit_submode_transaction();
 	(void)mce_send_devlock_mode(NULL);
 	devicelock_ui_visible = FALSE;
 	status = TRUE;
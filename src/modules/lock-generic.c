@@ -13,6 +13,8 @@
 #include "mce-log.h"
 #include "mce-conf.h"
 #include "datapipe.h"
+#include "mce-input-frame.h"
+#include "mce-spawn.h"
 #include "powerkey.h"
 
 #define MODULE_NAME		"lock-generic"
@@ -34,7 +36,12 @@ static bool slidelock = false;
 static guint autolock_cb_id = 0;
 static uint16_t power_keycode;
 
-char *lock_command = NULL;
+static char *lock_command = NULL;
+
+/** The running lock command; NULL if none */
+static mce_spawn_t *visual_lock_spawn = NULL;
+/** Lock state to apply once the lock command finishes; -1 for none */
+static gint visual_lock_pending = -1;
 
 static void synthesise_activity(void)
 {
@@ -43,19 +50,46 @@ static void synthesise_activity(void)
 			       USE_INDATA, CACHE_INDATA);
 }
 
+static void set_visual_lock( bool lock );
+
+static void visual_lock_done_cb(gboolean success, gint64 elapsed, gpointer data)
+{
+	bool lock = GPOINTER_TO_INT(data);
+
+	visual_lock_spawn = NULL;
+
+	if (success)
+		mce_log(LL_DEBUG, "%s: %s took %" G_GINT64_FORMAT " ms",
+			MODULE_NAME, lock ? "lock" : "unlock", elapsed / 1000);
+	else
+		mce_log(LL_WARN, "%s: %s command failed",
+			MODULE_NAME, lock ? "lock" : "unlock");
+
+	/* Run the latest request that came in while the command ran */
+	if (visual_lock_pending != -1) {
+		lock = visual_lock_pending;
+		visual_lock_pending = -1;
+		set_visual_lock(lock);
+	}
+}
+
 static void set_visual_lock( bool lock )
 {
 	if (lock_command)
 	{
-		pid_t pid = getpid();
-		pid_t fpid = fork();
-		if (fpid < 0) {
-			mce_log(LL_CRIT, "%s: Failed to fork", MODULE_NAME);
+		const gchar *argv[] = { lock_command, lock ? "lock" : "reset", NULL };
+
+		/* Keep lock and unlock in order */
+		if (visual_lock_spawn != NULL) {
+			visual_lock_pending = lock;
 			return;
 		}
-		
-		if (getpid() != pid)
-			execlp(lock_command, "", lock ? "lock" : "reset", (char *)NULL);
+
+		visual_lock_spawn = mce_spawn(argv, visual_lock_done_cb,
+					      GINT_TO_POINTER(lock));
+
+		if (visual_lock_spawn == NULL)
+			mce_log(LL_CRIT, "%s: Failed to run %s", MODULE_NAME, lock_command);
 	}
 }
 
@@ -143,17 +177,24 @@ static void keyboard_slide_trigger(gconstpointer data)
 static void powerkey_trigger(gconstpointer const data)
 {
 	static display_state_t display_state_prev = MCE_DISPLAY_UNDEF;
-	display_state_t display_state = datapipe_get_gint(display_state_pipe);
-	struct input_event const *const *evp;
-	struct input_event const *ev;
+	const mce_input_frame_t *frame = data;
+	guint i;
 
-	if (data == NULL)
+	if (frame == NULL)
 		return;
 
-	evp = data;
-	ev = *evp;
+	/* Handle every power key event in order, like one event
+	 * at a time; a press and release in the same frame both count
+	 */
+	for (i = 0; i < frame->count; i++) {
+		const struct input_event *ev = &frame->events[i];
+		display_state_t display_state;
+
+		if (ev->code != power_keycode)
+			continue;
+
+		display_state = datapipe_get_gint(display_state_pipe);
 
-	if (ev != NULL && ev->code == power_keycode) {
 		if ( ev->value == 0 && display_state == MCE_DISPLAY_OFF && display_state_prev == MCE_DISPLAY_OFF) {
 			display_state_prev = MCE_DISPLAY_UNDEF;
 			execute_datapipe(&display_state_pipe, GINT_TO_POINTER(MCE_DISPLAY_ON),USE_INDATA, CACHE_INDATA);
@@ -212,4 +253,9 @@ void g_module_unload(GModule * module)
 	remove_output_trigger_from_datapipe(&keypress_pipe, powerkey_trigger);
 	remove_output_trigger_from_datapipe(&call_state_pipe, call_alarm_state_trigger);
 	remove_output_trigger_from_datapipe(&alarm_ui_state_pipe, call_alarm_state_trigger);
+
+	/* The lock command may outlive this module */
+	mce_spawn_detach(visual_lock_spawn);
+	visual_lock_spawn = NULL;
+	visual_lock_pending = -1;
 }
@@ -39,6 +39,7 @@
 #include "mce-dbus.h"
 #include "mce-rtconf.h"
 #include "event-input.h"
+#include "mce-input-frame.h"
 #include "powerkey.h"
 
 #define MODULE_NAME		"lock-tklock"
@@ -670,12 +671,14 @@ static gboolean enable_tklock(gboolean silent)
 		goto EXIT;
 	}
 
+	mce_begin_submode_transaction();
 	mce_add_submode_int32(MCE_TKLOCK_SUBMODE);
 	mce_rem_submode_int32(MCE_EVEATER_SUBMODE);
 	mce_rem_submode_int32(MCE_VISUAL_TKLOCK_SUBMODE);
-	(void)mce_send_tklock_mode(NULL);
-
 	enable_autorelock();
+	mce_commit_submode_transaction();
+
+	(void)mce_send_tklock_mode(NULL);
 
 	status = TRUE;
 
@@ -903,8 +906,10 @@ static gboolean disable_tklock(gboolean silent)
 	cancel_tklock_unlock_timeout();
 	cancel_tklock_dim_timeout();
 
+	mce_begin_submode_transaction();
 	mce_rem_submode_int32(MCE_VISUAL_TKLOCK_SUBMODE);
 	mce_rem_submode_int32(MCE_TKLOCK_SUBMODE);
+	mce_commit_submode_transaction();
 	(void)mce_send_tklock_mode(NULL);
 	(void)ts_event_control(TRUE);
 	status = TRUE;
@@ -1506,21 +1511,23 @@ static void lockkey_trigger(gconstpointer const data)
 static void keypress_trigger(gconstpointer const data)
 {
 	submode_t submode = datapipe_get_gint(submode_pipe);
-	struct input_event const *const *evp;
-	struct input_event const *ev;
+	const mce_input_frame_t *frame = data;
+	gboolean power_pressed = FALSE;
+	guint i;
 
 	/* Don't dereference until we know it's safe */
-	if (data == NULL)
+	if (frame == NULL)
 		goto EXIT;
 
-	evp = data;
-	ev = *evp;
+	for (i = 0; i < frame->count; i++) {
+		if ((frame->events[i].code == power_keycode) &&
+		    (frame->events[i].value == 1))
+			power_pressed = TRUE;
+	}
 
 	disable_autorelock_policy();
 
-	if ((((submode & MCE_BOOTUP_SUBMODE) == 0) &&
-	    ((ev != NULL) &&
-	     (ev->code == power_keycode) && (ev->value == 1))) ||
+	if ((((submode & MCE_BOOTUP_SUBMODE) == 0) && power_pressed) ||
 	     is_eveater_enabled()) {
 		if (is_eveater_enabled()) {
 			mce_log(LL_DEBUG, "disable eveater (TRUE) - power key");
@@ -1692,8 +1699,10 @@ static void alarm_ui_state_trigger(gconstpointer data)
 				setup_dim_blank_timeout_policy(FALSE);
 				goto EXIT;
 			}
+			mce_begin_submode_transaction();
 			mce_add_submode_int32(MCE_TKLOCK_SUBMODE);
 			disable_eveater(TRUE);
+			mce_commit_submode_transaction();
 			if (open_tklock_ui(TKLOCK_ENABLE, TRUE) == FALSE) {
 				disable_tklock(TRUE);
 				goto EXIT;
@@ -1730,11 +1739,10 @@ static void alarm_ui_state_trigger(gconstpointer data)
 				disable_tklock(TRUE);
 				goto EXIT;
 			}
+			mce_begin_submode_transaction();
 			mce_rem_submode_int32(MCE_EVEATER_SUBMODE);
 			mce_rem_submode_int32(MCE_TKLOCK_SUBMODE);
-			/* Disable timeouts, just to be sure */
-			mce_rem_submode_int32(MCE_EVEATER_SUBMODE);
-			mce_rem_submode_int32(MCE_TKLOCK_SUBMODE);
+			mce_commit_submode_transaction();
 			/* Disable timeouts, just to be sure */
 			cancel_tklock_visual_forced_blank_timeout();
 			cancel_tklock_visual_blank_timeout();
@@ -1908,8 +1916,10 @@ static void call_state_trigger(gconstpointer data)
 						return;
 				}
 				mce_log(LL_DEBUG, "%s: %s: removing lock submodes", MODULE_NAME, __func__);
+				mce_begin_submode_transaction();
 				mce_rem_submode_int32(MCE_EVEATER_SUBMODE);
 				mce_rem_submode_int32(MCE_TKLOCK_SUBMODE);
+				mce_commit_submode_transaction();
 				/* Disable timeouts, just to be sure */
 				cancel_tklock_visual_forced_blank_timeout();
 				cancel_tklock_visual_blank_timeout();
@@ -1960,8 +1970,10 @@ static gboolean tklock_disable_timeout_cb(gpointer data)
 		cancel_tklock_visual_blank_timeout();
 		cancel_tklock_unlock_timeout();
 		cancel_tklock_dim_timeout();
+		mce_begin_submode_transaction();
 		mce_rem_submode_int32(MCE_VISUAL_TKLOCK_SUBMODE);
 		mce_rem_submode_int32(MCE_TKLOCK_SUBMODE);
+		mce_commit_submode_transaction();
 		(void)mce_send_tklock_mode(NULL);
 		(void)ts_event_control(TRUE);
 		synthesise_activity();
@@ -29,6 +29,7 @@
 #include <unistd.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <poll.h>
 #include <dsme/state.h>
 #include <dsme/messages.h>
 #include <dsme/protocol.h>
@@ -38,6 +39,7 @@
 #include "mce.h"
 #include "mce-lib.h"
 #include "mce-log.h"
+#include "mce-patterns.h"
 #include "mce-dbus.h"
 #include "mce-conf.h"
 #include "datapipe.h"
@@ -57,6 +59,9 @@ G_MODULE_EXPORT module_info_struct module_info = {
 
 #define TRANSITION_DELAY		1000		/**< 1 second */
 
+/** Largest number of DSME messages handled per main loop wakeup */
+#define DSME_MAX_MESSAGES_PER_WAKEUP	32
+
 #define MCE_CONF_SOFTPOWEROFF_GROUP	"SoftPowerOff"
 
 #define MCE_CONF_SOFTPOWEROFF_CONNECTIVITY_POLICY_CHARGER "ConnectivityPolicyCharger"
@@ -317,7 +322,7 @@ static void request_soft_poweron(void)
 {
 	/* Disable the soft poweroff LED pattern */
 	execute_datapipe_output_triggers(&led_pattern_deactivate_pipe,
-					 MCE_LED_PATTERN_DEVICE_SOFT_OFF,
+					 mce_pattern_data(MCE_LED_PATTERN_DEVICE_SOFT_OFF),
 					 USE_INDATA);
 
 	mce_rem_submode_int32(MCE_SOFTOFF_SUBMODE);
@@ -376,9 +381,7 @@ static void request_soft_poweroff(void)
 	mce_add_submode_int32(MCE_SOFTOFF_SUBMODE);
 
 	/* Enable the soft poweroff LED pattern */
-	gchar *pattern = g_strdup(MCE_LED_PATTERN_DEVICE_SOFT_OFF);
-	execute_datapipe(&led_pattern_activate_pipe, pattern, USE_INDATA, DONT_CACHE_INDATA);
-	g_free(pattern);
+	execute_datapipe(&led_pattern_activate_pipe, mce_pattern_data(MCE_LED_PATTERN_DEVICE_SOFT_OFF), USE_INDATA, DONT_CACHE_INDATA);
 }
 
 /**
@@ -496,9 +499,78 @@ static system_state_t normalise_dsme_state(dsme_state_t dsmestate)
 	return state;
 }
 
+/**
+ * Apply a DSME system state
+ *
+ * @param newstate The new system state
+ */
+static void apply_system_state(system_state_t newstate)
+{
+	system_state_t oldstate = datapipe_get_gint(system_state_pipe);
+
+	mce_log(LL_DEBUG,
+		"DSME device state change: %d",
+		newstate);
+
+	mce_begin_submode_transaction();
+
+	/* If we're changing to a different state,
+	 * add the transition flag, UNLESS the old state
+	 * was MCE_STATE_UNDEF
+	 */
+	if ((oldstate != newstate) && (oldstate != MCE_STATE_UNDEF))
+		mce_add_submode_int32(MCE_TRANSITION_SUBMODE);
+
+	switch (newstate) {
+	case MCE_STATE_USER:
+		execute_datapipe(&led_pattern_activate_pipe, mce_pattern_data(MCE_LED_PATTERN_DEVICE_ON), USE_INDATA, DONT_CACHE_INDATA);
+		break;
+
+	case MCE_STATE_ACTDEAD:
+	case MCE_STATE_BOOT:
+	case MCE_STATE_UNDEF:
+		mce_rem_submode_int32(MCE_MODECHG_SUBMODE);
+		break;
+
+	case MCE_STATE_SHUTDOWN:
+	case MCE_STATE_REBOOT:
+		mce_rem_submode_int32(MCE_MODECHG_SUBMODE);
+		execute_datapipe_output_triggers(&led_pattern_deactivate_pipe, mce_pattern_data(MCE_LED_PATTERN_DEVICE_ON), USE_INDATA);
+		break;
+
+	default:
+		break;
+	}
+
+	mce_commit_submode_transaction();
+
+	execute_datapipe(&system_state_pipe,
+			 GINT_TO_POINTER(newstate),
+			 USE_INDATA, CACHE_INDATA);
+}
+
+/**
+ * Check whether there is more data to read from dsmesock
+ *
+ * @return TRUE if a read will not block, FALSE otherwise
+ */
+static gboolean dsmesock_pending(void)
+{
+	struct pollfd pfd = {
+		.fd = dsme_conn->fd,
+		.events = POLLIN,
+	};
+
+	return ((poll(&pfd, 1, 0) == 1) && (pfd.revents & POLLIN));
+}
+
 /**
  * Callback for pending I/O from dsmesock
  *
+ * All pending messages are read in one go; process watchdog pings
+ * are answered as soon as they are read, while state changes
+ * are collapsed so that only the last one is applied
+ *
  * XXX: is the error policy reasonable?
  *
  * @param source Unused
@@ -510,10 +582,9 @@ static gboolean io_data_ready_cb(GIOChannel *source,
 				 GIOCondition condition,
 				 gpointer data)
 {
-	dsmemsg_generic_t *msg;
-	DSM_MSGTYPE_STATE_CHANGE_IND *msg2;
-	system_state_t oldstate = datapipe_get_gint(system_state_pipe);
 	system_state_t newstate = MCE_STATE_UNDEF;
+	gboolean state_changed = FALSE;
+	guint count = 0;
 
 	(void)source;
 	(void)condition;
@@ -522,70 +593,51 @@ static gboolean io_data_ready_cb(GIOChannel *source,
 	if (dsme_disabled == TRUE)
 		goto EXIT;
 
-	if ((msg = (dsmemsg_generic_t *)dsmesock_receive(dsme_conn)) == NULL)
-		goto EXIT;
-
-        if (DSMEMSG_CAST(DSM_MSGTYPE_CLOSE, msg)) {
-		/* DSME socket closed: try once to reopen;
-		 * if that fails, exit
-		 */
-		mce_log(LL_ERR,
-			"DSME socket closed; trying to reopen");
+	do {
+		DSM_MSGTYPE_STATE_CHANGE_IND *msg2;
+		dsmemsg_generic_t *msg;
 
-		if ((init_dsmesock()) == FALSE) {
-			g_main_loop_quit(mainloop);
-			exit(EXIT_FAILURE);
-		}
-        } else if (DSMEMSG_CAST(DSM_MSGTYPE_PROCESSWD_PING, msg)) {
-		dsme_send_pong();
-        } else if ((msg2 = DSMEMSG_CAST(DSM_MSGTYPE_STATE_CHANGE_IND, msg))) {
-		newstate = normalise_dsme_state(msg2->state);
-		mce_log(LL_DEBUG,
-			"DSME device state change: %d",
-			newstate);
-
-		/* If we're changing to a different state,
-		 * add the transition flag, UNLESS the old state
-		 * was MCE_STATE_UNDEF
-		 */
-		if ((oldstate != newstate) && (oldstate != MCE_STATE_UNDEF))
-			mce_add_submode_int32(MCE_TRANSITION_SUBMODE);
-
-		switch (newstate) {
-		case MCE_STATE_USER:
-		{
-			gchar *pattern = g_strdup(MCE_LED_PATTERN_DEVICE_ON);
-			execute_datapipe(&led_pattern_activate_pipe, pattern, USE_INDATA, DONT_CACHE_INDATA);
-			g_free(pattern);
+		if ((msg = (dsmemsg_generic_t *)dsmesock_receive(dsme_conn)) == NULL)
 			break;
-		}
 
-		case MCE_STATE_ACTDEAD:
-		case MCE_STATE_BOOT:
-		case MCE_STATE_UNDEF:
-			mce_rem_submode_int32(MCE_MODECHG_SUBMODE);
-			break;
+		count++;
 
-		case MCE_STATE_SHUTDOWN:
-		case MCE_STATE_REBOOT:
-			mce_rem_submode_int32(MCE_MODECHG_SUBMODE);
-			execute_datapipe_output_triggers(&led_pattern_deactivate_pipe, MCE_LED_PATTERN_DEVICE_ON, USE_INDATA);
-			break;
+		if (DSMEMSG_CAST(DSM_MSGTYPE_CLOSE, msg)) {
+			free(msg);
+
+			/* DSME socket closed: try once to reopen;
+			 * if that fails, exit
+			 */
+			mce_log(LL_ERR,
+				"DSME socket closed; trying to reopen");
+
+			if ((init_dsmesock()) == FALSE) {
+				g_main_loop_quit(mainloop);
+				exit(EXIT_FAILURE);
+			}
 
-		default:
 			break;
+		} else if (DSMEMSG_CAST(DSM_MSGTYPE_PROCESSWD_PING, msg)) {
+			dsme_send_pong();
+		} else if ((msg2 = DSMEMSG_CAST(DSM_MSGTYPE_STATE_CHANGE_IND, msg))) {
+			newstate = normalise_dsme_state(msg2->state);
+			state_changed = TRUE;
+		} else {
+			mce_log(LL_DEBUG,
+				"Unknown message type (%x) received from DSME!",
+				msg->type_); /* <- unholy access of a private member */
 		}
 
-		execute_datapipe(&system_state_pipe,
-				 GINT_TO_POINTER(newstate),
-				 USE_INDATA, CACHE_INDATA);
-        } else {
+		free(msg);
+	} while ((count < DSME_MAX_MESSAGES_PER_WAKEUP) &&
+		 (dsmesock_pending() == TRUE));
+
+	if (count > 1)
 		mce_log(LL_DEBUG,
-			"Unknown message type (%x) received from DSME!",
-			msg->type_); /* <- unholy access of a private member */
-	}
+			"Read %u messages from DSME", count);
 
-	free(msg);
+	if (state_changed == TRUE)
+		apply_system_state(newstate);
 
 EXIT:
 	return TRUE;
@@ -4,6 +4,7 @@
 #include "mce.h"
 #include "mce-log.h"
 #include "datapipe.h"
+#include "mce-spawn.h"
 
 
 #define MODULE_NAME		"power-generic"
@@ -18,6 +19,9 @@ G_MODULE_EXPORT module_info_struct module_info = {
 	.priority = 100
 };
 
+static const gchar *const poweroff_argv[] = { "poweroff", NULL };
+static const gchar *const reboot_argv[] = { "reboot", NULL };
+
 static void system_power_request_trigger(gconstpointer data)
 {
 	power_req_t request = (power_req_t)data;
@@ -34,13 +38,13 @@ static void system_power_request_trigger(gconstpointer data)
 		case MCE_POWER_REQ_OFF:
 		case MCE_POWER_REQ_SOFT_OFF:
 			execute_datapipe(&system_state_pipe, GINT_TO_POINTER(MCE_STATE_SHUTDOWN), USE_INDATA, CACHE_INDATA);
-			if (system("poweroff") < 0)
-				mce_log(LL_WARN, "%s: Could not shutdown system() failed", MODULE_NAME);
+			if (mce_spawn(poweroff_argv, NULL, NULL) == NULL)
+				mce_log(LL_WARN, "%s: Could not shutdown", MODULE_NAME);
 			break;
 		case MCE_POWER_REQ_REBOOT:
 			execute_datapipe(&system_state_pipe, GINT_TO_POINTER(MCE_STATE_SHUTDOWN), USE_INDATA, CACHE_INDATA);
-			if (system("reboot") < 0)
-				mce_log(LL_WARN, "%s: Could not reboot system() failed", MODULE_NAME);
+			if (mce_spawn(reboot_argv, NULL, NULL) == NULL)
+				mce_log(LL_WARN, "%s: Could not reboot", MODULE_NAME);
 			break;
 		case MCE_POWER_REQ_UNDEF:
 		default:
@@ -14,7 +14,6 @@
 #include "datapipe.h"
 #include "mce-conf.h"
 
-#define CPU1_ONLINE_PATH	"/sys/devices/system/cpu/cpu1/online"
 #define GSMTTY1_PATH 		"/dev/gsmtty1"
 
 #define MODULE_NAME		"quirks-mapphone"
@@ -30,7 +29,6 @@ G_MODULE_EXPORT module_info_struct module_info = {
 
 static guint kick_timeout_cb_id = 0;
 static display_state_t display_state;
-static bool offline_cpu;
 static GCancellable *cancellable = NULL;
 
 static void modem_close_cb(GObject *source_object, GAsyncResult *res,
@@ -112,7 +110,6 @@ static void display_state_trigger(gconstpointer data)
 {
 	display_state_t new_state = GPOINTER_TO_INT(data);
 	display_state_t old_state = display_state;
-	int fd;
 
 	if (new_state == old_state)
 		return;
@@ -136,41 +133,6 @@ static void display_state_trigger(gconstpointer data)
 	g_file_append_to_async(file, G_FILE_CREATE_NONE, 0, cancellable,
 			       modem_append_cb, GINT_TO_POINTER(display_state));
 	g_object_unref(file);
-
-	if (offline_cpu) {
-		fd = open(CPU1_ONLINE_PATH, O_WRONLY);
-
-		if (fd < 0) {
-			mce_log(LL_WARN, "%s: can not open "
-				CPU1_ONLINE_PATH, MODULE_NAME);
-		} else {
-			if (display_state == MCE_DISPLAY_ON) {
-				const char *const msg = "1";
-
-				mce_log(LL_DEBUG, "%s: Turning on cpu1",
-					MODULE_NAME);
-
-				if (write(fd, msg, strlen(msg)) < 0) {
-					mce_log(LL_WARN,
-						"%s: can not turn on cpu1",
-						MODULE_NAME);
-				}
-			} else {
-				const char *const msg = "0";
-
-				mce_log(LL_DEBUG, "%s: Turning off cpu1",
-					MODULE_NAME);
-
-				if (write(fd, msg, strlen(msg)) < 0) {
-					mce_log(LL_WARN,
-						"%s: can not turn off cpu1",
-						MODULE_NAME);
-				}
-			}
-
-			close(fd);
-		}
-	}
 }
 
 static gboolean inactivity_timeout_cb(gpointer data)
@@ -207,8 +169,6 @@ const char *g_module_check_init(GModule * module)
 	kick_timeout_cb_id = g_timeout_add_seconds(600, inactivity_timeout_cb, NULL);
 	inactivity_timeout_cb(NULL);
 
-	offline_cpu = mce_conf_get_bool("QuirksMapphone", "OfflineCpu", true, NULL);
-
 	return NULL;
 }
 
@@ -23,13 +23,18 @@ G_MODULE_EXPORT module_info_struct module_info = {
 };
 
 static GSettings *gsettings_client = NULL;
-static GList *gsettings_notifiers = NULL;
+
+/** Map from gsettings key to the list of notifiers for it */
+static GHashTable *gsettings_notifiers = NULL;
+
+/** Map from callback ID to notifier */
+static GHashTable *gsettings_notifier_ids = NULL;
 
 struct notifier {
 	guint callback_id;
 	mce_rtconf_callback callback;
 	void *user_data;
-	const gchar* key;
+	gchar *key;
 };
 
 static gchar *mce_gsettings_translate_key(const gchar * const key)
@@ -84,18 +89,20 @@ static gboolean mce_gsettings_get_int(const gchar * const key, gint * value)
 
 static void mce_gsettings_callback(GSettings *client, gchar* key, gpointer user_data)
 {
-	struct notifier *not;
-	GList *l;
+	GSList *l;
 
 	(void)user_data;
 	(void)client;
 
-	for (l = gsettings_notifiers; l != NULL; l = l->next) {
-		not = (struct notifier *)l->data;
-		if (g_strcmp0(not->key, key) == 0) {
-			not->callback(not->key, not->callback_id, not->user_data);
-			break;
-		}
+	l = g_hash_table_lookup(gsettings_notifiers, key);
+
+	while (l != NULL) {
+		struct notifier *not = l->data;
+
+		/* The callback may remove its own notifier */
+		l = l->next;
+
+		not->callback(not->key, not->callback_id, not->user_data);
 	}
 }
 
@@ -113,6 +120,7 @@ static gboolean mce_gsettings_notifier_add(const gchar * key,
 {
 	static int cb_id_counter = 0;
 	struct notifier *not = g_malloc0(sizeof(*not));
+	GSList *list;
 	
 	*cb_id = cb_id_counter++;
 
@@ -121,7 +129,12 @@ static gboolean mce_gsettings_notifier_add(const gchar * key,
 	not->user_data = user_data;
 	not->key = mce_gsettings_translate_key(key);
 
-	gsettings_notifiers = g_list_prepend(gsettings_notifiers, not);
+	list = g_hash_table_lookup(gsettings_notifiers, not->key);
+	list = g_slist_prepend(list, not);
+	g_hash_table_insert(gsettings_notifiers, g_strdup(not->key), list);
+
+	g_hash_table_insert(gsettings_notifier_ids,
+			    GUINT_TO_POINTER(not->callback_id), not);
 
 	return TRUE;
 }
@@ -134,15 +147,28 @@ static gboolean mce_gsettings_notifier_add(const gchar * key,
  */
 static void mce_gsettings_notifier_remove(guint cb_id)
 {
-	GList *l;
-
-	for (l = gsettings_notifiers; l != NULL; l = l->next) {
-		if (((struct notifier *)l->data)->callback_id == cb_id) {
-			gsettings_notifiers = g_list_remove(gsettings_notifiers, l->data);
-			g_free(l->data);
-			break;
-		}
-	}
+	struct notifier *not;
+	GSList *list;
+
+	not = g_hash_table_lookup(gsettings_notifier_ids,
+				  GUINT_TO_POINTER(cb_id));
+
+	if (not == NULL)
+		return;
+
+	g_hash_table_remove(gsettings_notifier_ids, GUINT_TO_POINTER(cb_id));
+
+	list = g_hash_table_lookup(gsettings_notifiers, not->key);
+	list = g_slist_remove(list, not);
+
+	if (list != NULL)
+		g_hash_table_insert(gsettings_notifiers,
+				    g_strdup(not->key), list);
+	else
+		g_hash_table_remove(gsettings_notifiers, not->key);
+
+	g_free(not->key);
+	g_free(not);
 }
 
 /**
@@ -156,6 +182,11 @@ const gchar *g_module_check_init(GModule * module)
 {
 	(void)module;
 
+	gsettings_notifiers = g_hash_table_new_full(g_str_hash, g_str_equal,
+						    g_free, NULL);
+	gsettings_notifier_ids = g_hash_table_new(g_direct_hash,
+						  g_direct_equal);
+
 	/* Get the default gesettings client */
 	if ((gsettings_client = g_settings_new("com.nokia.mce")) == FALSE) {
 		mce_log(LL_CRIT, "Could not connect to gesettings");
@@ -175,10 +206,25 @@ const gchar *g_module_check_init(GModule * module)
 	return NULL;
 }
 
-static void mce_gsettings_notifier_remove_cb(gpointer cb_id, gpointer user_data)
+static void mce_gsettings_notifier_free_cb(gpointer key, gpointer value,
+					   gpointer user_data)
 {
+	struct notifier *not = value;
+
+	(void)key;
 	(void)user_data;
-	mce_gsettings_notifier_remove(GPOINTER_TO_INT(cb_id));
+
+	g_free(not->key);
+	g_free(not);
+}
+
+static void mce_gsettings_list_free_cb(gpointer key, gpointer value,
+				       gpointer user_data)
+{
+	(void)key;
+	(void)user_data;
+
+	g_slist_free(value);
 }
 
 /**
@@ -190,11 +236,17 @@ void g_module_unload(GModule * module)
 	(void)module;
 
 	if (gsettings_client != NULL) {
-		/* Free the list of gesettings notifiers */
-		if (gsettings_notifiers != NULL) {
-			g_list_foreach(gsettings_notifiers, (GFunc) mce_gsettings_notifier_remove_cb, NULL);
-			gsettings_notifiers = NULL;
-		}
+		/* Free the gesettings notifiers */
+		g_hash_table_foreach(gsettings_notifier_ids,
+				     mce_gsettings_notifier_free_cb, NULL);
+		g_hash_table_destroy(gsettings_notifier_ids);
+		gsettings_notifier_ids = NULL;
+
+		/* The lists only point to the notifiers freed above */
+		g_hash_table_foreach(gsettings_notifiers,
+				     mce_gsettings_list_free_cb, NULL);
+		g_hash_table_destroy(gsettings_notifiers);
+		gsettings_notifiers = NULL;
 
 		/* Unreference gesettings client */
 		g_object_unref(gsettings_client);
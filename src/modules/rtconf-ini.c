@@ -1,5 +1,10 @@
 #include <glib.h>
+#include <gio/gio.h>
 #include <gmodule.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
 #include "mce.h"
 #include "mce-conf.h"
 #include "mce-rtconf.h"
@@ -22,17 +27,315 @@ G_MODULE_EXPORT module_info_struct module_info = {
 	.priority = 250
 };
 
-#define RTCONF_INI_KEY_FILE_PATH "/etc/mce/rtconf.ini"
+/** Default settings; a packaged file, so it is never written */
+#define RTCONF_INI_KEY_FILE_PATH G_STRINGIFY(MCE_CONF_DIR) "/rtconf.ini"
+/** Directory for the settings changed at runtime */
+#define RTCONF_INI_STATE_DIR G_STRINGIFY(MCE_VAR_DIR)
+/** Settings changed at runtime; they override the defaults */
+#define RTCONF_INI_STATE_FILE_PATH RTCONF_INI_STATE_DIR "/rtconf.ini"
 #define RTCONF_INI_GROUP "Rtconf"
 
+/** Delay from the first unsaved change to writing the file; [ms] */
+#define RTCONF_INI_WRITE_DELAY		1000
+
+/** Delay from a change of the file on disk to reloading it; [ms] */
+#define RTCONF_INI_RELOAD_DELAY		100
+
+/** Effective settings; the defaults with the changed settings applied */
 static gpointer keyfile;
 
-static gboolean rtconf_ini_set_int(const gchar * const key, const gint value)
+/** Settings changed at runtime, saved or not */
+static GKeyFile *state_keyfile = NULL;
+
+/** Changes not saved yet; key to value */
+static GHashTable *unsaved = NULL;
+
+/** Monitor for changes of the defaults on disk */
+static GFileMonitor *keyfile_monitor = NULL;
+
+/** Monitor for changes of the saved settings on disk */
+static GFileMonitor *state_keyfile_monitor = NULL;
+
+/** ID for the write-behind timeout */
+static guint write_cb_id = 0;
+
+/** ID for the reload timeout */
+static guint reload_cb_id = 0;
+
+/** Registered notifiers */
+static GSList *rtconf_ini_notifiers = NULL;
+
+/** Nesting depth of notifier dispatch */
+static guint rtconf_ini_notify_depth = 0;
+
+struct notifier {
+	guint callback_id;
+	mce_rtconf_callback callback;
+	void *user_data;
+	gchar *key;
+	/** Removed during dispatch; freed once dispatch has finished */
+	gboolean removed;
+};
+
+/**
+ * Free a notifier
+ *
+ * @param not The notifier to free
+ */
+static void rtconf_ini_notifier_free(struct notifier *not)
 {
-	if(!keyfile)
+	g_free(not->key);
+	g_free(not);
+}
+
+/**
+ * Free the notifiers that were removed during dispatch
+ */
+static void rtconf_ini_notifier_purge(void)
+{
+	GSList *l = rtconf_ini_notifiers;
+
+	while (l != NULL) {
+		GSList *next = l->next;
+		struct notifier *not = l->data;
+
+		if (not->removed == TRUE) {
+			rtconf_ini_notifiers =
+				g_slist_delete_link(rtconf_ini_notifiers, l);
+			rtconf_ini_notifier_free(not);
+		}
+
+		l = next;
+	}
+}
+
+/**
+ * Call the notifiers registered for a key
+ *
+ * Callbacks may add or remove any notifier; removed notifiers
+ * are only marked during dispatch, and freed once it has finished
+ *
+ * @param key The key that changed
+ */
+static void rtconf_ini_notify(const gchar *const key)
+{
+	GSList *l;
+
+	mce_log(LL_DEBUG, "%s: %s changed", MODULE_NAME, key);
+
+	rtconf_ini_notify_depth++;
+
+	for (l = rtconf_ini_notifiers; l != NULL; l = l->next) {
+		struct notifier *not = l->data;
+
+		if (not->removed == FALSE && g_strcmp0(not->key, key) == 0)
+			not->callback(not->key, not->callback_id, not->user_data);
+	}
+
+	if (--rtconf_ini_notify_depth == 0)
+		rtconf_ini_notifier_purge();
+}
+
+/**
+ * Sync a directory, so that a rename in it survives a power loss
+ *
+ * @param path The directory
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean rtconf_ini_sync_dir(const gchar *const path)
+{
+	gboolean status = FALSE;
+	int fd;
+
+	if ((fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1) {
+		mce_log(LL_ERR, "%s: Cannot open %s; %s",
+			MODULE_NAME, path, g_strerror(errno));
+		goto EXIT;
+	}
+
+	if (fsync(fd) == -1) {
+		mce_log(LL_ERR, "%s: Cannot sync %s; %s",
+			MODULE_NAME, path, g_strerror(errno));
+		goto EXIT;
+	}
+
+	status = TRUE;
+
+EXIT:
+	if (fd != -1)
+		close(fd);
+
+	return status;
+}
+
+/**
+ * Write the changed settings to disk;
+ * the file is written to a temporary file that is then renamed,
+ * so a crash or power loss cannot leave a partial file behind
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean rtconf_ini_write(void)
+{
+	static const gchar tmppath[] = RTCONF_INI_STATE_FILE_PATH ".tmp";
+	gboolean status = FALSE;
+	gchar *data = NULL;
+	gsize length = 0;
+	gsize written = 0;
+	int fd = -1;
+
+	if ((data = g_key_file_to_data(state_keyfile, &length, NULL)) == NULL)
+		goto EXIT;
+
+	if ((fd = open(tmppath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+		       0644)) == -1) {
+		mce_log(LL_ERR, "%s: Cannot open %s; %s",
+			MODULE_NAME, tmppath, g_strerror(errno));
+		goto EXIT;
+	}
+
+	while (written < length) {
+		ssize_t rc = write(fd, data + written, length - written);
+
+		if (rc == -1) {
+			if (errno == EINTR)
+				continue;
+
+			mce_log(LL_ERR, "%s: Cannot write %s; %s",
+				MODULE_NAME, tmppath, g_strerror(errno));
+			goto EXIT;
+		}
+
+		written += rc;
+	}
+
+	if (fsync(fd) == -1) {
+		mce_log(LL_ERR, "%s: Cannot sync %s; %s",
+			MODULE_NAME, tmppath, g_strerror(errno));
+		goto EXIT;
+	}
+
+	if (close(fd) == -1) {
+		fd = -1;
+		mce_log(LL_ERR, "%s: Cannot close %s; %s",
+			MODULE_NAME, tmppath, g_strerror(errno));
+		goto EXIT;
+	}
+
+	fd = -1;
+
+	if (rename(tmppath, RTCONF_INI_STATE_FILE_PATH) == -1) {
+		mce_log(LL_ERR, "%s: Cannot rename %s to %s; %s",
+			MODULE_NAME, tmppath, RTCONF_INI_STATE_FILE_PATH,
+			g_strerror(errno));
+		goto EXIT;
+	}
+
+	if (rtconf_ini_sync_dir(RTCONF_INI_STATE_DIR) == FALSE)
+		goto EXIT;
+
+	g_hash_table_remove_all(unsaved);
+
+	mce_log(LL_DEBUG, "%s: %s written", MODULE_NAME,
+		RTCONF_INI_STATE_FILE_PATH);
+
+	status = TRUE;
+
+EXIT:
+	if (fd != -1) {
+		close(fd);
+		unlink(tmppath);
+	}
+
+	g_free(data);
+
+	return status;
+}
+
+static void rtconf_ini_reload(void);
+
+/**
+ * Write out the unsaved changes; a reload that is still
+ * waiting for things to settle is done first, so that
+ * changes made to the file on disk are not overwritten
+ */
+static void rtconf_ini_flush(void)
+{
+	if (reload_cb_id != 0) {
+		g_source_remove(reload_cb_id);
+		reload_cb_id = 0;
+		rtconf_ini_reload();
+	}
+
+	rtconf_ini_write();
+}
+
+/**
+ * Timeout callback for the write-behind
+ *
+ * @param data Unused
+ * @return Always returns FALSE, to disable the timeout
+ */
+static gboolean rtconf_ini_write_cb(gpointer data)
+{
+	(void)data;
+
+	write_cb_id = 0;
+	rtconf_ini_flush();
+
+	return FALSE;
+}
+
+/**
+ * Schedule writing the key file to disk;
+ * changes made before the write happens are written together
+ */
+static void rtconf_ini_schedule_write(void)
+{
+	if (write_cb_id == 0)
+		write_cb_id = g_timeout_add(RTCONF_INI_WRITE_DELAY,
+					    rtconf_ini_write_cb, NULL);
+}
+
+/**
+ * Set the value of a key, notify about the change,
+ * and schedule writing the key file
+ *
+ * @param key The key to set
+ * @param value The value as a string
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean rtconf_ini_set_value(const gchar *const key,
+				     const gchar *const value)
+{
+	gchar *old;
+
+	if (!keyfile)
 		return FALSE;
 
-	return mce_conf_set_int(RTCONF_INI_GROUP, key, value, keyfile);
+	old = g_key_file_get_value(keyfile, RTCONF_INI_GROUP, key, NULL);
+
+	if (g_strcmp0(old, value) != 0) {
+		g_key_file_set_value(keyfile, RTCONF_INI_GROUP, key, value);
+		g_key_file_set_value(state_keyfile, RTCONF_INI_GROUP,
+				     key, value);
+		g_hash_table_replace(unsaved, g_strdup(key), g_strdup(value));
+		rtconf_ini_schedule_write();
+		rtconf_ini_notify(key);
+	}
+
+	g_free(old);
+
+	return TRUE;
+}
+
+static gboolean rtconf_ini_set_int(const gchar * const key, const gint value)
+{
+	gchar buf[16];
+
+	g_snprintf(buf, sizeof buf, "%d", value);
+
+	return rtconf_ini_set_value(key, buf);
 }
 
 static gboolean rtconf_ini_get_bool(const gchar * const key, gboolean * value)
@@ -48,10 +351,7 @@ static gboolean rtconf_ini_get_bool(const gchar * const key, gboolean * value)
 
 static gboolean rtconf_ini_set_bool(const gchar * const key, const gboolean value)
 {
-	if(!keyfile)
-		return FALSE;
-
-	return mce_conf_set_bool(RTCONF_INI_GROUP, key, value, keyfile);
+	return rtconf_ini_set_value(key, value ? "true" : "false");
 }
 
 static gboolean rtconf_ini_get_int(const gchar * const key, gint * value)
@@ -65,19 +365,272 @@ static gboolean rtconf_ini_get_int(const gchar * const key, gint * value)
 	return TRUE;
 }
 
+/**
+ * Add a notifier
+ *
+ * @param key The key to add the notifier for
+ * @param callback The callback function
+ * @param user_data Data to pass to the callback
+ * @param[out] cb_id Will contain the callback ID on return
+ * @return TRUE on success, FALSE on failure
+ */
 static gboolean rtconf_ini_notifier_add(const gchar * key,
 				       const mce_rtconf_callback callback, void *user_data, guint *cb_id)
 {
-	(void)key;
-	(void)callback;
-	(void)user_data;
-	(void)cb_id;
+	static guint cb_id_counter = 0;
+	struct notifier *not = g_malloc0(sizeof(*not));
+
+	/* 0 is never a valid callback ID */
+	*cb_id = ++cb_id_counter;
+
+	not->callback_id = *cb_id;
+	not->callback = callback;
+	not->user_data = user_data;
+	not->key = g_strdup(key);
+
+	rtconf_ini_notifiers = g_slist_prepend(rtconf_ini_notifiers, not);
+
 	return TRUE;
 }
 
+/**
+ * Remove a notifier
+ *
+ * @param cb_id The ID of the notifier to remove
+ */
 static void rtconf_ini_notifier_remove(guint cb_id)
 {
-	(void)cb_id;
+	GSList *l;
+
+	for (l = rtconf_ini_notifiers; l != NULL; l = l->next) {
+		struct notifier *not = l->data;
+
+		if (not->callback_id != cb_id || not->removed == TRUE)
+			continue;
+
+		if (rtconf_ini_notify_depth > 0) {
+			not->removed = TRUE;
+		} else {
+			rtconf_ini_notifiers =
+				g_slist_delete_link(rtconf_ini_notifiers, l);
+			rtconf_ini_notifier_free(not);
+		}
+
+		break;
+	}
+}
+
+/**
+ * Notify about the keys that differ between two key files
+ *
+ * @param old The key file before the reload
+ * @param new The reloaded key file
+ */
+static void rtconf_ini_diff(GKeyFile *old, GKeyFile *new)
+{
+	gchar **keys;
+	gchar **oldkeys;
+	gsize i;
+
+	keys = g_key_file_get_keys(new, RTCONF_INI_GROUP, NULL, NULL);
+	oldkeys = g_key_file_get_keys(old, RTCONF_INI_GROUP, NULL, NULL);
+
+	/* Changed and added keys */
+	for (i = 0; keys && keys[i]; i++) {
+		gchar *oldval = g_key_file_get_value(old, RTCONF_INI_GROUP,
+						     keys[i], NULL);
+		gchar *newval = g_key_file_get_value(new, RTCONF_INI_GROUP,
+						     keys[i], NULL);
+
+		if (g_strcmp0(oldval, newval) != 0)
+			rtconf_ini_notify(keys[i]);
+
+		g_free(oldval);
+		g_free(newval);
+	}
+
+	/* Removed keys */
+	for (i = 0; oldkeys && oldkeys[i]; i++) {
+		if (g_key_file_has_key(new, RTCONF_INI_GROUP,
+				       oldkeys[i], NULL) == FALSE)
+			rtconf_ini_notify(oldkeys[i]);
+	}
+
+	g_strfreev(keys);
+	g_strfreev(oldkeys);
+}
+
+/**
+ * Read the settings changed at runtime, with the unsaved
+ * changes applied on top; a missing file means no changes
+ *
+ * @return The changed settings
+ */
+static GKeyFile *rtconf_ini_read_state(void)
+{
+	GKeyFile *state = g_key_file_new();
+	GError *error = NULL;
+	GHashTableIter iter;
+	gpointer key;
+	gpointer value;
+
+	if ((g_key_file_load_from_file(state, RTCONF_INI_STATE_FILE_PATH,
+				       G_KEY_FILE_NONE, &error) == FALSE) &&
+	    (g_error_matches(error, G_FILE_ERROR,
+			     G_FILE_ERROR_NOENT) == FALSE)) {
+		mce_log(LL_WARN, "%s: Could not load %s; %s",
+			MODULE_NAME, RTCONF_INI_STATE_FILE_PATH,
+			error->message);
+	}
+
+	g_clear_error(&error);
+
+	/* Our own unsaved changes win over the file on disk */
+	g_hash_table_iter_init(&iter, unsaved);
+
+	while (g_hash_table_iter_next(&iter, &key, &value) == TRUE)
+		g_key_file_set_value(state, RTCONF_INI_GROUP, key, value);
+
+	return state;
+}
+
+/**
+ * Read the defaults and the changed settings,
+ * and combine them into the effective settings
+ *
+ * @param[out] state Will contain the changed settings on success
+ * @return The effective settings, or NULL on failure
+ */
+static gpointer rtconf_ini_read(GKeyFile **state)
+{
+	gpointer newkeyfile;
+	gchar **keys;
+	gsize i;
+
+	if ((newkeyfile = mce_conf_read_conf_file(RTCONF_INI_KEY_FILE_PATH)) == NULL)
+		goto EXIT;
+
+	*state = rtconf_ini_read_state();
+	keys = g_key_file_get_keys(*state, RTCONF_INI_GROUP, NULL, NULL);
+
+	for (i = 0; keys && keys[i]; i++) {
+		gchar *value = g_key_file_get_value(*state, RTCONF_INI_GROUP,
+						    keys[i], NULL);
+
+		g_key_file_set_value(newkeyfile, RTCONF_INI_GROUP,
+				     keys[i], value);
+		g_free(value);
+	}
+
+	g_strfreev(keys);
+
+EXIT:
+	return newkeyfile;
+}
+
+/**
+ * Reload the settings from disk, and notify about the changes
+ */
+static void rtconf_ini_reload(void)
+{
+	GKeyFile *newstate = NULL;
+	gpointer newkeyfile;
+	gpointer oldkeyfile;
+
+	if ((newkeyfile = rtconf_ini_read(&newstate)) == NULL)
+		goto EXIT;
+
+	mce_log(LL_DEBUG, "%s: settings reloaded", MODULE_NAME);
+
+	g_key_file_free(state_keyfile);
+	state_keyfile = newstate;
+
+	/* Swap before notifying, so that the notifiers see the new values */
+	oldkeyfile = keyfile;
+	keyfile = newkeyfile;
+
+	rtconf_ini_diff(oldkeyfile, newkeyfile);
+
+	mce_conf_free_conf_file(oldkeyfile);
+
+EXIT:
+	return;
+}
+
+/**
+ * Timeout callback for reloading the settings
+ *
+ * @param data Unused
+ * @return Always returns FALSE, to disable the timeout
+ */
+static gboolean rtconf_ini_reload_cb(gpointer data)
+{
+	(void)data;
+
+	reload_cb_id = 0;
+	rtconf_ini_reload();
+
+	return FALSE;
+}
+
+/**
+ * Callback for changes of the key file on disk
+ *
+ * @param monitor Unused
+ * @param file Unused
+ * @param other_file Unused
+ * @param event The type of change
+ * @param data Unused
+ */
+static void rtconf_ini_changed_cb(GFileMonitor *monitor, GFile *file,
+				  GFile *other_file, GFileMonitorEvent event,
+				  gpointer data)
+{
+	(void)monitor;
+	(void)file;
+	(void)other_file;
+	(void)data;
+
+	if ((event != G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT) &&
+	    (event != G_FILE_MONITOR_EVENT_CREATED))
+		return;
+
+	/* Editors and package managers tend to touch the file
+	 * several times in a row; reload once things have settled
+	 */
+	if (reload_cb_id != 0)
+		g_source_remove(reload_cb_id);
+
+	reload_cb_id = g_timeout_add(RTCONF_INI_RELOAD_DELAY,
+				     rtconf_ini_reload_cb, NULL);
+}
+
+/**
+ * Monitor a settings file for changes
+ *
+ * @param path The file to monitor
+ * @return The file monitor, or NULL on failure
+ */
+static GFileMonitor *rtconf_ini_monitor(const gchar *const path)
+{
+	GFileMonitor *monitor;
+	GFile *file;
+
+	/* GIO monitors local files with inotify */
+	file = g_file_new_for_path(path);
+	monitor = g_file_monitor_file(file, G_FILE_MONITOR_NONE, NULL, NULL);
+	g_object_unref(file);
+
+	if (monitor != NULL) {
+		g_signal_connect(G_OBJECT(monitor), "changed",
+				 G_CALLBACK(rtconf_ini_changed_cb), NULL);
+	} else {
+		mce_log(LL_WARN, "%s: Cannot monitor %s; changes will "
+			"not be picked up until restart",
+			MODULE_NAME, path);
+	}
+
+	return monitor;
 }
 
 /**
@@ -91,7 +644,9 @@ const gchar *g_module_check_init(GModule * module)
 {
 	(void)module;
 
-	keyfile = mce_conf_read_conf_file(RTCONF_INI_KEY_FILE_PATH);
+	unsaved = g_hash_table_new_full(g_str_hash, g_str_equal,
+					g_free, g_free);
+	keyfile = rtconf_ini_read(&state_keyfile);
 
 	if (!keyfile) {
 		mce_log(LL_WARN, "%s: %s not available", MODULE_NAME, RTCONF_INI_KEY_FILE_PATH);
@@ -103,6 +658,10 @@ const gchar *g_module_check_init(GModule * module)
 									 rtconf_ini_notifier_remove)) {
 		mce_log(LL_WARN, "Could not set rtconf-ini as rtconf backend");
 		return "Could not set rtconf-ini as rtconf backend";
+	} else {
+		keyfile_monitor = rtconf_ini_monitor(RTCONF_INI_KEY_FILE_PATH);
+		state_keyfile_monitor =
+			rtconf_ini_monitor(RTCONF_INI_STATE_FILE_PATH);
 	}
 
 	return NULL;
@@ -116,8 +675,42 @@ void g_module_unload(GModule * module)
 {
 	(void)module;
 
+	/* Write out any unsaved changes */
+	if (write_cb_id != 0) {
+		g_source_remove(write_cb_id);
+		write_cb_id = 0;
+		rtconf_ini_flush();
+	}
+
+	if (keyfile_monitor != NULL) {
+		g_file_monitor_cancel(keyfile_monitor);
+		g_object_unref(keyfile_monitor);
+		keyfile_monitor = NULL;
+	}
+
+	if (state_keyfile_monitor != NULL) {
+		g_file_monitor_cancel(state_keyfile_monitor);
+		g_object_unref(state_keyfile_monitor);
+		state_keyfile_monitor = NULL;
+	}
+
+	if (reload_cb_id != 0) {
+		g_source_remove(reload_cb_id);
+		reload_cb_id = 0;
+	}
+
+	g_slist_free_full(rtconf_ini_notifiers,
+			  (GDestroyNotify)rtconf_ini_notifier_free);
+	rtconf_ini_notifiers = NULL;
+
 	if (keyfile)
 		mce_conf_free_conf_file(keyfile);
 
+	if (state_keyfile != NULL)
+		g_key_file_free(state_keyfile);
+
+	if (unsaved != NULL)
+		g_hash_table_destroy(unsaved);
+
 	mce_rtconf_backend_unregister();
 }
@@ -22,6 +22,7 @@
 #include <stdbool.h>
 #include "mce.h"
 #include "mce-log.h"
+#include "mce-patterns.h"
 #include "mce-dbus.h"
 #include "datapipe.h"
 
@@ -80,7 +81,7 @@ static gboolean desktop_startup_dbus_cb(DBusMessage *const msg)
 	mce_log(LL_DEBUG, "Received desktop startup notification");
 
 	execute_datapipe_output_triggers(&led_pattern_deactivate_pipe,
-					 MCE_LED_PATTERN_POWER_ON, USE_INDATA);
+					 mce_pattern_data(MCE_LED_PATTERN_POWER_ON), USE_INDATA);
 	mce_rem_submode_int32(MCE_BOOTUP_SUBMODE);
 
 	/* Start inactivity timeout */
@@ -21,7 +21,9 @@
 #include <glib.h>
 #include <gmodule.h>
 #include <stdbool.h>
+#include <mce/mode-names.h>
 #include "mce.h"
+#include "mce-lib.h"
 #include "mce-log.h"
 #include "mce-dbus.h"
 #include "mce-rtconf.h"
@@ -44,6 +46,90 @@ G_MODULE_EXPORT module_info_struct module_info = {
 };
 
 static gconstpointer keyboard_status_cookie;
+static gconstpointer all_state_cookie;
+
+/** Mapping of submode bit <-> lock mode string; same for the device lock */
+static const mce_translation_t lock_mode_translation[] = {
+	{
+		.number = TRUE,
+		.string = MCE_TK_LOCKED
+	}, { /* MCE_INVALID_TRANSLATION marks the end of this array */
+		.number = MCE_INVALID_TRANSLATION,
+		.string = MCE_TK_UNLOCKED
+	}
+};
+
+/** One value in the get_all_state snapshot */
+typedef struct {
+	/** Key in the reply */
+	const gchar *key;
+	/** Datapipe the value is cached in */
+	datapipe_struct *datapipe;
+	/** Submode bit to report, for values taken from submode_pipe */
+	submode_t submode;
+	/** Bits of the cached value to report; 0 for all */
+	gint mask;
+	/** D-Bus type of the value; DBUS_TYPE_STRING, INT32 or BOOLEAN */
+	int type;
+	/** Translation to a string, for DBUS_TYPE_STRING values */
+	const mce_translation_t *translation;
+	/** Value when the generation was last bumped */
+	gint value;
+	/** Generation in which the value last changed */
+	guint generation;
+} state_entry_t;
+
+/**
+ * The values in the get_all_state snapshot;
+ * booleans are TRUE when the cached value is positive,
+ * so that undefined states report FALSE
+ */
+static state_entry_t state_entries[] = {
+	{ "device_mode", &mode_pipe, 0, 0,
+	  DBUS_TYPE_STRING, mce_device_mode_translation, 0, 0 },
+	{ "call_state", &call_state_pipe, 0, 0,
+	  DBUS_TYPE_STRING, mce_call_state_translation, 0, 0 },
+	{ "call_type", &call_type_pipe, 0, 0,
+	  DBUS_TYPE_STRING, mce_call_type_translation, 0, 0 },
+	{ "display_status", &display_state_pipe, 0, 0,
+	  DBUS_TYPE_STRING, mce_display_state_translation, 0, 0 },
+	/* The cache holds the brightness setting, as set by display;
+	 * the filters only change the data passed on, which also
+	 * carries the high brightness boost in bits 8-15
+	 */
+	{ "display_brightness", &display_brightness_pipe, 0, 0xff,
+	  DBUS_TYPE_INT32, NULL, 0, 0 },
+	{ "display_timeout", &inactivity_timeout_pipe, 0, 0,
+	  DBUS_TYPE_INT32, NULL, 0, 0 },
+	{ "tklock_mode", &submode_pipe, MCE_TKLOCK_SUBMODE, 0,
+	  DBUS_TYPE_STRING, lock_mode_translation, 0, 0 },
+	{ "devicelock_mode", &submode_pipe, MCE_DEVLOCK_SUBMODE, 0,
+	  DBUS_TYPE_STRING, lock_mode_translation, 0, 0 },
+	{ "inactivity_status", &device_inactive_pipe, 0, 0,
+	  DBUS_TYPE_BOOLEAN, NULL, 0, 0 },
+	{ "keyboard_slide", &keyboard_slide_pipe, 0, 0,
+	  DBUS_TYPE_BOOLEAN, NULL, 0, 0 },
+	{ "system_state", &system_state_pipe, 0, 0,
+	  DBUS_TYPE_INT32, NULL, 0, 0 },
+	{ "submode", &submode_pipe, 0, 0,
+	  DBUS_TYPE_INT32, NULL, 0, 0 },
+	{ NULL, NULL, 0, 0, DBUS_TYPE_INVALID, NULL, 0, 0 }
+};
+
+/** Shift of the instance cookie in the reported generation */
+#define STATE_INSTANCE_SHIFT	16
+
+/** Largest state generation, before a new instance cookie is needed */
+#define STATE_GENERATION_MAX	0xffff
+
+/** Current state generation; 0 is never used, so that it means "all" */
+static guint state_generation = 0;
+
+/**
+ * Random nonzero cookie reported in the high bits of the generation,
+ * so that a generation from another instance of mce is recognised
+ */
+static guint state_instance = 0;
 
 static gboolean send_keyboard_status(DBusMessage *const method_call)
 {
@@ -102,11 +188,205 @@ static void keyboard_slide_trigger(gconstpointer data)
 	send_keyboard_status(NULL);
 }
 
+/**
+ * Get the current value of a snapshot entry
+ *
+ * @param entry The entry
+ * @return The cached datapipe value, or the submode bit as TRUE/FALSE
+ */
+static gint state_entry_get(const state_entry_t *entry)
+{
+	gint value = datapipe_get_gint(*entry->datapipe);
+
+	if (entry->submode != 0)
+		value = ((value & entry->submode) != 0);
+	else if (entry->mask != 0)
+		value &= entry->mask;
+
+	return value;
+}
+
+/**
+ * Pick a new instance cookie, different from the current one
+ */
+static void renew_state_instance(void)
+{
+	guint instance = state_instance;
+
+	while (instance == state_instance)
+		instance = g_random_int_range(1, 1 << STATE_INSTANCE_SHIFT);
+
+	state_instance = instance;
+}
+
+/**
+ * Bump the generation of the entries that changed since the last query
+ *
+ * The values are compared only when queried, so nothing is added
+ * to the datapipes; a value that changed and changed back in
+ * between is correctly reported as unchanged
+ */
+static void update_state_generations(void)
+{
+	gboolean changed = FALSE;
+	state_entry_t *entry;
+	gint value;
+
+	/* Out of generations; start over under a new cookie,
+	 * which makes every client fetch a full snapshot
+	 */
+	if (state_generation == STATE_GENERATION_MAX) {
+		renew_state_instance();
+		state_generation = 1;
+
+		for (entry = state_entries; entry->key != NULL; entry++)
+			entry->generation = state_generation;
+	}
+
+	for (entry = state_entries; entry->key != NULL; entry++) {
+		value = state_entry_get(entry);
+
+		if ((entry->generation != 0) && (entry->value == value))
+			continue;
+
+		if (changed == FALSE) {
+			state_generation++;
+			changed = TRUE;
+		}
+
+		entry->value = value;
+		entry->generation = state_generation;
+	}
+}
+
+/**
+ * Append one snapshot entry to a dictionary
+ *
+ * @param dict The a{sv} iterator to append to
+ * @param entry The entry
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean append_state_entry(DBusMessageIter *dict,
+				   const state_entry_t *entry)
+{
+	const char signature[] = { (char)entry->type, '\0' };
+	DBusMessageIter item;
+	DBusMessageIter variant;
+	const gchar *string;
+	dbus_int32_t number;
+	dbus_bool_t boolean;
+	const void *value;
+
+	switch (entry->type) {
+	case DBUS_TYPE_STRING:
+		string = mce_translate_int_to_string(entry->translation,
+						     entry->value);
+		value = &string;
+		break;
+
+	case DBUS_TYPE_BOOLEAN:
+		boolean = (entry->value > 0);
+		value = &boolean;
+		break;
+
+	default:
+		number = entry->value;
+		value = &number;
+		break;
+	}
+
+	return (dbus_message_iter_open_container(dict, DBUS_TYPE_DICT_ENTRY,
+						 NULL, &item) == TRUE) &&
+	       (dbus_message_iter_append_basic(&item, DBUS_TYPE_STRING,
+					       &entry->key) == TRUE) &&
+	       (dbus_message_iter_open_container(&item, DBUS_TYPE_VARIANT,
+						 signature, &variant) == TRUE) &&
+	       (dbus_message_iter_append_basic(&variant, entry->type,
+					       value) == TRUE) &&
+	       (dbus_message_iter_close_container(&item, &variant) == TRUE) &&
+	       (dbus_message_iter_close_container(dict, &item) == TRUE);
+}
+
+/**
+ * D-Bus callback for the get all state method call
+ *
+ * @param msg The D-Bus message
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean all_state_get_dbus_cb(DBusMessage *const msg)
+{
+	DBusMessage *reply = NULL;
+	DBusMessageIter iter;
+	DBusMessageIter dict;
+	dbus_uint32_t since = 0;
+	dbus_uint32_t generation;
+	const state_entry_t *entry;
+	gboolean status = FALSE;
+
+	mce_log(LL_DEBUG, "%s: Received get all state request", MODULE_NAME);
+
+	if ((dbus_message_iter_init(msg, &iter) == TRUE) &&
+	    (dbus_message_iter_get_arg_type(&iter) == DBUS_TYPE_UINT32))
+		dbus_message_iter_get_basic(&iter, &since);
+
+	if (dbus_message_get_no_reply(msg) == TRUE) {
+		status = TRUE;
+		goto EXIT;
+	}
+
+	update_state_generations();
+
+	/* A generation from another instance of mce is meaningless */
+	if ((since >> STATE_INSTANCE_SHIFT) != state_instance)
+		since = 0;
+	else
+		since &= STATE_GENERATION_MAX;
+
+	if (since > state_generation)
+		since = 0;
+
+	generation = (state_instance << STATE_INSTANCE_SHIFT) |
+		     state_generation;
+	reply = dbus_new_method_reply(msg);
+	dbus_message_iter_init_append(reply, &iter);
+
+	if ((dbus_message_iter_append_basic(&iter, DBUS_TYPE_UINT32,
+					    &generation) == FALSE) ||
+	    (dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					      "{sv}", &dict) == FALSE))
+		goto ERROR;
+
+	for (entry = state_entries; entry->key != NULL; entry++) {
+		if (entry->generation <= since)
+			continue;
+
+		if (append_state_entry(&dict, entry) == FALSE)
+			goto ERROR;
+	}
+
+	if (dbus_message_iter_close_container(&iter, &dict) == FALSE)
+		goto ERROR;
+
+	status = dbus_send_message(reply);
+	goto EXIT;
+
+ERROR:
+	mce_log(LL_CRIT,
+		"Failed to append reply argument to D-Bus message for %s.%s",
+		MCE_REQUEST_IF, MCE_ALL_STATE_GET);
+	dbus_message_unref(reply);
+
+EXIT:
+	return status;
+}
+
 G_MODULE_EXPORT const gchar *g_module_check_init(GModule *module);
 const gchar *g_module_check_init(GModule *module)
 {
 	(void)module;
 
+	renew_state_instance();
+
 	/* Append triggers/filters to datapipes */
 	append_output_trigger_to_datapipe(&keyboard_slide_pipe,
 				  keyboard_slide_trigger);
@@ -118,6 +398,13 @@ const gchar *g_module_check_init(GModule *module)
 				 DBUS_MESSAGE_TYPE_METHOD_CALL,
 				 keyboard_status_get_dbus_cb);
 
+	/* get_all_state */
+	all_state_cookie = mce_dbus_handler_add(MCE_REQUEST_IF,
+				 MCE_ALL_STATE_GET,
+				 NULL,
+				 DBUS_MESSAGE_TYPE_METHOD_CALL,
+				 all_state_get_dbus_cb);
+
 	keyboard_slide_trigger(datapipe_get_gpointer(keyboard_slide_pipe));
 
 	return NULL;
@@ -130,6 +417,9 @@ void g_module_unload(GModule *module)
 	
 	if (keyboard_status_cookie)
 		mce_dbus_handler_remove(keyboard_status_cookie);
+
+	if (all_state_cookie)
+		mce_dbus_handler_remove(all_state_cookie);
 	
 	/* Remove triggers/filters from datapipes */
 	remove_output_trigger_from_datapipe(&keyboard_slide_pipe,
@@ -29,30 +29,200 @@ G_MODULE_EXPORT module_info_struct module_info = {
 	.priority = 250
 };
 
+/** Persistent connection to the X server, NULL if not connected */
+static Display *x11_display = NULL;
+/** Main loop watch for the X server connection */
+static guint x11_watch_id = 0;
+/** Set when Xlib reports that the connection to the X server was lost */
+static bool x11_display_lost = false;
+/** Major opcode of the XInput extension */
+static int x11_xi_opcode = 0;
+/** Does the X server support DPMS? */
+static bool x11_dpms_capable = false;
+
+/** Cached XInput device list, NULL if it needs to be refreshed */
+static XIDeviceInfo *x11_devices = NULL;
+static int x11_device_count = 0;
+
+/** Ids of the devices disabled by us */
+static int *x11_disabled_devices = NULL;
+static unsigned int x11_disabled_device_count = 0;
+
 static Atom x11_atom_touchscreen = None;
 static Atom x11_atom_device_enabled = None;
 static Atom x11_atom_device_enabled_type = None;
 static int x11_atom_device_enabled_format = 0;
 
+static void x11_invalidate_devices(void)
+{
+	if (x11_devices != NULL) {
+		XIFreeDeviceInfo(x11_devices);
+		x11_devices = NULL;
+		x11_device_count = 0;
+	}
+}
+
+static void x11_display_close(void)
+{
+	if (x11_watch_id != 0) {
+		g_source_remove(x11_watch_id);
+		x11_watch_id = 0;
+	}
+
+	if (x11_display == NULL)
+		return;
+
+	x11_invalidate_devices();
+
+	/* A restarted X server enables all devices again */
+	if (x11_display_lost) {
+		free(x11_disabled_devices);
+		x11_disabled_devices = NULL;
+		x11_disabled_device_count = 0;
+	}
+
+	/* Atoms do not survive a restart of the X server */
+	x11_atom_touchscreen = None;
+	x11_atom_device_enabled = None;
+	x11_atom_device_enabled_type = None;
+	x11_atom_device_enabled_format = 0;
+
+	XCloseDisplay(x11_display);
+	x11_display = NULL;
+	x11_display_lost = false;
+}
+
+#ifdef HAVE_XSETIOERROREXITHANDLER
+static void x11_io_error_exit_handler(Display *dpy, void *user_data)
+{
+	(void)dpy;
+	(void)user_data;
+
+	/* Xlib returns to the caller instead of exiting;
+	 * the connection is closed once the caller is done with it
+	 */
+	mce_log(LL_WARN, "%s: lost connection to the X server", MODULE_NAME);
+	x11_display_lost = true;
+}
+
+static void x11_process_events(void)
+{
+	while (!x11_display_lost && XPending(x11_display) > 0) {
+		XEvent event;
+
+		XNextEvent(x11_display, &event);
+
+		if (event.xcookie.type != GenericEvent ||
+		    event.xcookie.extension != x11_xi_opcode)
+			continue;
+
+		if (XGetEventData(x11_display, &event.xcookie)) {
+			if (event.xcookie.evtype == XI_HierarchyChanged) {
+				mce_log(LL_DEBUG, "%s: input device hierarchy changed", MODULE_NAME);
+				x11_invalidate_devices();
+			}
+			XFreeEventData(x11_display, &event.xcookie);
+		}
+	}
+}
+
+static gboolean x11_display_io_cb(GIOChannel *source, GIOCondition condition,
+				  gpointer data)
+{
+	(void)source;
+	(void)data;
+
+	if (condition & (G_IO_ERR | G_IO_HUP | G_IO_NVAL)) {
+		mce_log(LL_WARN, "%s: X server connection closed", MODULE_NAME);
+		x11_display_lost = true;
+	} else {
+		x11_process_events();
+	}
+
+	if (x11_display_lost) {
+		/* The watch is removed by returning FALSE */
+		x11_watch_id = 0;
+		x11_display_close();
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void x11_display_watch(void)
+{
+	GIOChannel *channel = g_io_channel_unix_new(ConnectionNumber(x11_display));
+
+	x11_watch_id = g_io_add_watch(channel,
+				      G_IO_IN | G_IO_ERR | G_IO_HUP | G_IO_NVAL,
+				      x11_display_io_cb, NULL);
+	g_io_channel_unref(channel);
+}
+#endif /* HAVE_XSETIOERROREXITHANDLER */
+
 static Display *x11_get_display(void)
 {
-	Display *dpy = XOpenDisplay(NULL);
-	if (dpy == NULL) {
-		dpy = XOpenDisplay(":0.0");
+	int dummy;
+
+	if (x11_display != NULL)
+		return x11_display;
+
+	x11_display = XOpenDisplay(NULL);
+	if (x11_display == NULL) {
+		x11_display = XOpenDisplay(":0.0");
 	}
 
-	if (dpy == NULL) {
+	if (x11_display == NULL) {
 		mce_log(LL_INFO, "%s: unable to open display", MODULE_NAME);
+		return NULL;
+	}
+
+	x11_dpms_capable = DPMSQueryExtension(x11_display, &dummy, &dummy) &&
+			   DPMSCapable(x11_display);
+
+#ifdef HAVE_XSETIOERROREXITHANDLER
+	XSetIOErrorExitHandler(x11_display, x11_io_error_exit_handler, NULL);
+
+	/* Get told about added and removed input devices,
+	 * so that the cached device list can be refreshed
+	 */
+	if (XQueryExtension(x11_display, "XInputExtension", &x11_xi_opcode,
+			    &dummy, &dummy)) {
+		unsigned char mask_bits[XIMaskLen(XI_LASTEVENT)] = { 0 };
+		XIEventMask mask = {
+			.deviceid = XIAllDevices,
+			.mask_len = sizeof(mask_bits),
+			.mask = mask_bits
+		};
+
+		XISetMask(mask_bits, XI_HierarchyChanged);
+		XISelectEvents(x11_display, DefaultRootWindow(x11_display),
+			       &mask, 1);
+		XFlush(x11_display);
 	}
-	return dpy;
+
+	x11_display_watch();
+#endif /* HAVE_XSETIOERROREXITHANDLER */
+
+	return x11_display;
 }
 
-static bool x11_set_input_device_enabled(Display *dpy, const XIDeviceInfo devinfo, const bool enable)
+static void x11_release_display(void)
+{
+#ifdef HAVE_XSETIOERROREXITHANDLER
+	/* Keep the connection unless it was lost */
+	if (x11_display_lost)
+		x11_display_close();
+#else
+	/* Without an exit handler, losing the X server would
+	 * terminate mce; don't keep the connection open
+	 */
+	x11_display_close();
+#endif /* HAVE_XSETIOERROREXITHANDLER */
+}
+
+static bool x11_set_input_device_enabled(Display *dpy, const XIDeviceInfo *devinfo, const bool enable)
 {
-	if (dpy == NULL) {
-		mce_log(LL_WARN, "%s: XIDeviceInfo needs to be from same Display", MODULE_NAME);
-		return false;
-	}
 	if (x11_atom_device_enabled == None)
 		x11_atom_device_enabled = XInternAtom(dpy, "Device Enabled", False);
 	if (x11_atom_device_enabled == None) {
@@ -65,7 +235,7 @@ static bool x11_set_input_device_enabled(Display *dpy, const XIDeviceInfo devinf
 		unsigned char *ignore_data = NULL;
 
 		if (XIGetProperty
-		    (dpy, devinfo.deviceid, x11_atom_device_enabled, 0, 0, False, AnyPropertyType,
+		    (dpy, devinfo->deviceid, x11_atom_device_enabled, 0, 0, False, AnyPropertyType,
 		     &x11_atom_device_enabled_type, &x11_atom_device_enabled_format, &ignore_nitems,
 		     &ignore_bytes_after, &ignore_data)) {
 			mce_log(LL_WARN, "%s: unable to obtain X11 Device Enabled property atom type", MODULE_NAME);
@@ -75,7 +245,7 @@ static bool x11_set_input_device_enabled(Display *dpy, const XIDeviceInfo devinf
 		}
 	}
 
-	XIChangeProperty(dpy, devinfo.deviceid, x11_atom_device_enabled,
+	XIChangeProperty(dpy, devinfo->deviceid, x11_atom_device_enabled,
 			 x11_atom_device_enabled_type,
 			 x11_atom_device_enabled_format, PropModeReplace, (unsigned char *)&enable, 1);
 	return true;
@@ -83,147 +253,101 @@ static bool x11_set_input_device_enabled(Display *dpy, const XIDeviceInfo devinf
 
 static bool x11_set_all_input_devices_enabled(Display *dpy, const bool enable)
 {
-	bool ret = false;
-	XIDeviceInfo *devinfo = NULL;
-	int ndev = 0;
-
-	static XIDeviceInfo *disabledDevices = NULL;
-	static unsigned int disabledDevicesCount = 0;
-
-	bool ownsDisplay = false;
-	if (dpy == NULL) {
-		dpy = x11_get_display();
-		if (dpy == NULL)
-			return false;
-		ownsDisplay = true;
-	}
-
 	if (x11_atom_touchscreen == None)
 		x11_atom_touchscreen = XInternAtom(dpy, XI_TOUCHSCREEN, True);
 
 	if (x11_atom_touchscreen == None) {
 		mce_log(LL_WARN, "%s: unable to obtain X11 Atoms", MODULE_NAME);
-		goto done;
+		return false;
 	}
 
-	devinfo = XIQueryDevice(dpy, XIAllDevices, &ndev);
-	if (devinfo == NULL)
-		goto done;
+	if (enable && x11_disabled_devices == NULL)
+		return true;
+	else if (!enable && x11_disabled_devices != NULL)
+		return true;
 
-	if (enable && disabledDevices == NULL) {
-		goto doneXiFree;
-	} else if (!enable && disabledDevices != NULL) {
-		goto doneXiFree;
-	} else if (!enable && disabledDevices == NULL) {
-		disabledDevices = malloc(sizeof(*disabledDevices) * ndev);
+	if (x11_devices == NULL) {
+		x11_devices = XIQueryDevice(dpy, XIAllDevices, &x11_device_count);
+		if (x11_devices == NULL)
+			return false;
 	}
 
 	if (!enable) {
-		for (int i = 0; i < ndev; ++i) {
-			if (devinfo[i].use == XIMasterPointer || devinfo[i].use == XIMasterKeyboard
-			    || !devinfo[i].enabled)
+		x11_disabled_devices = malloc(sizeof(*x11_disabled_devices) * x11_device_count);
+		if (x11_disabled_devices == NULL)
+			return false;
+
+		for (int i = 0; i < x11_device_count; ++i) {
+			const XIDeviceInfo *devinfo = &x11_devices[i];
+
+			if (devinfo->use == XIMasterPointer || devinfo->use == XIMasterKeyboard
+			    || !devinfo->enabled)
 				continue;
 
-			if (devinfo[i].name && strstr(devinfo[i].name, "XTEST") != NULL)
+			if (devinfo->name && strstr(devinfo->name, "XTEST") != NULL)
 				continue;
 
-			mce_log(LL_INFO, "%s: disabling %s", MODULE_NAME, devinfo[i].name);
+			mce_log(LL_INFO, "%s: disabling %s", MODULE_NAME, devinfo->name);
 
-			if (x11_set_input_device_enabled(dpy, devinfo[i], enable)) {
-				disabledDevices[disabledDevicesCount] = devinfo[i];
-				++disabledDevicesCount;
+			if (x11_set_input_device_enabled(dpy, devinfo, enable)) {
+				x11_disabled_devices[x11_disabled_device_count] = devinfo->deviceid;
+				++x11_disabled_device_count;
 			}
 		}
 	} else {
-		for (int i = 0; i < ndev; ++i) {
-			if (devinfo[i].use == XIMasterPointer || devinfo[i].use == XIMasterKeyboard)
+		for (int i = 0; i < x11_device_count; ++i) {
+			const XIDeviceInfo *devinfo = &x11_devices[i];
+
+			if (devinfo->use == XIMasterPointer || devinfo->use == XIMasterKeyboard)
 				continue;
 
-			if (devinfo[i].name && strstr(devinfo[i].name, "XTEST") != NULL)
+			if (devinfo->name && strstr(devinfo->name, "XTEST") != NULL)
 				continue;
 
-			for (unsigned int j = 0; j < disabledDevicesCount; ++j) {
-				if (disabledDevices[j].deviceid == devinfo[i].deviceid) {
-					mce_log(LL_INFO, "%s: enableing %s", MODULE_NAME, devinfo[i].name);
-					x11_set_input_device_enabled(dpy, devinfo[i], enable);
+			for (unsigned int j = 0; j < x11_disabled_device_count; ++j) {
+				if (x11_disabled_devices[j] == devinfo->deviceid) {
+					mce_log(LL_INFO, "%s: enableing %s", MODULE_NAME, devinfo->name);
+					x11_set_input_device_enabled(dpy, devinfo, enable);
 				}
 			}
 		}
-		disabledDevicesCount = 0;
-		free(disabledDevices);
-		disabledDevices = NULL;
+		x11_disabled_device_count = 0;
+		free(x11_disabled_devices);
+		x11_disabled_devices = NULL;
 	}
 
-	ret = true;
-
- doneXiFree:
-	XIFreeDeviceInfo(devinfo);
-
- done:
-	if (dpy != NULL && ownsDisplay)
-		XCloseDisplay(dpy);
-
-	return ret;
+	return true;
 }
 
 static bool x11_set_dpms_enabled(Display *dpy, const bool enable)
 {
-	int dummy;
-	bool ownsDisplay = false;
-	if (dpy == NULL) {
-		dpy = x11_get_display();
-		if (dpy == NULL)
-			return false;
-		ownsDisplay = true;
-	}
+	uint16_t level;
+	unsigned char enabled;
 
-	if (DPMSQueryExtension(dpy, &dummy, &dummy)) {
-		uint16_t level;
-		bool enabled;
-		DPMSInfo(dpy, &level, (unsigned char *)&enabled);
-		if (enabled != enable)
-			enable ? DPMSEnable(dpy) : DPMSDisable(dpy);
-	} else {
-		mce_log(LL_INFO, "%s: XServer dosent have dpms extension", MODULE_NAME);
-		if (ownsDisplay)
-			XCloseDisplay(dpy);
-		return false;
-	}
+	DPMSInfo(dpy, &level, &enabled);
+	if ((bool)enabled != enable)
+		enable ? DPMSEnable(dpy) : DPMSDisable(dpy);
 
-	if (ownsDisplay)
-		XCloseDisplay(dpy);
 	return true;
 }
 
 static bool x11_set_dpms_display_level(Display *dpy, const bool state)
 {
-	bool ownsDisplay = false;
-	if (dpy == NULL) {
-		dpy = x11_get_display();
-		if (dpy == NULL)
-			return false;
-		ownsDisplay = true;
+	if (!x11_dpms_capable) {
+		mce_log(LL_WARN, "%s: Display dose not support DPMS", MODULE_NAME);
+		return false;
 	}
 
-	if (DPMSCapable(dpy)) {
-		x11_set_dpms_enabled(dpy, true);
-		if (state) {
-			DPMSForceLevel(dpy, DPMSModeOn);
-			XSync(dpy, false);
-		} else {
-			usleep(100000);
-			DPMSForceLevel(dpy, DPMSModeOff);
-			XSync(dpy, false);
-		}
+	x11_set_dpms_enabled(dpy, true);
+	if (state) {
+		DPMSForceLevel(dpy, DPMSModeOn);
+		XSync(dpy, false);
 	} else {
-		mce_log(LL_WARN, "%s: Display dose not support DPMS", MODULE_NAME);
-		if (ownsDisplay)
-			XCloseDisplay(dpy);
-		return false;
+		usleep(100000);
+		DPMSForceLevel(dpy, DPMSModeOff);
+		XSync(dpy, false);
 	}
 
-	if (ownsDisplay)
-		XCloseDisplay(dpy);
 	return true;
 }
 
@@ -235,16 +359,29 @@ static void x11_force_dpms_display_level(const bool on)
 	if (dpy == NULL)
 		return;
 
+#ifdef HAVE_XSETIOERROREXITHANDLER
+	/* Input devices may have been added or removed since
+	 * the mainloop last dispatched our X events; handle those
+	 * first, so that the cached device list is not stale
+	 */
+	x11_process_events();
+
+	if (x11_display_lost) {
+		x11_release_display();
+		return;
+	}
+#endif /* HAVE_XSETIOERROREXITHANDLER */
+
 	if (!on) {
 		x11_set_all_input_devices_enabled(dpy, false);
-		XSync(dpy, false);
+		XFlush(dpy);
 		x11_set_dpms_display_level(dpy, false);
 	} else {
 		x11_set_all_input_devices_enabled(dpy, true);
 		x11_set_dpms_display_level(dpy, true);
 	}
 
-	XCloseDisplay(dpy);
+	x11_release_display();
 }
 
 static void display_state_trigger(gconstpointer data)
@@ -270,6 +407,13 @@ const gchar *g_module_check_init(GModule *module)
 	append_output_trigger_to_datapipe(&display_state_pipe,
 					  display_state_trigger);
 
+#ifdef HAVE_XSETIOERROREXITHANDLER
+	/* Connect early to start tracking input device changes;
+	 * if X is not up yet, connect on the first display change
+	 */
+	x11_get_display();
+#endif /* HAVE_XSETIOERROREXITHANDLER */
+
 	return NULL;
 }
 
@@ -282,6 +426,13 @@ void g_module_unload(GModule *module)
 	remove_output_trigger_from_datapipe(&display_state_pipe,
 					    display_state_trigger);
 
-	x11_set_all_input_devices_enabled(NULL, true);
+	Display *dpy = x11_get_display();
+
+	if (dpy != NULL) {
+		x11_set_all_input_devices_enabled(dpy, true);
+		XSync(dpy, false);
+	}
+
+	x11_display_close();
 }
 
@@ -4,7 +4,7 @@
 #include <glib.h>
 
 /** Path to the input device directory */
-#define DEV_INPUT_PATH			"/dev/input"
+#define DEV_INPUT_PATH			MCE_DEVINPUT_DIR
 /** Prefix for event files */
 #define EVENT_FILE_PREFIX		"event"
 
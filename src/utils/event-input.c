@@ -39,6 +39,8 @@
 #include "datapipe.h"
 #include "event-input-utils.h"
 #include "mce-conf.h"
+#include "mce-profile.h"
+#include "mce-input-frame.h"
 
 /** ID for touchscreen I/O monitor timeout source */
 static guint pointer_io_monitor_timeout_cb_id = 0;
@@ -46,6 +48,13 @@ static guint pointer_io_monitor_timeout_cb_id = 0;
 /** ID for keypress timeout source */
 static guint keypress_repeat_timeout_cb_id = 0;
 
+/**
+ * Key events waiting for the end of their report;
+ * each device has its own, since reports of different
+ * devices may interleave
+ */
+static GHashTable *keypress_frames = NULL;
+
 /** List of touchscreen input devices */
 static GSList *pointer_dev_list = NULL;
 /** List of keyboard input devices */
@@ -156,12 +165,16 @@ static void setup_pointer_io_monitor_timeout(void)
  *
  * @param data The new data
  * @param bytes_read The number of bytes read
+ * @param iomon_id Unused
  */
-static void pointer_cb(gpointer data, gsize bytes_read)
+static void pointer_cb(gpointer data, gsize bytes_read,
+		       gconstpointer iomon_id)
 {
 	submode_t submode = mce_get_submode_int32();
 	struct input_event *ev;
 
+	(void)iomon_id;
+
 	ev = data;
 
 	/* Don't process invalid reads */
@@ -243,13 +256,74 @@ static void setup_keypress_repeat_timeout(void)
 				      keypress_repeat_timeout_cb, NULL);
 }
 
+/**
+ * Drop the pending key events of a device
+ *
+ * @param iomon_id The I/O monitor of the device
+ */
+static void drop_keypress_frame(gconstpointer iomon_id)
+{
+	if (keypress_frames != NULL)
+		g_hash_table_remove(keypress_frames, iomon_id);
+}
+
+/**
+ * Send the pending key events of a device to keypress_pipe
+ *
+ * @param iomon_id The I/O monitor of the device
+ */
+static void flush_keypress_frame(gconstpointer iomon_id)
+{
+	mce_input_frame_t *frame;
+
+	if ((keypress_frames == NULL) ||
+	    (g_hash_table_steal_extended(keypress_frames, iomon_id,
+					 NULL, (gpointer *)&frame) == FALSE))
+		return;
+
+	(void)execute_datapipe(&keypress_pipe, frame,
+			       USE_INDATA, DONT_CACHE_INDATA);
+	mce_input_frame_unref(frame);
+}
+
+/**
+ * Add a key event to the pending frame of a device
+ *
+ * @param iomon_id The I/O monitor of the device
+ * @param ev The key event
+ */
+static void append_keypress_frame(gconstpointer iomon_id,
+				  const struct input_event *ev)
+{
+	mce_input_frame_t *frame;
+
+	if (keypress_frames == NULL)
+		keypress_frames =
+			g_hash_table_new_full(g_direct_hash, g_direct_equal,
+					      NULL,
+					      (GDestroyNotify)mce_input_frame_unref);
+
+	frame = g_hash_table_lookup(keypress_frames, iomon_id);
+
+	if ((frame != NULL) && (mce_input_frame_append(frame, ev) == TRUE))
+		return;
+
+	/* New, or full; pass on what we have and start a new frame */
+	flush_keypress_frame(iomon_id);
+	frame = mce_input_frame_new();
+	(void)mce_input_frame_append(frame, ev);
+	g_hash_table_insert(keypress_frames, (gpointer)iomon_id, frame);
+}
+
 /**
  * I/O monitor callback for keypresses
  *
  * @param data The new data
  * @param bytes_read The number of bytes read
+ * @param iomon_id The I/O monitor of the device
  */
-static void keypress_cb(gpointer data, gsize bytes_read)
+static void keypress_cb(gpointer data, gsize bytes_read,
+			gconstpointer iomon_id)
 {
 	submode_t submode = mce_get_submode_int32();
 	struct input_event *ev;
@@ -262,6 +336,16 @@ static void keypress_cb(gpointer data, gsize bytes_read)
 	if (bytes_read != sizeof (struct input_event))
 		return;
 
+	/* The key events of one report are passed on together */
+	if (ev->type == EV_SYN) {
+		if (ev->code == SYN_REPORT)
+			flush_keypress_frame(iomon_id);
+		else if (ev->code == SYN_DROPPED)
+			drop_keypress_frame(iomon_id);
+
+		return;
+	}
+
 	/* Ignore non-keypress events */
 	if (ev->type != EV_KEY && ev->type != EV_SW)
 		return;
@@ -321,8 +405,7 @@ static void keypress_cb(gpointer data, gsize bytes_read)
 	}
 
 	if (!handled && (ev->value == 1 || ev->value == 0))
-		(void)execute_datapipe(&keypress_pipe, &ev,
-				       USE_INDATA, DONT_CACHE_INDATA);
+		append_keypress_frame(iomon_id, ev);
 }
 
 /**
@@ -424,6 +507,7 @@ static void remove_input_device(GSList **devices, const gchar *device)
 	if (list_entry != NULL) {
 		iomon_id = list_entry->data;
 		*devices = g_slist_remove(*devices, iomon_id);
+		drop_keypress_frame(iomon_id);
 		mce_unregister_io_monitor(iomon_id);
 	}
 }
@@ -571,6 +655,20 @@ GSList *mce_input_get_monitored_pointer_devices(void)
 	return pointer_dev_list;
 }
 
+/**
+ * @brief Get the monitor for /dev/input
+ *
+ * Modules that track input device hotplug connect to its
+ * "changed" signal, rather than adding monitors of their own
+ *
+ * @return: The #GFileMonitor (transfer none), or NULL if
+ *          /dev/input is not monitored
+ */
+GFileMonitor *mce_input_get_dev_input_monitor(void)
+{
+	return dev_input_gfmp;
+}
+
 static void pointer_control_trigger(gconstpointer data) {
 	gboolean enable = !GPOINTER_TO_INT(data);
 	if (enable)
@@ -588,6 +686,7 @@ gboolean mce_input_init(void)
 {
 	GError *error = NULL;
 	gboolean status = FALSE;
+	gint64 scan_start;
 
 #if !GLIB_CHECK_VERSION(2,35,0)
 	g_type_init ();
@@ -612,11 +711,13 @@ gboolean mce_input_init(void)
 	 *      and any workarounds are likely to be cumbersome
 	 */
 	/* Find the initial set of input devices */
+	scan_start = mce_profile_timestamp();
 	if ((status = mce_scan_inputdevices(match_and_register_io_monitor, NULL)) == FALSE) {
 		g_file_monitor_cancel(dev_input_gfmp);
 		dev_input_gfmp = NULL;
 		goto EXIT;
 	}
+	mce_profile_record(MCE_PROFILE_PHASE_INPUT, DEV_INPUT_PATH, scan_start);
 
 	/* Connect "changed" signal for the directory monitor */
 	g_signal_connect(G_OBJECT(dev_input_gfmp), "changed",
@@ -648,5 +749,12 @@ void mce_input_exit(void)
 	cancel_pointer_io_monitor_timeout();
 	cancel_keypress_repeat_timeout();
 
+	if (keypress_frames != NULL) {
+		g_hash_table_destroy(keypress_frames);
+		keypress_frames = NULL;
+	}
+
+	mce_input_frame_pool_exit();
+
 	return;
 }
@@ -23,6 +23,7 @@
 #define _EVENT_INPUT_H_
 
 #include <glib.h>
+#include <gio/gio.h>
 
 #include <linux/input.h>
 
@@ -144,5 +145,6 @@ void mce_input_exit(void);
 
 GSList *mce_input_get_monitored_keyboard_devices(void);
 GSList *mce_input_get_monitored_pointer_devices(void);
+GFileMonitor *mce_input_get_dev_input_monitor(void);
 
 #endif /* _EVENT_INPUT_H_ */
@@ -0,0 +1,202 @@
+/**
+ * @file mce-battery.c
+ * Battery status logic shared by the battery modules
+ * <p>
+ * The battery modules only differ in where they read the battery from;
+ * turning the readings into a battery status and feeding that
+ * to the datapipes is done here
+ * <p>
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <glib.h>
+#include "mce.h"
+#include "mce-log.h"
+#include "mce-conf.h"
+#include "mce-patterns.h"
+#include "mce-battery.h"
+
+/** Whether to support legacy pattery low led pattern; nonzero for yes */
+#define SUPPORT_BATTERY_LOW_LED_PATTERN 0
+
+#define MCE_CONF_BATTERY_SECTION "Battery"
+#define MCE_CONF_CRIT_VOLTAGE_KEY "CriticalVoltage"
+#define MCE_CONF_LOW_VOLTAGE_KEY "LowVoltage"
+#define MCE_CONF_LOW_PERCENT_KEY "LowPercentage"
+#define MCE_CONF_EMPTY_PERCENT_KEY "EmptyPercentage"
+#define MCE_CONF_USE_CAPACITY_LEVEL "UseCapacityLevel"
+#define MCE_CONF_CAPACITY_LOW_CRITICAL_KEY "CapacityLevelLowCritical"
+
+/**
+ * Read the battery thresholds from the configuration
+ *
+ * @param config The thresholds to fill in
+ * @param module The name of the calling module, for logging
+ */
+void mce_battery_read_config(mce_battery_config_t *config,
+			     const gchar *module)
+{
+	config->min_voltage = mce_conf_get_int(MCE_CONF_BATTERY_SECTION, MCE_CONF_CRIT_VOLTAGE_KEY, 0, NULL)/1000.0;
+	if(config->min_voltage > 0.1)
+		mce_log(LL_INFO, "%s: critical voltage set set to %f", module, config->min_voltage);
+	config->low_voltage = mce_conf_get_int(MCE_CONF_BATTERY_SECTION, MCE_CONF_LOW_VOLTAGE_KEY, 0, NULL)/1000.0;
+	if(config->low_voltage > 0.1)
+		mce_log(LL_INFO, "%s: low voltage set set to %f", module, config->low_voltage);
+	config->low_percentage = mce_conf_get_int(MCE_CONF_BATTERY_SECTION, MCE_CONF_LOW_PERCENT_KEY, 5, NULL);
+	config->empty_percentage = mce_conf_get_int(MCE_CONF_BATTERY_SECTION, MCE_CONF_EMPTY_PERCENT_KEY, 2, NULL);
+	config->use_capacity_level = mce_conf_get_bool(MCE_CONF_BATTERY_SECTION, MCE_CONF_USE_CAPACITY_LEVEL, FALSE, NULL);
+	config->level_low_critical = mce_conf_get_bool(MCE_CONF_BATTERY_SECTION, MCE_CONF_CAPACITY_LOW_CRITICAL_KEY, FALSE, NULL);
+}
+
+/**
+ * Work out the battery status from the battery readings
+ *
+ * @param config The battery thresholds
+ * @param charger_connected TRUE if a charger is connected
+ * @param full TRUE if the battery is fully charged
+ * @param voltage The battery voltage; [V], 0 if not reported
+ * @param percentage The charge percentage, negative if not reported
+ * @param capacity_level The capacity level, e.g. "Low"; may be NULL
+ * @return The battery status; one of BATTERY_STATUS_*
+ */
+gint mce_battery_evaluate(const mce_battery_config_t *config,
+			  gboolean charger_connected, gboolean full,
+			  gdouble voltage, gdouble percentage,
+			  const gchar *capacity_level)
+{
+	gint status = BATTERY_STATUS_UNDEF;
+
+	if (full)
+		status = BATTERY_STATUS_FULL;
+
+	/*
+	 * Inhibit shutdown if charger is connected or an alternate shutdown
+	 * method (voltage or capacity_level) is configured.
+	 */
+	if (charger_connected || config->min_voltage || config->use_capacity_level)
+		status = BATTERY_STATUS_OK;
+
+	if (config->min_voltage && voltage && voltage < config->min_voltage)
+		status = BATTERY_STATUS_EMPTY;
+	else if (config->use_capacity_level &&
+			g_strcmp0(capacity_level, "Critical") == 0)
+		status = BATTERY_STATUS_EMPTY;
+	else if (config->use_capacity_level && config->level_low_critical &&
+			g_strcmp0(capacity_level, "Low") == 0)
+		status = BATTERY_STATUS_EMPTY;
+	/*
+	 * Ensure low_voltage is only considered if min_voltage is set, to avoid
+	 * getting stuck in the battery low status
+	 */
+	else if (config->min_voltage && config->low_voltage &&
+			voltage && voltage < config->low_voltage)
+		status = BATTERY_STATUS_LOW;
+	else if (config->use_capacity_level &&
+			g_strcmp0(capacity_level, "Low") == 0)
+		status = BATTERY_STATUS_LOW;
+
+	/* Bypass percentage evaluation if status has already been determined */
+	if (status != BATTERY_STATUS_UNDEF)
+		goto EXIT;
+
+	/* Nothing to go by; better not to shut down */
+	if (percentage < 0)
+		status = BATTERY_STATUS_OK;
+	else if (percentage < config->empty_percentage)
+		status = BATTERY_STATUS_EMPTY;
+	else if (percentage < config->low_percentage)
+		status = BATTERY_STATUS_LOW;
+	else
+		status = BATTERY_STATUS_OK;
+
+EXIT:
+	return status;
+}
+
+static inline const char *
+charger_state_repr(gboolean state)
+{
+	return state ? "on" : "off";
+}
+
+/**
+ * Feed changes in the battery state to the datapipes
+ *
+ * @param module The name of the calling module, for logging
+ * @param prev The previously published battery state
+ * @param curr The current battery state
+ */
+void mce_battery_publish(const gchar *module,
+			 const mce_battery_state_t *prev,
+			 const mce_battery_state_t *curr)
+{
+	if (prev->charger_connected != curr->charger_connected)
+	{
+		mce_log(LL_INFO, "%s: charger: %s -> %s", module,
+				charger_state_repr(prev->charger_connected),
+				charger_state_repr(curr->charger_connected));
+
+		/* Charger connected state */
+		execute_datapipe(&charger_state_pipe,
+						GINT_TO_POINTER(curr->charger_connected),
+						USE_INDATA, CACHE_INDATA);
+
+		/* Charging led pattern */
+		if (curr->charger_connected) {
+			execute_datapipe(&led_pattern_activate_pipe, mce_pattern_data(MCE_LED_PATTERN_BATTERY_CHARGING), USE_INDATA, DONT_CACHE_INDATA);
+		}
+		else {
+			execute_datapipe_output_triggers(&led_pattern_deactivate_pipe,
+											mce_pattern_data(MCE_LED_PATTERN_BATTERY_CHARGING),
+											USE_INDATA);
+		}
+
+		/* Generate activity */
+		execute_datapipe(&device_inactive_pipe, GINT_TO_POINTER(FALSE),
+						USE_INDATA, CACHE_INDATA);
+	}
+
+	if (prev->status != curr->status) {
+		mce_log(LL_INFO, "%s: status: %d -> %d", module, prev->status, curr->status);
+
+		/* Battery full led pattern */
+		if (curr->status == BATTERY_STATUS_FULL) {
+			execute_datapipe(&led_pattern_activate_pipe, mce_pattern_data(MCE_LED_PATTERN_BATTERY_FULL), USE_INDATA, DONT_CACHE_INDATA);
+		}
+		else if (prev->status == BATTERY_STATUS_FULL) {
+			execute_datapipe_output_triggers(&led_pattern_deactivate_pipe,
+											mce_pattern_data(MCE_LED_PATTERN_BATTERY_FULL),
+											USE_INDATA);
+		}
+
+#if SUPPORT_BATTERY_LOW_LED_PATTERN
+		/* Battery low led pattern */
+		if (curr->status == BATTERY_STATUS_LOW ||
+			curr->status == BATTERY_STATUS_EMPTY) {
+			execute_datapipe(&led_pattern_activate_pipe, mce_pattern_data(MCE_LED_PATTERN_BATTERY_LOW), USE_INDATA, DONT_CACHE_INDATA);
+		}
+		else {
+			execute_datapipe_output_triggers(&led_pattern_deactivate_pipe,
+											mce_pattern_data(MCE_LED_PATTERN_BATTERY_LOW),
+											USE_INDATA);
+		}
+#endif /* SUPPORT_BATTERY_LOW_LED_PATTERN */
+
+		if(curr->status == BATTERY_STATUS_EMPTY)
+			mce_log(LL_INFO, "%s: battery is empty", module);
+
+		/* Battery charge state */
+		execute_datapipe(&battery_status_pipe,
+						GINT_TO_POINTER(curr->status),
+						USE_INDATA, CACHE_INDATA);
+	}
+}
@@ -0,0 +1,56 @@
+/**
+ * @file mce-battery.h
+ * Headers for the battery status logic shared by the battery modules
+ * <p>
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _MCE_BATTERY_H_
+#define _MCE_BATTERY_H_
+
+#include <glib.h>
+
+/** Battery thresholds, from the [Battery] section of mce.ini */
+typedef struct {
+	/** Voltage below which the battery is empty; [V], 0 to disable */
+	gdouble  min_voltage;
+	/** Voltage below which the battery is low; [V], 0 to disable */
+	gdouble  low_voltage;
+	/** Percentage below which the battery is low */
+	gint     low_percentage;
+	/** Percentage below which the battery is empty */
+	gint     empty_percentage;
+	/** Use the capacity level reported by the battery */
+	gboolean use_capacity_level;
+	/** Consider a "Low" capacity level empty rather than low */
+	gboolean level_low_critical;
+} mce_battery_config_t;
+
+/** Battery properties in mce statemachine compatible form */
+typedef struct {
+	/** Battery FULL/OK/LOW/EMPTY; for use with battery_status_pipe */
+	gint     status;
+	/** Charger connected; for use with charger_state_pipe */
+	gboolean charger_connected;
+} mce_battery_state_t;
+
+void mce_battery_read_config(mce_battery_config_t *config,
+			     const gchar *module);
+gint mce_battery_evaluate(const mce_battery_config_t *config,
+			  gboolean charger_connected, gboolean full,
+			  gdouble voltage, gdouble percentage,
+			  const gchar *capacity_level);
+void mce_battery_publish(const gchar *module,
+			 const mce_battery_state_t *prev,
+			 const mce_battery_state_t *curr);
+
+#endif /* _MCE_BATTERY_H_ */
@@ -72,6 +72,19 @@ static gpointer mce_conf_decide_keyfile_to_use(const gchar *group, const gchar *
 	return keyfile;
 }
 
+/**
+ * Check whether a configuration key is set
+ *
+ * @param group The configuration group
+ * @param key The configuration key
+ * @return TRUE if the key is set in any configuration file,
+ *         FALSE otherwise
+ */
+gboolean mce_conf_has_key(const gchar *group, const gchar *key)
+{
+	return mce_conf_find_key_in_files(group, key) != NULL;
+}
+
 /**
  * Get a boolean configuration value
  *
@@ -24,6 +24,8 @@
 
 #include <glib.h>
 
+gboolean mce_conf_has_key(const gchar *group, const gchar *key);
+
 gboolean mce_conf_get_bool(const gchar *group, const gchar *key,
 			   const gboolean defaultval, gpointer keyfileptr);
 gboolean mce_conf_set_bool(const gchar *group, const gchar *key,
@@ -404,24 +404,79 @@ EXIT:
 }
 
 /**
- * D-Bus message handler
+ * D-Bus callback for the log level set method call
  *
- * @param connection Unused
- * @param msg The D-Bus message received
- * @param user_data Unused
+ * @param msg The D-Bus message
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean log_level_set_dbus_cb(DBusMessage *const msg)
+{
+	dbus_bool_t no_reply = dbus_message_get_no_reply(msg);
+	const char *name = NULL;
+	dbus_int32_t verbosity;
+	gboolean status = FALSE;
+	DBusError error;
+
+	dbus_error_init(&error);
+
+	mce_log(LL_DEBUG, "Received log level set request");
+
+	if (dbus_message_get_args(msg, &error,
+				  DBUS_TYPE_STRING, &name,
+				  DBUS_TYPE_INT32, &verbosity,
+				  DBUS_TYPE_INVALID) == FALSE) {
+		mce_log(LL_CRIT,
+			"Failed to get argument from %s.%s: %s",
+			MCE_REQUEST_IF, MCE_LOG_LEVEL_SET,
+			error.message);
+		dbus_error_free(&error);
+		goto EXIT;
+	}
+
+	if ((verbosity > LL_DEBUG) || ((verbosity < LL_NONE) &&
+				       (*name == '\0'))) {
+		mce_log(LL_ERR, "Invalid log level %d requested", verbosity);
+		goto EXIT;
+	}
+
+	if (*name == '\0') {
+		mce_log_set_verbosity(verbosity);
+	} else if (mce_log_set_file_verbosity(name, verbosity) != 0) {
+		mce_log(LL_ERR, "Too many log levels set; "
+			"cannot set log level for %s", name);
+		goto EXIT;
+	}
+
+	mce_log(LL_INFO, "Log level for %s set to %d",
+		(*name == '\0') ? "mce" : name, verbosity);
+
+	if (no_reply == FALSE) {
+		DBusMessage *reply = dbus_new_method_reply(msg);
+
+		status = dbus_send_message(reply);
+	} else {
+		status = TRUE;
+	}
+
+EXIT:
+	return status;
+}
+
+/**
+ * Pass a D-Bus message to the registered handlers
+ *
+ * Used by the message filter of the bus connection; also usable
+ * without a bus connection, for instance by the benchmarks
+ *
+ * @param msg The D-Bus message
  * @return DBUS_HANDLER_RESULT_HANDLED for handled messages
- *         DBUS_HANDLER_RESULT_NOT_HANDLED for unhandled messages
+ *         DBUS_HANDLER_RESULT_NOT_YET_HANDLED for unhandled messages
  */
-static DBusHandlerResult msg_handler(DBusConnection *const connection,
-				     DBusMessage *const msg,
-				     gpointer const user_data)
+DBusHandlerResult mce_dbus_dispatch(DBusMessage *const msg)
 {
 	guint status = DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 	GSList *list;
 
-	(void)connection;
-	(void)user_data;
-
 	for (list = dbus_handlers; list != NULL; list = g_slist_next(list)) {
 		handler_struct *handler = list->data;
 
@@ -469,6 +524,25 @@ EXIT:
 	return status;
 }
 
+/**
+ * D-Bus message handler
+ *
+ * @param connection Unused
+ * @param msg The D-Bus message received
+ * @param user_data Unused
+ * @return DBUS_HANDLER_RESULT_HANDLED for handled messages
+ *         DBUS_HANDLER_RESULT_NOT_YET_HANDLED for unhandled messages
+ */
+static DBusHandlerResult msg_handler(DBusConnection *const connection,
+				     DBusMessage *const msg,
+				     gpointer const user_data)
+{
+	(void)connection;
+	(void)user_data;
+
+	return mce_dbus_dispatch(msg);
+}
+
 /**
  * Register a D-Bus signal or method handler
  *
@@ -478,6 +552,9 @@ EXIT:
  * @param type DBUS_MESSAGE_TYPE
  * @param callback The callback function
  * @return A D-Bus handler cookie on success, NULL on failure
+ *
+ * Without a bus connection, the handler is only added
+ * for mce_dbus_dispatch(), and no match rule is set up
  */
 gconstpointer mce_dbus_handler_add(const gchar *const interface,
 				    const gchar *const name,
@@ -562,7 +639,8 @@ gconstpointer mce_dbus_handler_add(const gchar *const interface,
 	h->type = type;
 	h->callback = callback;
 
-	dbus_bus_add_match(dbus_connection, match, &error);
+	if (dbus_connection != NULL)
+		dbus_bus_add_match(dbus_connection, match, &error);
 
 	if (dbus_error_is_set(&error) == TRUE) {
 		mce_log(LL_CRIT, "Failed to add D-Bus match '%s' for '%s'; %s",
@@ -624,7 +702,9 @@ void mce_dbus_handler_remove(gconstpointer cookie)
 			"MCE is trying to unregister an invalid message type");
 	}
 
-	if (match != NULL) {
+	if (dbus_connection == NULL) {
+		/* Added without a bus connection; no match rule */
+	} else if (match != NULL) {
 		dbus_bus_remove_match(dbus_connection, match, &error);
 
 		if (dbus_error_is_set(&error) == TRUE) {
@@ -946,6 +1026,14 @@ gboolean mce_dbus_init(const gboolean systembus)
 				 version_get_dbus_cb) == NULL)
 		goto EXIT;
 
+	/* set_log_level */
+	if (mce_dbus_handler_add(MCE_REQUEST_IF,
+				 MCE_LOG_LEVEL_SET,
+				 NULL,
+				 DBUS_MESSAGE_TYPE_METHOD_CALL,
+				 log_level_set_dbus_cb) == NULL)
+		goto EXIT;
+
 	status = TRUE;
 
 EXIT:
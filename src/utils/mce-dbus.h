@@ -60,6 +60,7 @@ gconstpointer mce_dbus_handler_add(const gchar *const interface,
 				   const guint type,
 				   gboolean (*callback)(DBusMessage *const msg));
 void mce_dbus_handler_remove(gconstpointer cookie);
+DBusHandlerResult mce_dbus_dispatch(DBusMessage *const msg);
 gboolean mce_dbus_is_owner_monitored(const gchar *service,
 				     GSList *monitor_list);
 gssize mce_dbus_owner_monitor_add(const gchar *service,
@@ -0,0 +1,117 @@
+/**
+ * @file mce-input-frame.c
+ * Input frames passed through keypress_pipe
+ * <p>
+ * Frames are reference counted, so that triggers can keep a frame
+ * beyond the datapipe dispatch, and recycled through a small pool,
+ * so that key events do not cause heap allocations
+ * <p>
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <glib.h>
+#include "mce-input-frame.h"
+
+/** Largest number of unused frames kept for reuse */
+#define FRAME_POOL_SIZE		4
+
+/** Unused frames */
+static mce_input_frame_t *frame_pool = NULL;
+
+/** Number of frames in frame_pool */
+static guint frame_pool_count = 0;
+
+/**
+ * Get an empty frame
+ *
+ * @return A frame with one reference
+ */
+mce_input_frame_t *mce_input_frame_new(void)
+{
+	mce_input_frame_t *frame = frame_pool;
+
+	if (frame != NULL) {
+		frame_pool = frame->next;
+		frame_pool_count--;
+	} else {
+		frame = g_new(mce_input_frame_t, 1);
+	}
+
+	frame->refcount = 1;
+	frame->count = 0;
+	frame->next = NULL;
+
+	return frame;
+}
+
+/**
+ * Drop a reference to a frame;
+ * the frame returns to the pool when the last reference is dropped
+ *
+ * @param frame The frame
+ */
+void mce_input_frame_unref(mce_input_frame_t *frame)
+{
+	if (frame == NULL)
+		goto EXIT;
+
+	if (--frame->refcount > 0)
+		goto EXIT;
+
+	if (frame_pool_count < FRAME_POOL_SIZE) {
+		frame->next = frame_pool;
+		frame_pool = frame;
+		frame_pool_count++;
+	} else {
+		g_free(frame);
+	}
+
+EXIT:
+	return;
+}
+
+/**
+ * Add an event to a frame
+ *
+ * @param frame The frame
+ * @param ev The event to add
+ * @return TRUE on success, FALSE if the frame is full
+ */
+gboolean mce_input_frame_append(mce_input_frame_t *frame,
+				const struct input_event *ev)
+{
+	gboolean status = FALSE;
+
+	if (frame->count >= MCE_INPUT_FRAME_MAX_EVENTS)
+		goto EXIT;
+
+	frame->events[frame->count++] = *ev;
+	status = TRUE;
+
+EXIT:
+	return status;
+}
+
+/**
+ * Free the unused frames
+ */
+void mce_input_frame_pool_exit(void)
+{
+	while (frame_pool != NULL) {
+		mce_input_frame_t *frame = frame_pool;
+
+		frame_pool = frame->next;
+		g_free(frame);
+	}
+
+	frame_pool_count = 0;
+}
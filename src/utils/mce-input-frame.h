@@ -0,0 +1,48 @@
+/**
+ * @file mce-input-frame.h
+ * Headers for the input frames passed through keypress_pipe
+ * <p>
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _MCE_INPUT_FRAME_H_
+#define _MCE_INPUT_FRAME_H_
+
+#include <glib.h>
+#include <linux/input.h>
+
+/** Largest number of key events in one frame */
+#define MCE_INPUT_FRAME_MAX_EVENTS	16
+
+/**
+ * The key events of one input report, up to SYN_REPORT;
+ * the events keep their kernel timestamps
+ */
+typedef struct mce_input_frame {
+	/** Reference count */
+	guint refcount;
+	/** Number of events in the frame */
+	guint count;
+	/** The events, in the order they were reported */
+	struct input_event events[MCE_INPUT_FRAME_MAX_EVENTS];
+	/** Next frame in the free pool */
+	struct mce_input_frame *next;
+} mce_input_frame_t;
+
+mce_input_frame_t *mce_input_frame_new(void);
+void mce_input_frame_unref(mce_input_frame_t *frame);
+gboolean mce_input_frame_append(mce_input_frame_t *frame,
+				const struct input_event *ev);
+
+void mce_input_frame_pool_exit(void);
+
+#endif /* _MCE_INPUT_FRAME_H_ */
@@ -312,7 +312,7 @@ static gboolean io_string_cb(GIOChannel *source,
 			"Empty read from %s",
 			iomon->file);
 	} else {
-		iomon->callback(str, bytes_read);
+		iomon->callback(str, bytes_read, iomon);
 		g_free(str);
 	}
 
@@ -400,7 +400,7 @@ static gboolean io_chunk_cb(GIOChannel *source,
 			"Empty read from %s",
 			iomon->file);
 	} else {
-		iomon->callback(chunk, bytes_read);
+		iomon->callback(chunk, bytes_read, iomon);
 	}
 
 	g_free(chunk);
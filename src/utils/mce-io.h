@@ -35,7 +35,7 @@ typedef enum {
 } error_policy_t;
 
 /** Function pointer for I/O monitor callback */
-typedef void (*iomon_cb)(gpointer data, gsize bytes_read);
+typedef void (*iomon_cb)(gpointer data, gsize bytes_read, gconstpointer iomon_id);
 typedef void (*iomon_error_cb)(gpointer data, const gchar* device, gconstpointer iomon_id, GError* err);
 
 gboolean mce_read_string_from_file(const gchar *const file, gchar **string);
@@ -0,0 +1,414 @@
+/**
+ * @file mce-led-arbiter.c
+ * LED pattern arbitration for the Mode Control Entity
+ * <p>
+ * Decides which of the active LED patterns to show.
+ * The visibility of each pattern is computed once for every
+ * context when the pattern is registered, and the active patterns
+ * are kept in one priority heap per context;
+ * the pattern to show is thus always the top of the heap
+ * for the current context
+ * <p>
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <glib.h>
+#include "mce.h"
+#include "mce-log.h"
+#include "mce-led-arbiter.h"
+
+/** Pattern registered with an LED arbiter */
+struct mce_led_arbiter_entry {
+	gpointer pattern;		/**< The module's pattern */
+	gint priority;			/**< Priority; lower is more important */
+	guint order;			/**< Registration order */
+	guint visible;			/**< Bit n set if visible in context n */
+	gboolean active;		/**< Is the pattern active? */
+	/** Position in the heap of each context; -1 if not in the heap */
+	gint position[MCE_LED_CONTEXT_COUNT];
+};
+
+/** LED arbiter */
+struct mce_led_arbiter {
+	mce_led_visible_cb visible;	/**< Visibility callback */
+	mce_led_changed_cb changed;	/**< Change callback */
+	gpointer user_data;		/**< User data for the change callback */
+	GPtrArray *entries;		/**< All registered entries */
+	/** Active visible entries of each context */
+	GPtrArray *heap[MCE_LED_CONTEXT_COUNT];
+	guint context;			/**< Current context */
+	gpointer current;		/**< Pattern currently shown */
+};
+
+/**
+ * Get the context for a system and display state
+ *
+ * @param system_state The system state
+ * @param display_state The display state
+ * @param led_enabled TRUE if the LED is enabled, FALSE if not
+ * @return The context; a mask of MCE_LED_CONTEXT_*
+ */
+guint mce_led_context(const system_state_t system_state,
+		      const display_state_t display_state,
+		      const gboolean led_enabled)
+{
+	guint context = 0;
+
+	if (system_state == MCE_STATE_ACTDEAD)
+		context |= MCE_LED_CONTEXT_ACTDEAD;
+
+	if (display_state == MCE_DISPLAY_OFF)
+		context |= MCE_LED_CONTEXT_DISPLAY_OFF;
+
+	if (led_enabled == TRUE)
+		context |= MCE_LED_CONTEXT_LED_ENABLED;
+
+	return context;
+}
+
+/**
+ * Check whether an entry should be shown before another
+ *
+ * Lower priority values win; for equal priorities
+ * the pattern registered last wins
+ *
+ * @param a The first entry
+ * @param b The second entry
+ * @return TRUE if a goes before b, FALSE otherwise
+ */
+static gboolean entry_before(const mce_led_arbiter_entry_t *a,
+			     const mce_led_arbiter_entry_t *b)
+{
+	if (a->priority != b->priority)
+		return a->priority < b->priority;
+
+	return a->order > b->order;
+}
+
+/**
+ * Place an entry at a position in a heap
+ *
+ * @param heap The heap
+ * @param context The context the heap belongs to
+ * @param position The position
+ * @param entry The entry
+ */
+static void heap_set(GPtrArray *heap, const guint context,
+		     const guint position, mce_led_arbiter_entry_t *entry)
+{
+	g_ptr_array_index(heap, position) = entry;
+	entry->position[context] = position;
+}
+
+/**
+ * Move an entry towards the top of a heap until the heap is ordered
+ *
+ * @param heap The heap
+ * @param context The context the heap belongs to
+ * @param position The position of the entry
+ */
+static void heap_sift_up(GPtrArray *heap, const guint context, guint position)
+{
+	mce_led_arbiter_entry_t *entry = g_ptr_array_index(heap, position);
+
+	while (position > 0) {
+		guint parent = (position - 1) / 2;
+		mce_led_arbiter_entry_t *pe = g_ptr_array_index(heap, parent);
+
+		if (entry_before(entry, pe) == FALSE)
+			break;
+
+		heap_set(heap, context, position, pe);
+		position = parent;
+	}
+
+	heap_set(heap, context, position, entry);
+}
+
+/**
+ * Move an entry towards the bottom of a heap until the heap is ordered
+ *
+ * @param heap The heap
+ * @param context The context the heap belongs to
+ * @param position The position of the entry
+ */
+static void heap_sift_down(GPtrArray *heap, const guint context,
+			   guint position)
+{
+	mce_led_arbiter_entry_t *entry = g_ptr_array_index(heap, position);
+
+	for (;;) {
+		guint child = (position * 2) + 1;
+		mce_led_arbiter_entry_t *ce;
+
+		if (child >= heap->len)
+			break;
+
+		if ((child + 1 < heap->len) &&
+		    (entry_before(g_ptr_array_index(heap, child + 1),
+				  g_ptr_array_index(heap, child)) == TRUE))
+			child++;
+
+		ce = g_ptr_array_index(heap, child);
+
+		if (entry_before(ce, entry) == FALSE)
+			break;
+
+		heap_set(heap, context, position, ce);
+		position = child;
+	}
+
+	heap_set(heap, context, position, entry);
+}
+
+/**
+ * Insert an entry into a heap
+ *
+ * @param heap The heap
+ * @param context The context the heap belongs to
+ * @param entry The entry
+ */
+static void heap_insert(GPtrArray *heap, const guint context,
+			mce_led_arbiter_entry_t *entry)
+{
+	g_ptr_array_add(heap, entry);
+	heap_sift_up(heap, context, heap->len - 1);
+}
+
+/**
+ * Remove an entry from a heap
+ *
+ * @param heap The heap
+ * @param context The context the heap belongs to
+ * @param entry The entry
+ */
+static void heap_remove(GPtrArray *heap, const guint context,
+			mce_led_arbiter_entry_t *entry)
+{
+	guint position = (guint)entry->position[context];
+	mce_led_arbiter_entry_t *last;
+
+	entry->position[context] = -1;
+	last = g_ptr_array_index(heap, heap->len - 1);
+	g_ptr_array_set_size(heap, heap->len - 1);
+
+	if (last == entry)
+		goto EXIT;
+
+	heap_set(heap, context, position, last);
+	heap_sift_down(heap, context, position);
+	heap_sift_up(heap, context, (guint)last->position[context]);
+
+EXIT:
+	return;
+}
+
+/**
+ * Get the pattern to show
+ *
+ * @param arbiter The arbiter
+ * @return The pattern to show, or NULL if no pattern should be shown
+ */
+gpointer mce_led_arbiter_top(const mce_led_arbiter_t *arbiter)
+{
+	GPtrArray *heap = arbiter->heap[arbiter->context];
+	mce_led_arbiter_entry_t *entry;
+
+	if (heap->len == 0)
+		return NULL;
+
+	entry = g_ptr_array_index(heap, 0);
+
+	return entry->pattern;
+}
+
+/**
+ * Notify the owner of the arbiter if the pattern to show changed
+ *
+ * @param arbiter The arbiter
+ */
+static void arbiter_update(mce_led_arbiter_t *arbiter)
+{
+	gpointer pattern = mce_led_arbiter_top(arbiter);
+	gpointer old;
+
+	if (pattern == arbiter->current)
+		goto EXIT;
+
+	old = arbiter->current;
+	arbiter->current = pattern;
+	arbiter->changed(old, pattern, arbiter->user_data);
+
+EXIT:
+	return;
+}
+
+/**
+ * Create an LED arbiter
+ *
+ * @param visible Callback deciding in which contexts a pattern is visible
+ * @param changed Callback called when the pattern to show changes
+ * @param user_data User data for the change callback
+ * @return A new LED arbiter
+ */
+mce_led_arbiter_t *mce_led_arbiter_new(mce_led_visible_cb visible,
+				       mce_led_changed_cb changed,
+				       gpointer user_data)
+{
+	mce_led_arbiter_t *arbiter = g_slice_new0(mce_led_arbiter_t);
+	guint i;
+
+	arbiter->visible = visible;
+	arbiter->changed = changed;
+	arbiter->user_data = user_data;
+	arbiter->entries = g_ptr_array_new();
+
+	for (i = 0; i < MCE_LED_CONTEXT_COUNT; i++)
+		arbiter->heap[i] = g_ptr_array_new();
+
+	return arbiter;
+}
+
+/**
+ * Free an LED arbiter and all its entries;
+ * the change callback is not called
+ *
+ * @param arbiter The arbiter
+ */
+void mce_led_arbiter_free(mce_led_arbiter_t *arbiter)
+{
+	guint i;
+
+	if (arbiter == NULL)
+		goto EXIT;
+
+	for (i = 0; i < arbiter->entries->len; i++)
+		g_slice_free(mce_led_arbiter_entry_t,
+			     g_ptr_array_index(arbiter->entries, i));
+
+	for (i = 0; i < MCE_LED_CONTEXT_COUNT; i++)
+		g_ptr_array_free(arbiter->heap[i], TRUE);
+
+	g_ptr_array_free(arbiter->entries, TRUE);
+	g_slice_free(mce_led_arbiter_t, arbiter);
+
+EXIT:
+	return;
+}
+
+/**
+ * Register a pattern with an LED arbiter;
+ * the pattern starts out inactive
+ *
+ * @param arbiter The arbiter
+ * @param pattern The pattern
+ * @param priority The priority of the pattern; lower is more important
+ * @return The entry for the pattern
+ */
+mce_led_arbiter_entry_t *mce_led_arbiter_add(mce_led_arbiter_t *arbiter,
+					     gpointer pattern,
+					     const gint priority)
+{
+	mce_led_arbiter_entry_t *entry = g_slice_new0(mce_led_arbiter_entry_t);
+	guint i;
+
+	entry->pattern = pattern;
+	entry->priority = priority;
+	entry->order = arbiter->entries->len;
+	entry->active = FALSE;
+
+	for (i = 0; i < MCE_LED_CONTEXT_COUNT; i++) {
+		entry->position[i] = -1;
+
+		if (arbiter->visible(pattern, i) == TRUE)
+			entry->visible |= 1U << i;
+	}
+
+	g_ptr_array_add(arbiter->entries, entry);
+
+	return entry;
+}
+
+/**
+ * Activate a pattern
+ *
+ * @param arbiter The arbiter
+ * @param entry The entry of the pattern
+ */
+void mce_led_arbiter_activate(mce_led_arbiter_t *arbiter,
+			      mce_led_arbiter_entry_t *entry)
+{
+	guint i;
+
+	if (entry->active == TRUE)
+		goto EXIT;
+
+	entry->active = TRUE;
+
+	for (i = 0; i < MCE_LED_CONTEXT_COUNT; i++) {
+		if ((entry->visible & (1U << i)) != 0)
+			heap_insert(arbiter->heap[i], i, entry);
+	}
+
+	arbiter_update(arbiter);
+
+EXIT:
+	return;
+}
+
+/**
+ * Deactivate a pattern
+ *
+ * @param arbiter The arbiter
+ * @param entry The entry of the pattern
+ */
+void mce_led_arbiter_deactivate(mce_led_arbiter_t *arbiter,
+				mce_led_arbiter_entry_t *entry)
+{
+	guint i;
+
+	if (entry->active == FALSE)
+		goto EXIT;
+
+	entry->active = FALSE;
+
+	for (i = 0; i < MCE_LED_CONTEXT_COUNT; i++) {
+		if (entry->position[i] != -1)
+			heap_remove(arbiter->heap[i], i, entry);
+	}
+
+	arbiter_update(arbiter);
+
+EXIT:
+	return;
+}
+
+/**
+ * Set the current context
+ *
+ * @param arbiter The arbiter
+ * @param context The context; a mask of MCE_LED_CONTEXT_*
+ */
+void mce_led_arbiter_set_context(mce_led_arbiter_t *arbiter,
+				 const guint context)
+{
+	if (context >= MCE_LED_CONTEXT_COUNT) {
+		mce_log(LL_ERR, "Invalid LED context %u", context);
+		goto EXIT;
+	}
+
+	arbiter->context = context;
+	arbiter_update(arbiter);
+
+EXIT:
+	return;
+}
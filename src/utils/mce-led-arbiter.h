@@ -0,0 +1,79 @@
+/**
+ * @file mce-led-arbiter.h
+ * Headers for the LED pattern arbitration of the Mode Control Entity
+ * <p>
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _MCE_LED_ARBITER_H_
+#define _MCE_LED_ARBITER_H_
+
+#include <glib.h>
+#include "mce.h"
+
+/** The system is in acting dead */
+#define MCE_LED_CONTEXT_ACTDEAD		(1 << 0)
+/** The display is off */
+#define MCE_LED_CONTEXT_DISPLAY_OFF	(1 << 1)
+/** The LED is enabled */
+#define MCE_LED_CONTEXT_LED_ENABLED	(1 << 2)
+/** Number of distinct contexts */
+#define MCE_LED_CONTEXT_COUNT		(1 << 3)
+
+/** LED arbiter */
+typedef struct mce_led_arbiter mce_led_arbiter_t;
+/** Pattern registered with an LED arbiter */
+typedef struct mce_led_arbiter_entry mce_led_arbiter_entry_t;
+
+/**
+ * Pattern visibility callback
+ *
+ * @param pattern The pattern
+ * @param context The context; a mask of MCE_LED_CONTEXT_*
+ * @return TRUE if the pattern may be shown in the context,
+ *         FALSE otherwise
+ */
+typedef gboolean (*mce_led_visible_cb)(gconstpointer pattern,
+				       const guint context);
+
+/**
+ * Callback for changes of the pattern to show
+ *
+ * @param old_pattern The pattern previously shown, or NULL
+ * @param new_pattern The pattern to show, or NULL
+ * @param user_data The user data passed to mce_led_arbiter_new()
+ */
+typedef void (*mce_led_changed_cb)(gpointer old_pattern,
+				   gpointer new_pattern,
+				   gpointer user_data);
+
+guint mce_led_context(const system_state_t system_state,
+		      const display_state_t display_state,
+		      const gboolean led_enabled);
+
+mce_led_arbiter_t *mce_led_arbiter_new(mce_led_visible_cb visible,
+				       mce_led_changed_cb changed,
+				       gpointer user_data);
+void mce_led_arbiter_free(mce_led_arbiter_t *arbiter);
+
+mce_led_arbiter_entry_t *mce_led_arbiter_add(mce_led_arbiter_t *arbiter,
+					     gpointer pattern,
+					     const gint priority);
+void mce_led_arbiter_activate(mce_led_arbiter_t *arbiter,
+			      mce_led_arbiter_entry_t *entry);
+void mce_led_arbiter_deactivate(mce_led_arbiter_t *arbiter,
+				mce_led_arbiter_entry_t *entry);
+void mce_led_arbiter_set_context(mce_led_arbiter_t *arbiter,
+				 const guint context);
+gpointer mce_led_arbiter_top(const mce_led_arbiter_t *arbiter);
+
+#endif /* _MCE_LED_ARBITER_H_ */
@@ -22,6 +22,7 @@
  */
 #include <glib.h>
 #include <string.h>
+#include <mce/mode-names.h>
 #include "mce.h"
 #include "mce-lib.h"
 
@@ -193,3 +194,89 @@ gchar *strstr_delim(const gchar *const haystack, const char *needle,
 EXIT:
 	return match;
 }
+
+/** Mapping of device mode integer <-> device mode string */
+const mce_translation_t mce_device_mode_translation[] = {
+	{
+		.number = MCE_NORMAL_MODE_INT32,
+		.string = MCE_NORMAL_MODE
+	}, {
+		.number = MCE_NORMAL_MODE_CONFIRM_INT32,
+		.string = MCE_NORMAL_MODE
+	}, {
+		.number = MCE_NORMAL_MODE_CONFIRM_INT32,
+		.string = MCE_NORMAL_MODE MCE_CONFIRM_SUFFIX
+	}, {
+		.number = MCE_FLIGHT_MODE_INT32,
+		.string = MCE_FLIGHT_MODE
+	}, {
+		.number = MCE_FLIGHT_MODE_CONFIRM_INT32,
+		.string = MCE_FLIGHT_MODE
+	}, {
+		.number = MCE_FLIGHT_MODE_CONFIRM_INT32,
+		.string = MCE_FLIGHT_MODE MCE_CONFIRM_SUFFIX
+	}, {
+		.number = MCE_OFFLINE_MODE_INT32,
+		.string = MCE_OFFLINE_MODE
+	}, {
+		.number = MCE_OFFLINE_MODE_CONFIRM_INT32,
+		.string = MCE_OFFLINE_MODE
+	}, {
+		.number = MCE_OFFLINE_MODE_CONFIRM_INT32,
+		.string = MCE_OFFLINE_MODE MCE_CONFIRM_SUFFIX
+	}, { /* MCE_INVALID_TRANSLATION marks the end of this array */
+		.number = MCE_INVALID_TRANSLATION,
+		.string = MCE_INVALID_MODE
+	}
+};
+
+/** Mapping of call state integer <-> call state string */
+const mce_translation_t mce_call_state_translation[] = {
+	{
+		.number = CALL_STATE_NONE,
+		.string = MCE_CALL_STATE_NONE
+	}, {
+		.number = CALL_STATE_RINGING,
+		.string = MCE_CALL_STATE_RINGING,
+	}, {
+		.number = CALL_STATE_ACTIVE,
+		.string = MCE_CALL_STATE_ACTIVE,
+	}, {
+		.number = CALL_STATE_SERVICE,
+		.string = MCE_CALL_STATE_SERVICE
+	}, { /* MCE_INVALID_TRANSLATION marks the end of this array */
+		.number = MCE_INVALID_TRANSLATION,
+		.string = MCE_CALL_STATE_NONE
+	}
+};
+
+/** Mapping of call type integer <-> call type string */
+const mce_translation_t mce_call_type_translation[] = {
+	{
+		.number = NORMAL_CALL,
+		.string = MCE_NORMAL_CALL
+	}, {
+		.number = EMERGENCY_CALL,
+		.string = MCE_EMERGENCY_CALL
+	}, { /* MCE_INVALID_TRANSLATION marks the end of this array */
+		.number = MCE_INVALID_TRANSLATION,
+		.string = MCE_NORMAL_CALL
+	}
+};
+
+/** Mapping of display state integer <-> display state string */
+const mce_translation_t mce_display_state_translation[] = {
+	{
+		.number = MCE_DISPLAY_OFF,
+		.string = MCE_DISPLAY_OFF_STRING
+	}, {
+		.number = MCE_DISPLAY_DIM,
+		.string = MCE_DISPLAY_DIM_STRING
+	}, {
+		.number = MCE_DISPLAY_ON,
+		.string = MCE_DISPLAY_ON_STRING
+	}, { /* MCE_INVALID_TRANSLATION marks the end of this array */
+		.number = MCE_INVALID_TRANSLATION,
+		.string = MCE_DISPLAY_ON_STRING
+	}
+};
@@ -44,5 +44,14 @@ gint mce_translate_string_to_int(const mce_translation_t translation[],
 gchar *strstr_delim(const gchar *const haystack, const char *needle,
 		    const char *const delimiter);
 
+/** Mapping of device mode integer <-> device mode string */
+extern const mce_translation_t mce_device_mode_translation[];
+/** Mapping of call state integer <-> call state string */
+extern const mce_translation_t mce_call_state_translation[];
+/** Mapping of call type integer <-> call type string */
+extern const mce_translation_t mce_call_type_translation[];
+/** Mapping of display state integer <-> display state string */
+extern const mce_translation_t mce_display_state_translation[];
+
 
 #endif /* _MCE_LIB_H_ */
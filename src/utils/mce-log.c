@@ -19,66 +19,819 @@
  * You should have received a copy of the GNU Lesser General Public
  * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
  */
+#include <time.h>
+#include <errno.h>
+#include <ctype.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #ifndef _BSD_SOURCE
 #define _BSD_SOURCE
 #endif /* _BSD_SOURCE */
 #include <syslog.h>
+#include <glib.h>
 #include "mce-log.h"
 
-static unsigned int logverbosity = LL_WARN;	/**< Log verbosity */
+/** Number of messages kept in the log ring */
+#define LOG_RING_SIZE			512
+
+/** Maximum number of format arguments stored per message */
+#define LOG_RING_MAX_ARGS		8
+
+/** Space for copies of string arguments per message */
+#define LOG_RING_STRING_SIZE		96
+
+/** Space for the copy of the format string per message */
+#define LOG_RING_FMT_SIZE		112
+
+/** Space for the copy of the source file and function per message */
+#define LOG_RING_LOCATION_SIZE		48
+
+/** Maximum number of per-file log level overrides */
+#define LOG_MAX_FILE_LEVELS		16
+
+/** Default rate limit window for a single call site; seconds */
+#define LOG_RATE_DEFAULT_INTERVAL	5
+
+/** Default number of messages a call site may log per window */
+#define LOG_RATE_DEFAULT_BURST		10
+
+/** Maximum number of call sites with suppressed messages at a time */
+#define LOG_MAX_SUPPRESSED		16
+
+/** Per-file log level override */
+typedef struct {
+	char name[32];			/**< File or module name */
+	int level;			/**< Verbosity for the file */
+} log_file_level_t;
+
+/** A raw format argument */
+typedef union {
+	intmax_t i;			/**< Integer argument */
+	double d;			/**< Floating point argument */
+	const void *p;			/**< Pointer argument */
+	size_t s;			/**< Offset of a copied string */
+} log_ring_arg_t;
+
+/** A message in the log ring, stored unformatted */
+typedef struct {
+	struct timespec ts;		/**< CLOCK_MONOTONIC timestamp */
+	loglevel_t loglevel;		/**< Level of severity */
+	unsigned int nargs;		/**< Number of stored arguments */
+	int truncated;			/**< Arguments did not fit */
+	int saved_errno;		/**< errno, for %m */
+	log_ring_arg_t args[LOG_RING_MAX_ARGS];	/**< Raw arguments */
+	char strings[LOG_RING_STRING_SIZE];	/**< String arguments */
+	char fmt[LOG_RING_FMT_SIZE];	/**< Format string */
+	char location[LOG_RING_LOCATION_SIZE];	/**< "file:function" */
+} log_ring_entry_t;
+
+static int logverbosity = LL_WARN;		/**< Log verbosity */
+static int ringverbosity = MCE_LOG_RING_DEFAULT_LEVEL;	/**< Ring verbosity */
 static int logtype = MCE_LOG_SYSLOG;		/**< Output for log messages */
 static char *logname = NULL;
 
+/** Most verbose level that is either logged or captured in the log ring */
+int mce_log_threshold = MCE_LOG_RING_DEFAULT_LEVEL;
+
+/** Per-file log level overrides */
+static log_file_level_t file_levels[LOG_MAX_FILE_LEVELS];
+
+/** Number of per-file log level overrides in use */
+static unsigned int file_levels_count = 0;
+
+/** Generation of the log level configuration; bumped on every change */
+static unsigned int log_generation = 1;
+
+/** Messages suppressed for a call site in its current window */
+typedef struct {
+	const mce_log_site_t *site;	/**< The call site; only compared,
+					 *   since its module may be unloaded */
+	loglevel_t loglevel;		/**< Level of the suppressed messages */
+	long window;			/**< Start of the rate limit window */
+	unsigned int suppressed;	/**< Number of suppressed messages */
+	char location[LOG_RING_LOCATION_SIZE];	/**< "file:function" */
+} log_suppressed_t;
+
+/** Messages a call site may log per window; 0 disables rate limiting */
+static unsigned int rate_burst = LOG_RATE_DEFAULT_BURST;
+
+/** Length of the rate limit window; seconds */
+static unsigned int rate_interval = LOG_RATE_DEFAULT_INTERVAL;
+
+/** Call sites with suppressed messages */
+static log_suppressed_t log_suppressed[LOG_MAX_SUPPRESSED];
+
+/** Number of call sites with suppressed messages */
+static unsigned int log_suppressed_count = 0;
+
+/** Timeout for reporting suppressed messages; 0 if not armed */
+static guint log_suppressed_cb_id = 0;
+
+/** The log ring */
+static log_ring_entry_t log_ring[LOG_RING_SIZE];
+
+/** Number of messages written to the log ring in total */
+static unsigned long log_ring_count = 0;
+
+/** Format conversion of a log ring argument */
+typedef struct {
+	char conv;			/**< Conversion specifier */
+	char length[3];			/**< Length modifier */
+	int stars;			/**< Number of '*' width/precision */
+	const char *end;		/**< First character after the spec */
+} log_ring_spec_t;
+
+/**
+ * Parse a printf conversion specification
+ *
+ * @param p Pointer to the character after the '%'
+ * @param[out] spec The parsed conversion specification
+ * @return TRUE if the specification could be parsed, FALSE otherwise
+ */
+static int log_ring_parse_spec(const char *p, log_ring_spec_t *spec)
+{
+	size_t i = 0;
+
+	memset(spec, 0, sizeof (*spec));
+
+	while ((*p != '\0') && (strchr("-+ #0'", *p) != NULL))
+		p++;
+
+	if (*p == '*') {
+		spec->stars++;
+		p++;
+	} else {
+		while (isdigit((unsigned char)*p))
+			p++;
+	}
+
+	if (*p == '.') {
+		p++;
+
+		if (*p == '*') {
+			spec->stars++;
+			p++;
+		} else {
+			while (isdigit((unsigned char)*p))
+				p++;
+		}
+	}
+
+	while ((*p != '\0') && (strchr("hlLqjzt", *p) != NULL) &&
+	       (i < sizeof (spec->length) - 1))
+		spec->length[i++] = *p++;
+
+	if ((*p == '\0') || (strchr("diouxXcseEfFgGaApm", *p) == NULL))
+		return 0;
+
+	spec->conv = *p;
+	spec->end = p + 1;
+
+	return 1;
+}
+
+/**
+ * Fetch an integer argument with the given length modifier
+ *
+ * @param length The length modifier
+ * @param is_signed Non-zero for signed conversions
+ * @param args The argument list
+ * @return The argument
+ */
+static intmax_t log_ring_fetch_int(const char *length, int is_signed,
+				   va_list *args)
+{
+	if (!strcmp(length, "l"))
+		return is_signed ? (intmax_t)va_arg(*args, long) :
+				   (intmax_t)va_arg(*args, unsigned long);
+	else if (!strcmp(length, "ll") || !strcmp(length, "q"))
+		return is_signed ? (intmax_t)va_arg(*args, long long) :
+				   (intmax_t)va_arg(*args, unsigned long long);
+	else if (!strcmp(length, "j"))
+		return va_arg(*args, intmax_t);
+	else if (!strcmp(length, "z"))
+		return (intmax_t)va_arg(*args, size_t);
+	else if (!strcmp(length, "t"))
+		return (intmax_t)va_arg(*args, ptrdiff_t);
+	else
+		return is_signed ? (intmax_t)va_arg(*args, int) :
+				   (intmax_t)va_arg(*args, unsigned int);
+}
+
+/**
+ * Store a message in the log ring without formatting it
+ *
+ * The format string and location are copied, since they may
+ * belong to a module that is unloaded before the ring is dumped
+ *
+ * @param loglevel The level of severity for this message
+ * @param file The source file
+ * @param function The function
+ * @param fmt The format string for this message
+ * @param args Input to the format string
+ */
+static void log_ring_store(const loglevel_t loglevel, const char *const file,
+			   const char *const function, const char *const fmt,
+			   va_list *args)
+{
+	log_ring_entry_t *entry = &log_ring[log_ring_count++ % LOG_RING_SIZE];
+	size_t strings_used = 0;
+	log_ring_spec_t spec;
+	const char *p;
+
+	entry->saved_errno = errno;
+	clock_gettime(CLOCK_MONOTONIC, &entry->ts);
+	entry->loglevel = loglevel;
+	entry->nargs = 0;
+	entry->truncated = (strlen(fmt) >= sizeof (entry->fmt));
+	snprintf(entry->fmt, sizeof (entry->fmt), "%s", fmt);
+	snprintf(entry->location, sizeof (entry->location), "%s:%s",
+		 (p = strrchr(file, '/')) != NULL ? p + 1 : file, function);
+
+	/* Only the arguments of the stored part of the format are kept */
+	for (p = entry->fmt; (p = strchr(p, '%')) != NULL; p = spec.end) {
+		int i;
+
+		if (p[1] == '%') {
+			spec.end = p + 2;
+			continue;
+		}
+
+		if ((log_ring_parse_spec(p + 1, &spec) == 0) ||
+		    (entry->nargs + spec.stars + 1 > LOG_RING_MAX_ARGS) ||
+		    (spec.conv == 'n') ||
+		    ((spec.conv == 's') && (spec.length[0] != '\0'))) {
+			entry->truncated = 1;
+			break;
+		}
+
+		for (i = 0; i < spec.stars; i++)
+			entry->args[entry->nargs++].i = va_arg(*args, int);
+
+		switch (spec.conv) {
+		case 'm':
+			/* No argument; formatted from the saved errno */
+			break;
+
+		case 's': {
+			const char *str = va_arg(*args, const char *);
+			size_t len;
+
+			if (str == NULL)
+				str = "(null)";
+
+			len = strlen(str);
+
+			if (len >= sizeof (entry->strings) - strings_used)
+				len = sizeof (entry->strings) - strings_used - 1;
+
+			memcpy(entry->strings + strings_used, str, len);
+			entry->strings[strings_used + len] = '\0';
+			entry->args[entry->nargs++].s = strings_used;
+			strings_used += len + 1;
+
+			if (strings_used >= sizeof (entry->strings))
+				strings_used = sizeof (entry->strings) - 1;
+			break;
+		}
+
+		case 'p':
+			entry->args[entry->nargs++].p = va_arg(*args, void *);
+			break;
+
+		case 'e': case 'E': case 'f': case 'F':
+		case 'g': case 'G': case 'a': case 'A':
+			entry->args[entry->nargs++].d =
+				(spec.length[0] == 'L') ?
+				(double)va_arg(*args, long double) :
+				va_arg(*args, double);
+			break;
+
+		case 'd': case 'i': case 'c':
+			entry->args[entry->nargs++].i =
+				log_ring_fetch_int(spec.length, 1, args);
+			break;
+
+		default:
+			entry->args[entry->nargs++].i =
+				log_ring_fetch_int(spec.length, 0, args);
+			break;
+		}
+	}
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+
+/**
+ * Format a single conversion of a log ring message
+ *
+ * @param stream The stream to write to
+ * @param start Pointer to the '%' of the conversion
+ * @param spec The parsed conversion specification
+ * @param entry The log ring message
+ * @param arg Index of the next argument; updated
+ */
+static void log_ring_format_spec(FILE *const stream, const char *start,
+				 const log_ring_spec_t *spec,
+				 const log_ring_entry_t *entry,
+				 unsigned int *arg)
+{
+	/* Room for the spec, with every '*' replaced by an int */
+	size_t size = (spec->end - start) + spec->stars * 11 + 1;
+	char buf[size];
+	size_t len = 0;
+	const char *p;
+
+	/* Substitute stored '*' arguments, so that only
+	 * the argument of the conversion itself is left
+	 */
+	for (p = start; p < spec->end; p++) {
+		if (*p == '*') {
+			int rc = snprintf(buf + len, size - len, "%d",
+					  (int)entry->args[(*arg)++].i);
+
+			if ((rc < 0) || ((size_t)rc >= size - len)) {
+				fputs("[bad format]", stream);
+				goto EXIT;
+			}
+
+			len += rc;
+		} else {
+			buf[len++] = *p;
+		}
+	}
+
+	buf[len] = '\0';
+
+	switch (spec->conv) {
+	case 'm':
+		fputs(strerror(entry->saved_errno), stream);
+		break;
+
+	case 's':
+		fprintf(stream, buf, entry->strings + entry->args[*arg].s);
+		break;
+
+	case 'p':
+		fprintf(stream, buf, entry->args[*arg].p);
+		break;
+
+	case 'e': case 'E': case 'f': case 'F':
+	case 'g': case 'G': case 'a': case 'A':
+		if (spec->length[0] == 'L')
+			fprintf(stream, buf, (long double)entry->args[*arg].d);
+		else
+			fprintf(stream, buf, entry->args[*arg].d);
+		break;
+
+	default:
+		if (!strcmp(spec->length, "l"))
+			fprintf(stream, buf, (long)entry->args[*arg].i);
+		else if (!strcmp(spec->length, "ll") ||
+			 !strcmp(spec->length, "q"))
+			fprintf(stream, buf, (long long)entry->args[*arg].i);
+		else if (!strcmp(spec->length, "j"))
+			fprintf(stream, buf, entry->args[*arg].i);
+		else if (!strcmp(spec->length, "z"))
+			fprintf(stream, buf, (size_t)entry->args[*arg].i);
+		else if (!strcmp(spec->length, "t"))
+			fprintf(stream, buf, (ptrdiff_t)entry->args[*arg].i);
+		else
+			fprintf(stream, buf, (int)entry->args[*arg].i);
+		break;
+	}
+
+	if (spec->conv != 'm')
+		(*arg)++;
+
+EXIT:
+	return;
+}
+
+#pragma GCC diagnostic pop
+
+/**
+ * Format a log ring message
+ *
+ * @param stream The stream to write to
+ * @param entry The log ring message
+ */
+static void log_ring_format(FILE *const stream, const log_ring_entry_t *entry)
+{
+	static const char levels[] = "-CEWID";
+	unsigned int arg = 0;
+	log_ring_spec_t spec;
+	const char *p;
+
+	fprintf(stream, "[%5ld.%06ld] %c %s(): ",
+		(long)entry->ts.tv_sec, entry->ts.tv_nsec / 1000,
+		levels[entry->loglevel], entry->location);
+
+	for (p = entry->fmt; *p != '\0'; p = spec.end) {
+		const char *next = strchr(p, '%');
+
+		if (next == NULL) {
+			fputs(p, stream);
+			break;
+		}
+
+		fwrite(p, 1, next - p, stream);
+
+		if (next[1] == '%') {
+			fputc('%', stream);
+			spec.end = next + 2;
+			continue;
+		}
+
+		/* %m takes no argument; it is formatted from the saved errno */
+		if ((log_ring_parse_spec(next + 1, &spec) == 0) ||
+		    (arg + spec.stars + (spec.conv != 'm') > entry->nargs)) {
+			/* The rest could not be stored */
+			fputs(next, stream);
+			break;
+		}
+
+		log_ring_format_spec(stream, next, &spec, entry, &arg);
+	}
+
+	if (entry->truncated != 0)
+		fputs(" [truncated]", stream);
+
+	fputc('\n', stream);
+}
+
+/**
+ * Format and write all messages in the log ring, oldest first
+ *
+ * @param stream The stream to write the messages to
+ */
+void mce_log_ring_dump(FILE *const stream)
+{
+	unsigned long i = 0;
+
+	if (log_ring_count > LOG_RING_SIZE)
+		i = log_ring_count - LOG_RING_SIZE;
+
+	for (; i < log_ring_count; i++)
+		log_ring_format(stream, &log_ring[i % LOG_RING_SIZE]);
+
+	fflush(stream);
+}
+
+/**
+ * Write a message to the log output
+ *
+ * @param loglevel The level of severity for this message
+ * @param fmt The format string for this message
+ * @param args Input to the format string
+ */
+static void log_output_va(const loglevel_t loglevel, const char *const fmt,
+			  va_list args)
+	__attribute__((format(printf, 2, 0)));
+static void log_output_va(const loglevel_t loglevel, const char *const fmt,
+			  va_list args)
+{
+	if (logtype == MCE_LOG_STDERR) {
+		fprintf(stderr, "%s: ", logname);
+		vfprintf(stderr, fmt, args);
+		fprintf(stderr, "\n");
+	} else {
+		switch (loglevel) {
+			case LL_DEBUG:
+				vsyslog(LOG_DEBUG, fmt, args);
+				break;
+
+			case LL_ERR:
+				vsyslog(LOG_ERR, fmt, args);
+				break;
+
+			case LL_CRIT:
+				vsyslog(LOG_CRIT, fmt, args);
+				break;
+
+			case LL_INFO:
+				vsyslog(LOG_INFO, fmt, args);
+				break;
+
+			case LL_WARN:
+			default:
+				vsyslog(LOG_WARNING, fmt, args);
+				break;
+		}
+	}
+}
+
 /**
+ * Write a message to the log output
  *
  * @param loglevel The level of severity for this message
  * @param fmt The format string for this message
  * @param ... Input to the format string
  */
-void mce_log(const loglevel_t loglevel, const char *const fmt, ...)
+static void log_output(const loglevel_t loglevel, const char *const fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+static void log_output(const loglevel_t loglevel, const char *const fmt, ...)
 {
 	va_list args;
 
 	va_start(args, fmt);
+	log_output_va(loglevel, fmt, args);
+	va_end(args);
+}
 
-	if (logverbosity >= loglevel) {
-		if (logtype == MCE_LOG_STDERR) {
-			fprintf(stderr, "%s: ", logname);
-			vfprintf(stderr, fmt, args);
-			fprintf(stderr, "\n");
-		} else {
-			switch (loglevel) {
-				case LL_DEBUG:
-					vsyslog(LOG_DEBUG, fmt, args);
-					break;
-
-				case LL_ERR:
-					vsyslog(LOG_ERR, fmt, args);
-					break;
-
-				case LL_CRIT:
-					vsyslog(LOG_CRIT, fmt, args);
-					break;
-
-				case LL_INFO:
-					vsyslog(LOG_INFO, fmt, args);
-					break;
-
-				case LL_WARN:
-				default:
-					vsyslog(LOG_WARNING, fmt, args);
-													break;
+/**
+ * Get the verbosity for a source file
+ *
+ * @param file The source file
+ * @return The per-file verbosity if one is set,
+ *         the global verbosity otherwise
+ */
+static int log_file_verbosity(const char *const file)
+{
+	const char *base = strrchr(file, '/');
+	size_t baselen;
+	unsigned int i;
+
+	base = (base != NULL) ? base + 1 : file;
+	baselen = strlen(base);
+
+	/* Strip the extension, so that modules can be
+	 * referred to by name as well as by file name
+	 */
+	if ((baselen > 2) && (strcmp(base + baselen - 2, ".c") == 0))
+		baselen -= 2;
+
+	for (i = 0; i < file_levels_count; i++) {
+		const char *name = file_levels[i].name;
+
+		if ((strcmp(name, base) == 0) ||
+		    ((strlen(name) == baselen) &&
+		     (strncmp(name, base, baselen) == 0)))
+			return file_levels[i].level;
+	}
+
+	return logverbosity;
+}
+
+/**
+ * Report the messages suppressed for a call site and forget about them
+ *
+ * @param i Index of the call site in log_suppressed
+ */
+static void log_suppressed_flush(const unsigned int i)
+{
+	log_output(log_suppressed[i].loglevel, "%s(): %u messages suppressed",
+		   log_suppressed[i].location, log_suppressed[i].suppressed);
+
+	log_suppressed[i] = log_suppressed[--log_suppressed_count];
+}
+
+/**
+ * Report the messages suppressed in windows that have ended
+ *
+ * @param all TRUE to report all suppressed messages,
+ *            FALSE to report only those of ended windows
+ */
+static void log_suppressed_flush_ended(const gboolean all)
+{
+	struct timespec ts;
+	unsigned int i = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	while (i < log_suppressed_count) {
+		if ((all == TRUE) ||
+		    ((ts.tv_sec - log_suppressed[i].window) >=
+		     (long)rate_interval))
+			log_suppressed_flush(i);
+		else
+			i++;
+	}
+}
+
+/**
+ * Timeout callback for reporting suppressed messages,
+ * so that they are reported even if the call site goes quiet
+ *
+ * @param data Unused
+ * @return TRUE while messages are still being suppressed, FALSE otherwise
+ */
+static gboolean log_suppressed_cb(gpointer data)
+{
+	(void)data;
+
+	log_suppressed_flush_ended(FALSE);
+
+	if (log_suppressed_count == 0) {
+		log_suppressed_cb_id = 0;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * Count a suppressed message of a call site
+ *
+ * @param site The call site
+ * @param loglevel The level of severity for this message
+ * @return TRUE if the message was counted,
+ *         FALSE if it has to be logged since there is no room to count it
+ */
+static gboolean log_suppressed_add(const mce_log_site_t *const site,
+				   const loglevel_t loglevel)
+{
+	log_suppressed_t *entry = NULL;
+	unsigned int i;
+
+	for (i = 0; i < log_suppressed_count; i++) {
+		if (log_suppressed[i].site == site) {
+			entry = &log_suppressed[i];
+			break;
+		}
+	}
+
+	if (entry == NULL) {
+		if (log_suppressed_count == LOG_MAX_SUPPRESSED)
+			return FALSE;
+
+		entry = &log_suppressed[log_suppressed_count++];
+		entry->site = site;
+		entry->window = site->window;
+		entry->suppressed = 0;
+		snprintf(entry->location, sizeof (entry->location), "%s:%s",
+			 site->file, site->function);
+	}
+
+	entry->loglevel = loglevel;
+	entry->suppressed++;
+
+	if (log_suppressed_cb_id == 0)
+		log_suppressed_cb_id = g_timeout_add_seconds(rate_interval,
+							     log_suppressed_cb,
+							     NULL);
+
+	return TRUE;
+}
+
+/**
+ * Check the rate limit of a call site
+ *
+ * @param site The call site
+ * @param loglevel The level of severity for this message
+ * @return Non-zero if the message should be suppressed, 0 otherwise
+ */
+static int log_rate_limited(mce_log_site_t *const site,
+			    const loglevel_t loglevel)
+{
+	struct timespec ts;
+	unsigned int i;
+
+	/* Every level is limited, since the storms worth limiting
+	 * are usually errors; what is dropped is still reported
+	 * in a summary once the window ends
+	 */
+	if (rate_burst == 0)
+		return 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	if ((ts.tv_sec - site->window) >= (long)rate_interval) {
+		for (i = 0; i < log_suppressed_count; i++) {
+			if (log_suppressed[i].site == site) {
+				log_suppressed_flush(i);
+				break;
 			}
 		}
+
+		site->window = ts.tv_sec;
+		site->count = 0;
 	}
 
+	if ((site->count >= rate_burst) &&
+	    (log_suppressed_add(site, loglevel) == TRUE))
+		return 1;
+
+	site->count++;
+
+	return 0;
+}
+
+/**
+ * Log a message, capture it in the log ring, or both
+ *
+ * @param site The call site; NULL to skip rate limiting
+ * @param verbosity The verbosity that applies to the message
+ * @param loglevel The level of severity for this message
+ * @param file The source file
+ * @param function The function
+ * @param fmt The format string for this message
+ * @param args Input to the format string
+ */
+static void log_message(mce_log_site_t *const site, const int verbosity,
+			const loglevel_t loglevel, const char *const file,
+			const char *const function, const char *const fmt,
+			va_list *args)
+	__attribute__((format(printf, 6, 0)));
+static void log_message(mce_log_site_t *const site, const int verbosity,
+			const loglevel_t loglevel, const char *const file,
+			const char *const function, const char *const fmt,
+			va_list *args)
+{
+	if (ringverbosity >= (int)loglevel) {
+		va_list copy;
+
+		va_copy(copy, *args);
+		log_ring_store(loglevel, file, function, fmt, &copy);
+		va_end(copy);
+	}
+
+	if (verbosity < (int)loglevel)
+		goto EXIT;
+
+	/* Only the log output is rate limited;
+	 * the log ring is cheap enough to take everything
+	 */
+	if ((site != NULL) && (log_rate_limited(site, loglevel) != 0))
+		goto EXIT;
+
+	log_output_va(loglevel, fmt, *args);
+
+EXIT:
+	return;
+}
+
+/**
+ * Log a message from a call site; use the mce_log() macro
+ * rather than calling this directly
+ *
+ * @param site The call site
+ * @param loglevel The level of severity for this message
+ * @param fmt The format string for this message
+ * @param ... Input to the format string
+ */
+void mce_log_site(mce_log_site_t *const site, const loglevel_t loglevel,
+		  const char *const fmt, ...)
+{
+	va_list args;
+
+	/* Resolve the verbosity once per configuration change,
+	 * rather than looking up the file on every message
+	 */
+	if (site->generation != log_generation) {
+		site->level = log_file_verbosity(site->file);
+		site->generation = log_generation;
+	}
+
+	va_start(args, fmt);
+	log_message(site, site->level, loglevel, site->file, site->function,
+		    fmt, &args);
+	va_end(args);
+}
+
+/**
+ * Log a message without call site state
+ *
+ * @param loglevel The level of severity for this message
+ * @param file The source file
+ * @param function The function
+ * @param fmt The format string for this message
+ * @param ... Input to the format string
+ */
+void mce_log_file(const loglevel_t loglevel, const char *const file,
+		  const char *const function, const char *const fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	log_message(NULL, log_file_verbosity(file), loglevel,
+		    file, function, fmt, &args);
 	va_end(args);
 }
 
+/**
+ * Update the threshold checked by mce_log_p()
+ */
+static void mce_log_update_threshold(void)
+{
+	unsigned int i;
+
+	mce_log_threshold = (logverbosity > ringverbosity) ?
+			    logverbosity : ringverbosity;
+
+	for (i = 0; i < file_levels_count; i++) {
+		if (file_levels[i].level > mce_log_threshold)
+			mce_log_threshold = file_levels[i].level;
+	}
+
+	log_generation++;
+}
+
 /**
  * Set log verbosity
  * messages with loglevel higher than or equal to verbosity will be logged
@@ -88,6 +841,77 @@ void mce_log(const loglevel_t loglevel, const char *const fmt, ...)
 void mce_log_set_verbosity(const int verbosity)
 {
 	logverbosity = verbosity;
+	mce_log_update_threshold();
+}
+
+/**
+ * Set log verbosity for a single source file or module
+ *
+ * @param name The file name, or the module name
+ *             (the file name without the .c extension)
+ * @param verbosity minimum level for log level;
+ *                  negative to use the global verbosity again
+ * @return 0 on success, -1 if there is no room for more overrides
+ */
+int mce_log_set_file_verbosity(const char *const name, const int verbosity)
+{
+	unsigned int i;
+	int status = 0;
+
+	for (i = 0; i < file_levels_count; i++) {
+		if (strcmp(file_levels[i].name, name) == 0)
+			break;
+	}
+
+	if (verbosity < 0) {
+		/* Remove the override, if there is one */
+		if (i < file_levels_count)
+			file_levels[i] = file_levels[--file_levels_count];
+	} else if (i < file_levels_count) {
+		file_levels[i].level = verbosity;
+	} else if (file_levels_count < LOG_MAX_FILE_LEVELS) {
+		snprintf(file_levels[i].name, sizeof (file_levels[i].name),
+			 "%s", name);
+		file_levels[i].level = verbosity;
+		file_levels_count++;
+	} else {
+		status = -1;
+	}
+
+	mce_log_update_threshold();
+
+	return status;
+}
+
+/**
+ * Set log ring verbosity
+ * messages with loglevel higher than or equal to verbosity
+ * will be captured in the log ring; LL_NONE disables the log ring
+ *
+ * @param verbosity minimum level for log level
+ */
+void mce_log_set_ring_verbosity(const int verbosity)
+{
+	ringverbosity = verbosity;
+	mce_log_update_threshold();
+}
+
+/**
+ * Set the rate limit of a single call site;
+ * it applies to messages of all levels
+ *
+ * @param burst The number of messages a call site may log per window;
+ *              0 disables rate limiting
+ * @param interval The length of the window in seconds
+ */
+void mce_log_set_rate_limit(const unsigned int burst,
+			    const unsigned int interval)
+{
+	/* Report what has been suppressed under the old limit */
+	log_suppressed_flush_ended(TRUE);
+
+	rate_burst = burst;
+	rate_interval = (interval > 0) ? interval : 1;
 }
 
 /**
@@ -112,6 +936,13 @@ void mce_log_open(const char *const name, const int facility, const int type)
  */
 void mce_log_close(void)
 {
+	log_suppressed_flush_ended(TRUE);
+
+	if (log_suppressed_cb_id != 0) {
+		g_source_remove(log_suppressed_cb_id);
+		log_suppressed_cb_id = 0;
+	}
+
 	if (logname)
 		free(logname);
 
@@ -22,6 +22,7 @@
 #ifndef _MCE_LOG_H_
 #define _MCE_LOG_H_
 
+#include <stdio.h>	/* FILE */
 #include <syslog.h>	/* LOG_DAEMON, LOG_USER */
 
 #define MCE_LOG_SYSLOG			1	/**< Log to syslog */
@@ -38,9 +39,80 @@ typedef enum {
 	LL_DEBUG = 5			/**< Useful when debugging */
 } loglevel_t;
 
-void mce_log(const loglevel_t loglevel, const char *const fmt, ...)
-	__attribute__((format(printf, 2, 3)));
+/**
+ * Most verbose level that is compiled in;
+ * calls to mce_log() above this level are optimised away
+ */
+#ifndef MCE_LOG_MAX_LEVEL
+#define MCE_LOG_MAX_LEVEL		LL_DEBUG
+#endif /* MCE_LOG_MAX_LEVEL */
+
+/**
+ * Default level of the messages captured in the log ring;
+ * debug messages are captured too, so that a dump has the full trace.
+ * The ring level also raises the threshold checked by mce_log_p(),
+ * so debug messages evaluate their arguments; they are stored
+ * unformatted, which keeps that cheap
+ */
+#ifndef MCE_LOG_RING_DEFAULT_LEVEL
+#define MCE_LOG_RING_DEFAULT_LEVEL	LL_DEBUG
+#endif /* MCE_LOG_RING_DEFAULT_LEVEL */
+
+/** Most verbose level that is either logged or captured in the log ring */
+extern int mce_log_threshold;
+
+/**
+ * Check whether a message at the given level would be
+ * logged or captured in the log ring
+ *
+ * @param LEV The level of severity
+ */
+#define mce_log_p(LEV) \
+	(((LEV) <= MCE_LOG_MAX_LEVEL) && ((int)(LEV) <= mce_log_threshold))
+
+/** State of a single mce_log() call site */
+typedef struct {
+	const char *const file;		/**< Source file */
+	const char *const function;	/**< Function */
+	unsigned int generation;	/**< Level configuration generation
+					 *   that level was resolved for */
+	int level;			/**< Verbosity for this call site */
+	long window;			/**< Start of the rate limit window */
+	unsigned int count;		/**< Messages logged in the window */
+} mce_log_site_t;
+
+/**
+ * Log a message;
+ * the arguments are only evaluated if the message is logged
+ * or captured in the log ring
+ *
+ * @param LEV The level of severity for this message
+ * @param FMT The format string for this message
+ * @param ARGS Input to the format string
+ */
+#define mce_log(LEV, FMT, ARGS...) \
+	do { \
+		static mce_log_site_t mce_log_callsite = { \
+			.file = __FILE__, \
+			.function = __FUNCTION__ \
+		}; \
+		if (mce_log_p(LEV)) \
+			mce_log_site(&mce_log_callsite, LEV, \
+				     FMT , ## ARGS); \
+	} while (0)
+
+void mce_log_site(mce_log_site_t *const site, const loglevel_t loglevel,
+		  const char *const fmt, ...)
+	__attribute__((format(printf, 3, 4)));
+void mce_log_file(const loglevel_t loglevel, const char *const file,
+		  const char *const function, const char *const fmt, ...)
+	__attribute__((format(printf, 4, 5)));
 void mce_log_set_verbosity(const int verbosity);
+int mce_log_set_file_verbosity(const char *const name, const int verbosity);
+void mce_log_set_ring_verbosity(const int verbosity);
+void mce_log_set_rate_limit(const unsigned int burst,
+			    const unsigned int interval);
+void mce_log_ring_dump(FILE *const stream);
 void mce_log_open(const char *const name, const int facility, const int type);
 void mce_log_close(void);
 
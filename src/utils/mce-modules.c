@@ -21,61 +21,231 @@
  */
 #include <glib.h>
 #include <gmodule.h>
+#include <dlfcn.h>
 #include "mce.h"
 #include "mce-modules.h"
 #include "mce-log.h"
 #include "mce-conf.h"
+#include "mce-profile.h"
 
-/** List of all loaded modules */
+/** Module has not been visited by the dependency sort yet */
+#define MODULE_STATE_UNSORTED		0
+/** Module is being visited by the dependency sort */
+#define MODULE_STATE_SORTING		1
+/** Module has been placed in the initialisation order */
+#define MODULE_STATE_SORTED		2
+
+/** Module bookkeeping entry */
+typedef struct {
+	gchar *name;				/**< Name from the module list */
+	gchar *path;				/**< Full path of the module */
+	void *handle;				/**< dlopen() handle; NULL once
+						 *   handed over to GModule */
+	const module_info_struct *info;		/**< Module information */
+	const mce_static_module_t *builtin;	/**< Static module table entry;
+						 *   NULL for loadable modules */
+	GModule *module;			/**< GModule; NULL until
+						 *   the module is initialised,
+						 *   and for built-in modules */
+	gboolean initialised;			/**< Module is initialised */
+	gint state;				/**< Dependency sort state */
+	gboolean critical;			/**< Initialise before ready */
+	gboolean dropped;			/**< Module will not be used */
+} module_entry_t;
+
+/**
+ * Functionality that is needed before mce reports that it is ready;
+ * this covers the device lock, and all modules that offer D-Bus methods,
+ * so that clients started after mce never see the lock unset
+ * or get UnknownMethod replies
+ */
+static const gchar *const default_critical_provides[] = {
+	"rtconf", "power", "display", "x11-ctrl", "input-ctrl",
+	"lock", "devlock", "battery", "inactivity", "inactivity-inhibit",
+	"callstate", "state-dbus", "alarm", "audiorouting",
+	"button-backlight", "evdevvibrator", "accelerometer",
+	"led-dbus", "key-dbus", "startup-hildon", NULL
+};
+
+/** Entries of all initialised modules, most recently initialised first */
 static GSList *modules = NULL;
 
-static gboolean mce_modules_check_provides(module_info_struct *new_module_info)
+/** Bookkeeping entries for all modules in the module lists */
+static GPtrArray *module_entries = NULL;
+
+/** Map from provided functionality to the module providing it */
+static GHashTable *module_providers = NULL;
+
+/** Modules waiting for deferred initialisation, in dependency order */
+static GQueue *pending_modules = NULL;
+
+/** ID for the deferred module initialisation idle callback */
+static guint deferred_init_cb_id = 0;
+
+/**
+ * Stop tracking the functionality provided by a module
+ *
+ * @param entry The module entry
+ */
+static void mce_modules_remove_provides(module_entry_t *entry)
 {
-	for (GSList *module = modules; module; module = module->next) {
-		gpointer mip = NULL;
-		module_info_struct *module_info;
-		if (g_module_symbol(module->data, "module_info", &mip) == FALSE)
-			continue;
-		module_info = (module_info_struct*)mip;
-		for (int i = 0; new_module_info->provides[i]; ++i) {
-			for (int j = 0; module_info->provides[j]; ++j) {
-				if (g_strcmp0(new_module_info->provides[i], module_info->provides[j]) == 0) {
-					mce_log(LL_WARN, "Module %s has the same provides as module %s, and will not be loaded.",
-							new_module_info->name, module_info->name);
-					return FALSE;
-				}
-			}
-		}
+	for (int i = 0; entry->info->provides[i]; ++i) {
+		if (g_hash_table_lookup(module_providers,
+					entry->info->provides[i]) == entry)
+			g_hash_table_remove(module_providers,
+					    entry->info->provides[i]);
 	}
-	return TRUE;
 }
 
-static gboolean mce_modules_check_essential(void)
+/**
+ * Drop a module that will not be initialised
+ *
+ * @param entry The module entry
+ */
+static void mce_modules_drop(module_entry_t *entry)
 {
-	gboolean foundRtconf = FALSE;
-	
-	for (GSList *module = modules; module; module = module->next) {
-		gpointer mip = NULL;
-		module_info_struct *module_info;
-		if (g_module_symbol(module->data, "module_info", (void**)&mip) == FALSE)
-			continue;
-		module_info = (module_info_struct*)mip;
-		for (int j = 0; module_info->provides[j]; ++j) {
-			if (g_strcmp0("rtconf", module_info->provides[j]) == 0) {
-				foundRtconf = TRUE;
-				break;
-			}
+	if (entry->info != NULL)
+		mce_modules_remove_provides(entry);
+
+	if (entry->handle != NULL) {
+		dlclose(entry->handle);
+		entry->handle = NULL;
+	}
+
+	entry->info = NULL;
+	entry->dropped = TRUE;
+}
+
+/**
+ * Register the functionality provided by a module;
+ * when two modules provide the same functionality,
+ * the one with the higher priority (lower value) is kept,
+ * and the one listed first wins a tie. The other module is
+ * dropped completely, including any other functionality it provides
+ *
+ * @param entry The module entry
+ * @return TRUE if the module is kept, FALSE if it was dropped
+ */
+static gboolean mce_modules_check_provides(module_entry_t *entry)
+{
+	const module_info_struct *info = entry->info;
+
+	for (int i = 0; info->provides[i]; ++i) {
+		module_entry_t *other =
+			g_hash_table_lookup(module_providers,
+					    info->provides[i]);
+
+		if ((other != NULL) &&
+		    (info->priority >= other->info->priority)) {
+			mce_log(LL_WARN, "Module %s (priority %d) has the same provides (%s) as module %s (priority %d), and will not be loaded.",
+				info->name, info->priority, info->provides[i],
+				other->info->name, other->info->priority);
+			return FALSE;
 		}
 	}
-	
-	if (!foundRtconf) {
-		mce_log(LL_ERR, "Could not find nessecary rtconf module aborting.");
-		return FALSE;
+
+	for (int i = 0; info->provides[i]; ++i) {
+		module_entry_t *other =
+			g_hash_table_lookup(module_providers,
+					    info->provides[i]);
+
+		if (other != NULL) {
+			mce_log(LL_WARN, "Module %s (priority %d) has the same provides (%s) as module %s (priority %d), and replaces it; %s will not be loaded.",
+				info->name, info->priority, info->provides[i],
+				other->info->name, other->info->priority,
+				other->info->name);
+			mce_modules_drop(other);
+		}
+
+		g_hash_table_insert(module_providers,
+				    (gpointer)info->provides[i], entry);
 	}
-	
+
 	return TRUE;
 }
 
+/**
+ * Find a module that is linked into mce
+ *
+ * @param name The name of the module
+ * @return The static module table entry, or NULL if the module
+ *         is not linked into mce
+ */
+static const mce_static_module_t *mce_modules_find_builtin(const gchar *name)
+{
+	const mce_static_module_t *builtin;
+
+	for (builtin = mce_static_modules; builtin->name; builtin++) {
+		if (g_strcmp0(builtin->name, name) == 0)
+			return builtin;
+	}
+
+	return NULL;
+}
+
+/**
+ * Map a module and retrieve its module information,
+ * without initialising it
+ *
+ * @param path The module path
+ * @param name The name of the module
+ */
+static void mce_modules_discover(const gchar *path, const gchar *name)
+{
+	module_entry_t *entry = g_new0(module_entry_t, 1);
+	gint64 start;
+
+	entry->name = g_strdup(name);
+	entry->path = g_module_build_path(path, name);
+	entry->builtin = mce_modules_find_builtin(name);
+	g_ptr_array_add(module_entries, entry);
+
+	if (entry->builtin != NULL) {
+		mce_log(LL_DEBUG, "Using built-in module: %s", name);
+		entry->info = entry->builtin->info;
+		goto CHECK;
+	}
+
+	mce_log(LL_DEBUG, "Loading module: %s from %s", name, path);
+
+	/* Map and relocate the module without running
+	 * g_module_check_init(); the module is initialised
+	 * once its place in the initialisation order is known
+	 */
+	start = mce_profile_timestamp();
+	entry->handle = dlopen(entry->path, RTLD_NOW | RTLD_LOCAL);
+	mce_profile_record(MCE_PROFILE_PHASE_LOAD, name, start);
+
+	if (entry->handle == NULL) {
+		mce_log(LL_WARN, "Failed to load module %s: %s; skipping",
+			name, dlerror());
+		entry->dropped = TRUE;
+		goto EXIT;
+	}
+
+	start = mce_profile_timestamp();
+	entry->info = dlsym(entry->handle, "module_info");
+	mce_profile_record(MCE_PROFILE_PHASE_SYMBOL, name, start);
+
+	if (entry->info == NULL) {
+		mce_log(LL_ERR, "Failed to retrieve module information for: %s", name);
+		mce_modules_drop(entry);
+		goto EXIT;
+	}
+
+CHECK:
+	if (mce_modules_check_provides(entry) == FALSE)
+		mce_modules_drop(entry);
+
+EXIT:
+	return;
+}
+
+/**
+ * Discover all modules in a module list
+ *
+ * @param modlist The NULL-terminated module list
+ */
 static void mce_modules_load(gchar **modlist)
 {
 	gchar *path = NULL;
@@ -86,35 +256,259 @@ static void mce_modules_load(gchar **modlist)
 				   DEFAULT_MCE_MODULE_PATH,
 				   NULL);
 
-	for (i = 0; modlist[i]; i++) {
-		GModule *module;
-		gchar *tmp = g_module_build_path(path, modlist[i]);
+	for (i = 0; modlist[i]; i++)
+		mce_modules_discover(path, modlist[i]);
 
-		mce_log(LL_DEBUG, "Loading module: %s from %s", modlist[i], path);
+	g_free(path);
+}
 
-		if ((module = g_module_open(tmp, 0)) != NULL) {
-			gpointer mip = NULL;
-			gboolean blockLoad = FALSE;
+static void mce_modules_sort_list(module_entry_t *entry,
+				  const gchar *const *list, GPtrArray *order);
 
-			if (g_module_symbol(module, "module_info", &mip) == FALSE) {
-				mce_log(LL_ERR, "Failed to retrieve module information for: %s", modlist[i]);
-				g_module_close(module);
-				blockLoad = TRUE;
-			} else if (!mce_modules_check_provides((module_info_struct*)mip)) {
-				g_module_close(module);
-				blockLoad = TRUE;
-			}
+/**
+ * Place a module in the initialisation order,
+ * after the modules providing the functionality it
+ * depends on, recommends or enhances
+ *
+ * @param entry The module entry
+ * @param order The initialisation order to append to
+ */
+static void mce_modules_sort(module_entry_t *entry, GPtrArray *order)
+{
+	if (entry->state != MODULE_STATE_UNSORTED)
+		goto EXIT;
 
-			if (!blockLoad)
-				modules = g_slist_append(modules, module);
-		} else {
-			mce_log(LL_WARN, "Failed to load module %s: %s; skipping", modlist[i], g_module_error());
+	entry->state = MODULE_STATE_SORTING;
+
+	mce_modules_sort_list(entry, entry->info->depends, order);
+	mce_modules_sort_list(entry, entry->info->recommends, order);
+	mce_modules_sort_list(entry, entry->info->enhances, order);
+
+	entry->state = MODULE_STATE_SORTED;
+	g_ptr_array_add(order, entry);
+
+EXIT:
+	return;
+}
+
+/**
+ * Place the providers of a list of functionality
+ * in the initialisation order
+ *
+ * @param entry The module entry that needs the functionality
+ * @param list The NULL-terminated functionality list; may be NULL
+ * @param order The initialisation order to append to
+ */
+static void mce_modules_sort_list(module_entry_t *entry,
+				  const gchar *const *list, GPtrArray *order)
+{
+	if (list == NULL)
+		goto EXIT;
+
+	for (int i = 0; list[i]; ++i) {
+		module_entry_t *provider =
+			g_hash_table_lookup(module_providers, list[i]);
+
+		if (provider == NULL) {
+			mce_log(LL_DEBUG, "Module %s: no provider for %s",
+				entry->info->name, list[i]);
+			continue;
+		}
+
+		if (provider == entry)
+			continue;
+
+		if (provider->state == MODULE_STATE_SORTING) {
+			mce_log(LL_WARN, "Module %s: circular dependency on %s; ignoring",
+				entry->info->name, list[i]);
+			continue;
 		}
 
-		g_free(tmp);
+		mce_modules_sort(provider, order);
 	}
 
-	g_free(path);
+EXIT:
+	return;
+}
+
+/**
+ * Mark a module, and the modules it depends on or recommends,
+ * as critical
+ *
+ * @param entry The module entry
+ */
+static void mce_modules_mark_critical(module_entry_t *entry)
+{
+	const gchar *const *lists[] = {
+		entry->info->depends, entry->info->recommends
+	};
+
+	if (entry->critical == TRUE)
+		goto EXIT;
+
+	entry->critical = TRUE;
+
+	for (guint l = 0; l < G_N_ELEMENTS(lists); ++l) {
+		if (lists[l] == NULL)
+			continue;
+
+		for (int i = 0; lists[l][i]; ++i) {
+			module_entry_t *provider =
+				g_hash_table_lookup(module_providers,
+						    lists[l][i]);
+
+			if (provider != NULL)
+				mce_modules_mark_critical(provider);
+		}
+	}
+
+EXIT:
+	return;
+}
+
+/**
+ * Mark the providers of a list of functionality as critical
+ *
+ * @param list The NULL-terminated functionality list
+ */
+static void mce_modules_mark_critical_list(const gchar *const *list)
+{
+	for (int i = 0; list[i]; ++i) {
+		module_entry_t *provider =
+			g_hash_table_lookup(module_providers, list[i]);
+
+		if (provider != NULL)
+			mce_modules_mark_critical(provider);
+	}
+}
+
+/**
+ * Mark modules that enhance critical functionality as critical
+ *
+ * Enhancing modules, such as the brightness filters, change how
+ * a critical module behaves, so they are needed before mce reports
+ * that it is ready too
+ */
+static void mce_modules_mark_critical_enhancers(void)
+{
+	gboolean changed;
+
+	do {
+		changed = FALSE;
+
+		for (guint i = 0; i < module_entries->len; i++) {
+			module_entry_t *entry =
+				g_ptr_array_index(module_entries, i);
+			const gchar *const *enhances;
+
+			if (entry->dropped == TRUE || entry->critical == TRUE)
+				continue;
+
+			enhances = entry->info->enhances;
+
+			for (int j = 0; enhances != NULL && enhances[j]; ++j) {
+				module_entry_t *provider =
+					g_hash_table_lookup(module_providers,
+							    enhances[j]);
+
+				if (provider == NULL ||
+				    provider->critical == FALSE)
+					continue;
+
+				mce_modules_mark_critical(entry);
+				changed = TRUE;
+				break;
+			}
+		}
+	} while (changed == TRUE);
+}
+
+/**
+ * Initialise a module
+ *
+ * @param entry The module entry
+ */
+static void mce_modules_open(module_entry_t *entry)
+{
+	const gchar *error = NULL;
+	gint64 start;
+
+	start = mce_profile_timestamp();
+
+	if (entry->builtin != NULL) {
+		/* Built-in modules have no GModule */
+		error = entry->builtin->init(NULL);
+	} else {
+		entry->module = g_module_open(entry->path, 0);
+
+		if (entry->module == NULL)
+			error = g_module_error();
+	}
+
+	mce_profile_record(MCE_PROFILE_PHASE_INIT, entry->name, start);
+
+	if (error != NULL) {
+		mce_log(LL_WARN, "Failed to load module %s: %s; skipping",
+			entry->name, error);
+		mce_modules_drop(entry);
+		goto EXIT;
+	}
+
+	/* GModule holds its own reference from here on */
+	if (entry->handle != NULL) {
+		dlclose(entry->handle);
+		entry->handle = NULL;
+	}
+
+	entry->initialised = TRUE;
+	modules = g_slist_prepend(modules, entry);
+
+EXIT:
+	return;
+}
+
+/**
+ * Idle callback that initialises the next non-critical module
+ *
+ * @param data Unused
+ * @return TRUE while there are modules left to initialise,
+ *         FALSE otherwise
+ */
+static gboolean mce_modules_deferred_init_cb(gpointer data)
+{
+	module_entry_t *entry = g_queue_pop_head(pending_modules);
+
+	(void)data;
+
+	if (entry != NULL)
+		mce_modules_open(entry);
+
+	if (g_queue_is_empty(pending_modules) == FALSE)
+		return TRUE;
+
+	mce_log(LL_DEBUG, "All deferred modules initialised");
+	deferred_init_cb_id = 0;
+
+	return FALSE;
+}
+
+/**
+ * Check that the modules needed for mce to function
+ * were initialised
+ *
+ * @return TRUE if all essential modules are present, FALSE otherwise
+ */
+static gboolean mce_modules_check_essential(void)
+{
+	module_entry_t *entry = g_hash_table_lookup(module_providers,
+						    "rtconf");
+
+	if ((entry == NULL) || (entry->initialised == FALSE)) {
+		mce_log(LL_ERR, "Could not find nessecary rtconf module aborting.");
+		return FALSE;
+	}
+
+	return TRUE;
 }
 
 /**
@@ -127,7 +521,15 @@ gboolean mce_modules_init(void)
 	gchar **modlist = NULL;
 	gchar **modlist_device = NULL;
 	gchar **modlist_user = NULL;
+	gchar **critical = NULL;
+	GPtrArray *order = NULL;
+	gboolean status;
 	gsize length;
+	guint i;
+
+	module_entries = g_ptr_array_new();
+	module_providers = g_hash_table_new(g_str_hash, g_str_equal);
+	pending_modules = g_queue_new();
 
 	/* Get the list modules to load */
 	modlist = mce_conf_get_string_list(MCE_CONF_MODULES_GROUP,
@@ -145,6 +547,11 @@ gboolean mce_modules_init(void)
 					   &length,
 					   NULL);
 
+	critical = mce_conf_get_string_list(MCE_CONF_MODULES_GROUP,
+					    MCE_CONF_MODULES_CRITICAL,
+					    &length,
+					    NULL);
+
 	if (modlist)
 		mce_modules_load(modlist);
 	if (modlist_device)
@@ -152,11 +559,56 @@ gboolean mce_modules_init(void)
 	if (modlist_user)
 		mce_modules_load(modlist_user);
 
+	/* Sort the modules in dependency order; the module lists
+	 * decide the order between modules that do not depend
+	 * on each other
+	 */
+	order = g_ptr_array_new();
+
+	for (i = 0; i < module_entries->len; i++) {
+		module_entry_t *entry = g_ptr_array_index(module_entries, i);
+
+		if (entry->dropped == FALSE)
+			mce_modules_sort(entry, order);
+	}
+
+	/* rtconf is always needed before anything else can work */
+	mce_modules_mark_critical_list((const gchar *const[]){ "rtconf", NULL });
+	mce_modules_mark_critical_list(critical != NULL ?
+				       (const gchar *const *)critical :
+				       default_critical_provides);
+	mce_modules_mark_critical_enhancers();
+
+	/* Initialise the critical modules now,
+	 * and everything else once the mainloop is idle
+	 */
+	for (i = 0; i < order->len; i++) {
+		module_entry_t *entry = g_ptr_array_index(order, i);
+
+		if (entry->critical == TRUE) {
+			mce_modules_open(entry);
+		} else {
+			mce_log(LL_DEBUG, "Deferring initialisation of module %s",
+				entry->name);
+			g_queue_push_tail(pending_modules, entry);
+		}
+	}
+
+	if (g_queue_is_empty(pending_modules) == FALSE)
+		deferred_init_cb_id =
+			g_idle_add_full(G_PRIORITY_LOW,
+					mce_modules_deferred_init_cb,
+					NULL, NULL);
+
+	status = mce_modules_check_essential();
+
+	g_ptr_array_free(order, TRUE);
 	g_strfreev(modlist);
 	g_strfreev(modlist_device);
 	g_strfreev(modlist_user);
+	g_strfreev(critical);
 
-	return mce_modules_check_essential();
+	return status;
 }
 
 /**
@@ -164,16 +616,52 @@ gboolean mce_modules_init(void)
  */
 void mce_modules_exit(void)
 {
-	GModule *module;
-	gint i;
+	GSList *module;
+	guint i;
+
+	if (deferred_init_cb_id != 0) {
+		g_source_remove(deferred_init_cb_id);
+		deferred_init_cb_id = 0;
+	}
+
+	/* Unload in reverse order of initialisation */
+	for (module = modules; module != NULL; module = module->next) {
+		module_entry_t *entry = module->data;
+
+		if (entry->builtin != NULL)
+			entry->builtin->unload(NULL);
+		else
+			g_module_close(entry->module);
+	}
+
+	g_slist_free(modules);
+	modules = NULL;
+
+	if (pending_modules != NULL) {
+		g_queue_free(pending_modules);
+		pending_modules = NULL;
+	}
+
+	if (module_providers != NULL) {
+		g_hash_table_destroy(module_providers);
+		module_providers = NULL;
+	}
+
+	if (module_entries != NULL) {
+		for (i = 0; i < module_entries->len; i++) {
+			module_entry_t *entry =
+				g_ptr_array_index(module_entries, i);
+
+			if (entry->handle != NULL)
+				dlclose(entry->handle);
 
-	if (modules != NULL) {
-		for (i = 0; (module = g_slist_nth_data(modules, i)) != NULL; i++) {
-			g_module_close(module);
+			g_free(entry->name);
+			g_free(entry->path);
+			g_free(entry);
 		}
 
-		g_slist_free(modules);
-		modules = NULL;
+		g_ptr_array_free(module_entries, TRUE);
+		module_entries = NULL;
 	}
 
 	return;
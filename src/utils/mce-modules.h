@@ -23,6 +23,9 @@
 #define _MCE_MODULES_H_
 
 #include <glib.h>
+#include <gmodule.h>
+
+#include "mce.h"
 
 /** Name of Modules configuration group */
 #define MCE_CONF_MODULES_GROUP		"Modules"
@@ -41,9 +44,27 @@
 
 #define MCE_CONF_MODULES_USRMODULES	"ModulesUser"
 
+/**
+ * Name of configuration key for the functionality that must be
+ * initialised before mce reports that it is ready;
+ * all other modules are initialised once the mainloop is idle
+ */
+#define MCE_CONF_MODULES_CRITICAL	"CriticalProvides"
+
 /** Default value for module path */
 #define DEFAULT_MCE_MODULE_PATH		"/usr/lib/mce/modules"
 
+/** Module linked into the mce executable */
+typedef struct {
+	const gchar *name;			/**< Name used in the module lists */
+	const module_info_struct *info;		/**< Module information */
+	const gchar *(*init)(GModule *module);	/**< g_module_check_init() */
+	void (*unload)(GModule *module);	/**< g_module_unload() */
+} mce_static_module_t;
+
+/** Modules linked into mce; terminated by an entry with a NULL name */
+extern const mce_static_module_t mce_static_modules[];
+
 gboolean mce_modules_init(void);
 void mce_modules_exit(void);
 
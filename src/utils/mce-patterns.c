@@ -0,0 +1,144 @@
+/**
+ * @file mce-patterns.c
+ * LED and vibrator pattern registry for the Mode Control Entity
+ * <p>
+ * Interns pattern names to small integer ids, so that patterns
+ * can be passed through datapipes without heap allocations
+ * and looked up without string comparisons
+ * <p>
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <glib.h>
+#include "mce-log.h"
+#include "mce-patterns.h"
+
+/** Pattern names indexed by pattern id; index 0 is unused */
+static GPtrArray *pattern_names = NULL;
+
+/** Pattern ids indexed by pattern name */
+static GHashTable *pattern_ids = NULL;
+
+/**
+ * Get the id of a pattern, registering the pattern if needed
+ *
+ * @param name The name of the pattern
+ * @return The id of the pattern,
+ *         or MCE_PATTERN_NONE if name is NULL
+ *         or the registry is not initialised
+ */
+mce_pattern_t mce_pattern_intern(const gchar *const name)
+{
+	mce_pattern_t id = MCE_PATTERN_NONE;
+	gchar *copy;
+
+	if ((name == NULL) || (pattern_ids == NULL))
+		goto EXIT;
+
+	if ((id = mce_pattern_lookup(name)) != MCE_PATTERN_NONE)
+		goto EXIT;
+
+	copy = g_strdup(name);
+	id = pattern_names->len;
+	g_ptr_array_add(pattern_names, copy);
+	g_hash_table_insert(pattern_ids, copy, GUINT_TO_POINTER(id));
+
+	mce_log(LL_DEBUG, "Registered pattern %s as %u", name, id);
+
+EXIT:
+	return id;
+}
+
+/**
+ * Get the id of a registered pattern
+ *
+ * @param name The name of the pattern
+ * @return The id of the pattern,
+ *         or MCE_PATTERN_NONE if the pattern is not registered
+ */
+mce_pattern_t mce_pattern_lookup(const gchar *const name)
+{
+	mce_pattern_t id = MCE_PATTERN_NONE;
+
+	if ((name == NULL) || (pattern_ids == NULL))
+		goto EXIT;
+
+	id = GPOINTER_TO_UINT(g_hash_table_lookup(pattern_ids, name));
+
+EXIT:
+	return id;
+}
+
+/**
+ * Get the name of a registered pattern
+ *
+ * @param id The id of the pattern
+ * @return The name of the pattern,
+ *         or NULL if the id does not refer to a pattern
+ */
+const gchar *mce_pattern_name(const mce_pattern_t id)
+{
+	const gchar *name = NULL;
+
+	if ((pattern_names == NULL) || (id == MCE_PATTERN_NONE) ||
+	    (id >= pattern_names->len))
+		goto EXIT;
+
+	name = g_ptr_array_index(pattern_names, id);
+
+EXIT:
+	return name;
+}
+
+/**
+ * Get the datapipe data for a pattern,
+ * registering the pattern if needed
+ *
+ * @param name The name of the pattern
+ * @return The id of the pattern, as datapipe data
+ */
+gpointer mce_pattern_data(const gchar *const name)
+{
+	return MCE_PATTERN_TO_POINTER(mce_pattern_intern(name));
+}
+
+/**
+ * Init function for the pattern registry
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+gboolean mce_patterns_init(void)
+{
+	pattern_names = g_ptr_array_new_with_free_func(g_free);
+	pattern_ids = g_hash_table_new(g_str_hash, g_str_equal);
+
+	/* Reserve MCE_PATTERN_NONE */
+	g_ptr_array_add(pattern_names, NULL);
+
+	return TRUE;
+}
+
+/**
+ * Exit function for the pattern registry
+ */
+void mce_patterns_exit(void)
+{
+	if (pattern_ids != NULL) {
+		g_hash_table_destroy(pattern_ids);
+		pattern_ids = NULL;
+	}
+
+	if (pattern_names != NULL) {
+		g_ptr_array_free(pattern_names, TRUE);
+		pattern_names = NULL;
+	}
+}
@@ -0,0 +1,41 @@
+/**
+ * @file mce-patterns.h
+ * Headers for the LED and vibrator pattern registry
+ * <p>
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _MCE_PATTERNS_H_
+#define _MCE_PATTERNS_H_
+
+#include <glib.h>
+
+/** Pattern id */
+typedef guint mce_pattern_t;
+
+/** Pattern id that never refers to a pattern */
+#define MCE_PATTERN_NONE		0
+
+/** Convert a pattern id to datapipe data */
+#define MCE_PATTERN_TO_POINTER(id)	GUINT_TO_POINTER(id)
+/** Convert datapipe data to a pattern id */
+#define MCE_POINTER_TO_PATTERN(p)	((mce_pattern_t)GPOINTER_TO_UINT(p))
+
+mce_pattern_t mce_pattern_intern(const gchar *const name);
+mce_pattern_t mce_pattern_lookup(const gchar *const name);
+const gchar *mce_pattern_name(const mce_pattern_t id);
+gpointer mce_pattern_data(const gchar *const name);
+
+gboolean mce_patterns_init(void);
+void mce_patterns_exit(void);
+
+#endif /* _MCE_PATTERNS_H_ */
@@ -0,0 +1,289 @@
+/**
+ * @file mce-profile.c
+ * Startup profiling for the Mode Control Entity
+ * <p>
+ * Records monotonic timestamps for each startup phase, so that
+ * the time until mce is ready can be attributed to the individual
+ * components and modules
+ * <p>
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <glib.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <dbus/dbus.h>
+#include "mce.h"
+#include "mce-log.h"
+#include "mce-dbus.h"
+#include "mce-profile.h"
+
+/** Path to the startup profile report written by mce_profile_save() */
+#define MCE_PROFILE_REPORT_PATH		G_STRINGIFY(MCE_VAR_DIR) "/startup-profile"
+
+/** Profile entry */
+typedef struct {
+	gchar *phase;			/**< Startup phase */
+	gchar *name;			/**< Component or module name */
+	gint64 start;			/**< Start time; usec since init */
+	gint64 duration;		/**< Duration in usec */
+} profile_entry_t;
+
+/** Monotonic time at which profiling was initialised */
+static gint64 profile_base = 0;
+
+/** Recorded profile entries, in order of completion */
+static GArray *profile_entries = NULL;
+
+/**
+ * Get a timestamp to pass to mce_profile_record()
+ *
+ * @return The current monotonic time in microseconds
+ */
+gint64 mce_profile_timestamp(void)
+{
+	return g_get_monotonic_time();
+}
+
+/**
+ * Record the completion of a startup phase
+ *
+ * @param phase The phase that completed; one of MCE_PROFILE_PHASE_*
+ * @param name The component or module the phase belongs to,
+ *             or NULL if not applicable
+ * @param start Timestamp from mce_profile_timestamp()
+ *              taken when the phase started
+ */
+void mce_profile_record(const gchar *const phase, const gchar *const name,
+			const gint64 start)
+{
+	profile_entry_t entry;
+
+	if (profile_entries == NULL)
+		goto EXIT;
+
+	entry.phase = g_strdup(phase);
+	entry.name = g_strdup(name ? name : "");
+	entry.start = start - profile_base;
+	entry.duration = mce_profile_timestamp() - start;
+
+	g_array_append_val(profile_entries, entry);
+
+	mce_log(LL_DEBUG, "profile: %s %s took %" G_GINT64_FORMAT " us",
+		entry.phase, entry.name, entry.duration);
+
+EXIT:
+	return;
+}
+
+/**
+ * Write a human readable startup profile report
+ *
+ * @param stream The stream to write the report to
+ */
+void mce_profile_dump(FILE *const stream)
+{
+	guint i;
+
+	if (profile_entries == NULL)
+		goto EXIT;
+
+	fprintf(stream, "%-14s %-28s %10s %10s\n",
+		"phase", "name", "start/us", "took/us");
+
+	for (i = 0; i < profile_entries->len; i++) {
+		profile_entry_t *entry = &g_array_index(profile_entries,
+							profile_entry_t, i);
+
+		fprintf(stream, "%-14s %-28s %10" G_GINT64_FORMAT
+			" %10" G_GINT64_FORMAT "\n",
+			entry->phase, entry->name,
+			entry->start, entry->duration);
+	}
+
+	fflush(stream);
+
+EXIT:
+	return;
+}
+
+/**
+ * Write the startup profile report to a file
+ *
+ * mce has normally daemonized by the time it is ready,
+ * so the report cannot go to stdout
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+gboolean mce_profile_save(void)
+{
+	gboolean status = FALSE;
+	FILE *fp;
+
+	if ((fp = fopen(MCE_PROFILE_REPORT_PATH, "w")) == NULL) {
+		mce_log(LL_ERR, "Failed to open %s; %s",
+			MCE_PROFILE_REPORT_PATH, g_strerror(errno));
+		goto EXIT;
+	}
+
+	mce_profile_dump(fp);
+
+	if (ferror(fp) != 0) {
+		mce_log(LL_ERR, "Failed to write %s",
+			MCE_PROFILE_REPORT_PATH);
+		(void)fclose(fp);
+		goto EXIT;
+	}
+
+	if (fclose(fp) == EOF) {
+		mce_log(LL_ERR, "Failed to close %s; %s",
+			MCE_PROFILE_REPORT_PATH, g_strerror(errno));
+		goto EXIT;
+	}
+
+	mce_log(LL_INFO, "Startup profile written to %s",
+		MCE_PROFILE_REPORT_PATH);
+	status = TRUE;
+
+EXIT:
+	return status;
+}
+
+/**
+ * D-Bus callback for the get startup profile method call
+ *
+ * @param msg The D-Bus message to reply to
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean startup_profile_get_dbus_cb(DBusMessage *const msg)
+{
+	DBusMessage *reply = NULL;
+	DBusMessageIter iter;
+	DBusMessageIter array;
+	gboolean status = FALSE;
+	guint i;
+
+	mce_log(LL_DEBUG, "Received startup profile get request");
+
+	reply = dbus_new_method_reply(msg);
+
+	dbus_message_iter_init_append(reply, &iter);
+
+	if (dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					     "(ssxx)", &array) == FALSE)
+		goto ERROR;
+
+	for (i = 0; i < profile_entries->len; i++) {
+		profile_entry_t *entry = &g_array_index(profile_entries,
+							profile_entry_t, i);
+		const char *phase = entry->phase;
+		const char *name = entry->name;
+		dbus_int64_t start = entry->start;
+		dbus_int64_t duration = entry->duration;
+		DBusMessageIter sub;
+
+		if ((dbus_message_iter_open_container(&array, DBUS_TYPE_STRUCT,
+						      NULL, &sub) == FALSE) ||
+		    (dbus_message_iter_append_basic(&sub, DBUS_TYPE_STRING,
+						    &phase) == FALSE) ||
+		    (dbus_message_iter_append_basic(&sub, DBUS_TYPE_STRING,
+						    &name) == FALSE) ||
+		    (dbus_message_iter_append_basic(&sub, DBUS_TYPE_INT64,
+						    &start) == FALSE) ||
+		    (dbus_message_iter_append_basic(&sub, DBUS_TYPE_INT64,
+						    &duration) == FALSE) ||
+		    (dbus_message_iter_close_container(&array,
+						       &sub) == FALSE))
+			goto ERROR;
+	}
+
+	if (dbus_message_iter_close_container(&iter, &array) == FALSE)
+		goto ERROR;
+
+	status = dbus_send_message(reply);
+	goto EXIT;
+
+ERROR:
+	mce_log(LL_CRIT,
+		"Failed to append reply argument to D-Bus message "
+		"for %s.%s",
+		MCE_REQUEST_IF, MCE_STARTUP_PROFILE_GET);
+	dbus_message_unref(reply);
+
+EXIT:
+	return status;
+}
+
+/**
+ * Init function for the startup profiling component;
+ * should be called as early as possible,
+ * since all timestamps are relative to this call
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+gboolean mce_profile_init(void)
+{
+	profile_base = mce_profile_timestamp();
+	profile_entries = g_array_new(FALSE, FALSE, sizeof (profile_entry_t));
+
+	return TRUE;
+}
+
+/**
+ * Register the D-Bus interface of the startup profiling component
+ * Pre-requisites: mce_dbus_init()
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+gboolean mce_profile_dbus_init(void)
+{
+	gboolean status = FALSE;
+
+	/* get_startup_profile */
+	if (mce_dbus_handler_add(MCE_REQUEST_IF,
+				 MCE_STARTUP_PROFILE_GET,
+				 NULL,
+				 DBUS_MESSAGE_TYPE_METHOD_CALL,
+				 startup_profile_get_dbus_cb) == NULL)
+		goto EXIT;
+
+	status = TRUE;
+
+EXIT:
+	return status;
+}
+
+/**
+ * Exit function for the startup profiling component
+ */
+void mce_profile_exit(void)
+{
+	guint i;
+
+	if (profile_entries == NULL)
+		goto EXIT;
+
+	for (i = 0; i < profile_entries->len; i++) {
+		profile_entry_t *entry = &g_array_index(profile_entries,
+							profile_entry_t, i);
+
+		g_free(entry->phase);
+		g_free(entry->name);
+	}
+
+	g_array_free(profile_entries, TRUE);
+	profile_entries = NULL;
+
+EXIT:
+	return;
+}
@@ -0,0 +1,50 @@
+/**
+ * @file mce-profile.h
+ * Headers for the startup profiling of the Mode Control Entity
+ * <p>
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _MCE_PROFILE_H_
+#define _MCE_PROFILE_H_
+
+#include <stdio.h>
+#include <glib.h>
+
+/** Startup phase: configuration parsing */
+#define MCE_PROFILE_PHASE_CONF		"conf"
+/** Startup phase: D-Bus connection setup */
+#define MCE_PROFILE_PHASE_DBUS		"dbus"
+/** Startup phase: built-in component initialisation */
+#define MCE_PROFILE_PHASE_CORE		"core"
+/** Startup phase: initial scan of the input devices */
+#define MCE_PROFILE_PHASE_INPUT		"input-scan"
+/** Startup phase: dlopen() and relocation of a module */
+#define MCE_PROFILE_PHASE_LOAD		"module-load"
+/** Startup phase: g_module_check_init() of a module */
+#define MCE_PROFILE_PHASE_INIT		"module-init"
+/** Startup phase: module_info symbol resolution */
+#define MCE_PROFILE_PHASE_SYMBOL	"module-symbol"
+/** Startup phase: everything up to the point mce is ready */
+#define MCE_PROFILE_PHASE_READY		"ready"
+
+gint64 mce_profile_timestamp(void);
+void mce_profile_record(const gchar *const phase, const gchar *const name,
+			const gint64 start);
+void mce_profile_dump(FILE *const stream);
+gboolean mce_profile_save(void);
+
+gboolean mce_profile_init(void);
+gboolean mce_profile_dbus_init(void);
+void mce_profile_exit(void);
+
+#endif /* _MCE_PROFILE_H_ */
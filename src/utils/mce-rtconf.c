@@ -13,6 +13,142 @@ gboolean(*mce_rtconf_notifier_add_backend) (const gchar * key,
 					    const mce_rtconf_callback callback, void *user_data, guint * cb_id);
 void (*mce_rtconf_notifier_remove_backend)(guint cb_id);
 
+/** Type of a cached value */
+typedef enum {
+	RTCONF_VALUE_NONE = 0,		/**< Nothing cached */
+	RTCONF_VALUE_BOOL,		/**< Boolean cached */
+	RTCONF_VALUE_INT		/**< Integer cached */
+} rtconf_value_type_t;
+
+/** State of a single key */
+typedef struct {
+	gchar *key;			/**< The key */
+	gboolean watched;		/**< Backend notifier registered */
+	guint backend_cb_id;		/**< Backend notifier ID */
+	GSList *notifiers;		/**< Notifiers for this key */
+	rtconf_value_type_t type;	/**< Type of the cached value */
+	gint value;			/**< Cached value */
+} rtconf_key_t;
+
+/** Notifier registered through mce_rtconf_notifier_add() */
+typedef struct {
+	guint cb_id;			/**< Notifier ID */
+	mce_rtconf_callback callback;	/**< Callback */
+	void *user_data;		/**< Data to pass to the callback */
+	rtconf_key_t *rkey;		/**< The key the notifier is for */
+} rtconf_notifier_t;
+
+/** Map from key to rtconf_key_t */
+static GHashTable *rtconf_keys = NULL;
+
+/** Map from notifier ID to rtconf_notifier_t */
+static GHashTable *rtconf_notifiers = NULL;
+
+/**
+ * Free a key entry
+ *
+ * @param data The rtconf_key_t to free
+ */
+static void rtconf_key_free(gpointer data)
+{
+	rtconf_key_t *rkey = data;
+
+	g_slist_free(rkey->notifiers);
+	g_free(rkey->key);
+	g_free(rkey);
+}
+
+/**
+ * Look up the entry for a key, creating it if needed
+ *
+ * @param key The key
+ * @return The key entry
+ */
+static rtconf_key_t *rtconf_key_get(const gchar *const key)
+{
+	rtconf_key_t *rkey;
+
+	if (rtconf_keys == NULL) {
+		rtconf_keys = g_hash_table_new_full(g_str_hash, g_str_equal,
+						    NULL, rtconf_key_free);
+		rtconf_notifiers = g_hash_table_new_full(g_direct_hash,
+							 g_direct_equal,
+							 NULL, g_free);
+	}
+
+	if ((rkey = g_hash_table_lookup(rtconf_keys, key)) == NULL) {
+		rkey = g_new0(rtconf_key_t, 1);
+		rkey->key = g_strdup(key);
+		g_hash_table_insert(rtconf_keys, rkey->key, rkey);
+	}
+
+	return rkey;
+}
+
+/**
+ * Backend notifier callback; drops the cached value
+ * and calls the notifiers registered for the key
+ *
+ * @param key The key that changed
+ * @param cb_id The backend notifier ID
+ * @param user_data The rtconf_key_t for the key
+ */
+static void rtconf_backend_cb(const gchar *key, guint cb_id, void *user_data)
+{
+	rtconf_key_t *rkey = user_data;
+	GArray *ids;
+	GSList *l;
+
+	(void)cb_id;
+
+	mce_log(LL_DEBUG, "%s: %s changed", MODULE_NAME, key);
+
+	rkey->type = RTCONF_VALUE_NONE;
+
+	/* Callbacks may remove any notifier, so dispatch from a snapshot
+	 * of the IDs, and skip the notifiers that are gone by the time
+	 * their turn comes
+	 */
+	ids = g_array_new(FALSE, FALSE, sizeof (guint));
+
+	for (l = rkey->notifiers; l != NULL; l = l->next) {
+		rtconf_notifier_t *not = l->data;
+
+		g_array_append_val(ids, not->cb_id);
+	}
+
+	for (guint i = 0; i < ids->len; i++) {
+		rtconf_notifier_t *not =
+			g_hash_table_lookup(rtconf_notifiers,
+					    GUINT_TO_POINTER(g_array_index(ids, guint, i)));
+
+		if (not != NULL)
+			not->callback(rkey->key, not->cb_id, not->user_data);
+	}
+
+	g_array_free(ids, TRUE);
+}
+
+/**
+ * Make sure that the backend notifies about changes of a key,
+ * so that its cached value and notifiers are kept up to date
+ *
+ * @param rkey The key entry
+ * @return TRUE if the backend watches the key, FALSE otherwise
+ */
+static gboolean rtconf_key_watch(rtconf_key_t *rkey)
+{
+	if ((rkey->watched == FALSE) &&
+	    (mce_rtconf_notifier_add_backend != NULL))
+		rkey->watched =
+			mce_rtconf_notifier_add_backend(rkey->key,
+							rtconf_backend_cb,
+							rkey,
+							&rkey->backend_cb_id);
+
+	return rkey->watched;
+}
+
 /**
  * Set an integer GConf key to the specified value
  *
@@ -22,8 +158,19 @@ void (*mce_rtconf_notifier_remove_backend)(guint cb_id);
  */
 gboolean mce_rtconf_set_int(const gchar * const key, const gint value)
 {
-	if (mce_rtconf_set_int_backend)
-		return mce_rtconf_set_int_backend(key, value);
+	if (mce_rtconf_set_int_backend) {
+		rtconf_key_t *rkey = rtconf_key_get(key);
+
+		if (mce_rtconf_set_int_backend(key, value) == FALSE)
+			return FALSE;
+
+		if (rtconf_key_watch(rkey) == TRUE) {
+			rkey->type = RTCONF_VALUE_INT;
+			rkey->value = value;
+		}
+
+		return TRUE;
+	}
 
 	mce_log(LL_WARN, "%s: %s used without backend", MODULE_NAME, __func__);
 	return FALSE;
@@ -38,8 +185,25 @@ gboolean mce_rtconf_set_int(const gchar * const key, const gint value)
  */
 gboolean mce_rtconf_get_bool(const gchar * const key, gboolean * value)
 {
-	if (mce_rtconf_get_bool_backend)
-		return mce_rtconf_get_bool_backend(key, value);
+	if (mce_rtconf_get_bool_backend) {
+		rtconf_key_t *rkey = rtconf_key_get(key);
+
+		if (rkey->type == RTCONF_VALUE_BOOL) {
+			*value = rkey->value;
+			return TRUE;
+		}
+
+		if (mce_rtconf_get_bool_backend(key, value) == FALSE)
+			return FALSE;
+
+		/* Only cache what the backend will tell us about */
+		if (rtconf_key_watch(rkey) == TRUE) {
+			rkey->type = RTCONF_VALUE_BOOL;
+			rkey->value = *value;
+		}
+
+		return TRUE;
+	}
 
 	mce_log(LL_WARN, "%s: %s used without backend", MODULE_NAME, __func__);
 	return FALSE;
@@ -54,8 +218,19 @@ gboolean mce_rtconf_get_bool(const gchar * const key, gboolean * value)
  */
 gboolean mce_rtconf_set_bool(const gchar * const key, const gboolean value)
 {
-	if (mce_rtconf_set_bool_backend)
-		return mce_rtconf_set_bool_backend(key, value);
+	if (mce_rtconf_set_bool_backend) {
+		rtconf_key_t *rkey = rtconf_key_get(key);
+
+		if (mce_rtconf_set_bool_backend(key, value) == FALSE)
+			return FALSE;
+
+		if (rtconf_key_watch(rkey) == TRUE) {
+			rkey->type = RTCONF_VALUE_BOOL;
+			rkey->value = value;
+		}
+
+		return TRUE;
+	}
 
 	mce_log(LL_WARN, "%s: %s used without backend", MODULE_NAME, __func__);
 	return FALSE;
@@ -70,8 +245,25 @@ gboolean mce_rtconf_set_bool(const gchar * const key, const gboolean value)
  */
 gboolean mce_rtconf_get_int(const gchar * const key, gint * value)
 {
-	if (mce_rtconf_get_int_backend)
-		return mce_rtconf_get_int_backend(key, value);
+	if (mce_rtconf_get_int_backend) {
+		rtconf_key_t *rkey = rtconf_key_get(key);
+
+		if (rkey->type == RTCONF_VALUE_INT) {
+			*value = rkey->value;
+			return TRUE;
+		}
+
+		if (mce_rtconf_get_int_backend(key, value) == FALSE)
+			return FALSE;
+
+		/* Only cache what the backend will tell us about */
+		if (rtconf_key_watch(rkey) == TRUE) {
+			rkey->type = RTCONF_VALUE_INT;
+			rkey->value = *value;
+		}
+
+		return TRUE;
+	}
 
 	mce_log(LL_WARN, "%s: %s used without backend", MODULE_NAME, __func__);
 	return FALSE;
@@ -89,8 +281,30 @@ gboolean mce_rtconf_get_int(const gchar * const key, gint * value)
 gboolean mce_rtconf_notifier_add(const gchar * key,
 				 const mce_rtconf_callback callback, void *user_data, guint * cb_id)
 {
-	if (mce_rtconf_notifier_add_backend)
-		return mce_rtconf_notifier_add_backend(key, callback, user_data, cb_id);
+	static guint cb_id_counter = 0;
+
+	if (mce_rtconf_notifier_add_backend) {
+		rtconf_key_t *rkey = rtconf_key_get(key);
+		rtconf_notifier_t *not;
+
+		/* One backend notifier per key serves all notifiers */
+		if (rtconf_key_watch(rkey) == FALSE)
+			return FALSE;
+
+		not = g_new0(rtconf_notifier_t, 1);
+		not->cb_id = ++cb_id_counter;
+		not->callback = callback;
+		not->user_data = user_data;
+		not->rkey = rkey;
+
+		rkey->notifiers = g_slist_append(rkey->notifiers, not);
+		g_hash_table_insert(rtconf_notifiers,
+				    GUINT_TO_POINTER(not->cb_id), not);
+
+		*cb_id = not->cb_id;
+
+		return TRUE;
+	}
 
 	mce_log(LL_WARN, "%s: %s used without backend", MODULE_NAME, __func__);
 	return FALSE;
@@ -104,9 +318,23 @@ gboolean mce_rtconf_notifier_add(const gchar * key,
  */
 void mce_rtconf_notifier_remove(guint cb_id)
 {
-	if (mce_rtconf_notifier_remove_backend)
-		mce_rtconf_notifier_remove_backend(cb_id);
-	else
+	if (mce_rtconf_notifier_remove_backend) {
+		rtconf_notifier_t *not = NULL;
+
+		if (rtconf_notifiers != NULL)
+			not = g_hash_table_lookup(rtconf_notifiers,
+						  GUINT_TO_POINTER(cb_id));
+
+		/* The backend notifier is kept, since it also
+		 * keeps the cached value coherent
+		 */
+		if (not != NULL) {
+			not->rkey->notifiers =
+				g_slist_remove(not->rkey->notifiers, not);
+			g_hash_table_remove(rtconf_notifiers,
+					    GUINT_TO_POINTER(cb_id));
+		}
+	} else
 		mce_log(LL_WARN, "%s: %s used without backend", MODULE_NAME, __func__);
 }
 
@@ -133,6 +361,16 @@ gboolean mce_rtconf_backend_register(gboolean(*set_int_backend) (const gchar * c
 
 void mce_rtconf_backend_unregister(void)
 {
+	/* The backend drops its notifiers when it goes away,
+	 * so nothing cached can be trusted anymore
+	 */
+	if (rtconf_keys != NULL) {
+		g_hash_table_destroy(rtconf_notifiers);
+		g_hash_table_destroy(rtconf_keys);
+		rtconf_notifiers = NULL;
+		rtconf_keys = NULL;
+	}
+
 	mce_rtconf_set_int_backend = NULL;
 	mce_rtconf_get_int_backend = NULL;
 	mce_rtconf_get_bool_backend = NULL;
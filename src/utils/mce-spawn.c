@@ -0,0 +1,175 @@
+/**
+ * @file mce-spawn.c
+ * Launching of helper programs
+ * <p>
+ * Helpers are started with posix_spawn(), which does not copy
+ * the page tables of mce the way fork() does, and their exit is
+ * picked up by a GLib child watch, which also reaps them
+ * <p>
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <glib.h>
+
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+
+#include "mce-spawn.h"
+#include "mce-log.h"
+
+extern char **environ;
+
+/** A running helper */
+struct mce_spawn {
+	/** Name of the helper, for logging */
+	gchar *name;
+	/** Process id of the helper */
+	GPid pid;
+	/** Child watch source id */
+	guint watch_id;
+	/** Launch time in microseconds, monotonic */
+	gint64 started;
+	/** Callback to call when the helper exits */
+	mce_spawn_cb_t callback;
+	/** User data for the callback */
+	gpointer data;
+};
+
+/**
+ * Child watch callback for a helper
+ *
+ * @param pid The process id of the helper
+ * @param status The wait status of the helper
+ * @param user_data The helper
+ */
+static void mce_spawn_exit_cb(GPid pid, gint status, gpointer user_data)
+{
+	mce_spawn_t *spawn = user_data;
+	gint64 elapsed = g_get_monotonic_time() - spawn->started;
+	gboolean success = FALSE;
+
+	if (WIFEXITED(status)) {
+		if (WEXITSTATUS(status) == 0) {
+			success = TRUE;
+			mce_log(LL_DEBUG,
+				"%s (pid %d) finished in %" G_GINT64_FORMAT
+				" ms", spawn->name, pid, elapsed / 1000);
+		} else {
+			mce_log(LL_WARN,
+				"%s (pid %d) failed with exit status %d "
+				"after %" G_GINT64_FORMAT " ms",
+				spawn->name, pid, WEXITSTATUS(status),
+				elapsed / 1000);
+		}
+	} else if (WIFSIGNALED(status)) {
+		mce_log(LL_WARN,
+			"%s (pid %d) killed by signal %d "
+			"after %" G_GINT64_FORMAT " ms",
+			spawn->name, pid, WTERMSIG(status), elapsed / 1000);
+	}
+
+	if (spawn->callback != NULL)
+		spawn->callback(success, elapsed, spawn->data);
+
+	g_spawn_close_pid(pid);
+	g_free(spawn->name);
+	g_free(spawn);
+}
+
+/**
+ * Launch a helper program
+ *
+ * The program is looked up in PATH; signals that mce ignores
+ * are reset to their defaults in the helper
+ *
+ * @param argv The NULL terminated argument vector;
+ *             argv[0] is the program to run
+ * @param callback Function to call when the helper exits, or NULL
+ * @param data User data for the callback
+ * @return The running helper, or NULL on failure;
+ *         callers that may go away before the helper exits,
+ *         such as modules, must detach it first
+ */
+mce_spawn_t *mce_spawn(const gchar *const argv[],
+		       mce_spawn_cb_t callback, gpointer data)
+{
+	posix_spawnattr_t attr;
+	sigset_t sigdefault;
+	sigset_t sigmask;
+	mce_spawn_t *spawn = NULL;
+	pid_t pid;
+	int err;
+
+	if ((argv == NULL) || (argv[0] == NULL))
+		goto EXIT;
+
+	sigemptyset(&sigmask);
+	sigemptyset(&sigdefault);
+	sigaddset(&sigdefault, SIGCHLD);
+	sigaddset(&sigdefault, SIGPIPE);
+	sigaddset(&sigdefault, SIGTSTP);
+	sigaddset(&sigdefault, SIGTTIN);
+	sigaddset(&sigdefault, SIGTTOU);
+
+	posix_spawnattr_init(&attr);
+	posix_spawnattr_setsigmask(&attr, &sigmask);
+	posix_spawnattr_setsigdefault(&attr, &sigdefault);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK |
+				 POSIX_SPAWN_SETSIGDEF);
+
+	err = posix_spawnp(&pid, argv[0], NULL, &attr,
+			   (char *const *)argv, environ);
+
+	posix_spawnattr_destroy(&attr);
+
+	if (err != 0) {
+		mce_log(LL_ERR,
+			"Failed to launch %s; %s",
+			argv[0], g_strerror(err));
+		goto EXIT;
+	}
+
+	spawn = g_new0(mce_spawn_t, 1);
+	spawn->name = g_strdup(argv[0]);
+	spawn->pid = pid;
+	spawn->started = g_get_monotonic_time();
+	spawn->callback = callback;
+	spawn->data = data;
+	spawn->watch_id = g_child_watch_add(pid, mce_spawn_exit_cb, spawn);
+
+EXIT:
+	return spawn;
+}
+
+/**
+ * Stop waiting for a helper
+ *
+ * The callback will not be called; the helper keeps running,
+ * and its exit is still reaped and logged
+ *
+ * @param spawn The running helper; not valid after this call
+ */
+void mce_spawn_detach(mce_spawn_t *spawn)
+{
+	if (spawn == NULL)
+		goto EXIT;
+
+	mce_log(LL_DEBUG, "%s (pid %d, watch %u) detached",
+		spawn->name, spawn->pid, spawn->watch_id);
+
+	spawn->callback = NULL;
+	spawn->data = NULL;
+
+EXIT:
+	return;
+}
@@ -0,0 +1,43 @@
+/**
+ * @file mce-spawn.h
+ * Headers for launching helper programs
+ * <p>
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _MCE_SPAWN_H_
+#define _MCE_SPAWN_H_
+
+#include <glib.h>
+
+/**
+ * Callback for a finished helper
+ *
+ * @param success TRUE if the helper exited with status 0,
+ *                FALSE otherwise
+ * @param elapsed Time from launch to exit in microseconds
+ * @param data The user data passed to mce_spawn()
+ */
+typedef void (*mce_spawn_cb_t)(gboolean success, gint64 elapsed,
+			       gpointer data);
+
+/**
+ * A running helper; valid until its callback has been called,
+ * or until it is detached
+ */
+typedef struct mce_spawn mce_spawn_t;
+
+mce_spawn_t *mce_spawn(const gchar *const argv[],
+		       mce_spawn_cb_t callback, gpointer data);
+void mce_spawn_detach(mce_spawn_t *spawn);
+
+#endif /* _MCE_SPAWN_H_ */
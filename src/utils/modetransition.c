@@ -38,46 +38,13 @@
 #include "mce-io.h"
 #include "mce-lib.h"
 #include "mce-log.h"
+#include "mce-patterns.h"
 #include "mce-dbus.h"
 #include "datapipe.h"
 #ifdef ENABLE_CONIC_SUPPORT
 #include "connectivity.h"
 #endif
 
-static const mce_translation_t device_mode_translation[] = {
-	{
-		.number = MCE_NORMAL_MODE_INT32,
-		.string = MCE_NORMAL_MODE
-	}, {
-		.number = MCE_NORMAL_MODE_CONFIRM_INT32,
-		.string = MCE_NORMAL_MODE
-	}, {
-		.number = MCE_NORMAL_MODE_CONFIRM_INT32,
-		.string = MCE_NORMAL_MODE MCE_CONFIRM_SUFFIX
-	}, {
-		.number = MCE_FLIGHT_MODE_INT32,
-		.string = MCE_FLIGHT_MODE
-	}, {
-		.number = MCE_FLIGHT_MODE_CONFIRM_INT32,
-		.string = MCE_FLIGHT_MODE
-	}, {
-		.number = MCE_FLIGHT_MODE_CONFIRM_INT32,
-		.string = MCE_FLIGHT_MODE MCE_CONFIRM_SUFFIX
-	}, {
-		.number = MCE_OFFLINE_MODE_INT32,
-		.string = MCE_OFFLINE_MODE
-	}, {
-		.number = MCE_OFFLINE_MODE_CONFIRM_INT32,
-		.string = MCE_OFFLINE_MODE
-	}, {
-		.number = MCE_OFFLINE_MODE_CONFIRM_INT32,
-		.string = MCE_OFFLINE_MODE MCE_CONFIRM_SUFFIX
-	}, {
-		.number = MCE_INVALID_TRANSLATION,
-		.string = MCE_INVALID_MODE
-	}
-};
-
 static device_mode_t mcedevmode = MCE_NORMAL_MODE_INT32;
 
 static guint32 transition = 0;
@@ -258,6 +225,12 @@ static gboolean show_acting_dead_ui(const gboolean enable)
 			 DBUS_TYPE_INVALID);
 }
 
+/** Nesting depth of open submode transactions */
+static guint submode_transaction_depth = 0;
+
+/** The submode as modified by the open submode transaction */
+static submode_t submode_transaction = MCE_NORMAL_SUBMODE;
+
 static gboolean mce_set_submode_int32(const submode_t submode)
 {
 	execute_datapipe(&submode_pipe, GINT_TO_POINTER(submode),
@@ -277,6 +250,11 @@ gboolean mce_add_submode_int32(const submode_t submode)
 {
 	submode_t old_submode = datapipe_get_gint(submode_pipe);
 
+	if (submode_transaction_depth > 0) {
+		submode_transaction |= submode;
+		return TRUE;
+	}
+
 	return mce_set_submode_int32(old_submode | submode);
 }
 
@@ -290,9 +268,57 @@ gboolean mce_rem_submode_int32(const submode_t submode)
 {
 	submode_t old_submode = datapipe_get_gint(submode_pipe);
 
+	if (submode_transaction_depth > 0) {
+		submode_transaction &= ~submode;
+		return TRUE;
+	}
+
 	return mce_set_submode_int32(old_submode & ~submode);
 }
 
+/**
+ * Begin a submode transaction
+ *
+ * Until the matching mce_commit_submode_transaction(),
+ * mce_add_submode_int32() and mce_rem_submode_int32() only
+ * update the pending submode, which mce_get_submode_int32() returns;
+ * the submode pipe is then executed once with the final submode.
+ * Transactions can be nested; only the outermost commit takes effect
+ */
+void mce_begin_submode_transaction(void)
+{
+	if (submode_transaction_depth++ == 0)
+		submode_transaction = datapipe_get_gint(submode_pipe);
+}
+
+/**
+ * Commit a submode transaction
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+gboolean mce_commit_submode_transaction(void)
+{
+	gboolean status = TRUE;
+
+	if (submode_transaction_depth == 0) {
+		mce_log(LL_ERR, "Submode transaction committed without begin");
+		status = FALSE;
+		goto EXIT;
+	}
+
+	if (--submode_transaction_depth > 0)
+		goto EXIT;
+
+	/* Don't bother the consumers if nothing changed in the end */
+	if (submode_transaction == datapipe_get_gint(submode_pipe))
+		goto EXIT;
+
+	status = mce_set_submode_int32(submode_transaction);
+
+EXIT:
+	return status;
+}
+
 /**
  * Return all set MCE submode flags
  *
@@ -303,6 +329,9 @@ submode_t mce_get_submode_int32(void)
 {
 	submode_t submode = datapipe_get_gint(submode_pipe);
 
+	if (submode_transaction_depth > 0)
+		submode = submode_transaction;
+
 	return submode;
 }
 
@@ -323,7 +352,7 @@ static gboolean device_mode_send(DBusMessage *const method_call,
 	if (mode != NULL)
 		smode = mode;
 	else
-		smode = mce_translate_int_to_string(device_mode_translation,
+		smode = mce_translate_int_to_string(mce_device_mode_translation,
 						    device_mode);
 
 	if (method_call != NULL) {
@@ -364,7 +393,7 @@ static gboolean set_raw_device_mode(const device_mode_t mode)
 	const gchar *smode = NULL;
 	gboolean status = FALSE;
 
-	smode = mce_translate_int_to_string(device_mode_translation, mode);
+	smode = mce_translate_int_to_string(mce_device_mode_translation, mode);
 
 	if ((status = device_mode_send(NULL, smode)) == FALSE)
 		goto EXIT;
@@ -442,7 +471,7 @@ static gboolean set_mce_mode_string(const gchar *const mode)
 {
 	device_mode_t newmode;
 
-	newmode = mce_translate_string_to_int(device_mode_translation, mode);
+	newmode = mce_translate_string_to_int(mce_device_mode_translation, mode);
 
 	return mce_set_device_mode_int32(newmode);
 }
@@ -541,7 +570,7 @@ static gboolean restore_mce_mode(void)
 
 		mode[i] = '\0';
 
-		newmode = mce_translate_string_to_int(device_mode_translation,
+		newmode = mce_translate_string_to_int(mce_device_mode_translation,
 						      mode);
 
 		if (newmode == MCE_INVALID_TRANSLATION)
@@ -574,10 +603,10 @@ static void system_state_trigger(gconstpointer data)
 						"Failed to open "
 						"power up splashscreen");
 				}
-				execute_datapipe_output_triggers(&led_pattern_deactivate_pipe, MCE_LED_PATTERN_BATTERY_CHARGING, USE_INDATA);
-				execute_datapipe_output_triggers(&led_pattern_deactivate_pipe, MCE_LED_PATTERN_BATTERY_FULL, USE_INDATA);
-				execute_datapipe_output_triggers(&led_pattern_deactivate_pipe, MCE_LED_PATTERN_POWER_ON, USE_INDATA);
-				execute_datapipe_output_triggers(&vibrator_pattern_deactivate_pipe, MCE_VIBRATOR_PATTERN_POWER_KEY_PRESS, USE_INDATA);
+				execute_datapipe_output_triggers(&led_pattern_deactivate_pipe, mce_pattern_data(MCE_LED_PATTERN_BATTERY_CHARGING), USE_INDATA);
+				execute_datapipe_output_triggers(&led_pattern_deactivate_pipe, mce_pattern_data(MCE_LED_PATTERN_BATTERY_FULL), USE_INDATA);
+				execute_datapipe_output_triggers(&led_pattern_deactivate_pipe, mce_pattern_data(MCE_LED_PATTERN_POWER_ON), USE_INDATA);
+				execute_datapipe_output_triggers(&vibrator_pattern_deactivate_pipe, mce_pattern_data(MCE_VIBRATOR_PATTERN_POWER_KEY_PRESS), USE_INDATA);
 			}
 		}
 
@@ -597,8 +626,8 @@ static void system_state_trigger(gconstpointer data)
 					"shutdown splashscreen");
 			}
 
-			execute_datapipe_output_triggers(&led_pattern_deactivate_pipe, MCE_LED_PATTERN_DEVICE_ON, USE_INDATA);
-			execute_datapipe_output_triggers(&led_pattern_activate_pipe, MCE_LED_PATTERN_POWER_OFF, USE_INDATA);
+			execute_datapipe_output_triggers(&led_pattern_deactivate_pipe, mce_pattern_data(MCE_LED_PATTERN_DEVICE_ON), USE_INDATA);
+			execute_datapipe_output_triggers(&led_pattern_activate_pipe, mce_pattern_data(MCE_LED_PATTERN_POWER_OFF), USE_INDATA);
 		}
 
 		/* If we're shutting down/rebooting from acting dead,
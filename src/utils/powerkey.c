@@ -31,20 +31,15 @@
 #include "mce.h"
 #include "powerkey.h"
 #include "mce-log.h"
+#include "mce-patterns.h"
 #include "mce-conf.h"
 #include "mce-dbus.h"
+#include "mce-input-frame.h"
 #include "datapipe.h"
 
 static gboolean initialised = FALSE;
 
 static submode_t timeing_submode = MCE_INVALID_SUBMODE;
-static submode_t power_trigger_submode = MCE_INVALID_SUBMODE;
-
-static guint longpress_timer_id;
-static guint shortpress_timer_id;
-static gint *shortpress_data = NULL;
-
-static bool handle_release = false;
 
 static uint16_t power_keycode;
 
@@ -62,9 +57,76 @@ static gint shortpressdelay = DEFAULT_POWER_DOUBLE_DELAY;
 static poweraction_t longpressaction = DEFAULT_POWERKEY_LONG_ACTION;
 /** Action to perform on a double key press */
 static poweraction_t doublepressaction = DEFAULT_POWERKEY_DOUBLE_ACTION;
+/** Action to perform on a triple key press */
+static poweraction_t triplepressaction = POWER_DISABLED;
+/** Action to perform when the key is held on the second press */
+static poweraction_t doublelongpressaction = POWER_DISABLED;
 
 static struct timeval mode_time;
 
+/** Power key gesture recognizer states */
+typedef enum {
+	/** Waiting for the first press */
+	PK_STATE_IDLE = 0,
+	/** Key is down; the deadline is the hold timeout */
+	PK_STATE_PRESSED = 1,
+	/** Key is up; the deadline ends the wait for another press */
+	PK_STATE_RELEASED = 2,
+	/** A gesture completed with the key down; waiting for release */
+	PK_STATE_HELD = 3,
+	/** Number of states */
+	PK_STATE_COUNT
+} pk_state_t;
+
+/** Power key gesture recognizer events */
+typedef enum {
+	/** Key pressed */
+	PK_EVENT_PRESS = 0,
+	/** Key released */
+	PK_EVENT_RELEASE = 1,
+	/** The deadline passed */
+	PK_EVENT_DEADLINE = 2,
+	/** Number of events */
+	PK_EVENT_COUNT
+} pk_event_t;
+
+/** Largest supported number of presses in a multi-press gesture */
+#define PK_MAX_PRESSES			3
+
+/**
+ * Handler for an event in a recognizer state
+ *
+ * @param time Time of the event; usec, in the input event clock
+ * @return The next state
+ */
+typedef pk_state_t (*pk_handler_t)(gint64 time);
+
+/** State of the gesture being recognized */
+static struct {
+	/** Current state */
+	pk_state_t state;
+	/** Number of presses so far */
+	guint presses;
+	/** Action for the current number of presses already done */
+	gboolean fired;
+	/** Time of the latest press; usec, in the input event clock */
+	gint64 press_time;
+	/** Pending deadline; usec, in the input event clock, or -1 */
+	gint64 deadline;
+	/** Time in milliseconds the key must be held for a hold gesture */
+	gint hold_delay;
+	/** System state at the latest key event */
+	system_state_t system_state;
+	/** Submode at the latest key event */
+	submode_t submode;
+} pk = {
+	.state = PK_STATE_IDLE,
+	.deadline = -1,
+};
+
+/** Deadline timer; allocated once and rearmed by setting its ready time */
+static GSource *pk_deadline_source = NULL;
+
 static gboolean can_show_menu(void)
 {
 	alarm_ui_state_t alarm_ui_state = datapipe_get_gint(alarm_ui_state_pipe);
@@ -434,183 +496,400 @@ static void device_mode_trigger(gconstpointer data)
 	}
 }
 
-static gboolean doublepress_cb(gpointer data)
+static void short_press_action(system_state_t system_state, submode_t submode)
+{
+	mce_log(LL_DEBUG, "powerkey: shortpress activated, submode: %d",
+		submode);
+
+	generic_powerkey_handler(shortpressaction);
+
+	if ((system_state == MCE_STATE_ACTDEAD) ||
+		((submode & MCE_SOFTOFF_SUBMODE) != 0)) {
+		execute_datapipe_output_triggers(&led_pattern_deactivate_pipe,
+						 mce_pattern_data(MCE_LED_PATTERN_POWER_ON),
+						 USE_INDATA);
+		execute_datapipe_output_triggers(
+					&vibrator_pattern_deactivate_pipe,
+					mce_pattern_data(MCE_VIBRATOR_PATTERN_POWER_KEY_PRESS),
+					USE_INDATA);
+	}
+}
+
+/**
+ * Check whether a gesture with the given number of presses exists
+ *
+ * Short and double presses always exist, even when disabled,
+ * so that a double press never triggers the short press action
+ *
+ * @param presses Number of presses
+ * @param hold TRUE for the gesture holding the key on the last press
+ * @return TRUE if the gesture exists, FALSE if not
+ */
+static gboolean pk_gesture_exists(guint presses, gboolean hold)
+{
+	if (hold == TRUE) {
+		if (presses == 1)
+			return TRUE;
+
+		return (presses == 2) && (doublelongpressaction != POWER_DISABLED);
+	}
+
+	if (presses <= 2)
+		return TRUE;
+
+	return (presses == 3) && (triplepressaction != POWER_DISABLED);
+}
+
+/**
+ * Get the current time in the input event clock
+ *
+ * @return The time in usec
+ */
+static gint64 pk_now(void)
+{
+	/* Input events are stamped with CLOCK_REALTIME */
+	return g_get_real_time();
+}
+
+/**
+ * Arm the deadline timer
+ *
+ * @param deadline The deadline in the input event clock,
+ *                 or -1 to disarm the timer
+ */
+static void pk_set_deadline(gint64 deadline)
 {
-	struct timeval *time = data;
+	pk.deadline = deadline;
+
+	if (deadline < 0) {
+		g_source_set_ready_time(pk_deadline_source, -1);
+	} else {
+		gint64 delay = MAX(deadline - pk_now(), 0);
 
-	if (timercmp(time, &mode_time, <)) {
-		mce_log(LL_DEBUG, "powerkey: doublepress igored in cb due to mode change");
-		g_free(time);
-		return G_SOURCE_REMOVE;
+		g_source_set_ready_time(pk_deadline_source,
+					g_get_monotonic_time() + delay);
 	}
+}
 
-	generic_powerkey_handler(doublepressaction);
+/**
+ * Check whether the current gesture started before the latest mode change
+ *
+ * @return TRUE if the gesture is stale, FALSE otherwise
+ */
+static gboolean pk_is_stale(void)
+{
+	gint64 changed = (gint64)mode_time.tv_sec * G_USEC_PER_SEC +
+			 mode_time.tv_usec;
 
-	g_free(time);
-	return G_SOURCE_REMOVE;
+	return pk.press_time < changed;
 }
 
-static gboolean longpress_cb(gpointer data)
+/**
+ * Perform the action for a completed gesture
+ *
+ * @param presses Number of presses in the gesture
+ * @param hold TRUE if the key was held on the last press
+ */
+static void pk_fire(guint presses, gboolean hold)
 {
-	struct timeval *time = data;
+	pk.fired = TRUE;
 
-	if (timercmp(time, &mode_time, <)) {
-		mce_log(LL_DEBUG, "powerkey: longpress igored in cb due to mode change");
-		g_free(time);
-		return G_SOURCE_REMOVE;
+	if (pk_is_stale() == TRUE) {
+		mce_log(LL_DEBUG, "powerkey: %u%s press ignored due to mode change",
+			presses, hold ? " long" : "");
+		return;
+	}
+
+	mce_log(LL_DEBUG, "powerkey: %u%s press activated after %" G_GINT64_FORMAT " us, submode: %d",
+		presses, hold ? " long" : "", pk_now() - pk.press_time,
+		pk.submode);
+
+	if (hold == TRUE) {
+		if (presses == 1)
+			handle_longpress();
+		else
+			generic_powerkey_handler(doublelongpressaction);
+	} else if (presses == 1) {
+		short_press_action(pk.system_state, pk.submode);
+	} else if (presses == 2) {
+		generic_powerkey_handler(doublepressaction);
+	} else {
+		generic_powerkey_handler(triplepressaction);
 	}
+}
+
+/**
+ * Start or stop the feedback given when powering up
+ *
+ * @param press TRUE on press, FALSE on release
+ */
+static void pk_feedback(gboolean press)
+{
+	if ((pk.system_state != MCE_STATE_ACTDEAD) &&
+	    ((pk.submode & MCE_SOFTOFF_SUBMODE) == 0))
+		return;
 
-	handle_longpress();
+	if (press == TRUE) {
+		execute_datapipe_output_triggers(&led_pattern_activate_pipe, mce_pattern_data(MCE_LED_PATTERN_POWER_ON), USE_INDATA);
+		execute_datapipe_output_triggers(&vibrator_pattern_activate_pipe, mce_pattern_data(MCE_VIBRATOR_PATTERN_POWER_KEY_PRESS), USE_INDATA);
+	} else {
+		execute_datapipe_output_triggers(&vibrator_pattern_deactivate_pipe, mce_pattern_data(MCE_VIBRATOR_PATTERN_POWER_KEY_PRESS), USE_INDATA);
+	}
+}
 
-	handle_release = false;
+static pk_state_t pk_ignore(gint64 time)
+{
+	(void)time;
 
-	g_free(time);
-	return G_SOURCE_REMOVE;
+	return pk.state;
 }
 
-static void short_press_action(system_state_t system_state, submode_t submode)
+/**
+ * Handle a press that continues the current gesture
+ *
+ * @param time Time of the press
+ * @return The next state
+ */
+static pk_state_t pk_press(gint64 time)
 {
-	mce_log(LL_DEBUG, "powerkey: shortpress activated, submode: %d",
-		submode);
+	pk.press_time = time;
+	pk.fired = FALSE;
+	pk_feedback(TRUE);
+
+	/* Complete right away if no longer gesture can follow */
+	if (!pk_gesture_exists(pk.presses + 1, FALSE) &&
+	    !pk_gesture_exists(pk.presses, TRUE)) {
+		pk_set_deadline(-1);
+		pk_fire(pk.presses, FALSE);
+		return PK_STATE_HELD;
+	}
 
-	generic_powerkey_handler(shortpressaction);
+	if (pk_gesture_exists(pk.presses, TRUE))
+		pk_set_deadline(time + (gint64)pk.hold_delay * 1000);
+	else
+		pk_set_deadline(-1);
 
-	if ((system_state == MCE_STATE_ACTDEAD) ||
-		((submode & MCE_SOFTOFF_SUBMODE) != 0)) {
-		execute_datapipe_output_triggers(&led_pattern_deactivate_pipe,
-						 MCE_LED_PATTERN_POWER_ON,
-						 USE_INDATA);
-		execute_datapipe_output_triggers(
-					&vibrator_pattern_deactivate_pipe,
-					MCE_VIBRATOR_PATTERN_POWER_KEY_PRESS,
-					USE_INDATA);
+	return PK_STATE_PRESSED;
+}
+
+static pk_state_t pk_first_press(gint64 time)
+{
+	/* Shorter delay for startup than for shutdown */
+	if ((pk.system_state == MCE_STATE_ACTDEAD) ||
+	    ((pk.submode & MCE_SOFTOFF_SUBMODE) != 0))
+		pk.hold_delay = mediumdelay;
+	else
+		pk.hold_delay = longdelay;
+
+	pk.presses = 1;
+
+	return pk_press(time);
+}
+
+/**
+ * Handle the end of the wait for another press
+ *
+ * @param time Time of the deadline
+ * @return The next state
+ */
+static pk_state_t pk_released_deadline(gint64 time)
+{
+	gint64 window_end = pk.press_time + (gint64)doublepressdelay * 1000;
+
+	if (pk.fired == FALSE)
+		pk_fire(pk.presses, FALSE);
+
+	/* Another press can still extend the gesture */
+	if (window_end > time) {
+		pk_set_deadline(window_end);
+		return PK_STATE_RELEASED;
+	}
+
+	pk_set_deadline(-1);
+
+	return PK_STATE_IDLE;
+}
+
+static pk_state_t pk_next_press(gint64 time)
+{
+	/* Too late for a multi-press; finish the previous gesture */
+	if (time - pk.press_time >= (gint64)doublepressdelay * 1000) {
+		if (pk.fired == FALSE)
+			pk_fire(pk.presses, FALSE);
+
+		return pk_first_press(time);
+	}
+
+	pk.presses++;
+
+	return pk_press(time);
+}
+
+static pk_state_t pk_release(gint64 time)
+{
+	gint64 delay;
+
+	pk_feedback(FALSE);
+
+	/* The deadline timer did not get to run in time */
+	if (pk.deadline >= 0 && time >= pk.deadline) {
+		pk_set_deadline(-1);
+		pk_fire(pk.presses, TRUE);
+		return PK_STATE_IDLE;
+	}
+
+	if (!pk_gesture_exists(pk.presses + 1, FALSE)) {
+		pk_set_deadline(-1);
+		pk_fire(pk.presses, FALSE);
+		return PK_STATE_IDLE;
+	}
+
+	/* The short press is only delayed if configured to be,
+	 * longer gestures wait for the whole multi-press window
+	 */
+	if (pk.presses == 1)
+		delay = (gint64)shortpressdelay * 1000;
+	else
+		delay = pk.press_time + (gint64)doublepressdelay * 1000 - time;
+
+	if (delay <= 0) {
+		pk_fire(pk.presses, FALSE);
+		return pk_released_deadline(time);
 	}
+
+	pk_set_deadline(time + delay);
+
+	return PK_STATE_RELEASED;
+}
+
+static pk_state_t pk_hold(gint64 time)
+{
+	(void)time;
+
+	pk_set_deadline(-1);
+	pk_fire(pk.presses, TRUE);
+
+	return PK_STATE_HELD;
+}
+
+static pk_state_t pk_held_release(gint64 time)
+{
+	(void)time;
+
+	pk_feedback(FALSE);
+
+	return PK_STATE_IDLE;
 }
 
-static gboolean
-short_press_cb(gpointer user_data)
+/** Gesture recognizer transitions, indexed by state and event */
+static const pk_handler_t pk_transitions[PK_STATE_COUNT][PK_EVENT_COUNT] = {
+	[PK_STATE_IDLE] = {
+		[PK_EVENT_PRESS] = pk_first_press,
+		[PK_EVENT_RELEASE] = pk_ignore,
+		[PK_EVENT_DEADLINE] = pk_ignore,
+	},
+	[PK_STATE_PRESSED] = {
+		[PK_EVENT_PRESS] = pk_ignore,
+		[PK_EVENT_RELEASE] = pk_release,
+		[PK_EVENT_DEADLINE] = pk_hold,
+	},
+	[PK_STATE_RELEASED] = {
+		[PK_EVENT_PRESS] = pk_next_press,
+		[PK_EVENT_RELEASE] = pk_ignore,
+		[PK_EVENT_DEADLINE] = pk_released_deadline,
+	},
+	[PK_STATE_HELD] = {
+		[PK_EVENT_PRESS] = pk_ignore,
+		[PK_EVENT_RELEASE] = pk_held_release,
+		[PK_EVENT_DEADLINE] = pk_ignore,
+	},
+};
+
+/**
+ * Feed an event to the gesture recognizer
+ *
+ * @param event The event
+ * @param time Time of the event; usec, in the input event clock
+ */
+static void pk_handle_event(pk_event_t event, gint64 time)
+{
+	pk.state = pk_transitions[pk.state][event](time);
+}
+
+/**
+ * Abandon the gesture being recognized
+ */
+static void pk_reset(void)
 {
+	pk_set_deadline(-1);
+	pk.state = PK_STATE_IDLE;
+	pk.presses = 0;
+}
+
+static gboolean pk_deadline_dispatch(GSource *source, GSourceFunc callback,
+				     gpointer user_data)
+{
+	(void)callback;
 	(void)user_data;
-	short_press_action(shortpress_data[0], shortpress_data[1]);
 
-	shortpress_timer_id = 0;
-	g_free(shortpress_data);
-	shortpress_data = NULL;
+	g_source_set_ready_time(source, -1);
+	pk_handle_event(PK_EVENT_DEADLINE, pk.deadline);
+
+	return G_SOURCE_CONTINUE;
+}
+
+static GSourceFuncs pk_deadline_funcs = {
+	.dispatch = pk_deadline_dispatch,
+};
+
+/**
+ * Handle a [power] key event
+ *
+ * @param ev The key event
+ */
+static void powerkey_event(const struct input_event *ev)
+{
+	gint64 time = (gint64)ev->input_event_sec * G_USEC_PER_SEC +
+		      ev->input_event_usec;
+
+	pk.system_state = datapipe_get_gint(system_state_pipe);
+	pk.submode = mce_get_submode_int32();
+
+	if (ev->value == 1) {
+		mce_log(LL_DEBUG, "[power] pressed");
+
+		/* The event eater swallows the press
+		 * and whatever gesture was in progress
+		 */
+		if ((pk.submode & MCE_EVEATER_SUBMODE) != 0) {
+			pk_reset();
+			return;
+		}
 
-	return FALSE;
+		pk_handle_event(PK_EVENT_PRESS, time);
+	} else if (ev->value == 0) {
+		mce_log(LL_DEBUG, "powerkey: [power] released");
+		pk_handle_event(PK_EVENT_RELEASE, time);
+	}
 }
 
 /**
  * Datapipe trigger for the [power] key
  *
- * @param data A pointer to the input_event struct
+ * @param data The mce_input_frame_t with the key events
  */
 static void powerkey_trigger(gconstpointer const data)
 {
-	system_state_t system_state = datapipe_get_gint(system_state_pipe);
-	submode_t submode = mce_get_submode_int32();
-	struct input_event const *const *evp;
-	struct input_event const *ev;
-	static struct timeval press_time = {0};
-	static int longpress_delay = DEFAULT_POWER_LONG_DELAY;
+	const mce_input_frame_t *frame = data;
+	guint i;
 
 	/* Don't dereference until we know it's safe */
-	if (data == NULL)
+	if (frame == NULL)
 		goto EXIT;
 
-	evp = data;
-	ev = *evp;
-
-	if ((ev != NULL) && (ev->code == power_keycode)) {
-		if (ev->value == 1) {
-			power_trigger_submode = submode;
-			mce_log(LL_DEBUG, "[power] pressed");
-			if (shortpress_timer_id) {
-				g_source_remove(shortpress_timer_id);
-				shortpress_timer_id = 0;
-				g_free(shortpress_data);
-				shortpress_data = NULL;
-			}
-			if (!(submode & MCE_EVEATER_SUBMODE)) {
-				struct timeval double_delay_timeval = {doublepressdelay/1000, (doublepressdelay % 1000)*1000};
-				struct timeval diff;
-				struct timeval event_time = {ev->input_event_sec, ev->input_event_usec};
-				timersub(&event_time, &press_time, &diff);
-
-				if ((system_state == MCE_STATE_ACTDEAD) ||
-				    ((submode & MCE_SOFTOFF_SUBMODE) != 0)) {
-					execute_datapipe_output_triggers(&led_pattern_activate_pipe, MCE_LED_PATTERN_POWER_ON, USE_INDATA);
-					execute_datapipe_output_triggers(&vibrator_pattern_activate_pipe, MCE_VIBRATOR_PATTERN_POWER_KEY_PRESS, USE_INDATA);
-					/* Shorter delay for startup
-					 * than for shutdown
-					*/
-					longpress_delay = mediumdelay;
-				} else {
-					longpress_delay = longdelay;
-				}
-				if (timercmp(&diff, &double_delay_timeval, <)) {
-					if (longpress_timer_id != 0) {
-						g_source_remove(longpress_timer_id);
-						longpress_timer_id = 0;
-					}
-					if (!timercmp(&event_time, &mode_time, <)) {
-						struct timeval *ev_time = g_malloc0(sizeof(*ev_time));
-						*ev_time = event_time;
-						mce_log(LL_DEBUG, "powerkey: doublepress activated, submode: %d", submode);
-						g_idle_add(doublepress_cb, ev_time);
-					}
-					else {
-						mce_log(LL_DEBUG, "powerkey: doublepress igored due to mode change");
-					}
-					handle_release = false;
-				} else {
-					if (!timercmp(&event_time, &mode_time, <)) {
-						struct timeval *ev_time = g_malloc0(sizeof(*ev_time));
-						*ev_time = event_time;
-						longpress_timer_id = g_timeout_add(longpress_delay, longpress_cb, ev_time);
-						handle_release = true;
-					} else {
-						mce_log(LL_DEBUG, "powerkey: singlepress igored due to mode change");
-						handle_release = false;
-					}
-				}
-				press_time = event_time;
-			}
-		} else if (ev->value == 0) {
-			mce_log(LL_DEBUG, "powerkey: [power] released");
-			if (longpress_timer_id != 0) {
-					g_source_remove(longpress_timer_id);
-					longpress_timer_id = 0;
-			}
-			if (!(power_trigger_submode & MCE_EVEATER_SUBMODE) && handle_release) {
-				struct timeval long_delay_timeval = {longpress_delay/1000, (longpress_delay % 1000)*1000};
-				struct timeval diff;
-				struct timeval event_time = {ev->input_event_sec, ev->input_event_usec};
-				timersub(&event_time, &press_time, &diff);
-				if (!timercmp(&event_time, &mode_time, <)) {
-					if (timercmp(&diff, &long_delay_timeval, >)) {
-						handle_longpress();
-						mce_log(LL_DEBUG, "powerkey: longpress activated, submode: %d", submode);
-					} else {
-						if (shortpressdelay) {
-							shortpress_data = g_new(gint, 2);
-							shortpress_data[0] = system_state;
-							shortpress_data[1] = submode;
-
-							shortpress_timer_id = g_timeout_add(shortpressdelay, short_press_cb, NULL);
-						} else {
-							short_press_action(system_state, submode);
-						}
-					}
-				} else {
-					mce_log(LL_DEBUG, "powerkey: release ignored due to mode change");
-				}
-				if ((system_state == MCE_STATE_ACTDEAD) || ((submode & MCE_SOFTOFF_SUBMODE) != 0)) {
-						execute_datapipe_output_triggers(&vibrator_pattern_deactivate_pipe, MCE_VIBRATOR_PATTERN_POWER_KEY_PRESS, USE_INDATA);
-				}
-			}
-			handle_release = false;
-		}
+	for (i = 0; i < frame->count; i++) {
+		if (frame->events[i].code == power_keycode)
+			powerkey_event(&frame->events[i]);
 	}
 
 EXIT:
@@ -705,6 +984,11 @@ gboolean mce_powerkey_init(void)
 
 	(void)device_menu(FALSE);
 
+	/* The gesture deadline timer is reused for every press */
+	pk_deadline_source = g_source_new(&pk_deadline_funcs, sizeof(GSource));
+	g_source_set_ready_time(pk_deadline_source, -1);
+	g_source_attach(pk_deadline_source, NULL);
+
 	/* Append triggers/filters to datapipes */
 	append_input_trigger_to_datapipe(&keypress_pipe,
 					 powerkey_trigger);
@@ -777,6 +1061,18 @@ gboolean mce_powerkey_init(void)
 	/* Since we've set a default, error handling is unnecessary */
 	(void)parse_action(double_action, &doublepressaction);
 
+	tmp = mce_conf_get_string(MCE_CONF_POWERKEY_GROUP,
+				  MCE_CONF_POWERKEY_TRIPLE_ACTION,
+				  POWER_DISABLED_STR, NULL);
+	(void)parse_action(tmp, &triplepressaction);
+	g_free(tmp);
+
+	tmp = mce_conf_get_string(MCE_CONF_POWERKEY_GROUP,
+				  MCE_CONF_POWERKEY_DOUBLE_LONG_ACTION,
+				  POWER_DISABLED_STR, NULL);
+	(void)parse_action(tmp, &doublelongpressaction);
+	g_free(tmp);
+
 	/* check if current single/double press combo requires delay */
 	actions = mce_conf_get_string_list(MCE_CONF_POWERKEY_GROUP,
 					   MCE_CONF_POWERKEY_SD_APPLY,
@@ -845,11 +1141,9 @@ void mce_powerkey_exit(void)
 	remove_input_trigger_from_datapipe(&submode_pipe,
 					   submode_trigger);
 	
-	if (longpress_timer_id != 0)
-		g_source_remove(longpress_timer_id);
-
-	if (shortpress_timer_id != 0) {
-		g_source_remove(shortpress_timer_id);
-		g_free(shortpress_data);
+	if (pk_deadline_source != NULL) {
+		g_source_destroy(pk_deadline_source);
+		g_source_unref(pk_deadline_source);
+		pk_deadline_source = NULL;
 	}
 }
@@ -88,6 +88,14 @@ typedef enum {
 /** Name of configuration key for double [power] press action */
 #define MCE_CONF_POWERKEY_DOUBLE_ACTION	"PowerKeyDoubleAction"
 
+/** Name of configuration key for triple [power] press action */
+#define MCE_CONF_POWERKEY_TRIPLE_ACTION	"PowerKeyTripleAction"
+
+/** Name of configuration key for the action when [power] is held
+  * on the second press
+  */
+#define MCE_CONF_POWERKEY_DOUBLE_LONG_ACTION	"PowerKeyDoubleLongAction"
+
 /**
  * Long delay for the [power] button in milliseconds; 1.5 seconds
  */
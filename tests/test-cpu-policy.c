@@ -0,0 +1,258 @@
+/**
+ * @file test-cpu-policy.c
+ * Unit tests for the configuration and selection of CPU policies
+ * <p>
+ * The policies are private to cpu-policy.c, so the file is included here;
+ * the configuration is written to the test configuration directory
+ * and read through mce-conf
+ * <p>
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "cpu-policy.c"
+
+datapipe_struct display_state_pipe;
+datapipe_struct call_state_pipe;
+
+/**
+ * Write the main configuration file and read it
+ *
+ * @param contents The contents of the configuration file
+ */
+static void conf_load(const gchar *contents)
+{
+	const gchar *dir = G_STRINGIFY(MCE_CONF_DIR);
+	gchar *path = g_strconcat(dir, "/", G_STRINGIFY(MCE_CONF_FILE), NULL);
+
+	g_assert_cmpint(g_mkdir_with_parents(dir, 0755), ==, 0);
+	g_assert(g_file_set_contents(path, contents, -1, NULL) == TRUE);
+	g_assert(mce_conf_init() == TRUE);
+
+	g_free(path);
+}
+
+/**
+ * Forget the policies and the configuration
+ */
+static void conf_unload(void)
+{
+	policy_free_conf(&policy_display_on);
+	policy_free_conf(&policy_display_dim);
+	policy_free_conf(&policy_display_off);
+	policy_free_conf(&policy_call);
+
+	policy_display_on = (cpu_policy_t) {
+		.group = MCE_CONF_CPU_POLICY_DISPLAY_ON_GROUP,
+	};
+	policy_display_dim = (cpu_policy_t) {
+		.group = MCE_CONF_CPU_POLICY_DISPLAY_DIM_GROUP,
+	};
+	policy_display_off = (cpu_policy_t) {
+		.group = MCE_CONF_CPU_POLICY_DISPLAY_OFF_GROUP,
+	};
+	policy_call = (cpu_policy_t) {
+		.group = MCE_CONF_CPU_POLICY_CALL_GROUP,
+	};
+
+	current_policy = NULL;
+
+	mce_conf_exit();
+}
+
+/**
+ * Read all policies from the configuration
+ */
+static void read_policies(void)
+{
+	policy_read_conf(&policy_display_on);
+	policy_read_conf(&policy_display_dim);
+	policy_read_conf(&policy_display_off);
+	policy_read_conf(&policy_call);
+}
+
+/**
+ * Select a policy for the given display and call states
+ *
+ * @param display The display state
+ * @param call The call state
+ * @return The selected policy
+ */
+static const cpu_policy_t *select_policy(display_state_t display,
+					 call_state_t call)
+{
+	display_state = display;
+	call_state = call;
+	update_policy();
+
+	return current_policy;
+}
+
+static void test_conf_online(void)
+{
+	cpu_t cpu = { .index = 0 };
+
+	conf_load("[CPUPolicyDisplayOff]\n"
+		  "OnlineCpus=0;2\n");
+	read_policies();
+
+	g_assert(policy_display_off.defined == TRUE);
+	g_assert(policy_display_off.set_online == TRUE);
+	g_assert_cmpuint(policy_display_off.online, ==, 0x5);
+	g_assert_null(policy_display_off.governor);
+	g_assert_cmpint(policy_display_off.min_freq, ==, 0);
+	g_assert_cmpint(policy_display_off.max_freq, ==, 0);
+
+	g_assert(policy_wants_online(&policy_display_off, &cpu) == TRUE);
+	cpu.index = 1;
+	g_assert(policy_wants_online(&policy_display_off, &cpu) == FALSE);
+	cpu.index = 2;
+	g_assert(policy_wants_online(&policy_display_off, &cpu) == TRUE);
+
+	/* Without OnlineCpus, every CPU is wanted online */
+	g_assert(policy_display_on.defined == FALSE);
+	g_assert(policy_display_on.set_online == FALSE);
+	cpu.index = 1;
+	g_assert(policy_wants_online(&policy_display_on, &cpu) == TRUE);
+
+	conf_unload();
+}
+
+static void test_conf_online_invalid(void)
+{
+	cpu_t cpu = { .index = CPU_POLICY_MAX_CPUS };
+
+	/* CPUs out of range are ignored, the rest still apply */
+	conf_load("[CPUPolicyCall]\n"
+		  "OnlineCpus=-1;1;64;63\n");
+	read_policies();
+
+	g_assert(policy_call.set_online == TRUE);
+	g_assert_cmpuint(policy_call.online, ==,
+			 (G_GUINT64_CONSTANT(1) << 63) | 0x2);
+
+	/* CPUs that cannot be described are left online */
+	g_assert(policy_wants_online(&policy_call, &cpu) == TRUE);
+
+	conf_unload();
+}
+
+static void test_conf_cpufreq(void)
+{
+	conf_load("[CPUPolicyDisplayOn]\n"
+		  "Governor=schedutil\n"
+		  "MinFreq=300000\n"
+		  "MaxFreq=1200000\n"
+		  "EnergyPerformancePreference=balance_performance\n"
+		  "[CPUPolicyDisplayDim]\n"
+		  "MaxFreq=600000\n");
+	read_policies();
+
+	g_assert(policy_display_on.defined == TRUE);
+	g_assert(policy_display_on.set_online == FALSE);
+	g_assert_cmpstr(policy_display_on.governor, ==, "schedutil");
+	g_assert_cmpint(policy_display_on.min_freq, ==, 300000);
+	g_assert_cmpint(policy_display_on.max_freq, ==, 1200000);
+	g_assert_cmpstr(policy_display_on.epp, ==, "balance_performance");
+
+	/* Settings that are not set are left untouched */
+	g_assert(policy_display_dim.defined == TRUE);
+	g_assert_null(policy_display_dim.governor);
+	g_assert_cmpint(policy_display_dim.min_freq, ==, 0);
+	g_assert_cmpint(policy_display_dim.max_freq, ==, 600000);
+	g_assert_null(policy_display_dim.epp);
+
+	g_assert(policy_display_off.defined == FALSE);
+	g_assert(policy_call.defined == FALSE);
+
+	conf_unload();
+}
+
+static void test_conf_empty(void)
+{
+	/* Zero frequencies mean the same as no frequency */
+	conf_load("[CPUPolicyDisplayOff]\n"
+		  "MinFreq=0\n"
+		  "[Other]\n"
+		  "Governor=performance\n");
+	read_policies();
+
+	g_assert(policy_display_on.defined == FALSE);
+	g_assert(policy_display_dim.defined == FALSE);
+	g_assert(policy_display_off.defined == FALSE);
+	g_assert(policy_call.defined == FALSE);
+
+	conf_unload();
+}
+
+static void test_select(void)
+{
+	conf_load("[CPUPolicyDisplayOn]\n"
+		  "Governor=schedutil\n"
+		  "[CPUPolicyDisplayOff]\n"
+		  "OnlineCpus=0\n");
+	read_policies();
+
+	/* Nothing is applied before the display state is known */
+	g_assert_null(select_policy(MCE_DISPLAY_UNDEF, CALL_STATE_NONE));
+
+	g_assert(select_policy(MCE_DISPLAY_ON, CALL_STATE_NONE) ==
+		 &policy_display_on);
+	g_assert(select_policy(MCE_DISPLAY_OFF, CALL_STATE_NONE) ==
+		 &policy_display_off);
+
+	/* Without dim and call policies, the display decides */
+	g_assert(select_policy(MCE_DISPLAY_DIM, CALL_STATE_NONE) ==
+		 &policy_display_on);
+	g_assert(select_policy(MCE_DISPLAY_OFF, CALL_STATE_ACTIVE) ==
+		 &policy_display_off);
+
+	conf_unload();
+
+	conf_load("[CPUPolicyDisplayDim]\n"
+		  "MaxFreq=600000\n"
+		  "[CPUPolicyCall]\n"
+		  "OnlineCpus=0;1\n");
+	read_policies();
+
+	g_assert(select_policy(MCE_DISPLAY_DIM, CALL_STATE_NONE) ==
+		 &policy_display_dim);
+
+	/* A ringing or active call takes precedence over the display */
+	g_assert(select_policy(MCE_DISPLAY_OFF, CALL_STATE_RINGING) ==
+		 &policy_call);
+	g_assert(select_policy(MCE_DISPLAY_ON, CALL_STATE_ACTIVE) ==
+		 &policy_call);
+	g_assert(select_policy(MCE_DISPLAY_OFF, CALL_STATE_NONE) ==
+		 &policy_display_off);
+
+	conf_unload();
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	mce_log_open("test-cpu-policy", LOG_USER, MCE_LOG_STDERR);
+	mce_log_set_verbosity(LL_NONE);
+
+	/* No CPUs are touched; only the policies are looked at */
+	cpus = g_ptr_array_new_with_free_func(cpu_free);
+
+	g_test_add_func("/cpu-policy/conf/online", test_conf_online);
+	g_test_add_func("/cpu-policy/conf/online-invalid",
+			test_conf_online_invalid);
+	g_test_add_func("/cpu-policy/conf/cpufreq", test_conf_cpufreq);
+	g_test_add_func("/cpu-policy/conf/empty", test_conf_empty);
+	g_test_add_func("/cpu-policy/select", test_select);
+
+	return g_test_run();
+}
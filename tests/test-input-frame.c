@@ -0,0 +1,412 @@
+/**
+ * @file test-input-frame.c
+ * Unit tests for the input frames and their assembly from key events
+ * <p>
+ * The frames are assembled by keypress_cb() in event-input.c,
+ * so the file is included here; the I/O monitors and input device
+ * scanning it uses are replaced with stubs
+ * <p>
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "event-input.c"
+
+/** Largest number of frames recorded per test */
+#define MAX_FRAMES			8
+
+/** Frames that reached keypress_pipe since the last reset */
+static mce_input_frame_t frames[MAX_FRAMES];
+
+/** Number of frames that reached keypress_pipe since the last reset */
+static guint frame_count = 0;
+
+/** I/O monitor cookies of two input devices */
+static int device_a, device_b;
+
+datapipe_struct keypress_pipe;
+datapipe_struct device_inactive_pipe;
+datapipe_struct lockkey_pipe;
+datapipe_struct keyboard_slide_pipe;
+datapipe_struct camera_button_pipe;
+datapipe_struct touchscreen_pipe;
+datapipe_struct touchscreen_suspend_pipe;
+
+submode_t mce_get_submode_int32(void)
+{
+	return MCE_NORMAL_SUBMODE;
+}
+
+gconstpointer mce_register_io_monitor_chunk(const gint fd,
+					    const gchar *const file,
+					    error_policy_t error_policy,
+					    gboolean rewind_policy,
+					    iomon_cb callback,
+					    gulong chunk_size,
+					    iomon_error_cb remdev_callback,
+					    gpointer remdev_data)
+{
+	(void)fd;
+	(void)file;
+	(void)error_policy;
+	(void)rewind_policy;
+	(void)callback;
+	(void)chunk_size;
+	(void)remdev_callback;
+	(void)remdev_data;
+
+	return NULL;
+}
+
+void mce_suspend_io_monitor(gconstpointer io_monitor)
+{
+	(void)io_monitor;
+}
+
+void mce_resume_io_monitor(gconstpointer io_monitor)
+{
+	(void)io_monitor;
+}
+
+void mce_unregister_io_monitor(gconstpointer io_monitor)
+{
+	(void)io_monitor;
+}
+
+const gchar *mce_get_io_monitor_name(gconstpointer io_monitor)
+{
+	(void)io_monitor;
+
+	return "";
+}
+
+int mce_match_event_file_by_caps(const gchar *const filename,
+				 const int *const ev_types,
+				 const int *const ev_keys[])
+{
+	(void)filename;
+	(void)ev_types;
+	(void)ev_keys;
+
+	return -1;
+}
+
+int mce_match_event_file(const gchar *const filename,
+			 const gchar *const *const drivers)
+{
+	(void)filename;
+	(void)drivers;
+
+	return -1;
+}
+
+gboolean mce_scan_inputdevices(mce_input_match_callback match_callback,
+			       gpointer user_data)
+{
+	(void)match_callback;
+	(void)user_data;
+
+	return TRUE;
+}
+
+gint64 mce_profile_timestamp(void)
+{
+	return 0;
+}
+
+void mce_profile_record(const gchar *const phase, const gchar *const name,
+			const gint64 start)
+{
+	(void)phase;
+	(void)name;
+	(void)start;
+}
+
+/**
+ * Record the frames passed through keypress_pipe
+ *
+ * @param data The frame
+ */
+static void keypress_trigger(gconstpointer data)
+{
+	const mce_input_frame_t *frame = data;
+
+	g_assert(frame != NULL);
+	g_assert_cmpuint(frame_count, <, MAX_FRAMES);
+
+	frames[frame_count++] = *frame;
+}
+
+/**
+ * Feed an input event to keypress_cb()
+ *
+ * @param device The I/O monitor of the device
+ * @param type The event type
+ * @param code The event code
+ * @param value The event value
+ * @param usec The event timestamp; usec
+ */
+static void feed(const int *device, guint16 type, guint16 code,
+		 gint32 value, glong usec)
+{
+	struct input_event ev;
+
+	memset(&ev, 0, sizeof (ev));
+	ev.input_event_sec = 1000;
+	ev.input_event_usec = usec;
+	ev.type = type;
+	ev.code = code;
+	ev.value = value;
+
+	keypress_cb(&ev, sizeof (ev), device);
+}
+
+/**
+ * Feed a key event to keypress_cb()
+ *
+ * @param device The I/O monitor of the device
+ * @param code The key code
+ * @param value 1 for press, 0 for release, 2 for repeat
+ * @param usec The event timestamp; usec
+ */
+static void feed_key(const int *device, guint16 code, gint32 value,
+		     glong usec)
+{
+	feed(device, EV_KEY, code, value, usec);
+}
+
+/**
+ * End the report of a device
+ *
+ * @param device The I/O monitor of the device
+ */
+static void feed_report(const int *device)
+{
+	feed(device, EV_SYN, SYN_REPORT, 0, 0);
+}
+
+/**
+ * Check an event of a recorded frame
+ *
+ * @param frame The frame
+ * @param i Index of the event
+ * @param code The expected key code
+ * @param value The expected value
+ */
+static void assert_event(const mce_input_frame_t *frame, guint i,
+			 guint16 code, gint32 value)
+{
+	g_assert_cmpuint(i, <, frame->count);
+	g_assert_cmpuint(frame->events[i].type, ==, EV_KEY);
+	g_assert_cmpuint(frame->events[i].code, ==, code);
+	g_assert_cmpint(frame->events[i].value, ==, value);
+}
+
+/**
+ * Reset the recorded frames
+ */
+static void reset(void)
+{
+	frame_count = 0;
+}
+
+static void test_frame_append(void)
+{
+	mce_input_frame_t *frame = mce_input_frame_new();
+	struct input_event ev;
+	guint i;
+
+	memset(&ev, 0, sizeof (ev));
+	g_assert_cmpuint(frame->refcount, ==, 1);
+	g_assert_cmpuint(frame->count, ==, 0);
+
+	for (i = 0; i < MCE_INPUT_FRAME_MAX_EVENTS; i++) {
+		ev.code = i;
+		g_assert(mce_input_frame_append(frame, &ev) == TRUE);
+	}
+
+	/* A full frame takes no more events */
+	g_assert(mce_input_frame_append(frame, &ev) == FALSE);
+	g_assert_cmpuint(frame->count, ==, MCE_INPUT_FRAME_MAX_EVENTS);
+
+	for (i = 0; i < MCE_INPUT_FRAME_MAX_EVENTS; i++)
+		g_assert_cmpuint(frame->events[i].code, ==, i);
+
+	mce_input_frame_unref(frame);
+}
+
+static void test_frame_pool(void)
+{
+	mce_input_frame_t *frame = mce_input_frame_new();
+	mce_input_frame_t *reused;
+	struct input_event ev;
+
+	memset(&ev, 0, sizeof (ev));
+	(void)mce_input_frame_append(frame, &ev);
+
+	/* Still referenced; not returned to the pool */
+	frame->refcount++;
+	mce_input_frame_unref(frame);
+	g_assert_cmpuint(frame->refcount, ==, 1);
+
+	/* The last reference returns it to the pool, and the
+	 * next frame reuses it, empty
+	 */
+	mce_input_frame_unref(frame);
+	reused = mce_input_frame_new();
+	g_assert(reused == frame);
+	g_assert_cmpuint(reused->refcount, ==, 1);
+	g_assert_cmpuint(reused->count, ==, 0);
+
+	mce_input_frame_unref(reused);
+	mce_input_frame_unref(NULL);
+}
+
+static void test_assemble_report(void)
+{
+	reset();
+
+	/* Nothing is passed on before the end of the report */
+	feed_key(&device_a, KEY_POWER, 1, 100);
+	feed_key(&device_a, KEY_VOLUMEUP, 1, 100);
+	g_assert_cmpuint(frame_count, ==, 0);
+
+	feed_report(&device_a);
+	g_assert_cmpuint(frame_count, ==, 1);
+	g_assert_cmpuint(frames[0].count, ==, 2);
+	assert_event(&frames[0], 0, KEY_POWER, 1);
+	assert_event(&frames[0], 1, KEY_VOLUMEUP, 1);
+
+	/* The kernel timestamps are kept */
+	g_assert_cmpint(frames[0].events[0].input_event_sec, ==, 1000);
+	g_assert_cmpint(frames[0].events[0].input_event_usec, ==, 100);
+
+	/* An empty report passes nothing on */
+	feed_report(&device_a);
+	g_assert_cmpuint(frame_count, ==, 1);
+
+	feed_key(&device_a, KEY_POWER, 0, 200);
+	feed_report(&device_a);
+	g_assert_cmpuint(frame_count, ==, 2);
+	g_assert_cmpuint(frames[1].count, ==, 1);
+	assert_event(&frames[1], 0, KEY_POWER, 0);
+}
+
+static void test_assemble_devices(void)
+{
+	reset();
+
+	/* Reports of different devices may interleave */
+	feed_key(&device_a, KEY_POWER, 1, 100);
+	feed_key(&device_b, KEY_VOLUMEDOWN, 1, 110);
+	feed_key(&device_a, KEY_VOLUMEUP, 1, 120);
+
+	feed_report(&device_b);
+	g_assert_cmpuint(frame_count, ==, 1);
+	g_assert_cmpuint(frames[0].count, ==, 1);
+	assert_event(&frames[0], 0, KEY_VOLUMEDOWN, 1);
+
+	feed_report(&device_a);
+	g_assert_cmpuint(frame_count, ==, 2);
+	g_assert_cmpuint(frames[1].count, ==, 2);
+	assert_event(&frames[1], 0, KEY_POWER, 1);
+	assert_event(&frames[1], 1, KEY_VOLUMEUP, 1);
+}
+
+static void test_assemble_dropped(void)
+{
+	reset();
+
+	/* The events before SYN_DROPPED are incomplete; drop them */
+	feed_key(&device_a, KEY_POWER, 1, 100);
+	feed_key(&device_b, KEY_VOLUMEUP, 1, 100);
+	feed(&device_a, EV_SYN, SYN_DROPPED, 0, 0);
+	feed_report(&device_a);
+	g_assert_cmpuint(frame_count, ==, 0);
+
+	/* Other devices are not affected */
+	feed_report(&device_b);
+	g_assert_cmpuint(frame_count, ==, 1);
+	assert_event(&frames[0], 0, KEY_VOLUMEUP, 1);
+}
+
+static void test_assemble_full(void)
+{
+	guint i;
+
+	reset();
+
+	/* A full frame is passed on, and the rest start a new one */
+	for (i = 0; i <= MCE_INPUT_FRAME_MAX_EVENTS; i++)
+		feed_key(&device_a, KEY_1 + (i % 9), i % 2, i);
+
+	g_assert_cmpuint(frame_count, ==, 1);
+	g_assert_cmpuint(frames[0].count, ==, MCE_INPUT_FRAME_MAX_EVENTS);
+
+	feed_report(&device_a);
+	g_assert_cmpuint(frame_count, ==, 2);
+	g_assert_cmpuint(frames[1].count, ==, 1);
+	g_assert_cmpint(frames[1].events[0].input_event_usec, ==,
+			MCE_INPUT_FRAME_MAX_EVENTS);
+}
+
+static void test_assemble_filtered(void)
+{
+	reset();
+
+	/* Repeats, keys handled in event-input, switches
+	 * and other event types are not passed on in frames
+	 */
+	feed_key(&device_a, KEY_POWER, 2, 100);
+	feed_key(&device_a, KEY_CAMERA, 1, 100);
+	feed(&device_a, EV_SW, SW_CAMERA_LENS_COVER, 1, 100);
+	feed(&device_a, EV_ABS, ABS_X, 10, 100);
+	feed_report(&device_a);
+	g_assert_cmpuint(frame_count, ==, 0);
+	g_assert_cmpint(datapipe_get_gint(camera_button_pipe), ==, 1);
+
+	/* Short reads are ignored */
+	keypress_cb(&frames[0], 1, &device_a);
+	g_assert_cmpuint(frame_count, ==, 0);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	mce_log_open("test-input-frame", LOG_USER, MCE_LOG_STDERR);
+	mce_log_set_verbosity(LL_NONE);
+
+	setup_datapipe(&keypress_pipe, READ_ONLY, DONT_FREE_CACHE,
+		       0, NULL);
+	setup_datapipe(&device_inactive_pipe, READ_WRITE, DONT_FREE_CACHE,
+		       0, GINT_TO_POINTER(FALSE));
+	setup_datapipe(&lockkey_pipe, READ_ONLY, DONT_FREE_CACHE,
+		       0, GINT_TO_POINTER(0));
+	setup_datapipe(&keyboard_slide_pipe, READ_ONLY, DONT_FREE_CACHE,
+		       0, GINT_TO_POINTER(0));
+	setup_datapipe(&camera_button_pipe, READ_ONLY, DONT_FREE_CACHE,
+		       0, GINT_TO_POINTER(CAMERA_BUTTON_UNDEF));
+	append_output_trigger_to_datapipe(&keypress_pipe, keypress_trigger);
+
+	g_test_add_func("/input-frame/append", test_frame_append);
+	g_test_add_func("/input-frame/pool", test_frame_pool);
+	g_test_add_func("/input-frame/assemble/report", test_assemble_report);
+	g_test_add_func("/input-frame/assemble/devices",
+			test_assemble_devices);
+	g_test_add_func("/input-frame/assemble/dropped",
+			test_assemble_dropped);
+	g_test_add_func("/input-frame/assemble/full", test_assemble_full);
+	g_test_add_func("/input-frame/assemble/filtered",
+			test_assemble_filtered);
+
+	return g_test_run();
+}
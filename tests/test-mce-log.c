@@ -0,0 +1,411 @@
+/**
+ * @file test-mce-log.c
+ * Unit tests for the logging functions
+ * <p>
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib.h>
+#include "mce-log.h"
+
+/**
+ * Dump the log ring
+ *
+ * @return The lines of the dump; free with g_strfreev()
+ */
+static gchar **ring_dump(void)
+{
+	char *buf = NULL;
+	size_t size = 0;
+	FILE *stream;
+	gchar **lines;
+
+	stream = open_memstream(&buf, &size);
+	g_assert(stream != NULL);
+
+	mce_log_ring_dump(stream);
+	fclose(stream);
+
+	/* The dump ends with a newline, which leaves an empty last line */
+	lines = g_strsplit(buf, "\n", -1);
+	free(buf);
+
+	return lines;
+}
+
+/**
+ * Get the number of messages in a log ring dump
+ *
+ * @param lines The lines of the dump
+ * @return The number of messages
+ */
+static guint ring_count(gchar **lines)
+{
+	guint count = g_strv_length(lines);
+
+	return (count > 0) ? count - 1 : 0;
+}
+
+/**
+ * Get the text of a message in a log ring dump
+ *
+ * @param line A line of the dump
+ * @return The message without its timestamp, level and location
+ */
+static const gchar *ring_text(const gchar *line)
+{
+	const gchar *text = strstr(line, "(): ");
+
+	g_assert(text != NULL);
+
+	return text + 4;
+}
+
+/**
+ * Get the text of the latest message in the log ring
+ *
+ * @return The message; free with g_free()
+ */
+static gchar *ring_last(void)
+{
+	gchar **lines = ring_dump();
+	guint count = ring_count(lines);
+	gchar *text;
+
+	g_assert_cmpuint(count, >, 0);
+	text = g_strdup(ring_text(lines[count - 1]));
+	g_strfreev(lines);
+
+	return text;
+}
+
+/**
+ * Check the latest message in the log ring
+ *
+ * @param expected The expected message text
+ */
+static void assert_ring_last(const gchar *expected)
+{
+	gchar *text = ring_last();
+
+	g_assert_cmpstr(text, ==, expected);
+	g_free(text);
+}
+
+static void test_ring_format(void)
+{
+	gchar **lines;
+	guint count;
+
+	mce_log(LL_WARN, "int %d str %s hex %#x %%", -5, "abc", 255);
+	assert_ring_last("int -5 str abc hex 0xff %");
+
+	mce_log(LL_DEBUG, "%*d|%.2f|%lu|%c|%lld", 4, 7, 1.5, 42UL, 'x',
+		-9000000000LL);
+	assert_ring_last("   7|1.50|42|x|-9000000000");
+
+	/* The level and the location are kept as well */
+	lines = ring_dump();
+	count = ring_count(lines);
+	g_assert(strstr(lines[count - 1],
+			" D test-mce-log.c:test_ring_format(): ") != NULL);
+	g_strfreev(lines);
+}
+
+static void test_ring_string_copy(void)
+{
+	gchar buf[] = "before";
+
+	/* The ring is formatted when dumped, so string arguments
+	 * have to be copied rather than referred to
+	 */
+	mce_log(LL_DEBUG, "value %s", buf);
+	strcpy(buf, "after!");
+	assert_ring_last("value before");
+}
+
+static void test_ring_errno(void)
+{
+	gchar *expected = g_strdup_printf("failed: %s", strerror(ENOENT));
+
+	errno = ENOENT;
+	mce_log(LL_ERR, "failed: %m");
+	errno = 0;
+
+	assert_ring_last(expected);
+	g_free(expected);
+}
+
+static void test_ring_truncated(void)
+{
+	/* Arguments that do not fit are left unformatted */
+	mce_log(LL_DEBUG, "%d %d %d %d %d %d %d %d %d",
+		1, 2, 3, 4, 5, 6, 7, 8, 9);
+	assert_ring_last("1 2 3 4 5 6 7 8 %d [truncated]");
+}
+
+static void test_ring_wrap(void)
+{
+	const guint total = 2000;
+	gchar **lines;
+	guint count;
+	guint i;
+
+	for (i = 0; i < total; i++)
+		mce_log(LL_DEBUG, "msg %u", i);
+
+	/* Only the newest messages are kept, oldest first */
+	lines = ring_dump();
+	count = ring_count(lines);
+	g_assert_cmpuint(count, >, 0);
+	g_assert_cmpuint(count, <, total);
+
+	for (i = 0; i < count; i++) {
+		gchar *expected = g_strdup_printf("msg %u",
+						  total - count + i);
+
+		g_assert_cmpstr(ring_text(lines[i]), ==, expected);
+		g_free(expected);
+	}
+
+	g_strfreev(lines);
+}
+
+static void test_ring_verbosity(void)
+{
+	mce_log(LL_WARN, "kept");
+
+	/* Messages above the ring verbosity are not captured */
+	mce_log_set_ring_verbosity(LL_INFO);
+	mce_log(LL_DEBUG, "dropped");
+	assert_ring_last("kept");
+
+	mce_log(LL_INFO, "info");
+	assert_ring_last("info");
+
+	mce_log_set_ring_verbosity(LL_NONE);
+	mce_log(LL_CRIT, "dropped");
+	assert_ring_last("info");
+
+	mce_log_set_ring_verbosity(LL_DEBUG);
+}
+
+/** Saved stderr while the log output is captured */
+static int capture_fd = -1;
+
+/** File the log output is captured in */
+static FILE *capture_file = NULL;
+
+/**
+ * Start capturing the log output written to stderr
+ */
+static void capture_begin(void)
+{
+	fflush(stderr);
+
+	capture_file = tmpfile();
+	g_assert(capture_file != NULL);
+
+	capture_fd = dup(STDERR_FILENO);
+	g_assert_cmpint(capture_fd, !=, -1);
+
+	if (dup2(fileno(capture_file), STDERR_FILENO) == -1)
+		g_error("failed to redirect stderr: %m");
+}
+
+/**
+ * Stop capturing the log output
+ *
+ * @return The captured lines; free with g_strfreev()
+ */
+static gchar **capture_end(void)
+{
+	char *buf = NULL;
+	size_t size = 0;
+	gchar **lines;
+
+	fflush(stderr);
+
+	if (dup2(capture_fd, STDERR_FILENO) == -1)
+		g_error("failed to restore stderr: %m");
+
+	close(capture_fd);
+	capture_fd = -1;
+
+	rewind(capture_file);
+
+	if (getdelim(&buf, &size, '\0', capture_file) == -1) {
+		free(buf);
+		buf = NULL;
+	}
+
+	fclose(capture_file);
+	capture_file = NULL;
+
+	lines = g_strsplit((buf != NULL) ? buf : "", "\n", -1);
+	free(buf);
+
+	return lines;
+}
+
+static void test_rate_burst(void)
+{
+	gchar **lines;
+	int i;
+
+	mce_log_set_verbosity(LL_DEBUG);
+	mce_log_set_rate_limit(3, 60);
+
+	capture_begin();
+
+	for (i = 0; i < 10; i++)
+		mce_log(LL_INFO, "tick %d", i);
+
+	/* Changing the limit reports what has been suppressed */
+	mce_log_set_rate_limit(0, 60);
+
+	lines = capture_end();
+
+	g_assert_cmpuint(g_strv_length(lines), ==, 5);
+	g_assert_cmpstr(lines[0], ==, "test-mce-log: tick 0");
+	g_assert_cmpstr(lines[1], ==, "test-mce-log: tick 1");
+	g_assert_cmpstr(lines[2], ==, "test-mce-log: tick 2");
+	g_assert(g_str_has_suffix(lines[3],
+				  "test-mce-log.c:test_rate_burst(): "
+				  "7 messages suppressed"));
+	g_assert_cmpstr(lines[4], ==, "");
+	g_strfreev(lines);
+
+	/* The log ring takes the suppressed messages too */
+	assert_ring_last("tick 9");
+
+	mce_log_set_verbosity(LL_NONE);
+}
+
+static void test_rate_sites(void)
+{
+	gchar **lines;
+	int i;
+
+	mce_log_set_verbosity(LL_DEBUG);
+	mce_log_set_rate_limit(2, 60);
+
+	capture_begin();
+
+	/* Every call site has a limit of its own */
+	for (i = 0; i < 4; i++) {
+		mce_log(LL_INFO, "tick %d", i);
+		mce_log(LL_ERR, "tock %d", i);
+	}
+
+	lines = capture_end();
+
+	g_assert_cmpuint(g_strv_length(lines), ==, 5);
+	g_assert_cmpstr(lines[0], ==, "test-mce-log: tick 0");
+	g_assert_cmpstr(lines[1], ==, "test-mce-log: tock 0");
+	g_assert_cmpstr(lines[2], ==, "test-mce-log: tick 1");
+	g_assert_cmpstr(lines[3], ==, "test-mce-log: tock 1");
+	g_strfreev(lines);
+
+	capture_begin();
+	mce_log_set_rate_limit(0, 60);
+	lines = capture_end();
+
+	g_assert_cmpuint(g_strv_length(lines), ==, 3);
+	g_assert(strstr(lines[0], "2 messages suppressed") != NULL);
+	g_assert(strstr(lines[1], "2 messages suppressed") != NULL);
+	g_strfreev(lines);
+
+	mce_log_set_verbosity(LL_NONE);
+}
+
+static void test_rate_window(void)
+{
+	gchar **lines;
+	int i;
+
+	mce_log_set_verbosity(LL_DEBUG);
+	mce_log_set_rate_limit(2, 1);
+
+	capture_begin();
+
+	for (i = 0; i < 6; i++) {
+		/* A new window reports the previous one, then starts over */
+		if (i == 4)
+			sleep(2);
+
+		mce_log(LL_DEBUG, "tick %d", i);
+	}
+
+	lines = capture_end();
+
+	g_assert_cmpuint(g_strv_length(lines), ==, 6);
+	g_assert_cmpstr(lines[0], ==, "test-mce-log: tick 0");
+	g_assert_cmpstr(lines[1], ==, "test-mce-log: tick 1");
+	g_assert(g_str_has_suffix(lines[2], "2 messages suppressed"));
+	g_assert_cmpstr(lines[3], ==, "test-mce-log: tick 4");
+	g_assert_cmpstr(lines[4], ==, "test-mce-log: tick 5");
+	g_strfreev(lines);
+
+	mce_log_set_rate_limit(0, 1);
+	mce_log_set_verbosity(LL_NONE);
+}
+
+static void test_rate_disabled(void)
+{
+	gchar **lines;
+	int i;
+
+	mce_log_set_verbosity(LL_DEBUG);
+	mce_log_set_rate_limit(0, 60);
+
+	capture_begin();
+
+	for (i = 0; i < 20; i++)
+		mce_log(LL_INFO, "tick %d", i);
+
+	lines = capture_end();
+
+	g_assert_cmpuint(g_strv_length(lines), ==, 21);
+	g_assert_cmpstr(lines[19], ==, "test-mce-log: tick 19");
+	g_strfreev(lines);
+
+	mce_log_set_verbosity(LL_NONE);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	/* Only the log ring is of interest; keep the output quiet */
+	mce_log_open("test-mce-log", LOG_USER, MCE_LOG_STDERR);
+	mce_log_set_verbosity(LL_NONE);
+	mce_log_set_ring_verbosity(LL_DEBUG);
+
+	g_test_add_func("/log/ring/format", test_ring_format);
+	g_test_add_func("/log/ring/string-copy", test_ring_string_copy);
+	g_test_add_func("/log/ring/errno", test_ring_errno);
+	g_test_add_func("/log/ring/truncated", test_ring_truncated);
+	g_test_add_func("/log/ring/wrap", test_ring_wrap);
+	g_test_add_func("/log/ring/verbosity", test_ring_verbosity);
+	g_test_add_func("/log/rate/burst", test_rate_burst);
+	g_test_add_func("/log/rate/sites", test_rate_sites);
+	g_test_add_func("/log/rate/window", test_rate_window);
+	g_test_add_func("/log/rate/disabled", test_rate_disabled);
+
+	return g_test_run();
+}
@@ -0,0 +1,556 @@
+/**
+ * @file test-powerkey.c
+ * Unit tests for the power key gesture recognizer
+ * <p>
+ * The recognizer is private to powerkey.c, so the file is included here;
+ * the parts of mce it uses are replaced with stubs that record the
+ * requests the gestures make
+ * <p>
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "powerkey.c"
+
+/** Largest number of requests recorded per test */
+#define MAX_REQUESTS			16
+
+/** A request made through a datapipe */
+typedef struct {
+	const datapipe_struct *pipe;	/**< The datapipe */
+	gint value;			/**< The value fed to it */
+} request_t;
+
+/** Requests made since the last reset */
+static request_t requests[MAX_REQUESTS];
+
+/** Number of requests made since the last reset */
+static guint request_count = 0;
+
+/** Number of blocking D-Bus calls, i.e. powerkey menu requests */
+static guint menu_count = 0;
+
+/** Current submode, as returned by mce_get_submode_int32() */
+static submode_t test_submode = MCE_NORMAL_SUBMODE;
+
+datapipe_struct keypress_pipe;
+datapipe_struct mode_pipe;
+datapipe_struct submode_pipe;
+datapipe_struct call_state_pipe;
+datapipe_struct system_state_pipe;
+datapipe_struct alarm_ui_state_pipe;
+datapipe_struct system_power_request_pipe;
+datapipe_struct tk_lock_pipe;
+datapipe_struct device_lock_pipe;
+datapipe_struct led_pattern_activate_pipe;
+datapipe_struct led_pattern_deactivate_pipe;
+datapipe_struct vibrator_pattern_activate_pipe;
+datapipe_struct vibrator_pattern_deactivate_pipe;
+
+gconstpointer execute_datapipe(datapipe_struct *const datapipe,
+			       gpointer indata,
+			       const data_source_t use_cache,
+			       const caching_policy_t cache_indata)
+{
+	(void)use_cache;
+
+	g_assert_cmpuint(request_count, <, MAX_REQUESTS);
+	requests[request_count].pipe = datapipe;
+	requests[request_count].value = GPOINTER_TO_INT(indata);
+	request_count++;
+
+	if (cache_indata == CACHE_INDATA)
+		datapipe->cached_data = indata;
+
+	return indata;
+}
+
+void execute_datapipe_output_triggers(const datapipe_struct *const datapipe,
+				      gconstpointer indata,
+				      const data_source_t use_cache)
+{
+	(void)datapipe;
+	(void)indata;
+	(void)use_cache;
+}
+
+void append_input_trigger_to_datapipe(datapipe_struct *const datapipe,
+				      void (*trigger)(gconstpointer data))
+{
+	(void)datapipe;
+	(void)trigger;
+}
+
+void remove_input_trigger_from_datapipe(datapipe_struct *const datapipe,
+					void (*trigger)(gconstpointer data))
+{
+	(void)datapipe;
+	(void)trigger;
+}
+
+void append_output_trigger_to_datapipe(datapipe_struct *const datapipe,
+				       void (*trigger)(gconstpointer data))
+{
+	(void)datapipe;
+	(void)trigger;
+}
+
+void remove_output_trigger_from_datapipe(datapipe_struct *const datapipe,
+					 void (*trigger)(gconstpointer data))
+{
+	(void)datapipe;
+	(void)trigger;
+}
+
+submode_t mce_get_submode_int32(void)
+{
+	return test_submode;
+}
+
+gboolean mce_add_submode_int32(const submode_t submode)
+{
+	test_submode |= submode;
+
+	return TRUE;
+}
+
+gboolean mce_rem_submode_int32(const submode_t submode)
+{
+	test_submode &= ~submode;
+
+	return TRUE;
+}
+
+gboolean mce_set_device_mode_int32(const device_mode_t mode)
+{
+	(void)mode;
+
+	return TRUE;
+}
+
+gpointer mce_pattern_data(const gchar *const name)
+{
+	return (gpointer)name;
+}
+
+DBusMessage *dbus_send_with_block(const gchar *const service,
+				  const gchar *const path,
+				  const gchar *const interface,
+				  const gchar *const name,
+				  gint timeout, int first_arg_type, ...)
+{
+	(void)service;
+	(void)path;
+	(void)interface;
+	(void)name;
+	(void)timeout;
+	(void)first_arg_type;
+
+	menu_count++;
+
+	return NULL;
+}
+
+DBusMessage *dbus_new_method_reply(DBusMessage *const message)
+{
+	(void)message;
+
+	return NULL;
+}
+
+gboolean dbus_send_message(DBusMessage *const msg)
+{
+	(void)msg;
+
+	return TRUE;
+}
+
+gconstpointer mce_dbus_handler_add(const gchar *const interface,
+				   const gchar *const name,
+				   const gchar *const rules,
+				   const guint type,
+				   gboolean (*callback)(DBusMessage *const msg))
+{
+	(void)interface;
+	(void)name;
+	(void)rules;
+	(void)type;
+	(void)callback;
+
+	return NULL;
+}
+
+gint mce_conf_get_int(const gchar *group, const gchar *key,
+		      const gint defaultval, gpointer keyfileptr)
+{
+	(void)group;
+	(void)key;
+	(void)keyfileptr;
+
+	return defaultval;
+}
+
+gchar *mce_conf_get_string(const gchar *group, const gchar *key,
+			   const gchar *defaultval, gpointer keyfileptr)
+{
+	(void)group;
+	(void)key;
+	(void)keyfileptr;
+
+	return g_strdup(defaultval);
+}
+
+gchar **mce_conf_get_string_list(const gchar *group, const gchar *key,
+				 gsize *length, gpointer keyfileptr)
+{
+	(void)group;
+	(void)key;
+	(void)keyfileptr;
+
+	*length = 0;
+
+	return NULL;
+}
+
+/** Time of the first press of every test; usec */
+#define T0				((gint64)1000 * G_USEC_PER_SEC)
+
+/** Milliseconds after the first press, in the input event clock */
+#define AT(ms)				(T0 + (gint64)(ms) * 1000)
+
+/**
+ * Reset the recognizer and the recorded requests
+ *
+ * @param shortpress The short press action
+ * @param shortdelay The short press delay; ms
+ * @param doublepress The double press action
+ * @param triplepress The triple press action
+ * @param longpress The long press action
+ * @param doublelongpress The double long press action
+ */
+static void setup(poweraction_t shortpress, gint shortdelay,
+		  poweraction_t doublepress, poweraction_t triplepress,
+		  poweraction_t longpress, poweraction_t doublelongpress)
+{
+	if (pk_deadline_source == NULL)
+		pk_deadline_source = g_source_new(&pk_deadline_funcs,
+						  sizeof (GSource));
+
+	pk_reset();
+	pk.fired = FALSE;
+	pk.press_time = 0;
+	pk.system_state = MCE_STATE_USER;
+	pk.submode = MCE_NORMAL_SUBMODE;
+
+	shortpressaction = shortpress;
+	shortpressdelay = shortdelay;
+	doublepressaction = doublepress;
+	triplepressaction = triplepress;
+	longpressaction = longpress;
+	doublelongpressaction = doublelongpress;
+	mediumdelay = DEFAULT_POWER_MEDIUM_DELAY;
+	longdelay = DEFAULT_POWER_LONG_DELAY;
+	doublepressdelay = DEFAULT_POWER_DOUBLE_DELAY;
+	timerclear(&mode_time);
+
+	system_state_pipe.cached_data = GINT_TO_POINTER(MCE_STATE_USER);
+	alarm_ui_state_pipe.cached_data =
+		GINT_TO_POINTER(MCE_ALARM_UI_OFF_INT32);
+	call_state_pipe.cached_data = GINT_TO_POINTER(CALL_STATE_NONE);
+	test_submode = MCE_NORMAL_SUBMODE;
+
+	request_count = 0;
+	menu_count = 0;
+}
+
+/**
+ * Feed an event to the recognizer and check the state it ends up in
+ *
+ * @param event The event
+ * @param time Time of the event
+ * @param expected The expected state
+ */
+static void feed(pk_event_t event, gint64 time, pk_state_t expected)
+{
+	pk_handle_event(event, time);
+	g_assert_cmpint(pk.state, ==, expected);
+}
+
+/**
+ * Check a recorded request
+ *
+ * @param i Index of the request
+ * @param pipe The expected datapipe
+ * @param value The expected value
+ */
+static void assert_request(guint i, const datapipe_struct *pipe, gint value)
+{
+	g_assert_cmpuint(i, <, request_count);
+	g_assert(requests[i].pipe == pipe);
+	g_assert_cmpint(requests[i].value, ==, value);
+}
+
+static void test_table_complete(void)
+{
+	guint state;
+	guint event;
+
+	for (state = 0; state < PK_STATE_COUNT; state++) {
+		for (event = 0; event < PK_EVENT_COUNT; event++)
+			g_assert(pk_transitions[state][event] != NULL);
+	}
+}
+
+static void test_short_press(void)
+{
+	/* Without a double press delay, the action is not held back */
+	setup(POWER_TKLOCK, 0, POWER_DISABLED, POWER_DISABLED,
+	      POWER_POWEROFF, POWER_DISABLED);
+
+	feed(PK_EVENT_PRESS, AT(0), PK_STATE_PRESSED);
+	g_assert_cmpint(pk.deadline, ==, AT(DEFAULT_POWER_LONG_DELAY));
+
+	feed(PK_EVENT_RELEASE, AT(100), PK_STATE_RELEASED);
+	g_assert_cmpuint(request_count, ==, 1);
+	assert_request(0, &tk_lock_pipe, LOCK_ON);
+
+	/* A second press could still follow */
+	g_assert_cmpint(pk.deadline, ==, AT(DEFAULT_POWER_DOUBLE_DELAY));
+	feed(PK_EVENT_DEADLINE, pk.deadline, PK_STATE_IDLE);
+	g_assert_cmpuint(request_count, ==, 1);
+	g_assert_cmpint(pk.deadline, ==, -1);
+}
+
+static void test_short_press_delayed(void)
+{
+	setup(POWER_TKLOCK, DEFAULT_POWER_DOUBLE_DELAY, POWER_SOFT_POWEROFF,
+	      POWER_DISABLED, POWER_POWEROFF, POWER_DISABLED);
+
+	feed(PK_EVENT_PRESS, AT(0), PK_STATE_PRESSED);
+	feed(PK_EVENT_RELEASE, AT(100), PK_STATE_RELEASED);
+	g_assert_cmpuint(request_count, ==, 0);
+
+	feed(PK_EVENT_DEADLINE, pk.deadline, PK_STATE_IDLE);
+	g_assert_cmpuint(request_count, ==, 1);
+	assert_request(0, &tk_lock_pipe, LOCK_ON);
+}
+
+static void test_double_press(void)
+{
+	setup(POWER_TKLOCK, DEFAULT_POWER_DOUBLE_DELAY, POWER_SOFT_POWEROFF,
+	      POWER_DISABLED, POWER_POWEROFF, POWER_DISABLED);
+
+	feed(PK_EVENT_PRESS, AT(0), PK_STATE_PRESSED);
+	feed(PK_EVENT_RELEASE, AT(100), PK_STATE_RELEASED);
+
+	/* No longer gesture exists, so the second press completes it */
+	feed(PK_EVENT_PRESS, AT(300), PK_STATE_HELD);
+	g_assert_cmpuint(request_count, ==, 1);
+	assert_request(0, &system_power_request_pipe, MCE_POWER_REQ_SOFT_OFF);
+
+	feed(PK_EVENT_RELEASE, AT(400), PK_STATE_IDLE);
+	feed(PK_EVENT_DEADLINE, AT(2000), PK_STATE_IDLE);
+	g_assert_cmpuint(request_count, ==, 1);
+}
+
+static void test_triple_press(void)
+{
+	setup(POWER_TKLOCK, DEFAULT_POWER_DOUBLE_DELAY, POWER_SOFT_POWEROFF,
+	      POWER_POWEROFF, POWER_DISABLED, POWER_DISABLED);
+
+	feed(PK_EVENT_PRESS, AT(0), PK_STATE_PRESSED);
+	feed(PK_EVENT_RELEASE, AT(100), PK_STATE_RELEASED);
+	feed(PK_EVENT_PRESS, AT(300), PK_STATE_PRESSED);
+	feed(PK_EVENT_RELEASE, AT(400), PK_STATE_RELEASED);
+	g_assert_cmpuint(request_count, ==, 0);
+
+	feed(PK_EVENT_PRESS, AT(600), PK_STATE_HELD);
+	feed(PK_EVENT_RELEASE, AT(700), PK_STATE_IDLE);
+	g_assert_cmpuint(request_count, ==, 1);
+	assert_request(0, &system_power_request_pipe, MCE_POWER_REQ_OFF);
+}
+
+static void test_double_press_with_triple(void)
+{
+	setup(POWER_TKLOCK, DEFAULT_POWER_DOUBLE_DELAY, POWER_SOFT_POWEROFF,
+	      POWER_POWEROFF, POWER_DISABLED, POWER_DISABLED);
+
+	/* A triple press could follow, so the double press waits
+	 * until the multi-press window of the second press ends
+	 */
+	feed(PK_EVENT_PRESS, AT(0), PK_STATE_PRESSED);
+	feed(PK_EVENT_RELEASE, AT(100), PK_STATE_RELEASED);
+	feed(PK_EVENT_PRESS, AT(300), PK_STATE_PRESSED);
+	feed(PK_EVENT_RELEASE, AT(400), PK_STATE_RELEASED);
+	g_assert_cmpint(pk.deadline, ==, AT(300 + DEFAULT_POWER_DOUBLE_DELAY));
+
+	feed(PK_EVENT_DEADLINE, pk.deadline, PK_STATE_IDLE);
+	g_assert_cmpuint(request_count, ==, 1);
+	assert_request(0, &system_power_request_pipe, MCE_POWER_REQ_SOFT_OFF);
+}
+
+static void test_long_press(void)
+{
+	setup(POWER_TKLOCK, 0, POWER_DISABLED, POWER_DISABLED,
+	      POWER_POWEROFF, POWER_DISABLED);
+
+	feed(PK_EVENT_PRESS, AT(0), PK_STATE_PRESSED);
+	feed(PK_EVENT_DEADLINE, pk.deadline, PK_STATE_HELD);
+	g_assert_cmpuint(request_count, ==, 1);
+	assert_request(0, &system_power_request_pipe, MCE_POWER_REQ_OFF);
+
+	/* The release ends the gesture without a short press */
+	feed(PK_EVENT_RELEASE, AT(2000), PK_STATE_IDLE);
+	g_assert_cmpuint(request_count, ==, 1);
+}
+
+static void test_long_press_late_deadline(void)
+{
+	setup(POWER_TKLOCK, 0, POWER_DISABLED, POWER_DISABLED,
+	      POWER_POWEROFF, POWER_DISABLED);
+
+	/* The release comes in before the deadline timer got to run */
+	feed(PK_EVENT_PRESS, AT(0), PK_STATE_PRESSED);
+	feed(PK_EVENT_RELEASE, AT(DEFAULT_POWER_LONG_DELAY + 100),
+	     PK_STATE_IDLE);
+	g_assert_cmpuint(request_count, ==, 1);
+	assert_request(0, &system_power_request_pipe, MCE_POWER_REQ_OFF);
+	g_assert_cmpint(pk.deadline, ==, -1);
+}
+
+static void test_long_press_startup(void)
+{
+	setup(POWER_TKLOCK, 0, POWER_DISABLED, POWER_DISABLED,
+	      POWER_POWEROFF, POWER_DISABLED);
+
+	/* Starting up takes a shorter hold than shutting down */
+	pk.system_state = MCE_STATE_ACTDEAD;
+	system_state_pipe.cached_data = GINT_TO_POINTER(MCE_STATE_ACTDEAD);
+
+	feed(PK_EVENT_PRESS, AT(0), PK_STATE_PRESSED);
+	g_assert_cmpint(pk.deadline, ==, AT(DEFAULT_POWER_MEDIUM_DELAY));
+
+	feed(PK_EVENT_DEADLINE, pk.deadline, PK_STATE_HELD);
+	g_assert_cmpuint(request_count, ==, 1);
+	assert_request(0, &system_power_request_pipe, MCE_POWER_REQ_ON);
+}
+
+static void test_double_long_press(void)
+{
+	setup(POWER_TKLOCK, DEFAULT_POWER_DOUBLE_DELAY, POWER_SOFT_POWEROFF,
+	      POWER_DISABLED, POWER_DISABLED, POWER_POWEROFF);
+
+	feed(PK_EVENT_PRESS, AT(0), PK_STATE_PRESSED);
+	feed(PK_EVENT_RELEASE, AT(100), PK_STATE_RELEASED);
+	feed(PK_EVENT_PRESS, AT(300), PK_STATE_PRESSED);
+	g_assert_cmpint(pk.deadline, ==, AT(300 + DEFAULT_POWER_LONG_DELAY));
+
+	feed(PK_EVENT_DEADLINE, pk.deadline, PK_STATE_HELD);
+	g_assert_cmpuint(request_count, ==, 1);
+	assert_request(0, &system_power_request_pipe, MCE_POWER_REQ_OFF);
+
+	feed(PK_EVENT_RELEASE, AT(2000), PK_STATE_IDLE);
+	g_assert_cmpuint(request_count, ==, 1);
+}
+
+static void test_slow_second_press(void)
+{
+	setup(POWER_TKLOCK, DEFAULT_POWER_DOUBLE_DELAY, POWER_SOFT_POWEROFF,
+	      POWER_DISABLED, POWER_POWEROFF, POWER_DISABLED);
+
+	feed(PK_EVENT_PRESS, AT(0), PK_STATE_PRESSED);
+	feed(PK_EVENT_RELEASE, AT(100), PK_STATE_RELEASED);
+
+	/* The deadline was missed; the press finishes the short press
+	 * and starts a new gesture instead of making a double press
+	 */
+	feed(PK_EVENT_PRESS, AT(1500), PK_STATE_PRESSED);
+	g_assert_cmpuint(pk.presses, ==, 1);
+	g_assert_cmpuint(request_count, ==, 1);
+	assert_request(0, &tk_lock_pipe, LOCK_ON);
+}
+
+static void test_stale_gesture(void)
+{
+	setup(POWER_TKLOCK, 0, POWER_DISABLED, POWER_DISABLED,
+	      POWER_POWEROFF, POWER_DISABLED);
+
+	feed(PK_EVENT_PRESS, AT(0), PK_STATE_PRESSED);
+
+	/* The device mode changed after the press */
+	mode_time.tv_sec = T0 / G_USEC_PER_SEC;
+	mode_time.tv_usec = 50000;
+
+	feed(PK_EVENT_RELEASE, AT(100), PK_STATE_RELEASED);
+	g_assert_cmpuint(request_count, ==, 0);
+	g_assert(pk.fired == TRUE);
+}
+
+static void test_ignored_events(void)
+{
+	setup(POWER_TKLOCK, 0, POWER_DISABLED, POWER_DISABLED,
+	      POWER_POWEROFF, POWER_DISABLED);
+
+	feed(PK_EVENT_RELEASE, AT(0), PK_STATE_IDLE);
+	feed(PK_EVENT_DEADLINE, AT(0), PK_STATE_IDLE);
+
+	feed(PK_EVENT_PRESS, AT(100), PK_STATE_PRESSED);
+	feed(PK_EVENT_PRESS, AT(200), PK_STATE_PRESSED);
+	g_assert_cmpint(pk.press_time, ==, AT(100));
+	g_assert_cmpuint(request_count, ==, 0);
+}
+
+static void test_menu(void)
+{
+	setup(POWER_MENU, 0, POWER_DISABLED, POWER_DISABLED,
+	      POWER_POWEROFF, POWER_DISABLED);
+
+	feed(PK_EVENT_PRESS, AT(0), PK_STATE_PRESSED);
+	feed(PK_EVENT_RELEASE, AT(100), PK_STATE_RELEASED);
+	g_assert_cmpuint(menu_count, ==, 1);
+
+	/* Not while the alarm UI is up */
+	setup(POWER_MENU, 0, POWER_DISABLED, POWER_DISABLED,
+	      POWER_POWEROFF, POWER_DISABLED);
+	alarm_ui_state_pipe.cached_data =
+		GINT_TO_POINTER(MCE_ALARM_UI_RINGING_INT32);
+
+	feed(PK_EVENT_PRESS, AT(0), PK_STATE_PRESSED);
+	feed(PK_EVENT_RELEASE, AT(100), PK_STATE_RELEASED);
+	g_assert_cmpuint(menu_count, ==, 0);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	mce_log_open("test-powerkey", LOG_USER, MCE_LOG_STDERR);
+	mce_log_set_verbosity(LL_NONE);
+
+	g_test_add_func("/powerkey/table-complete", test_table_complete);
+	g_test_add_func("/powerkey/short", test_short_press);
+	g_test_add_func("/powerkey/short-delayed", test_short_press_delayed);
+	g_test_add_func("/powerkey/double", test_double_press);
+	g_test_add_func("/powerkey/triple", test_triple_press);
+	g_test_add_func("/powerkey/double-with-triple",
+			test_double_press_with_triple);
+	g_test_add_func("/powerkey/long", test_long_press);
+	g_test_add_func("/powerkey/long-late-deadline",
+			test_long_press_late_deadline);
+	g_test_add_func("/powerkey/long-startup", test_long_press_startup);
+	g_test_add_func("/powerkey/double-long", test_double_long_press);
+	g_test_add_func("/powerkey/slow-second-press", test_slow_second_press);
+	g_test_add_func("/powerkey/stale", test_stale_gesture);
+	g_test_add_func("/powerkey/ignored", test_ignored_events);
+	g_test_add_func("/powerkey/menu", test_menu);
+
+	return g_test_run();
+}
@@ -0,0 +1,376 @@
+/**
+ * @file test-state-dbus.c
+ * Unit tests for the generations reported by get_all_state
+ * <p>
+ * The snapshot is private to state-dbus.c, so the file is included here;
+ * the method call is made and the reply read through libdbus,
+ * with the states set directly in the datapipe caches
+ * <p>
+ * mce is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * mce is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mce.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "state-dbus.c"
+
+/** All keys of the snapshot, in reply order */
+#define ALL_KEYS	"device_mode call_state call_type display_status " \
+			"display_brightness display_timeout tklock_mode " \
+			"devicelock_mode inactivity_status keyboard_slide " \
+			"system_state submode"
+
+datapipe_struct mode_pipe;
+datapipe_struct call_state_pipe;
+datapipe_struct call_type_pipe;
+datapipe_struct display_state_pipe;
+datapipe_struct display_brightness_pipe;
+datapipe_struct inactivity_timeout_pipe;
+datapipe_struct submode_pipe;
+datapipe_struct device_inactive_pipe;
+datapipe_struct keyboard_slide_pipe;
+datapipe_struct system_state_pipe;
+
+/** The latest message sent */
+static DBusMessage *sent = NULL;
+
+DBusMessage *dbus_new_signal(const gchar *const path,
+			     const gchar *const interface,
+			     const gchar *const name)
+{
+	return dbus_message_new_signal(path, interface, name);
+}
+
+DBusMessage *dbus_new_method_reply(DBusMessage *const message)
+{
+	return dbus_message_new_method_return(message);
+}
+
+gboolean dbus_send_message(DBusMessage *const msg)
+{
+	if (sent != NULL)
+		dbus_message_unref(sent);
+
+	sent = msg;
+
+	return TRUE;
+}
+
+gconstpointer mce_dbus_handler_add(const gchar *const interface,
+				   const gchar *const name,
+				   const gchar *const rules,
+				   const guint type,
+				   gboolean (*callback)(DBusMessage *const msg))
+{
+	(void)interface;
+	(void)name;
+	(void)rules;
+	(void)type;
+	(void)callback;
+
+	return NULL;
+}
+
+void mce_dbus_handler_remove(gconstpointer cookie)
+{
+	(void)cookie;
+}
+
+/**
+ * Set the cached value of a datapipe
+ *
+ * @param datapipe The datapipe
+ * @param value The value
+ */
+static void set_state(datapipe_struct *datapipe, gint value)
+{
+	datapipe->cached_data = GINT_TO_POINTER(value);
+}
+
+/**
+ * Call get_all_state
+ *
+ * @param with_since TRUE to pass the generation, FALSE to pass nothing
+ * @param since The generation to pass
+ * @param keys Where to store the reported keys, separated by spaces;
+ *             free with g_free()
+ * @return The generation in the reply
+ */
+static dbus_uint32_t query(gboolean with_since, dbus_uint32_t since,
+			   gchar **keys)
+{
+	DBusMessage *msg;
+	DBusMessageIter iter;
+	DBusMessageIter dict;
+	DBusMessageIter item;
+	dbus_uint32_t generation = 0;
+	const char *key;
+	GString *str = g_string_new(NULL);
+
+	msg = dbus_message_new_method_call(MCE_SERVICE, MCE_REQUEST_PATH,
+					   MCE_REQUEST_IF, MCE_ALL_STATE_GET);
+	g_assert(msg != NULL);
+
+	/* A reply needs the serial of the call */
+	dbus_message_set_serial(msg, 1);
+
+	if (with_since == TRUE)
+		g_assert(dbus_message_append_args(msg,
+						  DBUS_TYPE_UINT32, &since,
+						  DBUS_TYPE_INVALID) == TRUE);
+
+	g_assert(all_state_get_dbus_cb(msg) == TRUE);
+	dbus_message_unref(msg);
+
+	g_assert(sent != NULL);
+	g_assert(dbus_message_iter_init(sent, &iter) == TRUE);
+	g_assert_cmpint(dbus_message_iter_get_arg_type(&iter), ==,
+			DBUS_TYPE_UINT32);
+	dbus_message_iter_get_basic(&iter, &generation);
+
+	g_assert(dbus_message_iter_next(&iter) == TRUE);
+	g_assert_cmpint(dbus_message_iter_get_arg_type(&iter), ==,
+			DBUS_TYPE_ARRAY);
+	dbus_message_iter_recurse(&iter, &dict);
+
+	while (dbus_message_iter_get_arg_type(&dict) ==
+	       DBUS_TYPE_DICT_ENTRY) {
+		dbus_message_iter_recurse(&dict, &item);
+		dbus_message_iter_get_basic(&item, &key);
+
+		if (str->len > 0)
+			g_string_append_c(str, ' ');
+
+		g_string_append(str, key);
+		dbus_message_iter_next(&dict);
+	}
+
+	*keys = g_string_free(str, FALSE);
+
+	return generation;
+}
+
+/**
+ * Get an INT32 value from the latest reply
+ *
+ * @param wanted The key of the value
+ * @return The value
+ */
+static dbus_int32_t reply_int(const gchar *wanted)
+{
+	DBusMessageIter iter;
+	DBusMessageIter dict;
+	DBusMessageIter item;
+	DBusMessageIter variant;
+	const char *key;
+	dbus_int32_t value;
+
+	dbus_message_iter_init(sent, &iter);
+	dbus_message_iter_next(&iter);
+	dbus_message_iter_recurse(&iter, &dict);
+
+	while (dbus_message_iter_get_arg_type(&dict) ==
+	       DBUS_TYPE_DICT_ENTRY) {
+		dbus_message_iter_recurse(&dict, &item);
+		dbus_message_iter_get_basic(&item, &key);
+
+		if (strcmp(key, wanted) == 0) {
+			dbus_message_iter_next(&item);
+			dbus_message_iter_recurse(&item, &variant);
+			g_assert_cmpint(dbus_message_iter_get_arg_type(&variant),
+					==, DBUS_TYPE_INT32);
+			dbus_message_iter_get_basic(&variant, &value);
+
+			return value;
+		}
+
+		dbus_message_iter_next(&dict);
+	}
+
+	g_error("%s not in the reply", wanted);
+}
+
+/**
+ * Call get_all_state and check the reported keys
+ *
+ * @param since The generation to pass
+ * @param expected The expected keys, separated by spaces
+ * @return The generation in the reply
+ */
+static dbus_uint32_t assert_query(dbus_uint32_t since, const gchar *expected)
+{
+	dbus_uint32_t generation;
+	gchar *keys;
+
+	generation = query(TRUE, since, &keys);
+	g_assert_cmpstr(keys, ==, expected);
+	g_free(keys);
+
+	return generation;
+}
+
+static void test_full(void)
+{
+	dbus_uint32_t generation;
+	gchar *keys;
+
+	/* The first query reports everything, as does a query without
+	 * a generation or with generation 0
+	 */
+	generation = query(FALSE, 0, &keys);
+	g_assert_cmpstr(keys, ==, ALL_KEYS);
+	g_free(keys);
+
+	g_assert_cmpuint(generation >> STATE_INSTANCE_SHIFT, ==,
+			 state_instance);
+	g_assert_cmpuint(generation & STATE_GENERATION_MAX, ==, 1);
+
+	g_assert_cmpuint(assert_query(0, ALL_KEYS), ==, generation);
+}
+
+static void test_unchanged(void)
+{
+	dbus_uint32_t generation = assert_query(0, ALL_KEYS);
+
+	/* Without changes, nothing is reported and the generation stays */
+	g_assert_cmpuint(assert_query(generation, ""), ==, generation);
+	g_assert_cmpuint(assert_query(generation, ""), ==, generation);
+}
+
+static void test_changed(void)
+{
+	dbus_uint32_t first = assert_query(0, ALL_KEYS);
+	dbus_uint32_t second;
+	dbus_uint32_t third;
+
+	set_state(&display_state_pipe, MCE_DISPLAY_OFF);
+	set_state(&submode_pipe, MCE_TKLOCK_SUBMODE);
+	second = assert_query(first, "display_status tklock_mode submode");
+	g_assert_cmpuint(second, ==, first + 1);
+
+	set_state(&call_state_pipe, CALL_STATE_RINGING);
+	third = assert_query(second, "call_state");
+	g_assert_cmpuint(third, ==, second + 1);
+
+	/* An older generation gets every change since then */
+	g_assert_cmpuint(assert_query(first,
+				      "call_state display_status "
+				      "tklock_mode submode"), ==, third);
+
+	set_state(&display_state_pipe, MCE_DISPLAY_ON);
+	set_state(&submode_pipe, MCE_NORMAL_SUBMODE);
+	set_state(&call_state_pipe, CALL_STATE_NONE);
+	assert_query(third, "call_state display_status tklock_mode submode");
+}
+
+static void test_changed_back(void)
+{
+	dbus_uint32_t generation = assert_query(0, ALL_KEYS);
+
+	/* Values are compared when queried, so a change that was
+	 * undone in between is not a change
+	 */
+	set_state(&system_state_pipe, MCE_STATE_SHUTDOWN);
+	set_state(&system_state_pipe, MCE_STATE_USER);
+	set_state(&keyboard_slide_pipe, TRUE);
+	set_state(&keyboard_slide_pipe, FALSE);
+
+	g_assert_cmpuint(assert_query(generation, ""), ==, generation);
+}
+
+static void test_brightness_mask(void)
+{
+	dbus_uint32_t generation;
+
+	set_state(&display_brightness_pipe, 0x03);
+	generation = assert_query(0, ALL_KEYS);
+	g_assert_cmpint(reply_int("display_brightness"), ==, 0x03);
+
+	/* The high brightness boost is not part of the setting */
+	set_state(&display_brightness_pipe, 0x0203);
+	g_assert_cmpuint(assert_query(generation, ""), ==, generation);
+
+	set_state(&display_brightness_pipe, 0x0205);
+	generation = assert_query(generation, "display_brightness");
+	g_assert_cmpint(reply_int("display_brightness"), ==, 0x05);
+
+	set_state(&display_brightness_pipe, 0);
+	assert_query(generation, "display_brightness");
+}
+
+static void test_invalid_since(void)
+{
+	dbus_uint32_t generation = assert_query(0, ALL_KEYS);
+	dbus_uint32_t other = (state_instance + 1) & STATE_GENERATION_MAX;
+
+	/* A generation of another instance of mce, or one that has
+	 * not been handed out yet, gets a full snapshot
+	 */
+	if (other == 0)
+		other = 1;
+
+	g_assert_cmpuint(assert_query((other << STATE_INSTANCE_SHIFT) |
+				      (generation & STATE_GENERATION_MAX),
+				      ALL_KEYS), ==, generation);
+	g_assert_cmpuint(assert_query(generation + 1, ALL_KEYS), ==,
+			 generation);
+	g_assert_cmpuint(assert_query(generation & STATE_GENERATION_MAX,
+				      ALL_KEYS), ==, generation);
+}
+
+static void test_wrap(void)
+{
+	dbus_uint32_t generation = assert_query(0, ALL_KEYS);
+	guint instance = state_instance;
+	dbus_uint32_t renewed;
+
+	/* Running out of generations changes the instance cookie,
+	 * which makes every client fetch a full snapshot
+	 */
+	state_generation = STATE_GENERATION_MAX;
+	renewed = assert_query(generation, ALL_KEYS);
+
+	g_assert_cmpuint(state_instance, !=, instance);
+	g_assert_cmpuint(renewed >> STATE_INSTANCE_SHIFT, ==, state_instance);
+	g_assert_cmpuint(renewed & STATE_GENERATION_MAX, ==, 1);
+
+	g_assert_cmpuint(assert_query(renewed, ""), ==, renewed);
+
+	/* A change while wrapping gets a generation of its own */
+	state_generation = STATE_GENERATION_MAX;
+	set_state(&inactivity_timeout_pipe, 30);
+	generation = assert_query(renewed, ALL_KEYS);
+	g_assert_cmpuint(generation & STATE_GENERATION_MAX, ==, 2);
+	assert_query((generation & ~STATE_GENERATION_MAX) | 1,
+		     "display_timeout");
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	mce_log_open("test-state-dbus", LOG_USER, MCE_LOG_STDERR);
+	mce_log_set_verbosity(LL_NONE);
+
+	renew_state_instance();
+
+	/* The other states start out as 0 */
+	set_state(&display_state_pipe, MCE_DISPLAY_ON);
+	set_state(&system_state_pipe, MCE_STATE_USER);
+
+	g_test_add_func("/state-dbus/full", test_full);
+	g_test_add_func("/state-dbus/unchanged", test_unchanged);
+	g_test_add_func("/state-dbus/changed", test_changed);
+	g_test_add_func("/state-dbus/changed-back", test_changed_back);
+	g_test_add_func("/state-dbus/brightness-mask", test_brightness_mask);
+	g_test_add_func("/state-dbus/invalid-since", test_invalid_since);
+	g_test_add_func("/state-dbus/wrap", test_wrap);
+
+	return g_test_run();
+}